@@ -5,6 +5,7 @@
  */
 
 #include <esp_log.h>
+#include <trace.h>
 #include <EspWifi.hxx>
 #include <MeshRoof.hxx>
 
@@ -388,7 +389,11 @@ void EspWifi::gotStaStop(const void *e)
 
 void EspWifi::gotStaDisconnected(const void *e)
 {
-    (void)(e);
+    const wifi_event_sta_disconnected_t *disconnected =
+        (const wifi_event_sta_disconnected_t *) e;
+
+    TRACE("wifi: disconnected reason=%u rssi=%d\n",
+          disconnected->reason, disconnected->rssi);
 
     resetStatus();
 
@@ -407,6 +412,8 @@ void EspWifi::gotStaConnected(const void *e)
     const wifi_event_sta_connected_t *sta_connected =
         (const wifi_event_sta_connected_t *) e;
 
+    TRACE("wifi: connected channel=%u\n", sta_connected->channel);
+
     memcpy(&_sta_connected, sta_connected, sizeof(_sta_connected));
 }
 
@@ -414,6 +421,12 @@ void EspWifi::gotStaGotIp(const void *e)
 {
     const ip_event_got_ip_t *event = (const ip_event_got_ip_t *) e;
 
+    TRACE("wifi: got ip %u.%u.%u.%u\n",
+          esp_ip4_addr1_16(&event->ip_info.ip),
+          esp_ip4_addr2_16(&event->ip_info.ip),
+          esp_ip4_addr3_16(&event->ip_info.ip),
+          esp_ip4_addr4_16(&event->ip_info.ip));
+
     memcpy(&_ip_info, &event->ip_info, sizeof(_ip_info));
     esp_netif_get_dns_info(_sta_netif, ESP_NETIF_DNS_MAIN, &_dns1_info);
     esp_netif_get_dns_info(_sta_netif, ESP_NETIF_DNS_BACKUP, &_dns2_info);
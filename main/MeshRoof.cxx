@@ -5,6 +5,9 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -16,11 +19,31 @@
 #include <nvs.h>
 #include <driver/gpio.h>
 #include <driver/temperature_sensor.h>
+#include <esp_timer.h>
+#include <esp_random.h>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <pb_encode.h>
+#include <meshtastic/admin.pb.h>
 #include <meshroof.h>
+#include <mtcache.h>
+#include <dedup.h>
+#include <tseries.h>
+#include <nodetab.h>
+#include <linkgraph.h>
 #include <MeshRoof.hxx>
+#include <MeshRoofCommands.hxx>
+
+#define LINK_PROBE_TRIES  2
+#define CACHE_PROBE_US    (10 * 1000000)
+
+struct cmd_job {
+    enum meshroof_cmd cmd;
+    uint32_t node_num;
+    uint8_t channel;
+    unsigned int arg;
+};
 
 static const char *TAG = "MeshRoof";
 
@@ -31,6 +54,25 @@ MeshRoof::MeshRoof()
     _isAmplifying = false;
     _resetCount = 0;
     _lastReset = time(NULL);
+    _wantConfigTries = 0;
+    _wantConfigUs = 0;
+    _configDownloadMs = 0;
+    _configDownloadBaud = 0;
+    _linkBaudRequested = false;
+    _cacheClearRequested = false;
+    _statsResetRequested = false;
+    _cacheTried = false;
+    _cacheProbeUs = 0;
+    _usableStartUs = 0;
+    _usableMs = 0;
+    _usableFromCache = false;
+    _replyChannel = 0;
+    _myNodeNum = 0;
+    _cmdQueue = xQueueCreate(CMD_QUEUE_LEN, sizeof(struct cmd_job));
+    bzero(&_cmdStats, sizeof(_cmdStats));
+    portMUX_INITIALIZE(&_cmdLock);
+    _resetRequested = false;
+    _resetPending = false;
 
     gpio_reset_pin(AMPLIFY_PIN);
     gpio_set_direction(AMPLIFY_PIN, GPIO_MODE_OUTPUT);
@@ -81,12 +123,23 @@ bool MeshRoof::isAmplifying(void) const
     return _isAmplifying;
 }
 
+/*
+ * Drop the API session and restart the radio. Only for the meshtastic
+ * task and start-up; other tasks use queueCommand(MESHROOF_CMD_RESET).
+ */
 void MeshRoof::reset(void)
 {
     _resetCount++;
 
     sendDisconnect();
+    _cacheTried = false;
+    _usableStartUs = 0;
+
+    resetPulse();
+}
 
+void MeshRoof::resetPulse(void)
+{
     gpio_set_level(OUTRESET_PIN, false);
     vTaskDelay(pdMS_TO_TICKS(500));
     gpio_set_level(OUTRESET_PIN, true);
@@ -129,6 +182,134 @@ void MeshRoof::buzzMorseCode(const string &text, bool clearPrevious)
     this->addMorseText(text);
 }
 
+/*
+ * Hand a command to the executor task, from any task. Returns false if
+ * the queue is full. Buzzes are capped at CMD_BUZZ_MAX_MS. A reset is
+ * only flagged here: serviceLink() ends the API session on the
+ * meshtastic task and then queues the reset pulse, and one that is
+ * already pending is not queued twice. Both reset flags change only
+ * under _cmdLock, as several tasks request resets.
+ */
+bool MeshRoof::queueCommand(enum meshroof_cmd cmd, uint32_t node_num,
+                            unsigned int arg)
+{
+    struct cmd_job job;
+
+    if (cmd == MESHROOF_CMD_RESET) {
+        portENTER_CRITICAL(&_cmdLock);
+        if (!_resetPending) {
+            _resetPending = true;
+            _resetRequested = true;
+        }
+        portEXIT_CRITICAL(&_cmdLock);
+        return true;
+    }
+
+    if ((cmd == MESHROOF_CMD_BUZZ) && (arg > CMD_BUZZ_MAX_MS)) {
+        arg = CMD_BUZZ_MAX_MS;
+    }
+
+    job.cmd = cmd;
+    job.node_num = node_num;
+    job.channel = _replyChannel;
+    job.arg = arg;
+
+    return submitCommand(&job);
+}
+
+bool MeshRoof::submitCommand(const struct cmd_job *job)
+{
+    unsigned int depth;
+
+    if (xQueueSend(_cmdQueue, job, 0) != pdTRUE) {
+        portENTER_CRITICAL(&_cmdLock);
+        _cmdStats.dropped++;
+        portEXIT_CRITICAL(&_cmdLock);
+        return false;
+    }
+
+    depth = uxQueueMessagesWaiting(_cmdQueue);
+    portENTER_CRITICAL(&_cmdLock);
+    if (depth > _cmdStats.max_depth) {
+        _cmdStats.max_depth = depth;
+    }
+    portEXIT_CRITICAL(&_cmdLock);
+
+    return true;
+}
+
+/*
+ * Body of the executor task: run one queued command, time it and send
+ * its reply, if any, through the normal outbound path.
+ */
+void MeshRoof::runCommands(void)
+{
+    struct cmd_job job;
+    vector<string> packets;
+    string reply;
+    int64_t start_us;
+    int64_t ms;
+    unsigned int bucket;
+    size_t i;
+
+    if (xQueueReceive(_cmdQueue, &job, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    start_us = esp_timer_get_time();
+    switch (job.cmd) {
+    case MESHROOF_CMD_BUZZ:
+        buzz(job.arg);
+        reply = "buzzed " + to_string(job.arg) + " ms";
+        break;
+    case MESHROOF_CMD_RESET:
+        resetPulse();
+        portENTER_CRITICAL(&_cmdLock);
+        _resetPending = false;
+        portEXIT_CRITICAL(&_cmdLock);
+        break;
+    case MESHROOF_CMD_CACHE_SAVE:
+        mtcache_save();
+        break;
+    default:
+        return;
+    }
+
+    ms = (esp_timer_get_time() - start_us) / 1000;
+    for (bucket = 0; (bucket < (CMD_HIST_BUCKETS - 1)) && (ms > 0); bucket++) {
+        ms >>= 1;
+    }
+    portENTER_CRITICAL(&_cmdLock);
+    _cmdStats.count[job.cmd]++;
+    _cmdStats.total_us[job.cmd] += esp_timer_get_time() - start_us;
+    _cmdStats.hist[job.cmd][bucket]++;
+    portEXIT_CRITICAL(&_cmdLock);
+
+    if (!reply.empty() && (job.node_num != 0)) {
+        packets = packReply(reply);
+        for (i = 0; i < packets.size(); i++) {
+            sendText(job.node_num, job.channel, packets[i]);
+        }
+    }
+}
+
+void MeshRoof::getCommandStats(struct cmd_stats *stats) const
+{
+    portENTER_CRITICAL(&_cmdLock);
+    memcpy(stats, &_cmdStats, sizeof(*stats));
+    portEXIT_CRITICAL(&_cmdLock);
+    stats->depth = uxQueueMessagesWaiting(_cmdQueue);
+}
+
+const char *MeshRoof::commandName(unsigned int cmd)
+{
+    static const char *names[MESHROOF_CMDS] = {
+        "buzz", "reset", "cache_save",
+    };
+
+    return (cmd < MESHROOF_CMDS) ? names[cmd] : "?";
+}
+
 bool MeshRoof::isOnboardLedOn(void) const
 {
     return _onboardLed;
@@ -166,12 +347,666 @@ done:
     return tempC;
 }
 
+/*
+ * Accept a node number as "!a1b2c3d4", "0xa1b2c3d4" or in decimal.
+ */
+bool MeshRoof::parseNodeNum(const string &text, uint32_t *node_num)
+{
+    const char *s = text.c_str();
+    char *end = NULL;
+    unsigned long val;
+    int base = 10;
+
+    if (s[0] == '!') {
+        s++;
+        base = 16;
+    } else if ((s[0] == '0') && ((s[1] == 'x') || (s[1] == 'X'))) {
+        base = 16;
+    }
+
+    if (*s == '\0') {
+        return false;
+    }
+
+    errno = 0;
+    val = strtoul(s, &end, base);
+    if ((errno != 0) || (*end != '\0') || (val == 0) ||
+        (val > UINT32_MAX)) {
+        return false;
+    }
+
+    *node_num = (uint32_t) val;
+
+    return true;
+}
+
+/*
+ * Send want_config at the current link rate. After LINK_PROBE_TRIES
+ * unanswered attempts the link alternates between the configured rate and
+ * the default 115200 until the device replies.
+ */
+bool MeshRoof::probeWantConfig(void)
+{
+    uint32_t target;
+
+    if (_resetPending) {
+        // The radio is being held in reset
+        return true;
+    }
+
+    if (_wantConfigTries >= LINK_PROBE_TRIES) {
+        target = (serial_get_baud() == getSerialBaud()) ?
+            SERIAL_DEFAULT_BAUD : getSerialBaud();
+        if (target != serial_get_baud()) {
+            TRACE("no reply at %u baud, trying %u\n",
+                  (unsigned int) serial_get_baud(),
+                  (unsigned int) target);
+            serial_set_baud(target);
+        }
+        _wantConfigTries = 0;
+    }
+
+    _wantConfigTries++;
+    _wantConfigUs = esp_timer_get_time();
+    if (_usableStartUs == 0) {
+        _usableStartUs = _wantConfigUs;
+    }
+
+    if (!_cacheTried && mtcache_valid()) {
+        const uint8_t *data;
+        size_t size;
+
+        // Replay the cached download and only ask for what may have
+        // changed, or for everything once the node database is stale
+        _cacheTried = true;
+        _cacheProbeUs = _wantConfigUs;
+        data = mtcache_data(&size);
+        serial_rx_inject(data, size);
+
+        if (mtcache_stale()) {
+            mtcache_begin(false);
+            return sendWantConfig();
+        }
+
+        mtcache_begin(true);
+        return sendWantConfigNonce(MTCACHE_NONCE_ONLY_CONFIG);
+    }
+
+    mtcache_begin(false);
+
+    return sendWantConfig();
+}
+
+bool MeshRoof::sendWantConfigNonce(uint32_t nonce)
+{
+    meshtastic_ToRadio toRadio = meshtastic_ToRadio_init_zero;
+    uint8_t hdr[MT_FRAME_HDR_SIZE];
+    uint8_t payload[MT_FRAME_MAX_PAYLOAD];
+    pb_ostream_t stream = pb_ostream_from_buffer(payload, sizeof(payload));
+    struct serial_iov iov[2];
+
+    toRadio.which_payload_variant = meshtastic_ToRadio_want_config_id_tag;
+    toRadio.want_config_id = nonce;
+    if (!pb_encode(&stream, meshtastic_ToRadio_fields, &toRadio)) {
+        return false;
+    }
+
+    hdr[0] = MT_FRAME_START1;
+    hdr[1] = MT_FRAME_START2;
+    hdr[2] = (stream.bytes_written >> 8) & 0xff;
+    hdr[3] = stream.bytes_written & 0xff;
+    iov[0].base = hdr;
+    iov[0].len = sizeof(hdr);
+    iov[1].base = payload;
+    iov[1].len = stream.bytes_written;
+
+    return serial_writev(iov, 2) > 0;
+}
+
+/*
+ * Ask the radio for its device metadata. The request is addressed to the
+ * radio itself, so it is answered over the serial link without going on
+ * air. Before my_info is known a heartbeat has to do.
+ */
+bool MeshRoof::sendProbe(void)
+{
+    meshtastic_ToRadio toRadio = meshtastic_ToRadio_init_zero;
+    meshtastic_MeshPacket *packet = &toRadio.packet;
+    meshtastic_AdminMessage admin = meshtastic_AdminMessage_init_zero;
+    struct mtcache_stats cache;
+    uint8_t hdr[MT_FRAME_HDR_SIZE];
+    uint8_t payload[MT_FRAME_MAX_PAYLOAD];
+    pb_ostream_t stream;
+    struct serial_iov iov[2];
+
+    mtcache_get_stats(&cache);
+    if (cache.my_node_num == 0) {
+        return sendHeartbeat();
+    }
+
+    admin.which_payload_variant =
+        meshtastic_AdminMessage_get_device_metadata_request_tag;
+    admin.get_device_metadata_request = true;
+    stream = pb_ostream_from_buffer(packet->decoded.payload.bytes,
+                                    sizeof(packet->decoded.payload.bytes));
+    if (!pb_encode(&stream, meshtastic_AdminMessage_fields, &admin)) {
+        return false;
+    }
+
+    toRadio.which_payload_variant = meshtastic_ToRadio_packet_tag;
+    packet->to = cache.my_node_num;
+    packet->id = esp_random();
+    packet->which_payload_variant = meshtastic_MeshPacket_decoded_tag;
+    packet->decoded.portnum = meshtastic_PortNum_ADMIN_APP;
+    packet->decoded.want_response = true;
+    packet->decoded.payload.size = stream.bytes_written;
+
+    stream = pb_ostream_from_buffer(payload, sizeof(payload));
+    if (!pb_encode(&stream, meshtastic_ToRadio_fields, &toRadio)) {
+        return false;
+    }
+
+    hdr[0] = MT_FRAME_START1;
+    hdr[1] = MT_FRAME_START2;
+    hdr[2] = (stream.bytes_written >> 8) & 0xff;
+    hdr[3] = stream.bytes_written & 0xff;
+    iov[0].base = hdr;
+    iov[0].len = sizeof(hdr);
+    iov[1].base = payload;
+    iov[1].len = stream.bytes_written;
+
+    return serial_writev(iov, 2) > 0;
+}
+
+/*
+ * Send a text message as our own ToRadio packet; it goes through
+ * serial_write() and so is paced like every other outgoing packet.
+ */
+bool MeshRoof::sendText(uint32_t dest, uint8_t channel, const string &text)
+{
+    meshtastic_ToRadio toRadio = meshtastic_ToRadio_init_zero;
+    meshtastic_MeshPacket *packet = &toRadio.packet;
+    uint8_t frame[MT_FRAME_HDR_SIZE + MT_FRAME_MAX_PAYLOAD];
+    pb_ostream_t stream = pb_ostream_from_buffer(frame + MT_FRAME_HDR_SIZE,
+                                                 MT_FRAME_MAX_PAYLOAD);
+
+    if (text.size() > sizeof(packet->decoded.payload.bytes)) {
+        return false;
+    }
+
+    toRadio.which_payload_variant = meshtastic_ToRadio_packet_tag;
+    packet->to = dest;
+    packet->channel = channel;
+    packet->id = esp_random();
+    packet->hop_limit = REPLY_HOP_LIMIT;
+    packet->want_ack = true;
+    packet->which_payload_variant = meshtastic_MeshPacket_decoded_tag;
+    packet->decoded.portnum = meshtastic_PortNum_TEXT_MESSAGE_APP;
+    packet->decoded.payload.size = text.size();
+    memcpy(packet->decoded.payload.bytes, text.data(), text.size());
+    if (!pb_encode(&stream, meshtastic_ToRadio_fields, &toRadio)) {
+        return false;
+    }
+
+    frame[0] = MT_FRAME_START1;
+    frame[1] = MT_FRAME_START2;
+    frame[2] = (stream.bytes_written >> 8) & 0xff;
+    frame[3] = stream.bytes_written & 0xff;
+
+    if (serial_write(frame, MT_FRAME_HDR_SIZE + stream.bytes_written) <= 0) {
+        return false;
+    }
+
+    linkgraph_sent(packet->id, dest,
+                   (uint32_t) (esp_timer_get_time() / 1000000));
+
+    return true;
+}
+
+/*
+ * Fill packets of at most REPLY_MAX_TEXT bytes with whole lines (a line
+ * that is too long on its own is cut). With more than one packet, each
+ * is prefixed with "i/n " so that the receiver can put them in order.
+ */
+vector<string> MeshRoof::packReply(const string &reply) const
+{
+    vector<string> lines;
+    vector<string> packets;
+    string line;
+    string current;
+    stringstream ss(reply);
+    size_t n = 1;
+    size_t room;
+    size_t i;
+
+    while (getline(ss, line)) {
+        lines.push_back(line);
+    }
+
+    for (;;) {
+        room = REPLY_MAX_TEXT;
+        if (n > 1) {
+            room -= (to_string(n).size() * 2) + 2;
+        }
+
+        packets.clear();
+        current.clear();
+        for (i = 0; i < lines.size(); i++) {
+            line = lines[i];
+            while (line.size() > room) {
+                if (!current.empty()) {
+                    packets.push_back(current);
+                    current.clear();
+                }
+                packets.push_back(line.substr(0, room));
+                line = line.substr(room);
+            }
+
+            if (current.empty()) {
+                current = line;
+            } else if ((current.size() + 1 + line.size()) <= room) {
+                current += "\n" + line;
+            } else {
+                packets.push_back(current);
+                current = line;
+            }
+        }
+        if (!current.empty() || packets.empty()) {
+            packets.push_back(current);
+        }
+
+        // The prefix eats into the room, which may take another packet
+        if (packets.size() <= n) {
+            break;
+        }
+        n = packets.size();
+    }
+
+    if (packets.size() > 1) {
+        for (i = 0; i < packets.size(); i++) {
+            packets[i] = to_string(i + 1) + "/" + to_string(packets.size()) +
+                " " + packets[i];
+        }
+    }
+
+    return packets;
+}
+
+/*
+ * Shorter spelling of the replies that list addresses: well-known keys
+ * are abbreviated, unset name servers left out and the padding that
+ * lines up values is dropped.
+ */
+string MeshRoof::compactReply(const string &reply) const
+{
+    static const struct {
+        const char *key;
+        const char *abbrev;
+    } abbrevs[] = {
+        { "(static ip)", "(static)", },
+        { "netmask:", "nm:", },
+        { "gateway:", "gw:", },
+        { "dns1:", "d1:", },
+        { "dns2:", "d2:", },
+        { "dns3:", "d3:", },
+        { "channel:", "ch:", },
+        { "cpu temperature:", "cpu:", },
+    };
+    stringstream in(reply);
+    stringstream out;
+    string line;
+    size_t colon;
+    size_t i;
+    bool first = true;
+
+    while (getline(in, line)) {
+        for (i = 0; i < sizeof(abbrevs) / sizeof(abbrevs[0]); i++) {
+            if (line.compare(0, strlen(abbrevs[i].key), abbrevs[i].key) == 0) {
+                line = abbrevs[i].abbrev + line.substr(strlen(abbrevs[i].key));
+                break;
+            }
+        }
+
+        colon = line.find(':');
+        if (colon != string::npos) {
+            i = line.find_first_not_of(' ', colon + 1);
+            if (i != string::npos) {
+                line = line.substr(0, colon + 1) + line.substr(i);
+            }
+            // An unset name server says nothing
+            if ((colon == 2) && (line[0] == 'd') &&
+                (line.compare(colon + 1, string::npos, "0.0.0.0") == 0)) {
+                continue;
+            }
+        }
+
+        if (!first) {
+            out << endl;
+        }
+        out << line;
+        first = false;
+    }
+
+    return out.str();
+}
+
+/*
+ * Split a reply into as few packets as possible, compacting it if that
+ * saves one. All but the last packet are sent here; the last is handed
+ * back for HomeChat to send as a normal reply.
+ */
+string MeshRoof::deliverReply(uint32_t node_num, const string &reply)
+{
+    vector<string> packets = packReply(reply);
+    vector<string> compact;
+    size_t i;
+
+    if (packets.size() > 1) {
+        compact = packReply(compactReply(reply));
+        if (compact.size() < packets.size()) {
+            packets = compact;
+        }
+    }
+
+    for (i = 0; (i + 1) < packets.size(); i++) {
+        if (!sendText(node_num, _replyChannel, packets[i])) {
+            ESP_LOGW(TAG, "reply fragment %zu/%zu to %08lx not sent",
+                     i + 1, packets.size(), (unsigned long) node_num);
+        }
+    }
+
+    return packets.back();
+}
+
+/*
+ * The last hour of a node's telemetry in 15 minute averages, newest last.
+ */
+string MeshRoof::envHistory(uint32_t node_num, const string &args) const
+{
+    stringstream ss;
+    struct tseries_point points[4];
+    struct nodetab_entry entry;
+    uint32_t target = node_num;
+    uint32_t now_s = (uint32_t) (esp_timer_get_time() / 1000000);
+    uint32_t window_s = 4 * TSERIES_L1_SECS;
+    unsigned int n, i, m;
+    char buf[16];
+
+    if (!args.empty() && !parseNodeNum(args, &target)) {
+        ss << "bad node '" << args << "'";
+        goto done;
+    }
+
+    snprintf(buf, sizeof(buf), "!%08lx", (unsigned long) target);
+    n = tseries_query(target, TSERIES_L1,
+                      (now_s > window_s) ? (now_s - window_s) : 0,
+                      points, 4);
+    if (n == 0) {
+        ss << "no history for " << buf << " in the last hour";
+        goto done;
+    }
+
+    ss << buf;
+    if (nodetab_lookup(target, &entry) && (entry.short_name[0] != '\0')) {
+        ss << " (" << entry.short_name << ")";
+    }
+    ss << " 15m avg";
+    for (i = 0; i < n; i++) {
+        ss << endl << "-" << ((now_s - points[i].t) / 60) << "m";
+        for (m = 0; m < TSERIES_METRICS; m++) {
+            if ((points[i].mask & (1 << m)) == 0) {
+                continue;
+            }
+            tseries_format(buf, sizeof(buf), m, points[i].avg[m]);
+            ss << " " << tseries_metric_name(m) << " " << buf;
+        }
+    }
+
+done:
+
+    return ss.str();
+}
+
+/*
+ * A node's short name if we know it, else its number.
+ */
+static string nodeLabel(uint32_t node_num)
+{
+    struct nodetab_entry entry;
+    char buf[16];
+
+    if (nodetab_lookup(node_num, &entry) && (entry.short_name[0] != '\0')) {
+        return entry.short_name;
+    }
+
+    snprintf(buf, sizeof(buf), "!%08lx", (unsigned long) node_num);
+
+    return buf;
+}
+
+/*
+ * Answer "route" from what the link graph already knows, so that asking
+ * again does not cost another traceroute on air.
+ */
+string MeshRoof::routeReport(uint32_t dest) const
+{
+    stringstream ss;
+    struct linkgraph_route route;
+    struct nodetab_entry entry;
+    uint32_t now_s = (uint32_t) (esp_timer_get_time() / 1000000);
+    char buf[16];
+    unsigned int i;
+    int reach;
+
+    snprintf(buf, sizeof(buf), "!%08lx", (unsigned long) dest);
+
+    if (linkgraph_route(getMyNodeNum(), dest, now_s, &route)) {
+        ss << "route to " << buf << ": " << route.hops << " hops, "
+           << (unsigned int) route.quality << "%";
+        for (i = 0; i < route.hops; i++) {
+            const struct linkgraph_hop &hop = route.hop[i];
+
+            ss << endl << nodeLabel(hop.from) << ">" << nodeLabel(hop.to);
+            if (hop.snr4 != LINKGRAPH_SNR_UNKNOWN) {
+                ss << " " << fixed << setprecision(2) << (hop.snr4 / 4.0f)
+                   << "dB";
+            }
+            ss << " " << (unsigned int) hop.quality << "% "
+               << (hop.age_s / 60) << "m";
+        }
+    } else {
+        ss << "no known route to " << buf;
+        if (nodetab_lookup(dest, &entry) &&
+            (entry.hops != NODETAB_HOPS_UNKNOWN)) {
+            ss << ", last heard " << (unsigned int) entry.hops
+               << " hops away";
+        }
+    }
+
+    reach = linkgraph_reachability(dest, now_s);
+    if (reach >= 0) {
+        ss << endl << "acked " << reach << "% of recent unicasts";
+    }
+
+    return ss.str();
+}
+
+void MeshRoof::serviceLink(void)
+{
+    struct cmd_job job;
+    bool reset;
+
+    portENTER_CRITICAL(&_cmdLock);
+    reset = _resetRequested;
+    _resetRequested = false;
+    portEXIT_CRITICAL(&_cmdLock);
+
+    if (reset) {
+        _resetCount++;
+        sendDisconnect();
+        _cacheTried = false;
+        _usableStartUs = 0;
+
+        job.cmd = MESHROOF_CMD_RESET;
+        job.node_num = 0;
+        job.channel = 0;
+        job.arg = 0;
+        if (!submitCommand(&job)) {
+            portENTER_CRITICAL(&_cmdLock);
+            _resetPending = false;
+            portEXIT_CRITICAL(&_cmdLock);
+        }
+    }
+
+    if (_linkBaudRequested) {
+        _linkBaudRequested = false;
+        if (serial_get_baud() != getSerialBaud()) {
+            serial_set_baud(getSerialBaud());
+            _wantConfigTries = 0;
+            sendDisconnect();
+        }
+    }
+
+    if (_cacheClearRequested) {
+        _cacheClearRequested = false;
+        serial_rx_inject(NULL, 0);
+        mtcache_invalidate();
+    }
+
+    if (_statsResetRequested) {
+        _statsResetRequested = false;
+        serial_reset_stats();
+    }
+
+    if (mtcache_save_requested()) {
+        job.cmd = MESHROOF_CMD_CACHE_SAVE;
+        job.node_num = 0;
+        job.channel = 0;
+        job.arg = 0;
+        submitCommand(&job);
+    }
+
+    if ((_usableStartUs != 0) && isConnected()) {
+        _usableMs = (esp_timer_get_time() - _usableStartUs) / 1000;
+        _usableFromCache = (_cacheProbeUs != 0);
+        _usableStartUs = 0;
+    }
+
+    if (_cacheProbeUs != 0) {
+        if (mtcache_complete()) {
+            _configDownloadMs = (esp_timer_get_time() - _wantConfigUs) / 1000;
+            _configDownloadBaud = serial_get_baud();
+            _wantConfigUs = 0;
+            _wantConfigTries = 0;
+            _cacheProbeUs = 0;
+        } else if ((esp_timer_get_time() - _cacheProbeUs) > CACHE_PROBE_US) {
+            // No answer to the config-only request, do a full download
+            serial_rx_inject(NULL, 0);
+            _cacheProbeUs = 0;
+            sendDisconnect();
+        }
+    } else if ((_wantConfigUs != 0) && isConnected()) {
+        _configDownloadMs = (esp_timer_get_time() - _wantConfigUs) / 1000;
+        _configDownloadBaud = serial_get_baud();
+        _wantConfigUs = 0;
+        _wantConfigTries = 0;
+    }
+}
+
+void MeshRoof::requestLinkBaud(void)
+{
+    _linkBaudRequested = true;
+}
+
+void MeshRoof::requestCacheClear(void)
+{
+    _cacheClearRequested = true;
+}
+
+void MeshRoof::requestStatsReset(void)
+{
+    _statsResetRequested = true;
+}
+
+/*
+ * Feed the node table from a frame the radio sent: every packet
+ * refreshes its sender, the radio's node database supplies short names
+ * and my_info tells our own node number.
+ */
+void MeshRoof::observeNode(const struct mt_frame_info *info, int64_t rx_us)
+{
+    int8_t snr4 = NODETAB_SNR_UNKNOWN;
+    int16_t rssi = 0;
+
+    // Packets that did not come over the air carry no rx_rssi
+    if ((info->rx_rssi != 0) || (info->variant == MT_FROMRADIO_NODE_INFO)) {
+        snr4 = (int8_t) ((info->rx_snr < -31.75f) ? -127 :
+                         (info->rx_snr > 31.0f) ? 124 : (info->rx_snr * 4));
+        rssi = (int16_t) info->rx_rssi;
+    }
+
+    if (info->variant == MT_FROMRADIO_MY_INFO) {
+        _myNodeNum = info->my_node_num;
+    } else if (info->variant == MT_FROMRADIO_PACKET) {
+        nodetab_heard(info->from, (uint32_t) (rx_us / 1000000), snr4,
+                      rssi, info->hops);
+    } else if (info->variant == MT_FROMRADIO_NODE_INFO) {
+        nodetab_named(info->from, info->short_name, snr4, info->hops);
+    }
+}
+
+/*
+ * Our node number as last told to the client in my_info, or 0.
+ */
+uint32_t MeshRoof::getMyNodeNum(void) const
+{
+    return _myNodeNum;
+}
+
+unsigned int MeshRoof::getConfigDownloadMs(void) const
+{
+    return _configDownloadMs;
+}
+
+uint32_t MeshRoof::getConfigDownloadBaud(void) const
+{
+    return _configDownloadBaud;
+}
+
+unsigned int MeshRoof::getUsableMs(void) const
+{
+    return _usableMs;
+}
+
+bool MeshRoof::wasUsableFromCache(void) const
+{
+    return _usableFromCache;
+}
+
+void MeshRoof::noteHandlerLatency(void) const
+{
+    int64_t first_byte_us = serial_rx_frame_us();
+
+    if (first_byte_us != 0) {
+        serial_note_handler_latency(esp_timer_get_time() - first_byte_us);
+    }
+}
+
 void MeshRoof::gotTextMessage(const meshtastic_MeshPacket &packet,
                               const string &message)
 {
     bool result = false;
+
+    noteHandlerLatency();
+
+    // A rebroadcast or retry of a command we already acted on
+    if (dedup_check(packet.from, packet.id, esp_timer_get_time())) {
+        return;
+    }
+
     SimpleClient::gotTextMessage(packet, message);
 
+    _replyChannel = packet.channel;
     result = handleTextMessage(packet, message);
     if (result) {
         return;
@@ -181,47 +1016,174 @@ void MeshRoof::gotTextMessage(const meshtastic_MeshPacket &packet,
 void MeshRoof::gotTelemetry(const meshtastic_MeshPacket &packet,
                             const meshtastic_Telemetry &telemetry)
 {
+    int16_t values[TSERIES_METRICS];
+    uint8_t mask = 0;
+
+    noteHandlerLatency();
     SimpleClient::gotTelemetry(packet, telemetry);
+
+    memset(values, 0x0, sizeof(values));
+    if (telemetry.which_variant == meshtastic_Telemetry_device_metrics_tag) {
+        const meshtastic_DeviceMetrics &metrics =
+            telemetry.variant.device_metrics;
+
+        if (metrics.has_battery_level) {
+            values[TSERIES_BATTERY] =
+                (int16_t) min(metrics.battery_level, (uint32_t) 101);
+            mask |= 1 << TSERIES_BATTERY;
+        }
+        if (metrics.has_voltage) {
+            values[TSERIES_VOLTAGE] =
+                (int16_t) clamp(metrics.voltage * 1000.0f, 0.0f, 32767.0f);
+            mask |= 1 << TSERIES_VOLTAGE;
+        }
+        if (metrics.has_channel_utilization) {
+            values[TSERIES_CHUTIL] = (int16_t)
+                clamp(metrics.channel_utilization * 10.0f, 0.0f, 1000.0f);
+            mask |= 1 << TSERIES_CHUTIL;
+        }
+        if (metrics.has_air_util_tx) {
+            values[TSERIES_AIRUTIL] = (int16_t)
+                clamp(metrics.air_util_tx * 10.0f, 0.0f, 1000.0f);
+            mask |= 1 << TSERIES_AIRUTIL;
+        }
+    } else if (telemetry.which_variant ==
+               meshtastic_Telemetry_environment_metrics_tag) {
+        const meshtastic_EnvironmentMetrics &metrics =
+            telemetry.variant.environment_metrics;
+
+        if (metrics.has_temperature) {
+            values[TSERIES_TEMPERATURE] = (int16_t)
+                clamp(metrics.temperature * 10.0f, -32768.0f, 32767.0f);
+            mask |= 1 << TSERIES_TEMPERATURE;
+        }
+    }
+
+    if (mask != 0) {
+        tseries_add(packet.from, (uint32_t) (esp_timer_get_time() / 1000000),
+                    mask, values);
+    }
 }
 
 void MeshRoof::gotRouting(const meshtastic_MeshPacket &packet,
                           const meshtastic_Routing &routing)
 {
     SimpleClient::gotRouting(packet, routing);
+
+    if (routing.which_variant == meshtastic_Routing_error_reason_tag) {
+        linkgraph_acked(packet.decoded.request_id, packet.from,
+                        routing.error_reason == meshtastic_Routing_Error_NONE,
+                        (uint32_t) (esp_timer_get_time() / 1000000));
+    }
+}
+
+/*
+ * Lay out first, route[], last as a path for the link graph, with the
+ * SNR (in 0.25 dB) measured on arrival at each hop.
+ */
+static unsigned int traceRoutePath(uint32_t first, const uint32_t *route,
+                                   unsigned int route_count, uint32_t last,
+                                   const int32_t *snr,
+                                   unsigned int snr_count,
+                                   uint32_t *path, int8_t *snr4)
+{
+    unsigned int n = 0;
+    unsigned int i;
+
+    if (route_count >= LINKGRAPH_MAX_HOPS) {
+        return 0;
+    }
+
+    path[n++] = first;
+    for (i = 0; i < route_count; i++) {
+        path[n++] = route[i];
+    }
+    path[n++] = last;
+
+    for (i = 0; (i + 1) < n; i++) {
+        if ((i < snr_count) && (snr[i] > INT8_MIN) && (snr[i] <= INT8_MAX)) {
+            snr4[i] = (int8_t) snr[i];
+        } else {
+            snr4[i] = LINKGRAPH_SNR_UNKNOWN;
+        }
+    }
+
+    return n;
 }
 
 void MeshRoof::gotTraceRoute(const meshtastic_MeshPacket &packet,
                              const meshtastic_RouteDiscovery &routeDiscovery)
 {
+    uint32_t path[LINKGRAPH_MAX_HOPS + 1];
+    int8_t snr4[LINKGRAPH_MAX_HOPS];
+    uint32_t now_s = (uint32_t) (esp_timer_get_time() / 1000000);
+    bool reply = packet.decoded.request_id != 0;
+    uint32_t requester = reply ? packet.to : packet.from;
+    uint32_t responder = reply ? packet.from : packet.to;
+    unsigned int n;
+
     SimpleClient::gotTraceRoute(packet, routeDiscovery);
+
+    n = traceRoutePath(requester, routeDiscovery.route,
+                       routeDiscovery.route_count, responder,
+                       routeDiscovery.snr_towards,
+                       routeDiscovery.snr_towards_count, path, snr4);
+    linkgraph_path(path, snr4, n, now_s);
+
+    // Firmware before 2.5 reports no way back
+    if (reply && (routeDiscovery.snr_back_count > 0)) {
+        n = traceRoutePath(responder, routeDiscovery.route_back,
+                           routeDiscovery.route_back_count, requester,
+                           routeDiscovery.snr_back,
+                           routeDiscovery.snr_back_count, path, snr4);
+        linkgraph_path(path, snr4, n, now_s);
+    }
 }
 
 string MeshRoof::handleUnknown(uint32_t node_num, string &message)
 {
     string reply;
-    string first_word;
+    string_view rest;
+    MeshRoofCommand cmd;
+    size_t offset;
 
-    (void)(node_num);
+    cmd = lookupCommand(commandWord(message, &rest), CMD_MESH);
+    if (cmd == MeshRoofCommand::Unknown) {
+        return reply;
+    }
 
-    first_word = message.substr(0, message.find(' '));
-    toLowercase(first_word);
-    message = message.substr(first_word.size());
-    trimWhitespace(message);
+    // Leave only the arguments in 'message', in place
+    offset = rest.data() - message.data();
+    message.erase(offset + rest.size());
+    message.erase(0, offset);
 
-    if (first_word == "status") {
+    switch (cmd) {
+    case MeshRoofCommand::Status:
         reply = handleStatus(node_num, message);
-    } else if (first_word == "wifi") {
+        break;
+    case MeshRoofCommand::Wifi:
         reply = handleWifi(node_num, message);
-    } else if (first_word == "net") {
+        break;
+    case MeshRoofCommand::Net:
         reply = handleNet(node_num, message);
-    } else if (first_word == "amplify") {
+        break;
+    case MeshRoofCommand::Amplify:
         reply = handleAmplify(node_num, message);
-    } else if (first_word == "reset") {
+        break;
+    case MeshRoofCommand::Reset:
         reply = handleReset(node_num, message);
-    } else if (first_word == "buzz") {
+        break;
+    case MeshRoofCommand::Buzz:
         reply = handleBuzz(node_num, message);
-    } else if (first_word == "morse") {
+        break;
+    case MeshRoofCommand::Morse:
         reply = handleMorse(node_num, message);
+        break;
+    case MeshRoofCommand::Route:
+        reply = handleRoute(node_num, message);
+        break;
+    default:
+        break;
     }
 
     return reply;
@@ -240,6 +1202,11 @@ string MeshRoof::handleStatus(uint32_t node_num, string &message)
 string MeshRoof::handleEnv(uint32_t node_num, string &message)
 {
     stringstream ss;
+    string_view rest;
+
+    if (commandCompare(commandWord(message, &rest), "history") == 0) {
+        return deliverReply(node_num, envHistory(node_num, string(rest)));
+    }
 
     ss << HomeChat::handleEnv(node_num, message);
     if (!ss.str().empty()) {
@@ -249,7 +1216,7 @@ string MeshRoof::handleEnv(uint32_t node_num, string &message)
     ss << "cpu temperature: ";
     ss <<  setprecision(3) << getCpuTempC();
 
-    return ss.str();
+    return deliverReply(node_num, ss.str());
 }
 
 string MeshRoof::handleWifi(uint32_t node_num, string &message)
@@ -258,8 +1225,6 @@ string MeshRoof::handleWifi(uint32_t node_num, string &message)
     const wifi_event_sta_connected_t *sta_connected =
         espWifi()->getStaConnected();
 
-    (void)(node_num);
-
     if (sta_connected->bssid[0] == 0x0) {
         ss << "Wifi not connected";
     } else {
@@ -283,7 +1248,7 @@ string MeshRoof::handleWifi(uint32_t node_num, string &message)
         ss << "rssi: " << espWifi()->getRssi();
     }
 
-    return ss.str();
+    return deliverReply(node_num, ss.str());
 }
 
 string MeshRoof::handleNet(uint32_t node_num, string &message)
@@ -295,12 +1260,10 @@ string MeshRoof::handleNet(uint32_t node_num, string &message)
     const esp_netif_dns_info_t *dns3_info = espWifi()->getDns3Info();
     char buf[80];
 
-    (void)(node_num);
-
     if (getIp() == 0) {
-        this->printf("(dhcp)\n");
+        ss << "(dhcp)" << endl;
     } else {
-        this->printf("(static ip)\n");
+        ss << "(static ip)" << endl;
     }
 
     snprintf(buf, sizeof(buf) - 1,
@@ -322,7 +1285,7 @@ string MeshRoof::handleNet(uint32_t node_num, string &message)
              "dns3:    " IPSTR, IP2STR(&dns3_info->ip.u_addr.ip4));
     ss << buf;
 
-    return ss.str();
+    return deliverReply(node_num, ss.str());
 }
 
 string MeshRoof::handleAmplify(uint32_t node_num, string &message)
@@ -349,10 +1312,9 @@ string MeshRoof::handleBuzz(uint32_t node_num, string &message)
 {
     string reply;
 
-    (void)(node_num);
     (void)(message);
 
-    buzz();
+    queueCommand(MESHROOF_CMD_BUZZ, node_num, 500);
 
     return reply;
 }
@@ -370,9 +1332,20 @@ string MeshRoof::handleMorse(uint32_t node_num, string &message)
     return reply;
 }
 
+string MeshRoof::handleRoute(uint32_t node_num, string &message)
+{
+    uint32_t dest;
+
+    if (!parseNodeNum(message, &dest)) {
+        return "usage: route <!node>";
+    }
+
+    return deliverReply(node_num, routeReport(dest));
+}
+
 int MeshRoof::vprintf(const char *format, va_list ap) const
 {
-    return usb_vprintf(format, ap);
+    return log_vprintf(format, ap);
 }
 
 string MeshRoof::getWifiSsid(void) const
@@ -457,6 +1430,15 @@ string MeshRoof::getDns3String(void) const
     return string(buf);
 }
 
+uint32_t MeshRoof::getSerialBaud(void) const
+{
+    if (_main_body.serial_baud == 0) {
+        return SERIAL_DEFAULT_BAUD;
+    }
+
+    return _main_body.serial_baud;
+}
+
 uint32_t MeshRoof::getIp(void) const
 {
     return _main_body.ip;
@@ -618,8 +1600,38 @@ bool MeshRoof::setNetIfPasswd(const string &passwd)
     return true;
 }
 
+/*
+ * Only the ESP32 side of the link follows this setting: nothing is sent
+ * to the radio, whose serial module must be set to the same rate by hand
+ * (e.g. with the meshtastic CLI). Until it is, probeWantConfig() falls
+ * back to 115200 and keeps the link up.
+ */
+bool MeshRoof::setSerialBaud(uint32_t baud)
+{
+    switch (baud) {
+    case 115200:
+    case 230400:
+    case 460800:
+    case 921600:
+        break;
+    default:
+        return false;
+    }
+
+    _main_body.serial_baud = baud;
+
+    return true;
+}
+
 #define FLASH_TARGET_SIZE   8192
 
+/*
+ * struct nvm_main_body only grows at the end; a blob written by an older
+ * firmware has a shorter body and the missing fields are left zeroed.
+ */
+#define NVM_MAIN_BODY_MIN_SIZE \
+    (offsetof(struct nvm_main_body, n_mates) + sizeof(uint32_t))
+
 struct nvm_meta {
     size_t size;
 };
@@ -631,6 +1643,8 @@ bool MeshRoof::loadNvm(void)
     nvs_handle_t handle;
     uint8_t *buf;
     size_t size = 0;
+    size_t body_size = 0;
+    size_t tail_size = 0;
     struct nvm_meta nvm_meta;
     const struct nvm_header *header = NULL;
     const struct nvm_main_body *main_body = NULL;
@@ -685,6 +1699,11 @@ bool MeshRoof::loadNvm(void)
         goto done;
     }
 
+    if (size < (sizeof(struct nvm_header) + NVM_MAIN_BODY_MIN_SIZE)) {
+        ESP_LOGE(TAG, "Truncated size=%zu!", size);
+        result = false;
+        goto done;
+    }
     header = (const struct nvm_header *) buf;
     if (header->magic != NVM_HEADER_MAGIC) {
         ESP_LOGE(TAG, "Wrong header magic!");
@@ -693,20 +1712,38 @@ bool MeshRoof::loadNvm(void)
     }
     main_body = (const struct nvm_main_body *)
         (((const uint8_t *) header) + sizeof(*header));
-    size =
-        sizeof(struct nvm_header) +
-        sizeof(struct nvm_main_body) +
+    // Bounded so that the sizes below cannot wrap
+    if ((main_body->n_authchans > size) || (main_body->n_admins > size) ||
+        (main_body->n_mates > size)) {
+        ESP_LOGE(TAG, "Bad entry counts!");
+        result = false;
+        goto done;
+    }
+    tail_size =
         (main_body->n_authchans * sizeof(struct nvm_authchan_entry)) +
         (main_body->n_admins * sizeof(struct nvm_admin_entry)) +
         (main_body->n_mates * sizeof(struct nvm_mate_entry)) +
         sizeof(struct nvm_footer);
+    if ((sizeof(struct nvm_header) + tail_size) > size) {
+        ESP_LOGE(TAG, "Truncated size=%zu!", size);
+        result = false;
+        goto done;
+    }
+    body_size = size - sizeof(struct nvm_header) - tail_size;
+    if ((body_size < NVM_MAIN_BODY_MIN_SIZE) ||
+        (body_size > sizeof(struct nvm_main_body))) {
+        ESP_LOGE(TAG, "Bad main body size=%zu!", body_size);
+        result = false;
+        goto done;
+    }
+    size = sizeof(struct nvm_header) + body_size + tail_size;
     if (size > FLASH_TARGET_SIZE) {
         ESP_LOGE(TAG, "Too big size=%zu!", size);
         result = false;
         goto done;
     }
     authchans = (const struct nvm_authchan_entry *)
-        (((uint8_t *) main_body) + sizeof(*main_body));
+        (((uint8_t *) main_body) + body_size);
     admins = (const struct nvm_admin_entry *)
         (((uint8_t *) authchans) +
          (sizeof(struct nvm_authchan_entry) * main_body->n_authchans));
@@ -721,7 +1758,8 @@ bool MeshRoof::loadNvm(void)
         result = false;
         goto done;
     }
-    memcpy(&_main_body, main_body, sizeof(struct nvm_main_body));
+    bzero(&_main_body, sizeof(_main_body));
+    memcpy(&_main_body, main_body, body_size);
     _nvm_authchans.clear();
     for (i = 0; i < main_body->n_authchans; i++) {
         _nvm_authchans.push_back(authchans[i]);
@@ -863,6 +1901,7 @@ bool MeshRoof::applyNvmToHomeChat(void)
 
 
     clearAuthchansAdminsMates();
+    nodetab_clear_flags(NODETAB_ADMIN | NODETAB_MATE);
 
     for (vector<struct nvm_authchan_entry>::const_iterator it =
              nvmAuthchans().begin(); it != nvmAuthchans().end(); it++) {
@@ -876,6 +1915,7 @@ bool MeshRoof::applyNvmToHomeChat(void)
         if (addAdmin(it->node_num, it->pubkey) == false) {
             result = false;
         }
+        nodetab_set_flags(it->node_num, NODETAB_ADMIN);
     }
 
     for (vector<struct nvm_mate_entry>::const_iterator it =
@@ -883,6 +1923,7 @@ bool MeshRoof::applyNvmToHomeChat(void)
         if (addMate(it->node_num, it->pubkey) == false) {
             result = false;
         }
+        nodetab_set_flags(it->node_num, NODETAB_MATE);
     }
 
     return result;
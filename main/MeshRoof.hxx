@@ -8,6 +8,9 @@
 #define MESHROOF_HXX
 
 #include <memory>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 #include <SimpleClient.hxx>
 #include <HomeChat.hxx>
 #include <BaseNvm.hxx>
@@ -21,6 +24,13 @@
 #define BUZZER_PIN        ((gpio_num_t)  8)
 #define ONBOARD_LED_PIN   ((gpio_num_t) 21)
 
+#define REPLY_MAX_TEXT    200
+#define REPLY_HOP_LIMIT   3
+
+#define CMD_QUEUE_LEN     8
+#define CMD_HIST_BUCKETS  12
+#define CMD_BUZZ_MAX_MS   5000
+
 using namespace std;
 
 struct nvm_header {
@@ -44,8 +54,40 @@ struct nvm_main_body {
     uint32_t n_authchans;
     uint32_t n_admins;
     uint32_t n_mates;
+
+    uint32_t serial_baud;
 } __attribute__((packed));
 
+/*
+ * Commands that may block, run by the command executor task instead of
+ * the task that drains the UART. For a reset the executor only holds the
+ * radio's reset line; the API session is torn down beforehand by
+ * serviceLink() on the meshtastic task, which owns it. A cache save
+ * writes the snapshot mtcache took to NVS.
+ */
+enum meshroof_cmd {
+    MESHROOF_CMD_BUZZ = 0,
+    MESHROOF_CMD_RESET,
+    MESHROOF_CMD_CACHE_SAVE,
+    MESHROOF_CMDS,
+};
+
+/*
+ * hist[c][0] counts runs under 1 ms, hist[c][i] runs in
+ * [2^(i-1), 2^i) ms and the last bucket everything longer.
+ */
+struct cmd_stats {
+    unsigned int depth;
+    unsigned int max_depth;
+    uint32_t dropped;
+    uint32_t count[MESHROOF_CMDS];
+    uint64_t total_us[MESHROOF_CMDS];
+    uint32_t hist[MESHROOF_CMDS][CMD_HIST_BUCKETS];
+};
+
+struct cmd_job;
+struct mt_frame_info;
+
 struct nvm_footer {
     uint32_t magic;
 #define NVM_FOOTER_MAGIC 0xe8148afd
@@ -72,6 +114,7 @@ public:
     bool isAmplifying(void) const;
 
     void reset(void);
+    void resetPulse(void);
     unsigned int getResetCount(void) const;
     time_t getLastReset(void) const;
     unsigned int getLastResetSecsAgo(void) const;
@@ -85,8 +128,39 @@ public:
 
     float getCpuTempC(void) const;
 
+    static bool parseNodeNum(const string &text, uint32_t *node_num);
+    string routeReport(uint32_t dest) const;
+
+    bool queueCommand(enum meshroof_cmd cmd, uint32_t node_num = 0,
+                      unsigned int arg = 0);
+    void runCommands(void);
+    void getCommandStats(struct cmd_stats *stats) const;
+    static const char *commandName(unsigned int cmd);
+
+    bool probeWantConfig(void);
+    bool sendProbe(void);
+    void serviceLink(void);
+    void requestLinkBaud(void);
+    void requestCacheClear(void);
+    void requestStatsReset(void);
+    void observeNode(const struct mt_frame_info *info, int64_t rx_us);
+    uint32_t getMyNodeNum(void) const;
+    unsigned int getConfigDownloadMs(void) const;
+    uint32_t getConfigDownloadBaud(void) const;
+    unsigned int getUsableMs(void) const;
+    bool wasUsableFromCache(void) const;
+
 protected:
 
+    bool sendWantConfigNonce(uint32_t nonce);
+    void noteHandlerLatency(void) const;
+
+    bool sendText(uint32_t dest, uint8_t channel, const string &text);
+    vector<string> packReply(const string &reply) const;
+    string compactReply(const string &reply) const;
+    string deliverReply(uint32_t node_num, const string &reply);
+    string envHistory(uint32_t node_num, const string &args) const;
+
     // Extend SimpleClient
 
     virtual void gotTextMessage(const meshtastic_MeshPacket &packet,
@@ -111,6 +185,7 @@ protected:
     virtual string handleReset(uint32_t node_num, string &message);
     virtual string handleBuzz(uint32_t node_num, string &message);
     virtual string handleMorse(uint32_t node_num, string &message);
+    virtual string handleRoute(uint32_t node_num, string &message);
     virtual int vprintf(const char *format, va_list ap) const;
 
 public:
@@ -132,6 +207,7 @@ public:
     uint32_t getDns2(void) const;
     uint32_t getDns3(void) const;
     string getNetIfPassword(void) const;
+    uint32_t getSerialBaud(void) const;
 
     bool setWifiSsid(const string &ssid);
     bool setWifiPasswd(const string &passwd);
@@ -142,6 +218,7 @@ public:
     bool setDns2(const string &addr);
     bool setDns3(const string &addr);
     bool setNetIfPasswd(const string &passwd);
+    bool setSerialBaud(uint32_t baud);
 
     virtual bool loadNvm(void);
     virtual bool saveNvm(void);
@@ -156,6 +233,8 @@ protected:
 
 private:
 
+    bool submitCommand(const struct cmd_job *job);
+
     struct nvm_main_body _main_body;
 
     bool _isAmplifying;
@@ -164,6 +243,27 @@ private:
     bool _onboardLed;
     void *_esp_temp_handle;
 
+    unsigned int _wantConfigTries;
+    int64_t _wantConfigUs;
+    unsigned int _configDownloadMs;
+    uint32_t _configDownloadBaud;
+    volatile bool _linkBaudRequested;
+    volatile bool _cacheClearRequested;
+    volatile bool _statsResetRequested;
+    bool _cacheTried;
+    int64_t _cacheProbeUs;
+    int64_t _usableStartUs;
+    unsigned int _usableMs;
+    bool _usableFromCache;
+    uint8_t _replyChannel;
+    volatile uint32_t _myNodeNum;
+
+    QueueHandle_t _cmdQueue;
+    struct cmd_stats _cmdStats;
+    mutable portMUX_TYPE _cmdLock;
+    volatile bool _resetRequested;
+    volatile bool _resetPending;
+
 };
 
 #endif
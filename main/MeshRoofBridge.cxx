@@ -0,0 +1,167 @@
+/*
+ * MeshRoofBridge.cxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <meshroof.h>
+#include <MeshRoofBridge.hxx>
+
+struct bridge_stats MeshRoofBridge::_stats;
+
+MeshRoofBridge::MeshRoofBridge()
+    : _fd(-1),
+      _ooff(0),
+      _olen(0)
+{
+    mt_ring_init(&_iring, _ibuf, sizeof(_ibuf));
+}
+
+MeshRoofBridge::~MeshRoofBridge()
+{
+
+}
+
+void MeshRoofBridge::attach(int fd)
+{
+    _fd = fd;
+    mt_ring_init(&_iring, _ibuf, sizeof(_ibuf));
+    _ooff = 0;
+    _olen = 0;
+    pktmirror_subscribe(&_cursor);
+}
+
+void MeshRoofBridge::detach(void)
+{
+    pktmirror_unsubscribe(&_cursor);
+    _fd = -1;
+}
+
+int MeshRoofBridge::fd(void) const
+{
+    return _fd;
+}
+
+bool MeshRoofBridge::pending(void) const
+{
+    return _ooff != _olen;
+}
+
+/*
+ * A client must not be able to end the device's API session under
+ * MeshRoof, so disconnect requests stop here; everything else, including
+ * want_config, goes to the device and the replies reach every client.
+ */
+void MeshRoofBridge::forward(const struct mt_frame *frame)
+{
+    uint8_t hdr[MT_FRAME_HDR_SIZE];
+    struct serial_iov iov[3];
+    uint32_t variant;
+
+    if ((mt_frame_toradio_variant(frame, &variant) != 0) ||
+        (variant == MT_TORADIO_DISCONNECT)) {
+        _stats.filtered++;
+        return;
+    }
+
+    hdr[0] = MT_FRAME_START1;
+    hdr[1] = MT_FRAME_START2;
+    hdr[2] = (frame->len >> 8) & 0xff;
+    hdr[3] = frame->len & 0xff;
+    iov[0].base = hdr;
+    iov[0].len = sizeof(hdr);
+    iov[1].base = frame->seg[0];
+    iov[1].len = frame->seg_len[0];
+    iov[2].base = frame->seg[1];
+    iov[2].len = frame->seg_len[1];
+
+    if (serial_writev(iov, 3) > 0) {
+        _stats.to_radio++;
+    } else {
+        _stats.tx_errors++;
+    }
+}
+
+/*
+ * Read what the socket has into the input ring and pass every complete
+ * ToRadio frame on. Returns -1 when the connection should be closed.
+ */
+int MeshRoofBridge::process(void)
+{
+    struct mt_frame frame;
+    uint8_t *ptr;
+    size_t space;
+    int ret;
+
+    space = mt_ring_write_ptr(&_iring, &ptr);
+    if (space == 0) {
+        mt_ring_resync(&_iring);
+        space = mt_ring_write_ptr(&_iring, &ptr);
+    }
+
+    ret = recv(_fd, ptr, space, MSG_DONTWAIT);
+    if (ret == 0) {
+        return -1;
+    } else if (ret < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+    mt_ring_commit(&_iring, ret);
+
+    while (mt_frame_next(&_iring, &frame)) {
+        forward(&frame);
+        mt_frame_consume(&_iring, &frame);
+    }
+
+    return 0;
+}
+
+/*
+ * Send mirrored FromRadio frames until the socket would block. Returns
+ * -1 when the connection should be closed.
+ */
+int MeshRoofBridge::drain(void)
+{
+    int ret;
+
+    for (;;) {
+        if (_ooff == _olen) {
+            _ooff = 0;
+            _olen = pktmirror_read(&_cursor, _obuf, sizeof(_obuf));
+            if (_cursor.dropped != 0) {
+                _stats.overruns++;
+                _olen = 0;
+                return -1;
+            }
+            if (_olen <= 0) {
+                _olen = 0;
+                return 0;
+            }
+        }
+
+        ret = send(_fd, _obuf + _ooff, _olen - _ooff, MSG_DONTWAIT);
+        if (ret < 0) {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        }
+
+        _ooff += ret;
+    }
+}
+
+void MeshRoofBridge::getStats(struct bridge_stats *stats)
+{
+    memcpy(stats, &_stats, sizeof(*stats));
+}
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
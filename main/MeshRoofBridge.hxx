@@ -0,0 +1,76 @@
+/*
+ * MeshRoofBridge.hxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MESHROOFBRIDGE_HXX
+#define MESHROOFBRIDGE_HXX
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mtframe.h>
+#include <pktmirror.h>
+
+#define BRIDGE_IBUF_SIZE  1024
+
+struct bridge_stats {
+    uint32_t to_radio;
+    uint32_t filtered;
+    uint32_t tx_errors;
+    uint32_t overruns;
+};
+
+/*
+ * Meshtastic stream API (as served by the firmware on TCP port 4403) for
+ * host clients, multiplexed onto the serial link that MeshRoof owns.
+ * ToRadio frames from a client are queued to the UART whole; every
+ * FromRadio frame from the device is fanned out to all clients through
+ * the packet mirror while MeshRoof keeps processing it locally. The API
+ * has no way to tell a client it missed frames, so one that falls a
+ * mirror ring behind is disconnected rather than left waiting for them.
+ */
+class MeshRoofBridge {
+
+public:
+
+    MeshRoofBridge();
+    ~MeshRoofBridge();
+
+    void attach(int fd);
+    void detach(void);
+    int fd(void) const;
+    bool pending(void) const;
+
+    int process(void);
+    int drain(void);
+
+    static void getStats(struct bridge_stats *stats);
+
+private:
+
+    void forward(const struct mt_frame *frame);
+
+    int _fd;
+    struct mt_ring _iring;
+    uint8_t _ibuf[BRIDGE_IBUF_SIZE];
+    struct pktmirror_cursor _cursor;
+    uint8_t _obuf[PKTMIRROR_MAX_FRAME];
+    int _ooff;
+    int _olen;
+
+    static struct bridge_stats _stats;
+
+};
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,183 @@
+/*
+ * MeshRoofCommands.hxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MESHROOFCOMMANDS_HXX
+#define MESHROOFCOMMANDS_HXX
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <string_view>
+
+/*
+ * The commands understood over the mesh and in the shell, resolved
+ * against one table sorted at compile time. Lookups are case-insensitive
+ * binary searches over string_views and never allocate.
+ */
+enum class MeshRoofCommand : uint8_t {
+    Unknown = 0,
+    Airtime,
+    Amplify,
+    Buzz,
+    Env,
+    Exit,
+    Morse,
+    Net,
+    Nodes,
+    Ping,
+    Reset,
+    Route,
+    Serial,
+    Stats,
+    Status,
+    Trace,
+    Wifi,
+};
+
+#define CMD_MESH   0x1
+#define CMD_SHELL  0x2
+
+struct MeshRoofCommandEntry {
+    std::string_view name;
+    MeshRoofCommand cmd;
+    uint8_t where;
+};
+
+constexpr std::array<MeshRoofCommandEntry, 16> meshRoofCommands = {{
+    { "airtime", MeshRoofCommand::Airtime, CMD_SHELL, },
+    { "amplify", MeshRoofCommand::Amplify, CMD_MESH | CMD_SHELL, },
+    { "buzz",    MeshRoofCommand::Buzz,    CMD_MESH | CMD_SHELL, },
+    { "env",     MeshRoofCommand::Env,     CMD_SHELL, },
+    { "exit",    MeshRoofCommand::Exit,    CMD_SHELL, },
+    { "morse",   MeshRoofCommand::Morse,   CMD_MESH | CMD_SHELL, },
+    { "net",     MeshRoofCommand::Net,     CMD_MESH | CMD_SHELL, },
+    { "nodes",   MeshRoofCommand::Nodes,   CMD_SHELL, },
+    { "ping",    MeshRoofCommand::Ping,    CMD_SHELL, },
+    { "reset",   MeshRoofCommand::Reset,   CMD_MESH | CMD_SHELL, },
+    { "route",   MeshRoofCommand::Route,   CMD_MESH | CMD_SHELL, },
+    { "serial",  MeshRoofCommand::Serial,  CMD_SHELL, },
+    { "stats",   MeshRoofCommand::Stats,   CMD_SHELL, },
+    { "status",  MeshRoofCommand::Status,  CMD_MESH, },
+    { "trace",   MeshRoofCommand::Trace,   CMD_SHELL, },
+    { "wifi",    MeshRoofCommand::Wifi,    CMD_MESH | CMD_SHELL, },
+}};
+
+constexpr char commandLower(char c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? (char) (c - 'A' + 'a') : c;
+}
+
+constexpr bool commandIsSpace(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+/*
+ * strcasecmp() for string_views: < 0, 0 or > 0.
+ */
+constexpr int commandCompare(std::string_view a, std::string_view b)
+{
+    size_t i = 0;
+    char ca = '\0', cb = '\0';
+
+    for (i = 0; (i < a.size()) && (i < b.size()); i++) {
+        ca = commandLower(a[i]);
+        cb = commandLower(b[i]);
+        if (ca != cb) {
+            return (ca < cb) ? -1 : 1;
+        }
+    }
+
+    return (a.size() == b.size()) ? 0 : ((a.size() < b.size()) ? -1 : 1);
+}
+
+constexpr bool commandTableSorted(void)
+{
+    size_t i = 0;
+
+    for (i = 1; i < meshRoofCommands.size(); i++) {
+        if (commandCompare(meshRoofCommands[i - 1].name,
+                           meshRoofCommands[i].name) >= 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static_assert(commandTableSorted(), "meshRoofCommands must stay sorted");
+
+/*
+ * Resolve a command word for the mesh (CMD_MESH) or the shell (CMD_SHELL).
+ */
+constexpr MeshRoofCommand lookupCommand(std::string_view word, uint8_t where)
+{
+    size_t lo = 0;
+    size_t hi = meshRoofCommands.size();
+    size_t mid = 0;
+    int cmp = 0;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        cmp = commandCompare(word, meshRoofCommands[mid].name);
+        if (cmp == 0) {
+            return (meshRoofCommands[mid].where & where) ?
+                meshRoofCommands[mid].cmd : MeshRoofCommand::Unknown;
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return MeshRoofCommand::Unknown;
+}
+
+/*
+ * Split 'text' into its first word and the rest, both without the
+ * surrounding whitespace. The views point into 'text'.
+ */
+constexpr std::string_view commandWord(std::string_view text,
+                                       std::string_view *rest)
+{
+    size_t start = 0;
+    size_t end = 0;
+
+    while ((start < text.size()) && commandIsSpace(text[start])) {
+        start++;
+    }
+    end = start;
+    while ((end < text.size()) && !commandIsSpace(text[end])) {
+        end++;
+    }
+
+    if (rest != NULL) {
+        *rest = text.substr(end);
+        while (!rest->empty() && commandIsSpace(rest->front())) {
+            rest->remove_prefix(1);
+        }
+        while (!rest->empty() && commandIsSpace(rest->back())) {
+            rest->remove_suffix(1);
+        }
+    }
+
+    return text.substr(start, end - start);
+}
+
+static_assert(lookupCommand("WiFi", CMD_MESH) == MeshRoofCommand::Wifi);
+static_assert(lookupCommand("trace", CMD_MESH) == MeshRoofCommand::Unknown);
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
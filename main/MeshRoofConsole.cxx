@@ -0,0 +1,722 @@
+/*
+ * MeshRoofConsole.cxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <MeshRoofConsole.hxx>
+
+static const char *TAG = "console";
+
+/*
+ * Watch fd, unless it is a listener that failed to open.
+ */
+static inline void fd_watch(int fd, fd_set *fds, int *max_fd)
+{
+    if (fd == -1) {
+        return;
+    }
+
+    FD_SET(fd, fds);
+    if (fd > *max_fd) {
+        *max_fd = fd;
+    }
+}
+
+MeshRoofConsole::MeshRoofConsole()
+    : _serverSock(-1),
+      _rpcSock(-1),
+      _httpSock(-1),
+      _mirrorSock(-1),
+      _bridgeSock(-1)
+{
+    int i;
+
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS; i++) {
+        _sessions[i].fd = -1;
+        _sessions[i].shell = NULL;
+    }
+
+    for (i = 0; i < MIRROR_MAX_CLIENTS; i++) {
+        _mirror[i].fd = -1;
+    }
+}
+
+MeshRoofConsole::~MeshRoofConsole()
+{
+    stop();
+}
+
+void MeshRoofConsole::setShell(unsigned int session,
+                               shared_ptr<MeshRoofShell> shell)
+{
+    if (session < TCP_CONSOLE_MAX_SESSIONS) {
+        _sessions[session].shell = shell;
+    }
+}
+
+/*
+ * Open the listening sockets; a port of 0 picks any free one (see
+ * getPorts()). A port that cannot be opened is logged and its service
+ * left out, so that e.g. a taken port 80 does not take the console down
+ * with it. Returns -1 only if none could be opened.
+ */
+int MeshRoofConsole::start(const struct console_ports *ports)
+{
+    _serverSock = tcpListen(ports->console, TCP_CONSOLE_MAX_SESSIONS);
+    if (_serverSock == -1) {
+        ESP_LOGW(TAG, "running without the console on port %u",
+                 ports->console);
+    }
+
+    _rpcSock = tcpListen(ports->rpc, RPC_MAX_CLIENTS);
+    if (_rpcSock == -1) {
+        ESP_LOGW(TAG, "running without RPC on port %u", ports->rpc);
+    }
+
+    _httpSock = tcpListen(ports->http, HTTP_MAX_CLIENTS);
+    if (_httpSock == -1) {
+        ESP_LOGW(TAG, "running without HTTP on port %u", ports->http);
+    }
+
+    _mirrorSock = tcpListen(ports->mirror, MIRROR_MAX_CLIENTS);
+    if (_mirrorSock == -1) {
+        ESP_LOGW(TAG, "running without the mirror on port %u",
+                 ports->mirror);
+    }
+
+    _bridgeSock = tcpListen(ports->bridge, BRIDGE_MAX_CLIENTS);
+    if (_bridgeSock == -1) {
+        ESP_LOGW(TAG, "running without the API bridge on port %u",
+                 ports->bridge);
+    }
+
+    if ((_serverSock == -1) && (_rpcSock == -1) && (_httpSock == -1) &&
+        (_mirrorSock == -1) && (_bridgeSock == -1)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Close every client and listening socket.
+ */
+void MeshRoofConsole::stop(void)
+{
+    int *socks[] = {
+        &_serverSock, &_rpcSock, &_httpSock, &_mirrorSock, &_bridgeSock,
+    };
+    unsigned int i;
+    int fd;
+
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS; i++) {
+        if (_sessions[i].fd != -1) {
+            sessionClose(&_sessions[i]);
+        }
+    }
+
+    for (i = 0; i < RPC_MAX_CLIENTS; i++) {
+        fd = _rpc[i].fd();
+        if (fd != -1) {
+            _rpc[i].detach();
+            close(fd);
+        }
+    }
+
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        fd = _http[i].fd();
+        if (fd != -1) {
+            _http[i].detach();
+            close(fd);
+        }
+    }
+
+    for (i = 0; i < MIRROR_MAX_CLIENTS; i++) {
+        if (_mirror[i].fd != -1) {
+            mirrorClose(&_mirror[i]);
+        }
+    }
+
+    for (i = 0; i < BRIDGE_MAX_CLIENTS; i++) {
+        fd = _bridge[i].fd();
+        if (fd != -1) {
+            _bridge[i].detach();
+            close(fd);
+        }
+    }
+
+    for (i = 0; i < (sizeof(socks) / sizeof(socks[0])); i++) {
+        if (*socks[i] != -1) {
+            close(*socks[i]);
+            *socks[i] = -1;
+        }
+    }
+}
+
+void MeshRoofConsole::getPorts(struct console_ports *ports) const
+{
+    ports->console = localPort(_serverSock);
+    ports->rpc = localPort(_rpcSock);
+    ports->http = localPort(_httpSock);
+    ports->mirror = localPort(_mirrorSock);
+    ports->bridge = localPort(_bridgeSock);
+}
+
+int MeshRoofConsole::tcpListen(uint16_t port, int backlog)
+{
+    int ret;
+    int sock;
+    int one = 1;
+    struct sockaddr_in addr;
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == -1) {
+        ESP_LOGE(TAG, "socket ret=%d", sock);
+        goto done;
+    }
+
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    ret = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
+    if (ret != 0) {
+        ESP_LOGE(TAG, "bind port %u ret=%d", port, ret);
+        close(sock);
+        sock = -1;
+        goto done;
+    }
+
+    ret = ::listen(sock, backlog);
+    if (ret == -1) {
+        ESP_LOGE(TAG, "listen port %u ret=%d", port, ret);
+        close(sock);
+        sock = -1;
+        goto done;
+    }
+
+done:
+
+    return sock;
+}
+
+int MeshRoofConsole::tcpAccept(int server_sock)
+{
+    int client_sock;
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    client_sock = ::accept(server_sock, (struct sockaddr *) &addr, &len);
+    if (client_sock == -1) {
+        ESP_LOGE(TAG, "accept ret=%d", client_sock);
+    }
+
+    return client_sock;
+}
+
+uint16_t MeshRoofConsole::localPort(int sock)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if ((sock == -1) ||
+        (getsockname(sock, (struct sockaddr *) &addr, &len) != 0)) {
+        return 0;
+    }
+
+    return ntohs(addr.sin_port);
+}
+
+/*
+ * Forward pending log messages to a TCP session without blocking; a
+ * message that only partially fits in the socket is finished next time.
+ */
+int MeshRoofConsole::sessionDrainLog(struct tcp_session *session)
+{
+    int ret;
+
+    for (;;) {
+        if (session->log_off == session->log_len) {
+            session->log_off = 0;
+            session->log_len = log_read(&session->log_cursor,
+                                        session->log_buf,
+                                        sizeof(session->log_buf));
+            if (session->log_len <= 0) {
+                session->log_len = 0;
+                return 0;
+            }
+        }
+
+        ret = send(session->fd, session->log_buf + session->log_off,
+                   session->log_len - session->log_off, MSG_DONTWAIT);
+        if (ret < 0) {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        }
+
+        session->log_off += ret;
+    }
+}
+
+void MeshRoofConsole::sessionOpen(int fd)
+{
+    static const string msg = "Too many connected clients, bye!\n";
+    struct tcp_session *session = NULL;
+    uint32_t ctx;
+    int one = 1;
+    int i;
+
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS; i++) {
+        if ((_sessions[i].fd == -1) && (_sessions[i].shell != NULL) &&
+            !_sessions[i].shell->busy()) {
+            session = &_sessions[i];
+            break;
+        }
+    }
+
+    if (session == NULL) {
+        write(fd, msg.c_str(), msg.size());
+        close(fd);
+        return;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    ctx = 0x80000000 | fd;
+    session->fd = fd;
+    session->log_off = 0;
+    session->log_len = 0;
+    log_cursor_init(&session->log_cursor);
+    session->shell->attach((void *) (uintptr_t) ctx);
+    session->shell->telnetStart();
+    session->shell->showWelcome();
+    session->shell->flush();
+}
+
+void MeshRoofConsole::sessionClose(struct tcp_session *session)
+{
+    session->shell->cancel();
+    session->shell->detach();
+    session->shell->flush();
+    close(session->fd);
+    session->fd = -1;
+}
+
+/*
+ * Serve input on a readable session. A zero-length peek means the peer
+ * (or the 'exit' command) shut the connection down. Commands stop being
+ * read once one of them starts a job.
+ */
+int MeshRoofConsole::sessionInput(struct tcp_session *session)
+{
+    int ret;
+    char c;
+
+    ret = recv(session->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (ret == 0) {
+        return -1;
+    } else if (ret < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+
+    do {
+        ret = session->shell->process();
+    } while ((ret > 0) && !session->shell->busy());
+
+    if (session->shell->flush() < 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+void MeshRoofConsole::rpcOpen(int fd)
+{
+    static const string msg = "Too many connected clients, bye!\n";
+    int one = 1;
+    int i;
+
+    for (i = 0; i < RPC_MAX_CLIENTS; i++) {
+        if (_rpc[i].fd() == -1) {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            _rpc[i].attach(fd);
+            return;
+        }
+    }
+
+    write(fd, msg.c_str(), msg.size());
+    close(fd);
+}
+
+void MeshRoofConsole::httpOpen(int fd)
+{
+    int i;
+
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        if (_http[i].fd() == -1) {
+            _http[i].attach(fd);
+            return;
+        }
+    }
+
+    // Scrapers retry; no need to explain
+    close(fd);
+}
+
+void MeshRoofConsole::mirrorOpen(int fd)
+{
+    struct mirror_client *client;
+    int one = 1;
+    int i;
+
+    for (i = 0; i < MIRROR_MAX_CLIENTS; i++) {
+        client = &_mirror[i];
+        if (client->fd == -1) {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            client->fd = fd;
+            client->off = 0;
+            client->len = 0;
+            pktmirror_subscribe(&client->cursor);
+            return;
+        }
+    }
+
+    close(fd);
+}
+
+void MeshRoofConsole::mirrorClose(struct mirror_client *client)
+{
+    pktmirror_unsubscribe(&client->cursor);
+    close(client->fd);
+    client->fd = -1;
+}
+
+/*
+ * Mirror subscribers only listen; anything they send is discarded and a
+ * zero-length read means they went away.
+ */
+int MeshRoofConsole::mirrorInput(struct mirror_client *client)
+{
+    uint8_t buf[32];
+    int ret;
+
+    ret = recv(client->fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (ret == 0) {
+        return -1;
+    } else if (ret < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+
+    return 0;
+}
+
+int MeshRoofConsole::mirrorDrain(struct mirror_client *client)
+{
+    int ret;
+
+    for (;;) {
+        if (client->off == client->len) {
+            client->off = 0;
+            client->len = pktmirror_read(&client->cursor, client->buf,
+                                         sizeof(client->buf));
+            if (client->len <= 0) {
+                client->len = 0;
+                return 0;
+            }
+        }
+
+        ret = send(client->fd, client->buf + client->off,
+                   client->len - client->off, MSG_DONTWAIT);
+        if (ret < 0) {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        }
+
+        client->off += ret;
+    }
+}
+
+void MeshRoofConsole::bridgeOpen(int fd)
+{
+    int one = 1;
+    int i;
+
+    for (i = 0; i < BRIDGE_MAX_CLIENTS; i++) {
+        if (_bridge[i].fd() == -1) {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            _bridge[i].attach(fd);
+            return;
+        }
+    }
+
+    close(fd);
+}
+
+void MeshRoofConsole::watch(fd_set *rfds, fd_set *wfds, int *max_fd)
+{
+    struct tcp_session *session;
+    struct mirror_client *mirror;
+    MeshRoofBridge *bridge;
+    int i;
+
+    fd_watch(_serverSock, rfds, max_fd);
+    fd_watch(_rpcSock, rfds, max_fd);
+    fd_watch(_httpSock, rfds, max_fd);
+    fd_watch(_mirrorSock, rfds, max_fd);
+    fd_watch(_bridgeSock, rfds, max_fd);
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS; i++) {
+        session = &_sessions[i];
+        if (session->fd == -1) {
+            continue;
+        }
+        // A job reads its own input (for ^C) when polled, and no more
+        // commands are read while a slow peer has output pending
+        if (!session->shell->busy() && !session->shell->pending()) {
+            fd_watch(session->fd, rfds, max_fd);
+        }
+        if ((session->log_off != session->log_len) ||
+            session->shell->pending()) {
+            fd_watch(session->fd, wfds, max_fd);
+        }
+    }
+    for (i = 0; i < RPC_MAX_CLIENTS; i++) {
+        if (_rpc[i].fd() == -1) {
+            continue;
+        }
+        // Requests wait while a slow client has replies pending
+        if (_rpc[i].pending()) {
+            fd_watch(_rpc[i].fd(), wfds, max_fd);
+        } else {
+            fd_watch(_rpc[i].fd(), rfds, max_fd);
+        }
+    }
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        if (_http[i].fd() == -1) {
+            continue;
+        }
+        // A slow scraper's reply goes out as its socket takes it
+        if (_http[i].pending()) {
+            fd_watch(_http[i].fd(), wfds, max_fd);
+        } else {
+            fd_watch(_http[i].fd(), rfds, max_fd);
+        }
+    }
+    for (i = 0; i < MIRROR_MAX_CLIENTS; i++) {
+        mirror = &_mirror[i];
+        if (mirror->fd == -1) {
+            continue;
+        }
+        fd_watch(mirror->fd, rfds, max_fd);
+        if (mirror->off != mirror->len) {
+            fd_watch(mirror->fd, wfds, max_fd);
+        }
+    }
+    for (i = 0; i < BRIDGE_MAX_CLIENTS; i++) {
+        bridge = &_bridge[i];
+        if (bridge->fd() == -1) {
+            continue;
+        }
+        fd_watch(bridge->fd(), rfds, max_fd);
+        if (bridge->pending()) {
+            fd_watch(bridge->fd(), wfds, max_fd);
+        }
+    }
+}
+
+void MeshRoofConsole::serve(const fd_set *rfds)
+{
+    struct tcp_session *session;
+    struct mirror_client *mirror;
+    MeshRoofBridge *bridge;
+    int client_sock;
+    int ret;
+    int i;
+
+    if ((_serverSock != -1) && FD_ISSET(_serverSock, rfds)) {
+        client_sock = tcpAccept(_serverSock);
+        if (client_sock != -1) {
+            sessionOpen(client_sock);
+        }
+    }
+
+    if ((_rpcSock != -1) && FD_ISSET(_rpcSock, rfds)) {
+        client_sock = tcpAccept(_rpcSock);
+        if (client_sock != -1) {
+            rpcOpen(client_sock);
+        }
+    }
+
+    if ((_httpSock != -1) && FD_ISSET(_httpSock, rfds)) {
+        client_sock = tcpAccept(_httpSock);
+        if (client_sock != -1) {
+            httpOpen(client_sock);
+        }
+    }
+
+    if ((_mirrorSock != -1) && FD_ISSET(_mirrorSock, rfds)) {
+        client_sock = tcpAccept(_mirrorSock);
+        if (client_sock != -1) {
+            mirrorOpen(client_sock);
+        }
+    }
+
+    if ((_bridgeSock != -1) && FD_ISSET(_bridgeSock, rfds)) {
+        client_sock = tcpAccept(_bridgeSock);
+        if (client_sock != -1) {
+            bridgeOpen(client_sock);
+        }
+    }
+
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS; i++) {
+        session = &_sessions[i];
+        if (session->fd == -1) {
+            // A job stopped by a disconnect may still be winding down
+            if ((session->shell != NULL) && session->shell->busy()) {
+                session->shell->poll();
+            }
+            continue;
+        }
+
+        ret = 0;
+        if (FD_ISSET(session->fd, rfds)) {
+            ret = sessionInput(session);
+        }
+        if (ret >= 0) {
+            ret = session->shell->poll();
+        }
+        if (ret >= 0) {
+            ret = sessionDrainLog(session);
+        }
+        if (ret < 0) {
+            sessionClose(session);
+        }
+    }
+
+    for (i = 0; i < RPC_MAX_CLIENTS; i++) {
+        client_sock = _rpc[i].fd();
+        if (client_sock == -1) {
+            continue;
+        }
+
+        ret = 0;
+        if (FD_ISSET(client_sock, rfds)) {
+            ret = _rpc[i].process();
+        } else if (_rpc[i].pending()) {
+            ret = _rpc[i].drain();
+        }
+        if (ret < 0) {
+            _rpc[i].detach();
+            close(client_sock);
+        }
+    }
+
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        client_sock = _http[i].fd();
+        if (client_sock == -1) {
+            continue;
+        }
+
+        ret = 1;
+        if (FD_ISSET(client_sock, rfds)) {
+            ret = _http[i].process();
+        } else if (_http[i].pending()) {
+            ret = _http[i].drain();
+        }
+        if ((ret <= 0) || _http[i].expired()) {
+            _http[i].detach();
+            close(client_sock);
+        }
+    }
+
+    for (i = 0; i < MIRROR_MAX_CLIENTS; i++) {
+        mirror = &_mirror[i];
+        if (mirror->fd == -1) {
+            continue;
+        }
+
+        ret = 0;
+        if (FD_ISSET(mirror->fd, rfds)) {
+            ret = mirrorInput(mirror);
+        }
+        if (ret >= 0) {
+            ret = mirrorDrain(mirror);
+        }
+        if (ret < 0) {
+            mirrorClose(mirror);
+        }
+    }
+
+    for (i = 0; i < BRIDGE_MAX_CLIENTS; i++) {
+        bridge = &_bridge[i];
+        client_sock = bridge->fd();
+        if (client_sock == -1) {
+            continue;
+        }
+
+        ret = 0;
+        if (FD_ISSET(client_sock, rfds)) {
+            ret = bridge->process();
+        }
+        if (ret >= 0) {
+            ret = bridge->drain();
+        }
+        if (ret < 0) {
+            bridge->detach();
+            close(client_sock);
+        }
+    }
+}
+
+/*
+ * One round of the event loop: select() wakes it for new connections and
+ * input, and the timeout bounds how long log messages, mirrored frames
+ * and running jobs wait to be serviced.
+ */
+void MeshRoofConsole::poll(unsigned int timeout_ms)
+{
+    fd_set rfds;
+    fd_set wfds;
+    struct timeval timeout;
+    int max_fd = -1;
+    int ret;
+
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    watch(&rfds, &wfds, &max_fd);
+
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    ret = select(max_fd + 1, &rfds, &wfds, NULL, &timeout);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "select ret=%d", ret);
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+        return;
+    }
+
+    if (ret == 0) {
+        FD_ZERO(&rfds);
+    }
+
+    serve(&rfds);
+}
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,122 @@
+/*
+ * MeshRoofConsole.hxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MESHROOFCONSOLE_HXX
+#define MESHROOFCONSOLE_HXX
+
+#include <stdint.h>
+#include <sys/select.h>
+#include <memory>
+#include <logring.h>
+#include <pktmirror.h>
+#include <MeshRoofShell.hxx>
+#include <MeshRoofRpc.hxx>
+#include <MeshRoofHttp.hxx>
+#include <MeshRoofBridge.hxx>
+
+using namespace std;
+
+#define TCP_CONSOLE_MAX_SESSIONS       4
+#define RPC_MAX_CLIENTS                2
+#define HTTP_MAX_CLIENTS               2
+#define MIRROR_MAX_CLIENTS             2
+#define BRIDGE_MAX_CLIENTS             2
+
+struct console_ports {
+    uint16_t console;
+    uint16_t rpc;
+    uint16_t http;
+    uint16_t mirror;
+    uint16_t bridge;
+};
+
+/*
+ * The network side of the firmware: one event loop serves the listening
+ * sockets and every client of the console, RPC, HTTP, mirror and API
+ * bridge ports. Nothing in it may block; a shell command that takes a
+ * while (ping) runs as a job that poll() advances on every round.
+ */
+class MeshRoofConsole {
+
+public:
+
+    MeshRoofConsole();
+    ~MeshRoofConsole();
+
+    void setShell(unsigned int session, shared_ptr<MeshRoofShell> shell);
+
+    int start(const struct console_ports *ports);
+    void stop(void);
+    void getPorts(struct console_ports *ports) const;
+
+    void poll(unsigned int timeout_ms);
+
+private:
+
+    struct tcp_session {
+        int fd;
+        shared_ptr<MeshRoofShell> shell;
+        struct log_cursor log_cursor;
+        char log_buf[LOG_MSG_MAX + 1];
+        int log_off;
+        int log_len;
+    };
+
+    struct mirror_client {
+        int fd;
+        struct pktmirror_cursor cursor;
+        uint8_t buf[PKTMIRROR_MAX_FRAME];
+        int off;
+        int len;
+    };
+
+    static int tcpListen(uint16_t port, int backlog);
+    static int tcpAccept(int server_sock);
+    static uint16_t localPort(int sock);
+
+    void watch(fd_set *rfds, fd_set *wfds, int *max_fd);
+    void serve(const fd_set *rfds);
+
+    void sessionOpen(int fd);
+    void sessionClose(struct tcp_session *session);
+    int sessionInput(struct tcp_session *session);
+    int sessionDrainLog(struct tcp_session *session);
+
+    void rpcOpen(int fd);
+    void httpOpen(int fd);
+
+    void mirrorOpen(int fd);
+    void mirrorClose(struct mirror_client *client);
+    int mirrorInput(struct mirror_client *client);
+    int mirrorDrain(struct mirror_client *client);
+
+    void bridgeOpen(int fd);
+
+    int _serverSock;
+    int _rpcSock;
+    int _httpSock;
+    int _mirrorSock;
+    int _bridgeSock;
+
+    struct tcp_session _sessions[TCP_CONSOLE_MAX_SESSIONS];
+    MeshRoofRpc _rpc[RPC_MAX_CLIENTS];
+    MeshRoofHttp _http[HTTP_MAX_CLIENTS];
+    struct mirror_client _mirror[MIRROR_MAX_CLIENTS];
+    MeshRoofBridge _bridge[BRIDGE_MAX_CLIENTS];
+
+};
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
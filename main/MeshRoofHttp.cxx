@@ -0,0 +1,417 @@
+/*
+ * MeshRoofHttp.cxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <meshroof.h>
+#include <mtcache.h>
+#include <pktmirror.h>
+#include <dedup.h>
+#include <tseries.h>
+#include <stuckdet.h>
+#include <MeshRoof.hxx>
+#include <MeshRoofHttp.hxx>
+#include <MeshRoofBridge.hxx>
+
+extern shared_ptr<MeshRoof> meshroof;
+
+/*
+ * Tasks whose stack high-water mark is exported. Handles are looked up
+ * by name once (that walks the task lists) and cached afterwards.
+ */
+static const char *metrics_task_names[] = {
+    "main",
+    "SerialTx",
+    "UsbTx",
+    "Console",
+    "TcpConsole",
+    "Led",
+    "MorseBuzzer",
+    "Command",
+    "TxSched",
+};
+
+#define METRICS_TASKS \
+    (sizeof(metrics_task_names) / sizeof(metrics_task_names[0]))
+
+static TaskHandle_t metrics_tasks[METRICS_TASKS];
+
+MeshRoofHttp::MeshRoofHttp()
+    : _fd(-1),
+      _openUs(0),
+      _ilen(0),
+      _replied(false),
+      _failed(false)
+{
+    outbuf_init(&_out, _obuf, sizeof(_obuf));
+}
+
+MeshRoofHttp::~MeshRoofHttp()
+{
+
+}
+
+void MeshRoofHttp::attach(int fd)
+{
+    _fd = fd;
+    _openUs = esp_timer_get_time();
+    _ilen = 0;
+    outbuf_init(&_out, _obuf, sizeof(_obuf));
+    _replied = false;
+    _failed = false;
+}
+
+void MeshRoofHttp::detach(void)
+{
+    _fd = -1;
+}
+
+int MeshRoofHttp::fd(void) const
+{
+    return _fd;
+}
+
+bool MeshRoofHttp::expired(void) const
+{
+    return (esp_timer_get_time() - _openUs) > HTTP_TIMEOUT_US;
+}
+
+/*
+ * Collect the request until the blank line that ends its header, then
+ * answer it. Returns 1 while more input is needed or the reply is still
+ * going out, and 0 or -1 once the connection should be closed.
+ */
+int MeshRoofHttp::process(void)
+{
+    int ret;
+
+    if (_replied) {
+        // Anything after the request is of no interest
+        ret = recv(_fd, _ibuf, HTTP_MAX_REQUEST, MSG_DONTWAIT);
+        if ((ret == 0) ||
+            ((ret < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+            return -1;
+        }
+        return drain();
+    }
+
+    ret = recv(_fd, _ibuf + _ilen, HTTP_MAX_REQUEST - _ilen, MSG_DONTWAIT);
+    if (ret == 0) {
+        return -1;
+    } else if (ret < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 1 : -1;
+    }
+    _ilen += ret;
+    _ibuf[_ilen] = '\0';
+
+    if (strstr(_ibuf, "\r\n\r\n") == NULL) {
+        if (_ilen == HTTP_MAX_REQUEST) {
+            respond("431 Request Header Fields Too Large", "text/plain");
+            emit("request too large\n");
+            _replied = true;
+            return drain();
+        }
+        return 1;
+    }
+
+    if ((strncmp(_ibuf, "GET /metrics ", 13) == 0) ||
+        (strncmp(_ibuf, "GET /metrics?", 13) == 0)) {
+        respond("200 OK", "text/plain; version=0.0.4");
+        metrics();
+    } else if (strncmp(_ibuf, "GET ", 4) != 0) {
+        respond("405 Method Not Allowed", "text/plain");
+        emit("only GET is supported\n");
+    } else {
+        respond("404 Not Found", "text/plain");
+        emit("try /metrics\n");
+    }
+    _replied = true;
+
+    return drain();
+}
+
+bool MeshRoofHttp::pending(void) const
+{
+    return _replied && outbuf_pending(&_out);
+}
+
+/*
+ * Send what the socket takes of the reply. Returns 1 while some is left,
+ * 0 once it is all out and -1 if the connection failed.
+ */
+int MeshRoofHttp::drain(void)
+{
+    if (_failed || (outbuf_send(&_out, _fd) < 0)) {
+        _failed = true;
+        return -1;
+    }
+
+    return outbuf_pending(&_out) ? 1 : 0;
+}
+
+void MeshRoofHttp::respond(const char *status, const char *type)
+{
+    emit("HTTP/1.0 %s\r\n"
+         "Content-Type: %s\r\n"
+         "Connection: close\r\n"
+         "\r\n", status, type);
+}
+
+void MeshRoofHttp::emit(const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    if (!_failed && (outbuf_vprintf(&_out, _fd, format, ap) < 0)) {
+        _failed = true;
+    }
+    va_end(ap);
+}
+
+void MeshRoofHttp::header(const char *name, const char *type,
+                          const char *help)
+{
+    emit("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void MeshRoofHttp::metrics(void)
+{
+    struct serial_rx_stats rx;
+    struct serial_tx_stats tx;
+    struct usb_tx_stats usb_tx;
+    struct log_stats log;
+    struct mtcache_stats cache;
+    struct pktmirror_stats mirror;
+    struct bridge_stats bridge;
+    struct dedup_stats dedup;
+    struct tseries_stats history;
+    struct stuckdet_stats stuck;
+    struct cmd_stats cmd;
+    uint32_t cumulative;
+    unsigned int i, j;
+
+    header("meshroof_uptime_seconds", "gauge", "Time since boot.");
+    emit("meshroof_uptime_seconds %.3f\n", esp_timer_get_time() / 1e6);
+
+    header("meshroof_heap_free_bytes", "gauge", "Free internal heap.");
+    emit("meshroof_heap_free_bytes %u\n",
+         (unsigned int) heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    header("meshroof_heap_min_free_bytes", "gauge",
+           "Lowest free internal heap since boot.");
+    emit("meshroof_heap_min_free_bytes %u\n",
+         (unsigned int) heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    header("meshroof_heap_largest_free_block_bytes", "gauge",
+           "Largest allocatable internal block.");
+    emit("meshroof_heap_largest_free_block_bytes %u\n",
+         (unsigned int) heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+
+    header("meshroof_task_stack_free_min_bytes", "gauge",
+           "Stack high-water mark (least free stack seen) per task.");
+    for (i = 0; i < METRICS_TASKS; i++) {
+        if (metrics_tasks[i] == NULL) {
+            metrics_tasks[i] = xTaskGetHandle(metrics_task_names[i]);
+        }
+        if (metrics_tasks[i] != NULL) {
+            emit("meshroof_task_stack_free_min_bytes{task=\"%s\"} %u\n",
+                 metrics_task_names[i],
+                 (unsigned int)
+                 uxTaskGetStackHighWaterMark(metrics_tasks[i]));
+        }
+    }
+
+    header("meshroof_cpu_temperature_celsius", "gauge",
+           "On-die temperature sensor.");
+    emit("meshroof_cpu_temperature_celsius %.1f\n", meshroof->getCpuTempC());
+
+    header("meshroof_wifi_rssi_dbm", "gauge",
+           "RSSI of the associated access point.");
+    emit("meshroof_wifi_rssi_dbm %d\n", meshroof->espWifi()->getRssi());
+
+    header("meshroof_meshtastic_connected", "gauge",
+           "1 when the Meshtastic device has completed its config download.");
+    emit("meshroof_meshtastic_connected %d\n",
+         meshroof->isConnected() ? 1 : 0);
+    header("meshroof_meshtastic_last_received_seconds", "gauge",
+           "Time since the Meshtastic device last sent anything.");
+    emit("meshroof_meshtastic_last_received_seconds %u\n",
+         (unsigned int) meshroof->meshDeviceLastRecivedSecondsAgo());
+    header("meshroof_meshtastic_resets_total", "counter",
+           "Meshtastic device resets.");
+    emit("meshroof_meshtastic_resets_total %u\n", meshroof->getResetCount());
+    header("meshroof_amplify", "gauge", "1 when the LNA is on.");
+    emit("meshroof_amplify %d\n", meshroof->isAmplifying() ? 1 : 0);
+
+    meshroof->getCommandStats(&cmd);
+    header("meshroof_command_queue_depth", "gauge",
+           "Commands waiting for the executor task.");
+    emit("meshroof_command_queue_depth %u\n", cmd.depth);
+    header("meshroof_command_dropped_total", "counter",
+           "Commands refused because the queue was full.");
+    emit("meshroof_command_dropped_total %u\n", (unsigned int) cmd.dropped);
+    header("meshroof_command_duration_seconds", "histogram",
+           "Execution time of queued commands.");
+    for (i = 0; i < MESHROOF_CMDS; i++) {
+        cumulative = 0;
+        for (j = 0; j < (CMD_HIST_BUCKETS - 1); j++) {
+            cumulative += cmd.hist[i][j];
+            emit("meshroof_command_duration_seconds_bucket"
+                 "{command=\"%s\",le=\"%g\"} %u\n",
+                 MeshRoof::commandName(i), (1U << j) / 1000.0,
+                 (unsigned int) cumulative);
+        }
+        emit("meshroof_command_duration_seconds_bucket"
+             "{command=\"%s\",le=\"+Inf\"} %u\n",
+             MeshRoof::commandName(i), (unsigned int) cmd.count[i]);
+        emit("meshroof_command_duration_seconds_sum{command=\"%s\"} %.6f\n",
+             MeshRoof::commandName(i), cmd.total_us[i] / 1e6);
+        emit("meshroof_command_duration_seconds_count{command=\"%s\"} %u\n",
+             MeshRoof::commandName(i), (unsigned int) cmd.count[i]);
+    }
+
+    serial_get_rx_stats(&rx);
+    serial_get_tx_stats(&tx);
+    header("meshroof_serial_baud", "gauge", "Current link rate.");
+    emit("meshroof_serial_baud %u\n", (unsigned int) serial_get_baud());
+    header("meshroof_serial_rx_bytes_total", "counter", "Bytes received.");
+    emit("meshroof_serial_rx_bytes_total %llu\n", rx.bytes_in);
+    header("meshroof_serial_rx_frames_total", "counter", "Frames received.");
+    emit("meshroof_serial_rx_frames_total %u\n", (unsigned int) rx.frames);
+    header("meshroof_serial_rx_errors_total", "counter",
+           "Receive errors by kind.");
+    emit("meshroof_serial_rx_errors_total{kind=\"decode\"} %u\n",
+         (unsigned int) rx.decode_errors);
+    emit("meshroof_serial_rx_errors_total{kind=\"fifo_overflow\"} %u\n",
+         (unsigned int) rx.fifo_overflows);
+    emit("meshroof_serial_rx_errors_total{kind=\"buffer_overflow\"} %u\n",
+         (unsigned int) rx.buffer_overflows);
+    emit("meshroof_serial_rx_errors_total{kind=\"ring_full\"} %u\n",
+         (unsigned int) rx.ring_full);
+    emit("meshroof_serial_rx_errors_total{kind=\"line\"} %u\n",
+         (unsigned int) rx.line_errors);
+    emit("meshroof_serial_rx_errors_total{kind=\"truncated\"} %u\n",
+         (unsigned int) rx.truncated);
+    emit("meshroof_serial_rx_errors_total{kind=\"oversized\"} %u\n",
+         (unsigned int) rx.oversized);
+    header("meshroof_serial_rx_resyncs_total", "counter",
+           "Times the receiver hunted for a new frame start.");
+    emit("meshroof_serial_rx_resyncs_total %u\n", (unsigned int) rx.resyncs);
+    header("meshroof_serial_tx_bytes_total", "counter", "Bytes sent.");
+    emit("meshroof_serial_tx_bytes_total %llu\n", tx.bytes_sent);
+    header("meshroof_serial_tx_frames_total", "counter", "Frames queued.");
+    emit("meshroof_serial_tx_frames_total %u\n", (unsigned int) tx.frames);
+    header("meshroof_serial_tx_dropped_total", "counter",
+           "Bytes dropped for a full queue or a link reset.");
+    emit("meshroof_serial_tx_dropped_total %u\n", (unsigned int) tx.dropped);
+    header("meshroof_serial_tx_full_total", "counter",
+           "Frames refused because the transmit queue was full.");
+    emit("meshroof_serial_tx_full_total %u\n", (unsigned int) tx.full);
+    header("meshroof_serial_tx_queue_bytes", "gauge",
+           "Bytes waiting in the transmit queue.");
+    emit("meshroof_serial_tx_queue_bytes %u\n", (unsigned int) tx.depth);
+
+    mtcache_get_stats(&cache);
+    header("meshroof_config_cache_replays_total", "counter",
+           "Config downloads served from the cache.");
+    emit("meshroof_config_cache_replays_total %u\n", cache.replays);
+
+    pktmirror_get_stats(&mirror);
+    header("meshroof_mirror_frames_total", "counter",
+           "Frames copied to the packet mirror.");
+    emit("meshroof_mirror_frames_total %u\n", (unsigned int) mirror.frames);
+    header("meshroof_mirror_dropped_total", "counter",
+           "Mirrored frames lost by subscribers that fell behind.");
+    emit("meshroof_mirror_dropped_total %u\n",
+         (unsigned int) mirror.dropped);
+
+    dedup_get_stats(&dedup);
+    header("meshroof_dedup_hits_total", "counter",
+           "Duplicate text messages dropped before handling.");
+    emit("meshroof_dedup_hits_total %u\n", (unsigned int) dedup.hits);
+    header("meshroof_dedup_misses_total", "counter",
+           "Text messages seen for the first time.");
+    emit("meshroof_dedup_misses_total %u\n", (unsigned int) dedup.misses);
+
+    tseries_get_stats(&history);
+    header("meshroof_history_nodes", "gauge",
+           "Nodes with a telemetry history.");
+    emit("meshroof_history_nodes %u\n", history.nodes);
+    header("meshroof_history_samples_total", "counter",
+           "Telemetry samples added to the history.");
+    emit("meshroof_history_samples_total %u\n",
+         (unsigned int) history.samples);
+
+    stuckdet_get_stats(&stuck);
+    header("meshroof_stuck_threshold_seconds", "gauge",
+           "Radio silence that triggers a liveness probe.");
+    emit("meshroof_stuck_threshold_seconds %u\n",
+         (unsigned int) stuck.threshold_s);
+    header("meshroof_stuck_probes_total", "counter",
+           "Liveness probes sent to a silent radio.");
+    emit("meshroof_stuck_probes_total %u\n", (unsigned int) stuck.probes);
+    header("meshroof_stuck_false_positives_total", "counter",
+           "Silences that ended before the radio was reset.");
+    emit("meshroof_stuck_false_positives_total %u\n",
+         (unsigned int) stuck.false_positives);
+    header("meshroof_stuck_detections_total", "counter",
+           "Radio resets after unanswered probes.");
+    emit("meshroof_stuck_detections_total %u\n",
+         (unsigned int) stuck.detections);
+    header("meshroof_stuck_last_latency_seconds", "gauge",
+           "Silence before the last radio reset.");
+    emit("meshroof_stuck_last_latency_seconds %u\n",
+         (unsigned int) stuck.last_latency_s);
+
+    MeshRoofBridge::getStats(&bridge);
+    header("meshroof_bridge_to_radio_total", "counter",
+           "ToRadio frames forwarded from API clients.");
+    emit("meshroof_bridge_to_radio_total %u\n",
+         (unsigned int) bridge.to_radio);
+    header("meshroof_bridge_filtered_total", "counter",
+           "ToRadio frames from API clients not forwarded.");
+    emit("meshroof_bridge_filtered_total %u\n",
+         (unsigned int) bridge.filtered);
+    header("meshroof_bridge_tx_errors_total", "counter",
+           "ToRadio frames from API clients the UART could not take.");
+    emit("meshroof_bridge_tx_errors_total %u\n",
+         (unsigned int) bridge.tx_errors);
+    header("meshroof_bridge_overruns_total", "counter",
+           "API clients disconnected for falling behind the mirror.");
+    emit("meshroof_bridge_overruns_total %u\n",
+         (unsigned int) bridge.overruns);
+
+    usb_get_tx_stats(&usb_tx);
+    log_get_stats(&log);
+    header("meshroof_usb_tx_dropped_bytes_total", "counter",
+           "Console bytes dropped on USB.");
+    emit("meshroof_usb_tx_dropped_bytes_total %u\n",
+         (unsigned int) usb_tx.dropped);
+    header("meshroof_log_messages_total", "counter", "Log messages written.");
+    emit("meshroof_log_messages_total %u\n", (unsigned int) log.messages);
+    header("meshroof_log_overwritten_total", "counter",
+           "Log messages overwritten before every reader saw them.");
+    emit("meshroof_log_overwritten_total %u\n",
+         (unsigned int) log.overwritten);
+    header("meshroof_log_lost_total", "counter",
+           "Log messages dropped because the ring was still being filled.");
+    emit("meshroof_log_lost_total %u\n", (unsigned int) log.lost);
+}
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
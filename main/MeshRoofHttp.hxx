@@ -0,0 +1,73 @@
+/*
+ * MeshRoofHttp.hxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MESHROOFHTTP_HXX
+#define MESHROOFHTTP_HXX
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <outbuf.h>
+
+#define HTTP_MAX_REQUEST  512
+#define HTTP_OBUF_SIZE    12288
+#define HTTP_TIMEOUT_US   (5 * 1000000LL)
+
+/*
+ * Minimal HTTP/1.0 server connection: one GET per connection, answered
+ * and closed. The only resource is /metrics in the Prometheus text
+ * exposition format, built from counters and state that can be read
+ * without taking locks held by the meshtastic task.
+ *
+ * The whole reply is built in an outbuf large enough to hold it and is
+ * sent without waiting; drain() sends more each time the console loop
+ * finds the socket writable.
+ */
+class MeshRoofHttp {
+
+public:
+
+    MeshRoofHttp();
+    ~MeshRoofHttp();
+
+    void attach(int fd);
+    void detach(void);
+    int fd(void) const;
+    bool expired(void) const;
+
+    int process(void);
+    bool pending(void) const;
+    int drain(void);
+
+private:
+
+    void respond(const char *status, const char *type);
+    void metrics(void);
+    void header(const char *name, const char *type, const char *help);
+    void emit(const char *format, ...);
+
+    int _fd;
+    int64_t _openUs;
+    char _ibuf[HTTP_MAX_REQUEST + 1];
+    size_t _ilen;
+    char _obuf[HTTP_OBUF_SIZE];
+    struct outbuf _out;
+    bool _replied;
+    bool _failed;
+
+};
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,507 @@
+/*
+ * MeshRoofRpc.cxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <esp_timer.h>
+#include <esp_netif.h>
+#include <meshroof.h>
+#include <MeshRoof.hxx>
+#include <MeshRoofRpc.hxx>
+
+extern shared_ptr<MeshRoof> meshroof;
+
+MeshRoofRpc::MeshRoofRpc()
+    : _fd(-1),
+      _ilen(0),
+      _olen(0),
+      _reply(0),
+      _replyId(0),
+      _overflow(false)
+{
+
+}
+
+MeshRoofRpc::~MeshRoofRpc()
+{
+
+}
+
+void MeshRoofRpc::attach(int fd)
+{
+    _fd = fd;
+    _ilen = 0;
+    _olen = 0;
+}
+
+void MeshRoofRpc::detach(void)
+{
+    _fd = -1;
+}
+
+int MeshRoofRpc::fd(void) const
+{
+    return _fd;
+}
+
+bool MeshRoofRpc::pending(void) const
+{
+    return _olen > 0;
+}
+
+/*
+ * Read what the socket has and answer the complete requests in it.
+ * Returns -1 when the connection should be closed.
+ */
+int MeshRoofRpc::process(void)
+{
+    int ret;
+
+    // Stop reading once the input is full of requests not yet answered
+    if ((_ilen + 1) < sizeof(_ibuf)) {
+        ret = recv(_fd, _ibuf + _ilen, sizeof(_ibuf) - 1 - _ilen,
+                   MSG_DONTWAIT);
+        if (ret == 0) {
+            return -1;
+        } else if (ret < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                return -1;
+            }
+        } else {
+            _ilen += ret;
+        }
+    }
+
+    return drain();
+}
+
+/*
+ * Answer buffered requests for as long as their replies fit next to the
+ * output a slow client has not taken yet, and send what the socket
+ * takes. The rest waits for the event loop to find the socket writable.
+ */
+int MeshRoofRpc::drain(void)
+{
+    size_t len;
+    size_t off = 0;
+
+    if (flush() < 0) {
+        return -1;
+    }
+
+    while (((_ilen - off) >= 4) &&
+           ((sizeof(_obuf) - _olen) >= (4 + RPC_MAX_MSG))) {
+        len = ((size_t) _ibuf[off] << 24) | ((size_t) _ibuf[off + 1] << 16) |
+            ((size_t) _ibuf[off + 2] << 8) | (size_t) _ibuf[off + 3];
+        if (len > RPC_MAX_MSG) {
+            error(-1, "request too long");
+            flush();
+            return -1;
+        }
+        if ((_ilen - off - 4) < len) {
+            break;
+        }
+
+        handle((char *) _ibuf + off + 4, len);
+        off += 4 + len;
+    }
+
+    memmove(_ibuf, _ibuf + off, _ilen - off);
+    _ilen -= off;
+
+    return flush();
+}
+
+/*
+ * Send without waiting; what the socket does not take stays queued.
+ */
+int MeshRoofRpc::flush(void)
+{
+    int ret;
+    size_t off = 0;
+
+    while (off < _olen) {
+        ret = send(_fd, _obuf + off, _olen - off, MSG_DONTWAIT);
+        if (ret < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+            _olen = 0;
+            return -1;
+        } else if (ret == 0) {
+            break;
+        }
+
+        off += ret;
+    }
+
+    memmove(_obuf, _obuf + off, _olen - off);
+    _olen -= off;
+
+    return 0;
+}
+
+void MeshRoofRpc::begin(long id)
+{
+    if ((sizeof(_obuf) - _olen) < (4 + RPC_MAX_MSG)) {
+        flush();
+    }
+
+    _reply = _olen;
+    _replyId = id;
+    _olen += 4;
+    _overflow = false;
+    add("{\"id\":%ld,", id);
+}
+
+void MeshRoofRpc::finish(void)
+{
+    size_t len;
+
+    if (_overflow) {
+        _olen = _reply + 4;
+        _overflow = false;
+        add("{\"id\":%ld,\"error\":\"reply too long\"}", _replyId);
+    }
+
+    len = _olen - _reply - 4;
+    _obuf[_reply] = (len >> 24) & 0xff;
+    _obuf[_reply + 1] = (len >> 16) & 0xff;
+    _obuf[_reply + 2] = (len >> 8) & 0xff;
+    _obuf[_reply + 3] = len & 0xff;
+}
+
+void MeshRoofRpc::add(const char *format, ...)
+{
+    va_list ap;
+    size_t space;
+    int ret;
+
+    if (_overflow) {
+        return;
+    }
+
+    space = _reply + 4 + RPC_MAX_MSG - _olen;
+    va_start(ap, format);
+    ret = vsnprintf(_obuf + _olen, space, format, ap);
+    va_end(ap);
+
+    if ((ret < 0) || ((size_t) ret >= space)) {
+        _overflow = true;
+    } else {
+        _olen += ret;
+    }
+}
+
+void MeshRoofRpc::addString(const char *key, const char *value)
+{
+    char buf[160];
+
+    json_escape(buf, sizeof(buf), value);
+    add("\"%s\":\"%s\",", key, buf);
+}
+
+void MeshRoofRpc::result(long id)
+{
+    begin(id);
+    add("\"result\":{");
+}
+
+void MeshRoofRpc::endResult(void)
+{
+    if (!_overflow && (_obuf[_olen - 1] == ',')) {
+        _olen--;
+    }
+    add("}}");
+    finish();
+}
+
+void MeshRoofRpc::error(long id, const char *message)
+{
+    char buf[80];
+
+    json_escape(buf, sizeof(buf), message);
+    begin(id);
+    add("\"error\":\"%s\"}", buf);
+    finish();
+}
+
+void MeshRoofRpc::handle(char *msg, size_t len)
+{
+    const char *js = msg;
+    char method[24];
+    long id = -1;
+    int params;
+    int n;
+
+    n = json_parse(js, len, _toks, RPC_MAX_TOKS);
+    if ((n <= 0) || (_toks[0].type != JSON_OBJECT)) {
+        error(-1, "parse error");
+        return;
+    }
+
+    n = json_find(js, _toks, 0, "id");
+    if ((n >= 0) && !json_get_int(js, &_toks[n], &id)) {
+        error(-1, "bad id");
+        return;
+    }
+
+    n = json_find(js, _toks, 0, "method");
+    if ((n < 0) || !json_get_str(js, &_toks[n], method, sizeof(method))) {
+        error(id, "missing method");
+        return;
+    }
+
+    params = json_find(js, _toks, 0, "params");
+    if ((params >= 0) && (_toks[params].type != JSON_OBJECT)) {
+        error(id, "params must be an object");
+        return;
+    }
+
+    if (strcmp(method, "status") == 0) {
+        status(id, js, _toks, params);
+    } else if (strcmp(method, "amplify") == 0) {
+        amplify(id, js, _toks, params);
+    } else if (strcmp(method, "reset") == 0) {
+        reset(id, js, _toks, params);
+    } else if (strcmp(method, "buzz") == 0) {
+        buzz(id, js, _toks, params);
+    } else if (strcmp(method, "morse") == 0) {
+        morse(id, js, _toks, params);
+    } else if (strcmp(method, "nvm.get") == 0) {
+        nvmGet(id, js, _toks, params);
+    } else if (strcmp(method, "nvm.set") == 0) {
+        nvmSet(id, js, _toks, params);
+    } else {
+        error(id, "unknown method");
+    }
+}
+
+void MeshRoofRpc::status(long id, const char *js,
+                         const struct json_tok *toks, int params)
+{
+    shared_ptr<EspWifi> wifi = meshroof->espWifi();
+    const wifi_event_sta_connected_t *sta_connected = wifi->getStaConnected();
+    const esp_netif_ip_info_t *ip_info = wifi->getIpInfo();
+    char ssid[40];
+    char ip[16];
+
+    (void)(js);
+    (void)(toks);
+    (void)(params);
+
+    result(id);
+    add("\"uptime_ms\":%lld,", esp_timer_get_time() / 1000);
+    add("\"connected\":%s,", meshroof->isConnected() ? "true" : "false");
+    add("\"amplify\":%s,", meshroof->isAmplifying() ? "true" : "false");
+    add("\"resets\":%u,", meshroof->getResetCount());
+    add("\"last_reset_secs_ago\":%u,", meshroof->getLastResetSecsAgo());
+    add("\"cpu_temp_c\":%.1f,", meshroof->getCpuTempC());
+    add("\"baud\":%u,", (unsigned int) serial_get_baud());
+    if (sta_connected->bssid[0] != 0x0) {
+        bzero(ssid, sizeof(ssid));
+        memcpy(ssid, sta_connected->ssid,
+               min((size_t) sta_connected->ssid_len, sizeof(ssid) - 1));
+        addString("ssid", ssid);
+        add("\"channel\":%d,", (int) sta_connected->channel);
+        add("\"rssi\":%d,", wifi->getRssi());
+        snprintf(ip, sizeof(ip), IPSTR, IP2STR(&ip_info->ip));
+        addString("ip", ip);
+    }
+    endResult();
+}
+
+void MeshRoofRpc::amplify(long id, const char *js,
+                          const struct json_tok *toks, int params)
+{
+    int n = json_find(js, toks, params, "on");
+    bool on;
+
+    if (n >= 0) {
+        if (!json_get_bool(js, &toks[n], &on)) {
+            error(id, "'on' must be a boolean");
+            return;
+        }
+        meshroof->amplify(on);
+    }
+
+    result(id);
+    add("\"amplify\":%s", meshroof->isAmplifying() ? "true" : "false");
+    endResult();
+}
+
+void MeshRoofRpc::reset(long id, const char *js,
+                        const struct json_tok *toks, int params)
+{
+    int n = json_find(js, toks, params, "apply");
+    bool apply = false;
+
+    if ((n >= 0) && !json_get_bool(js, &toks[n], &apply)) {
+        error(id, "'apply' must be a boolean");
+        return;
+    }
+
+    if (apply) {
+        meshroof->queueCommand(MESHROOF_CMD_RESET);
+    }
+
+    result(id);
+    add("\"reset_queued\":%s,", apply ? "true" : "false");
+    add("\"resets\":%u,", meshroof->getResetCount());
+    add("\"last_reset_secs_ago\":%u,", meshroof->getLastResetSecsAgo());
+    add("\"config_download_ms\":%u,", meshroof->getConfigDownloadMs());
+    add("\"config_download_baud\":%u,",
+        (unsigned int) meshroof->getConfigDownloadBaud());
+    add("\"usable_ms\":%u,", meshroof->getUsableMs());
+    add("\"usable_from_cache\":%s",
+        meshroof->wasUsableFromCache() ? "true" : "false");
+    endResult();
+}
+
+void MeshRoofRpc::buzz(long id, const char *js,
+                       const struct json_tok *toks, int params)
+{
+    int n = json_find(js, toks, params, "ms");
+    long ms = 500;
+    char msg[48];
+
+    if ((n >= 0) && (!json_get_int(js, &toks[n], &ms) || (ms <= 0) ||
+                     (ms > CMD_BUZZ_MAX_MS))) {
+        snprintf(msg, sizeof(msg), "'ms' must be an integer in 1..%u",
+                 CMD_BUZZ_MAX_MS);
+        error(id, msg);
+        return;
+    }
+
+    if (!meshroof->queueCommand(MESHROOF_CMD_BUZZ, 0, ms)) {
+        error(id, "command queue full");
+        return;
+    }
+
+    result(id);
+    endResult();
+}
+
+void MeshRoofRpc::morse(long id, const char *js,
+                        const struct json_tok *toks, int params)
+{
+    int n = json_find(js, toks, params, "text");
+    char text[128];
+
+    if ((n < 0) || !json_get_str(js, &toks[n], text, sizeof(text))) {
+        error(id, "'text' must be a string");
+        return;
+    }
+
+    meshroof->addMorseText(text);
+
+    result(id);
+    endResult();
+}
+
+void MeshRoofRpc::nvmGet(long id, const char *js,
+                         const struct json_tok *toks, int params)
+{
+    (void)(js);
+    (void)(toks);
+    (void)(params);
+
+    result(id);
+    addString("wifi_ssid", meshroof->getWifiSsid().c_str());
+    if (meshroof->getIp() == 0) {
+        addString("ip", "dhcp");
+    } else {
+        addString("ip", meshroof->getIpString().c_str());
+        addString("netmask", meshroof->getNetmaskString().c_str());
+        addString("gateway", meshroof->getGatewayString().c_str());
+        addString("dns1", meshroof->getDns1String().c_str());
+        addString("dns2", meshroof->getDns2String().c_str());
+        addString("dns3", meshroof->getDns3String().c_str());
+    }
+    add("\"serial_baud\":%u", (unsigned int) meshroof->getSerialBaud());
+    endResult();
+}
+
+/*
+ * Every given key is applied before the NVM is saved once; the first
+ * rejected value aborts without saving. A new serial_baud applies to the
+ * ESP32 side only; the radio must be set to match by hand.
+ */
+void MeshRoofRpc::nvmSet(long id, const char *js,
+                         const struct json_tok *toks, int params)
+{
+    static const struct {
+        const char *key;
+        bool (MeshRoof::*set)(const string &);
+    } strs[] = {
+        { "wifi_ssid", &MeshRoof::setWifiSsid, },
+        { "wifi_passwd", &MeshRoof::setWifiPasswd, },
+        { "ip", &MeshRoof::setIp, },
+        { "netmask", &MeshRoof::setNetmask, },
+        { "gateway", &MeshRoof::setGateway, },
+        { "dns1", &MeshRoof::setDns1, },
+        { "dns2", &MeshRoof::setDns2, },
+        { "dns3", &MeshRoof::setDns3, },
+    };
+    char value[80];
+    long baud;
+    bool baudChanged = false;
+    unsigned int i;
+    int n;
+
+    if (params < 0) {
+        error(id, "missing params");
+        return;
+    }
+
+    for (i = 0; i < (sizeof(strs) / sizeof(strs[0])); i++) {
+        n = json_find(js, toks, params, strs[i].key);
+        if (n < 0) {
+            continue;
+        }
+        if (!json_get_str(js, &toks[n], value, sizeof(value)) ||
+            !((*meshroof).*(strs[i].set))(value)) {
+            error(id, "invalid value");
+            return;
+        }
+    }
+
+    n = json_find(js, toks, params, "serial_baud");
+    if (n >= 0) {
+        if (!json_get_int(js, &toks[n], &baud) ||
+            !meshroof->setSerialBaud(baud)) {
+            error(id, "invalid value");
+            return;
+        }
+        baudChanged = true;
+    }
+
+    if (meshroof->saveNvm() == false) {
+        error(id, "saveNvm failed");
+        return;
+    }
+
+    if (baudChanged) {
+        meshroof->requestLinkBaud();
+    }
+
+    result(id);
+    endResult();
+}
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
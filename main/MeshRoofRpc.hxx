@@ -0,0 +1,94 @@
+/*
+ * MeshRoofRpc.hxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MESHROOFRPC_HXX
+#define MESHROOFRPC_HXX
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <jsontok.h>
+
+#define RPC_MAX_MSG      1024
+#define RPC_MAX_TOKS     64
+#define RPC_OBUF_SIZE    2048
+
+/*
+ * Machine-readable counterpart of MeshRoofShell. Messages in both
+ * directions are a 4-byte big-endian length followed by a JSON object:
+ *
+ *   -> {"id": 1, "method": "amplify", "params": {"on": true}}
+ *   <- {"id": 1, "result": {"amplify": true}}
+ *   <- {"id": 2, "error": "unknown method"}
+ *
+ * Requests are answered in order, so a client may pipeline them.
+ */
+class MeshRoofRpc {
+
+public:
+
+    MeshRoofRpc();
+    ~MeshRoofRpc();
+
+    void attach(int fd);
+    void detach(void);
+    int fd(void) const;
+    bool pending(void) const;
+
+    int process(void);
+    int drain(void);
+
+private:
+
+    void handle(char *msg, size_t len);
+    int flush(void);
+
+    void begin(long id);
+    void finish(void);
+    void add(const char *format, ...);
+    void addString(const char *key, const char *value);
+    void result(long id);
+    void endResult(void);
+    void error(long id, const char *message);
+
+    void status(long id, const char *js, const struct json_tok *toks,
+                int params);
+    void amplify(long id, const char *js, const struct json_tok *toks,
+                 int params);
+    void reset(long id, const char *js, const struct json_tok *toks,
+               int params);
+    void buzz(long id, const char *js, const struct json_tok *toks,
+              int params);
+    void morse(long id, const char *js, const struct json_tok *toks,
+               int params);
+    void nvmGet(long id, const char *js, const struct json_tok *toks,
+                int params);
+    void nvmSet(long id, const char *js, const struct json_tok *toks,
+                int params);
+
+    int _fd;
+    uint8_t _ibuf[4 + RPC_MAX_MSG + 1];
+    size_t _ilen;
+    char _obuf[RPC_OBUF_SIZE];
+    size_t _olen;
+    size_t _reply;
+    long _replyId;
+    bool _overflow;
+    struct json_tok _toks[RPC_MAX_TOKS];
+
+};
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
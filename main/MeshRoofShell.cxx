@@ -4,6 +4,9 @@
  * Copyright (C) 2025, Charles Chiou
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <sys/socket.h>
 #include <esp_timer.h>
 #include <esp_system.h>
 #include <esp_heap_caps.h>
@@ -12,16 +15,63 @@
 #include <lwip/netdb.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 #include <libmeshtastic.h>
 #include <serial.h>
+#include <logring.h>
+#include <trace.h>
+#include <telnet.h>
+#include <mtcache.h>
+#include <txsched.h>
+#include <dedup.h>
+#include <tseries.h>
+#include <nodetab.h>
+#include <linkgraph.h>
+#include <stuckdet.h>
 #include <MeshRoof.hxx>
 #include <MeshRoofShell.hxx>
+#include <MeshRoofCommands.hxx>
 
 extern shared_ptr<MeshRoof> meshroof;
 
+#define PING_LINGER_US  3000000
+
+static configRUN_TIME_COUNTER_TYPE last_idle_counter[portNUM_PROCESSORS];
+static int64_t last_idle_sample_us = 0;
+
+/*
+ * Parse a decimal argument. Unlike stoul() this never throws, so a value
+ * out of range is just another bad argument.
+ */
+static bool parse_uint(const char *s, unsigned int *val)
+{
+    char *end = NULL;
+    unsigned long v;
+
+    if ((*s < '0') || (*s > '9')) {
+        return false;
+    }
+
+    errno = 0;
+    v = strtoul(s, &end, 10);
+    if ((errno != 0) || (*end != '\0') || (v > UINT_MAX)) {
+        return false;
+    }
+
+    *val = (unsigned int) v;
+
+    return true;
+}
+
 MeshRoofShell::MeshRoofShell(shared_ptr<SimpleClient> client)
-    : SimpleShell(client)
+    : SimpleShell(client),
+      _interrupt(false),
+      _ping(NULL),
+      _pingStopUs(0),
+      _pingEnded(false)
 {
+    outbuf_init(&_out, _obuf, sizeof(_obuf));
+    _olock = xSemaphoreCreateRecursiveMutex();
     _help_list.push_back("exit");
     _help_list.push_back("wifi");
     _help_list.push_back("net");
@@ -30,11 +80,68 @@ MeshRoofShell::MeshRoofShell(shared_ptr<SimpleClient> client)
     _help_list.push_back("buzz");
     _help_list.push_back("morse");
     _help_list.push_back("reset");
+    _help_list.push_back("serial");
+    _help_list.push_back("stats");
+    _help_list.push_back("trace");
+    _help_list.push_back("airtime");
+    _help_list.push_back("env");
+    _help_list.push_back("nodes");
+    _help_list.push_back("route");
 }
 
 MeshRoofShell::~MeshRoofShell()
 {
+    if (_ping != NULL) {
+        esp_ping_stop(_ping);
+        esp_ping_delete_session(_ping);
+    }
+    vSemaphoreDelete(_olock);
+
+}
+
+/*
+ * The session socket, or -1 when output is to be discarded.
+ */
+int MeshRoofShell::tcp_fd(void) const
+{
+    uint32_t ctx = (uint32_t) _ctx;
+
+    return ((ctx & 0x80000000) != 0) ? (int) (ctx & 0x7fffffff) : -1;
+}
+
+/*
+ * Send whatever TCP output is staged without waiting; what the socket
+ * does not take is left for the next call (see outbuf.h).
+ */
+int MeshRoofShell::flush(void)
+{
+    int ret;
+
+    xSemaphoreTakeRecursive(_olock, portMAX_DELAY);
+    ret = outbuf_send(&_out, tcp_fd());
+    xSemaphoreGiveRecursive(_olock);
+
+    return ret;
+}
+
+bool MeshRoofShell::pending(void) const
+{
+    return outbuf_pending(&_out);
+}
+
+/*
+ * Append to the TCP output buffer, streaming it out in buffer-sized
+ * chunks when the data does not fit.
+ */
+int MeshRoofShell::obuf_write(const char *data, size_t len)
+{
+    int ret;
+
+    xSemaphoreTakeRecursive(_olock, portMAX_DELAY);
+    ret = outbuf_write(&_out, tcp_fd(), data, len);
+    xSemaphoreGiveRecursive(_olock);
 
+    return (ret < 0) ? -1 : (int) len;
 }
 
 int MeshRoofShell::tx_write(const uint8_t *buf, size_t size)
@@ -45,8 +152,7 @@ int MeshRoofShell::tx_write(const uint8_t *buf, size_t size)
     if (ctx == 1) {
         ret = usb_tx_write(buf, size);
     } else {
-        int tcp_fd = (ctx & 0x7fffffff);
-        ret = write(tcp_fd, buf, size);
+        ret = obuf_write((const char *) buf, size);
     }
 
     return ret;
@@ -57,46 +163,75 @@ int MeshRoofShell::printf(const char *format, ...)
     int ret = 0;
     uint32_t ctx = (uint32_t) _ctx;
     va_list ap;
-    char *buf = NULL;
+
+    va_start(ap, format);
 
     if (ctx == 1) {
-        va_start(ap, format);
         ret = usb_vprintf(format, ap);
-        va_end(ap);
-    } else {
-        int tcp_fd = (ctx & 0x7fffffff);
-        char *s = NULL;
-        int len = 0;
+        goto done;
+    }
 
-        buf = (char *) malloc(512);
-        if (buf == NULL) {
-            goto done;
-        }
+    xSemaphoreTakeRecursive(_olock, portMAX_DELAY);
+    ret = outbuf_vprintf(&_out, tcp_fd(), format, ap);
+    xSemaphoreGiveRecursive(_olock);
 
-        va_start(ap, format);
-        len = vsnprintf(buf, 512 - 1, format, ap);
-        va_end(ap);
+done:
 
-        s = buf;
-        while (len > 0) {
-            ret = write(tcp_fd, s, len);
-            if (ret <= 0) {
-                ret = -1;
-                break;
-            }
+    va_end(ap);
+
+    return ret;
+}
+
+/*
+ * Bulk text (e.g. the task list) is streamed as is rather than
+ * formatted.
+ */
+int MeshRoofShell::write(const char *data, size_t len)
+{
+    return tx_write((const uint8_t *) data, len);
+}
+
+void MeshRoofShell::telnetStart(void)
+{
+    uint8_t buf[TELNET_REPLY_MAX];
+    size_t len;
+
+    _interrupt = false;
+    telnet_init(&_telnet);
+    len = telnet_start(&_telnet, buf, sizeof(buf));
+    obuf_write((const char *) buf, len);
+}
+
+/*
+ * Long-running commands poll this instead of reading the input
+ * themselves. Pending input is consumed; ^C, a telnet IP/BRK or a lost
+ * connection count as an interrupt.
+ */
+bool MeshRoofShell::interrupted(void)
+{
+    uint8_t buf[32];
+    int ret;
+
+    while (rx_ready() > 0) {
+        ret = rx_read(buf, sizeof(buf));
+        if (ret < 0) {
+            _interrupt = true;
+            break;
+        } else if (ret == 0) {
+            break;
+        }
 
-            len -= ret;
-            s += len;
+        if (memchr(buf, '\x03', ret) != NULL) {
+            _interrupt = true;
         }
     }
 
-done:
-
-    if (buf) {
-        free(buf);
+    if (_interrupt) {
+        _interrupt = false;
+        return true;
     }
 
-    return ret;
+    return false;
 }
 
 int MeshRoofShell::rx_ready(void) const
@@ -122,19 +257,28 @@ int MeshRoofShell::rx_read(uint8_t *buf, size_t size)
         ret = usb_rx_read_timeout(buf, size, pdMS_TO_TICKS(100));
     } else {
         int tcp_fd = (ctx & 0x7fffffff);
-        fd_set rfds;
-        struct timeval timeout = {
-            .tv_sec = 0,
-            .tv_usec = 500000,
-        };
 
-        FD_ZERO(&rfds);
-        FD_SET(tcp_fd, &rfds);
-
-        ret = select(tcp_fd + 1, &rfds, NULL, NULL, &timeout);
-
-        if (ret > 0) {
-            ret = read(tcp_fd, buf, size);
+        // The console event loop only calls in when the socket is readable
+        if (size > TELNET_RX_MAX) {
+            size = TELNET_RX_MAX;
+        }
+        ret = recv(tcp_fd, buf, size, MSG_DONTWAIT);
+        if (ret == 0) {
+            ret = -1;
+        } else if (ret < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                ret = 0;
+            }
+        } else {
+            ret = telnet_rx(&_telnet, buf, ret);
+            if (_telnet.reply_len > 0) {
+                obuf_write((const char *) _telnet.reply, _telnet.reply_len);
+                _telnet.reply_len = 0;
+            }
+            if (_telnet.interrupt) {
+                _telnet.interrupt = false;
+                _interrupt = true;
+            }
         }
     }
 
@@ -147,18 +291,53 @@ int MeshRoofShell::system(int argc, char **argv)
     size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
     size_t used_heap = total_heap - free_heap;
     char cTaskListBuffer[1024];
+    struct usb_tx_stats usb_tx;
+    struct log_stats log;
+    int64_t now_us;
+    int i;
 
     SimpleShell::system(argc, argv);
     this->printf("Total Heap: %zu\n", total_heap);
     this->printf(" Free Heap: %zu\n", free_heap);
     this->printf(" Used Heap: %zu\n", used_heap);
     this->printf("  CPU Temp: %.1fC\n", meshroof->getCpuTempC());
+    usb_get_tx_stats(&usb_tx);
+    this->printf("    USB TX: %llu bytes, %u dropped\n",
+                 usb_tx.bytes_sent, (unsigned int) usb_tx.dropped);
+    log_get_stats(&log);
+    this->printf("       Log: %u messages, %llu bytes, %u overwritten, "
+                 "%u lost\n",
+                 (unsigned int) log.messages, log.bytes,
+                 (unsigned int) log.overwritten, (unsigned int) log.lost);
+    now_us = esp_timer_get_time();
+    this->printf("  CPU Idle:");
+    for (i = 0; i < portNUM_PROCESSORS; i++) {
+        this->printf(" core%d %lu%%", i,
+                     (unsigned long) ulTaskGetIdleRunTimePercentForCore(i));
+    }
+    this->printf(" (since boot)\n");
+    if (last_idle_sample_us != 0) {
+        this->printf("  CPU Idle:");
+        for (i = 0; i < portNUM_PROCESSORS; i++) {
+            configRUN_TIME_COUNTER_TYPE idle =
+                ulTaskGetIdleRunTimeCounterForCore(i);
+            configRUN_TIME_COUNTER_TYPE delta = idle - last_idle_counter[i];
+            this->printf(" core%d %.1f%%", i,
+                         (100.0 * delta) / (now_us - last_idle_sample_us));
+        }
+        this->printf(" (last %llds)\n",
+                     (now_us - last_idle_sample_us) / 1000000);
+    }
+    for (i = 0; i < portNUM_PROCESSORS; i++) {
+        last_idle_counter[i] = ulTaskGetIdleRunTimeCounterForCore(i);
+    }
+    last_idle_sample_us = now_us;
     bzero(cTaskListBuffer, sizeof(cTaskListBuffer));
     vTaskList(cTaskListBuffer);
     this->printf("  FreeRTOS:\n");
     this->printf("Name        State  Priority  StackRem   Task#   CPU Affn\n");
     this->printf("--------------------------------------------------------\n");
-    this->printf("%s", cTaskListBuffer);
+    this->write(cTaskListBuffer, strlen(cTaskListBuffer));
 
     return 0;
 }
@@ -179,6 +358,7 @@ int MeshRoofShell::nvm(int argc, char **argv)
 {
     wifi(argc, argv);
     net(argc, argv);
+    serial(argc, argv);
     SimpleShell::nvm(argc, argv);
 
     return 0;
@@ -190,7 +370,8 @@ int MeshRoofShell::exit(int argc, char **argv)
 
     if (ctx != 1) {
         int tcp_fd = (ctx & 0x7fffffff);
-        close(tcp_fd);
+        flush();
+        shutdown(tcp_fd, SHUT_RDWR);
     }
 
     return 0;
@@ -415,6 +596,7 @@ void MeshRoofShell::on_ping_end(esp_ping_handle_t hdl, void *args)
                          &total_time_ms, sizeof(total_time_ms));
     mrs->printf("%d packets transmitted, %d received, time %dms\n",
                 transmitted, received, total_time_ms);
+    mrs->_pingEnded = true;
 }
 
 int MeshRoofShell::ping(int argc, char **argv)
@@ -474,55 +656,68 @@ int MeshRoofShell::ping(int argc, char **argv)
         goto done;
     }
 
-    for (;;) {
-        char c;
-
-        ret = this->rx_read((uint8_t *) &c, 1);
-        if (ret == -1) {
-            break;
-        }
-
-        if (c == 0xff) {  // IAC received
-            static const uint8_t iac_do_tm[3] = { 0xff, 0xfd, 0x06};
-            static const uint8_t iac_will_tm[3] = { 0xff, 0xfb, 0x06};
-            char iac2;
-
-            ret = this->rx_read((uint8_t *) &iac2, 1);
-            if (ret == 1) {
-                switch (iac2) {
-                case 0xf4:  // IAC IP (interrupt process)
-                    ret = this->tx_write(iac_do_tm, sizeof(iac_do_tm));
-                    ret = this->tx_write(iac_will_tm, sizeof(iac_will_tm));
-                    this->printf("\n> ");
-                    _inproc.i = 0;
-                    break;
-                default:
-                    break;
-                }
-            }
-
-            break;
-        }
-
-        if (c == '\x03') {
-            break;
-        }
-    }
-
-    esp_ping_stop(hdl);
+    _interrupt = false;
+    _pingEnded = false;
+    _pingStopUs = 0;
+    _ping = hdl;
+    hdl = NULL;
 
     ret = 0;
 
 done:
 
     if (hdl) {
-        vTaskDelay(pdMS_TO_TICKS(3000));
         esp_ping_delete_session(hdl);
     }
 
     return ret;
 }
 
+/*
+ * True while a job (ping) owns the session; its input then goes to
+ * poll() rather than the command line.
+ */
+bool MeshRoofShell::busy(void) const
+{
+    return _ping != NULL;
+}
+
+/*
+ * Advance a running job without blocking: ^C or a lost connection stops
+ * a ping, and the session is deleted once its summary is out (or after
+ * PING_LINGER_US). Also writes out any output the job produced.
+ */
+int MeshRoofShell::poll(void)
+{
+    if (_ping != NULL) {
+        if (_pingStopUs == 0) {
+            if (interrupted()) {
+                esp_ping_stop(_ping);
+                _pingStopUs = esp_timer_get_time();
+            }
+        } else if (_pingEnded ||
+                   ((esp_timer_get_time() - _pingStopUs) >=
+                    PING_LINGER_US)) {
+            esp_ping_delete_session(_ping);
+            _ping = NULL;
+        }
+    }
+
+    return this->flush();
+}
+
+/*
+ * Stop a running job, e.g. when its session goes away; poll() still has
+ * to be called until busy() turns false.
+ */
+void MeshRoofShell::cancel(void)
+{
+    if ((_ping != NULL) && (_pingStopUs == 0)) {
+        esp_ping_stop(_ping);
+        _pingStopUs = esp_timer_get_time();
+    }
+}
+
 int MeshRoofShell::amplify(int argc, char **argv)
 {
     int ret = 0;
@@ -546,14 +741,13 @@ int MeshRoofShell::amplify(int argc, char **argv)
 int MeshRoofShell::buzz(int argc, char **argv)
 {
     if (argc == 1) {
-        meshroof->buzz();
+        meshroof->queueCommand(MESHROOF_CMD_BUZZ, 0, 500);
     } else if ((argc == 2)) {
         unsigned int ms;
 
-        try {
-            ms = stoul(argv[1]);
-            meshroof->buzz(ms);
-        } catch (const invalid_argument &e) {
+        if (parse_uint(argv[1], &ms)) {
+            meshroof->queueCommand(MESHROOF_CMD_BUZZ, 0, ms);
+        } else {
             this->printf("syntax error!\n");
         }
     } else {
@@ -592,8 +786,456 @@ int MeshRoofShell::reset(int argc, char **argv)
         if (secs_ago != 0) {
             this->printf("last reset: %u seconds ago\n", secs_ago);
         }
+        if (meshroof->getConfigDownloadBaud() != 0) {
+            this->printf("config download: %u ms @ %u baud\n",
+                         meshroof->getConfigDownloadMs(),
+                         (unsigned int) meshroof->getConfigDownloadBaud());
+        }
+        if (meshroof->getUsableMs() != 0) {
+            this->printf("time to usable: %u ms (%s)\n",
+                         meshroof->getUsableMs(),
+                         meshroof->wasUsableFromCache() ? "cache" : "full");
+        }
     } else if ((argc == 2) && strcmp(argv[1], "apply") == 0) {
-        meshroof->reset();
+        meshroof->queueCommand(MESHROOF_CMD_RESET);
+    } else {
+        this->printf("syntax error!\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int MeshRoofShell::serial(int argc, char **argv)
+{
+    int ret = 0;
+
+    if (argc == 1) {
+        struct mtcache_stats cache;
+
+        this->printf("baud: %u (link %u)\n",
+                     (unsigned int) meshroof->getSerialBaud(),
+                     (unsigned int) serial_get_baud());
+        mtcache_get_stats(&cache);
+        this->printf("cache: %u frames (%u nodes), %zu bytes, "
+                     "%u commits, %u replays\n",
+                     cache.frames, cache.node_infos, cache.size,
+                     cache.commits, cache.replays);
+    } else if ((argc == 3) && (strcmp(argv[1], "cache") == 0) &&
+               (strcmp(argv[2], "clear") == 0)) {
+        meshroof->requestCacheClear();
+        this->printf("ok\n");
+    } else if ((argc == 3) && (strcmp(argv[1], "baud") == 0)) {
+        unsigned int baud = 0;
+
+        if (parse_uint(argv[2], &baud) &&
+            (meshroof->setSerialBaud(baud) == true) &&
+            (meshroof->saveNvm() == true)) {
+            meshroof->requestLinkBaud();
+            this->printf("set the radio's serial module to %u baud too\n",
+                         baud);
+            this->printf("ok\n");
+        } else {
+            this->printf("failed!\n");
+            ret = -1;
+        }
+    } else {
+        this->printf("syntax error!\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int MeshRoofShell::stats(int argc, char **argv)
+{
+    int ret = 0;
+
+    if ((argc == 2) && (strcmp(argv[1], "serial") == 0)) {
+        struct serial_rx_stats rx;
+        struct serial_tx_stats tx;
+        unsigned int i;
+
+        serial_get_rx_stats(&rx);
+        serial_get_tx_stats(&tx);
+        this->printf("rx: %llu bytes, %u frames, %u decode errors\n",
+                     rx.bytes_in, (unsigned int) rx.frames,
+                     (unsigned int) rx.decode_errors);
+        this->printf("rx overflows: %u fifo, %u buffer, %u ring\n",
+                     (unsigned int) rx.fifo_overflows,
+                     (unsigned int) rx.buffer_overflows,
+                     (unsigned int) rx.ring_full);
+        this->printf("rx resyncs: %u (%u bytes dropped, %u oversized, "
+                     "%u truncated, %u line errors)\n",
+                     (unsigned int) rx.resyncs, (unsigned int) rx.dropped,
+                     (unsigned int) rx.oversized,
+                     (unsigned int) rx.truncated,
+                     (unsigned int) rx.line_errors);
+        this->printf("rx portnums:");
+        for (i = 0; i <= SERIAL_STATS_PORTNUMS; i++) {
+            if (rx.portnums[i] == 0) {
+                continue;
+            }
+            if (i == SERIAL_STATS_PORTNUMS) {
+                this->printf(" other=%u", (unsigned int) rx.portnums[i]);
+            } else {
+                this->printf(" %u=%u", i, (unsigned int) rx.portnums[i]);
+            }
+        }
+        this->printf("\n");
+        this->printf("rx to handler latency:\n");
+        for (i = 0; i < SERIAL_STATS_LATENCY_BUCKETS; i++) {
+            if (rx.latency[i] == 0) {
+                continue;
+            }
+            this->printf("  < %8u us: %u\n", 2U << i,
+                         (unsigned int) rx.latency[i]);
+        }
+        this->printf("tx: %llu bytes queued, %llu sent, %u frames, "
+                     "%u writes, %u dropped (%u frames refused)\n",
+                     tx.bytes_queued, tx.bytes_sent,
+                     (unsigned int) tx.frames, (unsigned int) tx.writes,
+                     (unsigned int) tx.dropped, (unsigned int) tx.full);
+        this->printf("tx queue: %zu bytes (max %zu), "
+                     "max enqueue latency %lld us\n",
+                     tx.depth, tx.max_depth, tx.max_enqueue_us);
+    } else if ((argc == 3) && (strcmp(argv[1], "serial") == 0) &&
+               (strcmp(argv[2], "reset") == 0)) {
+        meshroof->requestStatsReset();
+        this->printf("ok\n");
+    } else if ((argc == 2) && (strcmp(argv[1], "commands") == 0)) {
+        struct cmd_stats cmd;
+        unsigned int i, j;
+
+        meshroof->getCommandStats(&cmd);
+        this->printf("queue: %u (max %u), %u dropped\n",
+                     cmd.depth, cmd.max_depth, (unsigned int) cmd.dropped);
+        for (i = 0; i < MESHROOF_CMDS; i++) {
+            if (cmd.count[i] == 0) {
+                continue;
+            }
+            this->printf("%s: %u runs, avg %llu ms\n",
+                         MeshRoof::commandName(i),
+                         (unsigned int) cmd.count[i],
+                         cmd.total_us[i] / cmd.count[i] / 1000);
+            for (j = 0; j < CMD_HIST_BUCKETS; j++) {
+                if (cmd.hist[i][j] == 0) {
+                    continue;
+                }
+                if (j == (CMD_HIST_BUCKETS - 1)) {
+                    this->printf("  >= %5u ms: %u\n", 1U << (j - 1),
+                                 (unsigned int) cmd.hist[i][j]);
+                } else {
+                    this->printf("  <  %5u ms: %u\n", 1U << j,
+                                 (unsigned int) cmd.hist[i][j]);
+                }
+            }
+        }
+    } else if ((argc == 2) && (strcmp(argv[1], "dedup") == 0)) {
+        struct dedup_stats dedup;
+
+        dedup_get_stats(&dedup);
+        this->printf("dedup: %u duplicates dropped, %u new, %u evicted\n",
+                     (unsigned int) dedup.hits,
+                     (unsigned int) dedup.misses,
+                     (unsigned int) dedup.evictions);
+    } else if ((argc == 2) && (strcmp(argv[1], "stuck") == 0)) {
+        struct stuckdet_stats stuck;
+        unsigned int i;
+
+        stuckdet_get_stats(&stuck);
+        this->printf("threshold: %us (silent %us, longest gap %us, "
+                     "%u gaps learned)\n",
+                     (unsigned int) stuck.threshold_s,
+                     (unsigned int) stuck.silence_s,
+                     (unsigned int) stuck.max_gap_s,
+                     (unsigned int) stuck.gaps);
+        this->printf("probes: %u, false positives: %u (last after %us)\n",
+                     (unsigned int) stuck.probes,
+                     (unsigned int) stuck.false_positives,
+                     (unsigned int) stuck.last_false_s);
+        this->printf("detections: %u (last after %us)\n",
+                     (unsigned int) stuck.detections,
+                     (unsigned int) stuck.last_latency_s);
+        this->printf("gaps:\n");
+        for (i = 0; i < STUCKDET_BUCKETS; i++) {
+            if (stuck.hist[i] == 0) {
+                continue;
+            }
+            this->printf("  < %6u ms: %u\n",
+                         (unsigned int) stuckdet_bucket_ms(i),
+                         (unsigned int) stuck.hist[i]);
+        }
+    } else {
+        this->printf("syntax error!\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/*
+ * Binary trace records are dumped as "@T" lines of hex words for
+ * misc/tracedecode.py: seq, timestamp (us), core, format address, args.
+ */
+int MeshRoofShell::trace(int argc, char **argv)
+{
+    int ret = 0;
+
+    if (argc == 1) {
+        struct trace_stats stats;
+
+        trace_get_stats(&stats);
+        this->printf("trace: %s, %u records, %u overwritten\n",
+                     trace_enabled() ? "on" : "off",
+                     (unsigned int) stats.records,
+                     (unsigned int) stats.overwritten);
+    } else if ((argc == 2) && (strcmp(argv[1], "on") == 0)) {
+        trace_enable(true);
+        this->printf("ok\n");
+    } else if ((argc == 2) && (strcmp(argv[1], "off") == 0)) {
+        trace_enable(false);
+        this->printf("ok\n");
+    } else if ((argc == 2) && (strcmp(argv[1], "clear") == 0)) {
+        trace_clear();
+        this->printf("ok\n");
+    } else if ((argc == 2) && (strcmp(argv[1], "dump") == 0)) {
+        struct trace_rec recs[8];
+        uint32_t pos = 0;
+        unsigned int total = 0;
+        unsigned int n, i, j;
+
+        while ((total < TRACE_RING_RECS) &&
+               ((n = trace_read(&pos, recs, 8)) > 0)) {
+            total += n;
+            for (i = 0; i < n; i++) {
+                this->printf("@T %04x %08lx %u %08lx",
+                             recs[i].seq, (unsigned long) recs[i].ts_us,
+                             recs[i].core, (unsigned long) recs[i].fmt);
+                for (j = 0; j < recs[i].nargs; j++) {
+                    this->printf(" %08lx", (unsigned long) recs[i].args[j]);
+                }
+                this->printf("\n");
+            }
+        }
+    } else {
+        this->printf("syntax error!\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int MeshRoofShell::airtime(int argc, char **argv)
+{
+    int ret = 0;
+
+    (void)(argv);
+
+    if (argc == 1) {
+        struct txsched_stats stats;
+        unsigned int i;
+
+        txsched_get_stats(&stats);
+        this->printf("preset: %s (SF%u, %u.%u kHz, 4/%u), "
+                     "100 bytes take %u ms\n",
+                     txsched_preset_name(stats.preset), stats.sf,
+                     stats.bw_hz / 1000, (stats.bw_hz % 1000) / 100,
+                     stats.cr,
+                     (unsigned int) (txsched_airtime_us(100) / 1000));
+        this->printf("budget: %u.%u%% of airtime (channel %u.%u%%, "
+                     "own tx %u.%u%%), %d/%u ms in bucket\n",
+                     (unsigned int) stats.rate_permille / 10,
+                     (unsigned int) stats.rate_permille % 10,
+                     (unsigned int) stats.channel_util_permille / 10,
+                     (unsigned int) stats.channel_util_permille % 10,
+                     (unsigned int) stats.air_util_tx_permille / 10,
+                     (unsigned int) stats.air_util_tx_permille % 10,
+                     (int) stats.tokens_ms, TXSCHED_BURST_MS);
+        this->printf("queue:");
+        for (i = 0; i < TXSCHED_CLASSES; i++) {
+            this->printf(" %s=%u", txsched_class_name(i), stats.depth[i]);
+        }
+        this->printf("\n");
+        this->printf("sent: %u packets, %llu ms airtime (%u.%u%% "
+                     "last minute)\n",
+                     (unsigned int) stats.sent, stats.airtime_us / 1000,
+                     (unsigned int) stats.recent_permille / 10,
+                     (unsigned int) stats.recent_permille % 10);
+        this->printf("coalesced: %u, dropped: %u, bypassed: %u\n",
+                     (unsigned int) stats.coalesced,
+                     (unsigned int) stats.dropped,
+                     (unsigned int) stats.bypassed);
+    } else {
+        this->printf("syntax error!\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int MeshRoofShell::env(int argc, char **argv)
+{
+    int ret = 0;
+    struct tseries_point points[TSERIES_RAW_LEN];
+    uint32_t now_s = (uint32_t) (esp_timer_get_time() / 1000000);
+    uint32_t node_num;
+    unsigned int level = TSERIES_L1;
+    unsigned int n, i, m;
+    char lo[16], avg[16], hi[16];
+
+    if (argc == 1) {
+        this->printf("cpu temperature: %.1f C\n", meshroof->getCpuTempC());
+    } else if ((argc == 2) && (strcmp(argv[1], "history") == 0)) {
+        struct tseries_stats stats;
+        uint32_t node_nums[TSERIES_NODES];
+
+        tseries_get_stats(&stats);
+        this->printf("%u/%u nodes, %u samples, %u recycled, %zu bytes\n",
+                     stats.nodes, TSERIES_NODES,
+                     (unsigned int) stats.samples,
+                     (unsigned int) stats.recycled, stats.memory);
+        n = tseries_nodes(node_nums, TSERIES_NODES);
+        for (i = 0; i < n; i++) {
+            if (tseries_query(node_nums[i], TSERIES_RAW, 0,
+                              points, 1) == 1) {
+                this->printf("!%08lx: last sample %us ago\n",
+                             (unsigned long) node_nums[i],
+                             (unsigned int) (now_s - points[0].t));
+            }
+        }
+    } else if (((argc == 3) || (argc == 4)) &&
+               (strcmp(argv[1], "history") == 0)) {
+        if (!MeshRoof::parseNodeNum(argv[2], &node_num)) {
+            this->printf("bad node '%s'!\n", argv[2]);
+            ret = -1;
+            goto done;
+        }
+
+        if (argc == 4) {
+            if (strcmp(argv[3], "raw") == 0) {
+                level = TSERIES_RAW;
+            } else if (strcmp(argv[3], "15m") == 0) {
+                level = TSERIES_L1;
+            } else if (strcmp(argv[3], "2h") == 0) {
+                level = TSERIES_L2;
+            } else {
+                this->printf("resolution is one of raw, 15m or 2h!\n");
+                ret = -1;
+                goto done;
+            }
+        }
+
+        n = tseries_query(node_num, level, 0, points, TSERIES_RAW_LEN);
+        if (n == 0) {
+            this->printf("no history for !%08lx\n", (unsigned long) node_num);
+            goto done;
+        }
+
+        for (i = 0; i < n; i++) {
+            this->printf("%6um ago:",
+                         (unsigned int) (now_s - points[i].t) / 60);
+            for (m = 0; m < TSERIES_METRICS; m++) {
+                if ((points[i].mask & (1 << m)) == 0) {
+                    continue;
+                }
+                tseries_format(avg, sizeof(avg), m, points[i].avg[m]);
+                if (level == TSERIES_RAW) {
+                    this->printf(" %s %s", tseries_metric_name(m), avg);
+                } else {
+                    tseries_format(lo, sizeof(lo), m, points[i].min[m]);
+                    tseries_format(hi, sizeof(hi), m, points[i].max[m]);
+                    this->printf(" %s %s/%s/%s", tseries_metric_name(m),
+                                 lo, avg, hi);
+                }
+            }
+            this->printf("\n");
+        }
+    } else {
+        this->printf("syntax error!\n");
+        ret = -1;
+    }
+
+done:
+
+    return ret;
+}
+
+int MeshRoofShell::nodes(int argc, char **argv)
+{
+    int ret = 0;
+    struct nodetab_stats stats;
+    struct nodetab_entry entry;
+    uint32_t now_s = (uint32_t) (esp_timer_get_time() / 1000000);
+    char snr[8], hops[4];
+    bool more;
+
+    (void)(argv);
+
+    if (argc != 1) {
+        this->printf("syntax error!\n");
+        ret = -1;
+        goto done;
+    }
+
+    nodetab_get_stats(&stats);
+    this->printf("%u/%u nodes, %zu bytes, %u evictions\n",
+                 stats.nodes, stats.capacity, stats.memory,
+                 (unsigned int) stats.evictions);
+    this->printf("node      name  heard     snr  rssi hops packets\n");
+
+    // Streamed straight from the table, most recently heard first
+    for (more = nodetab_next(NULL, &entry); more && !interrupted();
+         more = nodetab_next(&entry, &entry)) {
+        if (entry.snr4 == NODETAB_SNR_UNKNOWN) {
+            snprintf(snr, sizeof(snr), "-");
+        } else {
+            snprintf(snr, sizeof(snr), "%.2f", entry.snr4 / 4.0f);
+        }
+        if (entry.hops == NODETAB_HOPS_UNKNOWN) {
+            snprintf(hops, sizeof(hops), "-");
+        } else {
+            snprintf(hops, sizeof(hops), "%u", entry.hops);
+        }
+        if (entry.last_heard_s == 0) {
+            this->printf("!%08lx %-4s  %6s %6s %5s %4s %7s%s%s\n",
+                         (unsigned long) entry.node_num, entry.short_name,
+                         "never", snr, "-", hops, "-",
+                         (entry.flags & NODETAB_ADMIN) ? " admin" : "",
+                         (entry.flags & NODETAB_MATE) ? " mate" : "");
+        } else {
+            this->printf("!%08lx %-4s %6us %6s %5d %4s %7u%s%s\n",
+                         (unsigned long) entry.node_num, entry.short_name,
+                         (unsigned int) (now_s - entry.last_heard_s), snr,
+                         entry.rssi, hops, (unsigned int) entry.packets,
+                         (entry.flags & NODETAB_ADMIN) ? " admin" : "",
+                         (entry.flags & NODETAB_MATE) ? " mate" : "");
+        }
+    }
+
+done:
+
+    return ret;
+}
+
+int MeshRoofShell::route(int argc, char **argv)
+{
+    int ret = 0;
+    uint32_t node_num;
+
+    if (argc == 1) {
+        struct linkgraph_stats stats;
+
+        linkgraph_get_stats(&stats);
+        this->printf("%u/%u nodes, %u/%u links, %u paths, %u evictions\n",
+                     stats.nodes, LINKGRAPH_NODES, stats.edges,
+                     LINKGRAPH_EDGES, (unsigned int) stats.paths,
+                     (unsigned int) stats.evictions);
+        this->printf("unicasts: %u acked, %u failed\n",
+                     (unsigned int) stats.acks,
+                     (unsigned int) stats.failures);
+    } else if ((argc == 2) && MeshRoof::parseNodeNum(argv[1], &node_num)) {
+        this->printf("%s\n", meshroof->routeReport(node_num).c_str());
     } else {
         this->printf("syntax error!\n");
         ret = -1;
@@ -606,25 +1248,56 @@ int MeshRoofShell::unknown_command(int argc, char **argv)
 {
     int ret = 0;
 
-    if (strcmp(argv[0], "exit") == 0) {
+    switch (lookupCommand(argv[0], CMD_SHELL)) {
+    case MeshRoofCommand::Exit:
         ret = this->exit(argc, argv);
-    } else if (strcmp(argv[0], "wifi") == 0) {
+        break;
+    case MeshRoofCommand::Wifi:
         ret = this->wifi(argc, argv);
-    } else if (strcmp(argv[0], "net") == 0) {
+        break;
+    case MeshRoofCommand::Net:
         ret = this->net(argc, argv);
-    } else if (strcmp(argv[0], "ping") == 0) {
+        break;
+    case MeshRoofCommand::Ping:
         ret = this->ping(argc, argv);
-    } else if (strcmp(argv[0], "amplify") == 0) {
+        break;
+    case MeshRoofCommand::Amplify:
         ret = this->amplify(argc, argv);
-    } else if (strcmp(argv[0], "buzz") == 0) {
+        break;
+    case MeshRoofCommand::Buzz:
         ret = this->buzz(argc, argv);
-    } else if (strcmp(argv[0], "morse") == 0) {
+        break;
+    case MeshRoofCommand::Morse:
         ret = this->morse(argc, argv);
-    } else if (strcmp(argv[0], "reset") == 0) {
+        break;
+    case MeshRoofCommand::Reset:
         ret = this->reset(argc, argv);
-    } else {
+        break;
+    case MeshRoofCommand::Serial:
+        ret = this->serial(argc, argv);
+        break;
+    case MeshRoofCommand::Stats:
+        ret = this->stats(argc, argv);
+        break;
+    case MeshRoofCommand::Trace:
+        ret = this->trace(argc, argv);
+        break;
+    case MeshRoofCommand::Airtime:
+        ret = this->airtime(argc, argv);
+        break;
+    case MeshRoofCommand::Env:
+        ret = this->env(argc, argv);
+        break;
+    case MeshRoofCommand::Nodes:
+        ret = this->nodes(argc, argv);
+        break;
+    case MeshRoofCommand::Route:
+        ret = this->route(argc, argv);
+        break;
+    default:
         this->printf("Unknown command '%s'!\n", argv[0]);
         ret = -1;
+        break;
     }
 
     return ret;
@@ -7,11 +7,17 @@
 #ifndef MESHROOFSHELL_HXX
 #define MESHROOFSHELL_HXX
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <ping/ping_sock.h>
+#include <telnet.h>
+#include <outbuf.h>
 #include <SimpleShell.hxx>
 
 using namespace std;
 
+#define SHELL_OBUF_SIZE  1024
+
 class MeshRoofShell : public SimpleShell {
 
 public:
@@ -19,10 +25,23 @@ public:
     MeshRoofShell(shared_ptr<SimpleClient> client = NULL);
     ~MeshRoofShell();
 
+    int flush(void);
+    bool pending(void) const;
+    void telnetStart(void);
+
+    bool busy(void) const;
+    int poll(void);
+    void cancel(void);
+
 protected:
 
+    int tcp_fd(void) const;
+    int obuf_write(const char *data, size_t len);
+    bool interrupted(void);
+
     virtual int tx_write(const uint8_t *buf, size_t size);
     virtual int printf(const char *format, ...);
+    int write(const char *data, size_t len);
     virtual int rx_ready(void) const;
     virtual int rx_read(uint8_t *buf, size_t size);
 
@@ -40,8 +59,30 @@ protected:
     virtual int buzz(int argc, char **argv);
     virtual int morse(int argc, char **argv);
     virtual int reset(int argc, char **argv);
+    virtual int serial(int argc, char **argv);
+    virtual int stats(int argc, char **argv);
+    virtual int trace(int argc, char **argv);
+    virtual int airtime(int argc, char **argv);
+    virtual int env(int argc, char **argv);
+    virtual int nodes(int argc, char **argv);
+    virtual int route(int argc, char **argv);
     virtual int unknown_command(int argc, char **argv);
 
+private:
+
+    // TCP output is staged here and written out once per prompt
+    char _obuf[SHELL_OBUF_SIZE];
+    struct outbuf _out;
+    SemaphoreHandle_t _olock;
+
+    struct telnet _telnet;
+    bool _interrupt;
+
+    // A running ping; the console loop advances it through poll()
+    esp_ping_handle_t _ping;
+    int64_t _pingStopUs;
+    volatile bool _pingEnded;
+
 };
 
 #endif
@@ -0,0 +1,106 @@
+/*
+ * dedup.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <string.h>
+#include <dedup.h>
+
+struct dedup_entry {
+    uint32_t from;
+    uint32_t id;
+    int64_t seen_us;
+};
+
+static struct dedup_entry table[DEDUP_SLOTS];
+static struct dedup_stats stats;
+
+static inline unsigned int dedup_hash(uint32_t from, uint32_t id)
+{
+    uint32_t h = (from * 0x9e3779b1) ^ id;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+
+    return h & (DEDUP_SLOTS - 1);
+}
+
+static inline bool dedup_live(const struct dedup_entry *entry, int64_t now_us)
+{
+    return (entry->seen_us != 0) && ((now_us - entry->seen_us) < DEDUP_TTL_US);
+}
+
+void dedup_init(void)
+{
+    memset(table, 0x0, sizeof(table));
+    memset(&stats, 0x0, sizeof(stats));
+}
+
+/*
+ * Returns true if (from, id) was seen within DEDUP_TTL_US, otherwise
+ * records it. Packets without an id cannot be told apart and always pass.
+ */
+bool dedup_check(uint32_t from, uint32_t id, int64_t now_us)
+{
+    struct dedup_entry *entry;
+    struct dedup_entry *slot = NULL;
+    unsigned int home;
+    unsigned int i;
+
+    if (id == 0) {
+        return false;
+    }
+
+    if (now_us == 0) {
+        now_us = 1;
+    }
+
+    home = dedup_hash(from, id);
+    for (i = 0; i < DEDUP_MAX_PROBE; i++) {
+        entry = &table[(home + i) & (DEDUP_SLOTS - 1)];
+        if (!dedup_live(entry, now_us)) {
+            if ((slot == NULL) || dedup_live(slot, now_us)) {
+                slot = entry;
+            }
+            continue;
+        }
+
+        if ((entry->from == from) && (entry->id == id)) {
+            stats.hits++;
+            return true;
+        }
+
+        if ((slot == NULL) ||
+            (dedup_live(slot, now_us) && (entry->seen_us < slot->seen_us))) {
+            slot = entry;
+        }
+    }
+
+    if (dedup_live(slot, now_us)) {
+        stats.evictions++;
+    }
+
+    slot->from = from;
+    slot->id = id;
+    slot->seen_us = now_us;
+    stats.misses++;
+
+    return false;
+}
+
+void dedup_get_stats(struct dedup_stats *s)
+{
+    memcpy(s, &stats, sizeof(*s));
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,63 @@
+/*
+ * dedup.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Recently seen (from, packet id) pairs, so that a rebroadcast or a retry
+ * of a command is not acted on twice. Fixed-size open addressing: an
+ * entry lives within DEDUP_MAX_PROBE slots of its home slot, and when
+ * those are all live the oldest of them is evicted.
+ */
+#define DEDUP_SLOTS      128
+#define DEDUP_MAX_PROBE  8
+#define DEDUP_TTL_US     (10 * 60 * 1000000LL)
+
+struct dedup_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+};
+
+extern void dedup_init(void);
+extern bool dedup_check(uint32_t from, uint32_t id, int64_t now_us);
+extern void dedup_get_stats(struct dedup_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
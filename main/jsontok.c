@@ -0,0 +1,357 @@
+/*
+ * jsontok.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jsontok.h>
+
+struct json_parser {
+    const char *js;
+    size_t len;
+    size_t pos;
+    struct json_tok *toks;
+    unsigned int max;
+    unsigned int n;
+};
+
+static void skip_ws(struct json_parser *p)
+{
+    while ((p->pos < p->len) &&
+           ((p->js[p->pos] == ' ') || (p->js[p->pos] == '\t') ||
+            (p->js[p->pos] == '\r') || (p->js[p->pos] == '\n'))) {
+        p->pos++;
+    }
+}
+
+static int alloc_tok(struct json_parser *p, uint8_t type)
+{
+    struct json_tok *tok;
+
+    if (p->n >= p->max) {
+        return -1;
+    }
+
+    tok = &p->toks[p->n];
+    memset(tok, 0x0, sizeof(*tok));
+    tok->type = type;
+    tok->start = p->pos;
+
+    return p->n++;
+}
+
+static int parse_value(struct json_parser *p, int depth);
+
+static int parse_string(struct json_parser *p)
+{
+    int t;
+
+    p->pos++;  // opening quote
+    t = alloc_tok(p, JSON_STRING);
+    if (t < 0) {
+        return -1;
+    }
+
+    while (p->pos < p->len) {
+        if (p->js[p->pos] == '"') {
+            p->toks[t].end = p->pos;
+            p->pos++;
+            p->toks[t].next = p->n;
+            return t;
+        }
+        if (p->js[p->pos] == '\\') {
+            p->pos++;
+        }
+        p->pos++;
+    }
+
+    return -1;
+}
+
+static int parse_container(struct json_parser *p, int depth)
+{
+    char close = (p->js[p->pos] == '{') ? '}' : ']';
+    int t;
+    int v;
+
+    if (depth >= JSON_MAX_DEPTH) {
+        return -1;
+    }
+
+    t = alloc_tok(p, (close == '}') ? JSON_OBJECT : JSON_ARRAY);
+    if (t < 0) {
+        return -1;
+    }
+    p->pos++;
+
+    for (;;) {
+        skip_ws(p);
+        if (p->pos >= p->len) {
+            return -1;
+        }
+        if (p->js[p->pos] == close) {
+            p->pos++;
+            break;
+        }
+        if (p->toks[t].size > 0) {
+            if (p->js[p->pos] != ',') {
+                return -1;
+            }
+            p->pos++;
+            skip_ws(p);
+        }
+
+        if (close == '}') {
+            if ((p->pos >= p->len) || (p->js[p->pos] != '"') ||
+                (parse_string(p) < 0)) {
+                return -1;
+            }
+            skip_ws(p);
+            if ((p->pos >= p->len) || (p->js[p->pos] != ':')) {
+                return -1;
+            }
+            p->pos++;
+        }
+
+        v = parse_value(p, depth + 1);
+        if (v < 0) {
+            return -1;
+        }
+        p->toks[t].size++;
+    }
+
+    p->toks[t].end = p->pos;
+    p->toks[t].next = p->n;
+
+    return t;
+}
+
+static int parse_value(struct json_parser *p, int depth)
+{
+    int t;
+    char c;
+
+    skip_ws(p);
+    if (p->pos >= p->len) {
+        return -1;
+    }
+
+    c = p->js[p->pos];
+    if ((c == '{') || (c == '[')) {
+        return parse_container(p, depth);
+    } else if (c == '"') {
+        return parse_string(p);
+    }
+
+    t = alloc_tok(p, JSON_PRIMITIVE);
+    if (t < 0) {
+        return -1;
+    }
+    while ((p->pos < p->len) &&
+           (strchr(",]} \t\r\n", p->js[p->pos]) == NULL)) {
+        p->pos++;
+    }
+    p->toks[t].end = p->pos;
+    p->toks[t].next = p->n;
+    if (p->toks[t].end == p->toks[t].start) {
+        return -1;
+    }
+
+    return t;
+}
+
+/*
+ * Returns the number of tokens, or -1 if the text is malformed or needs
+ * more than 'max' tokens. Token 0 is the top-level value.
+ */
+int json_parse(const char *js, size_t len,
+               struct json_tok *toks, unsigned int max)
+{
+    struct json_parser p = {
+        .js = js,
+        .len = len,
+        .pos = 0,
+        .toks = toks,
+        .max = max,
+        .n = 0,
+    };
+
+    if ((len > UINT16_MAX) || (parse_value(&p, 0) < 0)) {
+        return -1;
+    }
+
+    skip_ws(&p);
+    if (p.pos != len) {
+        return -1;
+    }
+
+    return p.n;
+}
+
+/*
+ * Look up 'key' in the object at token 'obj'; returns the value's token.
+ */
+int json_find(const char *js, const struct json_tok *toks,
+              int obj, const char *key)
+{
+    size_t klen = strlen(key);
+    int i;
+    unsigned int n;
+
+    if ((obj < 0) || (toks[obj].type != JSON_OBJECT)) {
+        return -1;
+    }
+
+    i = obj + 1;
+    for (n = 0; n < toks[obj].size; n++) {
+        if (((size_t) (toks[i].end - toks[i].start) == klen) &&
+            (memcmp(js + toks[i].start, key, klen) == 0)) {
+            return i + 1;
+        }
+        i = toks[i + 1].next;
+    }
+
+    return -1;
+}
+
+bool json_get_str(const char *js, const struct json_tok *tok,
+                  char *buf, size_t size)
+{
+    size_t i;
+    size_t o = 0;
+    char c;
+
+    if ((tok == NULL) || (tok->type != JSON_STRING) || (size == 0)) {
+        return false;
+    }
+
+    for (i = tok->start; i < tok->end; i++) {
+        c = js[i];
+        if (c == '\\') {
+            c = js[++i];
+            switch (c) {
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'u':
+                // Only the ASCII range is supported
+                if (((i + 4) >= tok->end) ||
+                    (strncmp(js + i + 1, "00", 2) != 0)) {
+                    return false;
+                }
+                c = (char) strtol((char[]) { js[i + 3], js[i + 4], '\0' },
+                                  NULL, 16);
+                i += 4;
+                break;
+            default:
+                break;
+            }
+        }
+        if ((o + 1) >= size) {
+            return false;
+        }
+        buf[o++] = c;
+    }
+    buf[o] = '\0';
+
+    return true;
+}
+
+bool json_get_int(const char *js, const struct json_tok *tok, long *value)
+{
+    char num[24];
+    char *end;
+    size_t len;
+
+    if ((tok == NULL) || (tok->type != JSON_PRIMITIVE)) {
+        return false;
+    }
+
+    len = tok->end - tok->start;
+    if (len >= sizeof(num)) {
+        return false;
+    }
+    memcpy(num, js + tok->start, len);
+    num[len] = '\0';
+
+    *value = strtol(num, &end, 10);
+
+    return *end == '\0';
+}
+
+bool json_get_bool(const char *js, const struct json_tok *tok, bool *value)
+{
+    size_t len;
+
+    if ((tok == NULL) || (tok->type != JSON_PRIMITIVE)) {
+        return false;
+    }
+
+    len = tok->end - tok->start;
+    if ((len == 4) && (memcmp(js + tok->start, "true", 4) == 0)) {
+        *value = true;
+    } else if ((len == 5) && (memcmp(js + tok->start, "false", 5) == 0)) {
+        *value = false;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Copy 'src' into 'dst' as the body of a JSON string. Returns the length
+ * written (output is always NUL-terminated and truncated to fit).
+ */
+size_t json_escape(char *dst, size_t size, const char *src)
+{
+    size_t o = 0;
+    unsigned char c;
+    char esc[8];
+    size_t elen;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    for (; *src != '\0'; src++) {
+        c = (unsigned char) *src;
+        if ((c == '"') || (c == '\\')) {
+            esc[0] = '\\';
+            esc[1] = c;
+            elen = 2;
+        } else if (c == '\n') {
+            memcpy(esc, "\\n", 2);
+            elen = 2;
+        } else if (c < 0x20) {
+            elen = snprintf(esc, sizeof(esc), "\\u%04x", c);
+        } else {
+            esc[0] = c;
+            elen = 1;
+        }
+
+        if ((o + elen) >= size) {
+            break;
+        }
+        memcpy(dst + o, esc, elen);
+        o += elen;
+    }
+    dst[o] = '\0';
+
+    return o;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,79 @@
+/*
+ * jsontok.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef JSONTOK_H
+#define JSONTOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * A small in-place JSON tokenizer: the document is split into a flat
+ * array of tokens pointing back into the text, nothing is allocated.
+ * Each token records where its subtree ends so siblings can be skipped.
+ */
+#define JSON_MAX_DEPTH  8
+
+enum json_type {
+    JSON_NONE = 0,
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE,
+};
+
+struct json_tok {
+    uint8_t type;
+    uint16_t start;
+    uint16_t end;
+    uint16_t size;
+    uint16_t next;
+};
+
+extern int json_parse(const char *js, size_t len,
+                      struct json_tok *toks, unsigned int max);
+extern int json_find(const char *js, const struct json_tok *toks,
+                     int obj, const char *key);
+extern bool json_get_str(const char *js, const struct json_tok *tok,
+                         char *buf, size_t size);
+extern bool json_get_int(const char *js, const struct json_tok *tok,
+                         long *value);
+extern bool json_get_bool(const char *js, const struct json_tok *tok,
+                          bool *value);
+extern size_t json_escape(char *dst, size_t size, const char *src);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,441 @@
+/*
+ * linkgraph.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <math.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <linkgraph.h>
+
+#define LINKGRAPH_NONE      0xff
+#define LINKGRAPH_MIN_Q     0.01f
+
+struct linkgraph_node {
+    uint32_t node_num;
+    uint32_t last_s;
+    uint32_t reach_s;
+    float acked;
+    float failed;
+};
+
+struct linkgraph_edge {
+    uint32_t t;                 /* 0 if the slot is free */
+    uint8_t from;
+    uint8_t to;
+    int8_t snr4;
+    uint8_t samples;
+};
+
+struct linkgraph_pending {
+    uint32_t id;
+    uint32_t dest;
+};
+
+static struct linkgraph_node nodes[LINKGRAPH_NODES];
+static struct linkgraph_edge edges[LINKGRAPH_EDGES];
+static struct linkgraph_pending pending[LINKGRAPH_PENDING];
+static unsigned int pending_head = 0;
+static struct linkgraph_stats stats;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+void linkgraph_init(void)
+{
+    portENTER_CRITICAL(&lock);
+    memset(nodes, 0x0, sizeof(nodes));
+    memset(edges, 0x0, sizeof(edges));
+    memset(pending, 0x0, sizeof(pending));
+    memset(&stats, 0x0, sizeof(stats));
+    pending_head = 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+static inline float linkgraph_decay(uint32_t now_s, uint32_t then_s)
+{
+    if (now_s <= then_s) {
+        return 1.0f;
+    }
+
+    return exp2f(-(float) (now_s - then_s) / LINKGRAPH_HALF_LIFE_S);
+}
+
+/*
+ * Map SNR to [0.05, 1]: -20 dB is about where LoRa stops decoding even
+ * at SF12, and +10 dB leaves nothing to gain.
+ */
+static inline float linkgraph_snr_quality(int8_t snr4)
+{
+    float q;
+
+    if (snr4 == LINKGRAPH_SNR_UNKNOWN) {
+        return 0.5f;
+    }
+
+    q = ((snr4 / 4.0f) + 20.0f) / 30.0f;
+
+    return (q < 0.05f) ? 0.05f : (q > 1.0f) ? 1.0f : q;
+}
+
+static inline float linkgraph_quality(const struct linkgraph_edge *edge,
+                                      uint32_t now_s)
+{
+    float q = linkgraph_snr_quality(edge->snr4) *
+        linkgraph_decay(now_s, edge->t);
+
+    return (q < LINKGRAPH_MIN_Q) ? LINKGRAPH_MIN_Q : q;
+}
+
+static unsigned int linkgraph_find(uint32_t node_num)
+{
+    unsigned int i;
+
+    for (i = 0; i < LINKGRAPH_NODES; i++) {
+        if (nodes[i].node_num == node_num) {
+            return i;
+        }
+    }
+
+    return LINKGRAPH_NONE;
+}
+
+/*
+ * Find or add 'node_num'. A full table gives up its stalest node along
+ * with that node's links.
+ */
+static unsigned int linkgraph_claim(uint32_t node_num, uint32_t now_s)
+{
+    unsigned int idx;
+    unsigned int i;
+
+    idx = linkgraph_find(node_num);
+    if (idx != LINKGRAPH_NONE) {
+        nodes[idx].last_s = now_s;
+        return idx;
+    }
+
+    idx = 0;
+    for (i = 0; i < LINKGRAPH_NODES; i++) {
+        if (nodes[i].node_num == 0) {
+            idx = i;
+            break;
+        }
+        if (nodes[i].last_s < nodes[idx].last_s) {
+            idx = i;
+        }
+    }
+
+    if (nodes[idx].node_num != 0) {
+        for (i = 0; i < LINKGRAPH_EDGES; i++) {
+            if ((edges[i].t != 0) &&
+                ((edges[i].from == idx) || (edges[i].to == idx))) {
+                edges[i].t = 0;
+            }
+        }
+        stats.evictions++;
+    }
+
+    memset(&nodes[idx], 0x0, sizeof(nodes[idx]));
+    nodes[idx].node_num = node_num;
+    nodes[idx].last_s = now_s;
+
+    return idx;
+}
+
+static void linkgraph_link(unsigned int from, unsigned int to, int8_t snr4,
+                           uint32_t now_s)
+{
+    struct linkgraph_edge *edge = NULL;
+    struct linkgraph_edge *oldest = &edges[0];
+    float w;
+    unsigned int i;
+
+    for (i = 0; i < LINKGRAPH_EDGES; i++) {
+        if ((edges[i].t != 0) &&
+            (edges[i].from == from) && (edges[i].to == to)) {
+            edge = &edges[i];
+            break;
+        }
+        if ((oldest->t != 0) && (edges[i].t < oldest->t)) {
+            oldest = &edges[i];
+        }
+    }
+
+    if (edge == NULL) {
+        edge = oldest;
+        memset(edge, 0x0, sizeof(*edge));
+        edge->from = from;
+        edge->to = to;
+        edge->snr4 = LINKGRAPH_SNR_UNKNOWN;
+    }
+
+    if (snr4 != LINKGRAPH_SNR_UNKNOWN) {
+        if ((edge->samples == 0) || (edge->snr4 == LINKGRAPH_SNR_UNKNOWN)) {
+            edge->snr4 = snr4;
+        } else {
+            // Old measurements count for less the older they are
+            w = 0.5f * linkgraph_decay(now_s, edge->t);
+            edge->snr4 = (int8_t) lroundf((edge->snr4 * w) +
+                                          (snr4 * (1.0f - w)));
+        }
+    }
+    if (edge->samples < UINT8_MAX) {
+        edge->samples++;
+    }
+    edge->t = (now_s != 0) ? now_s : 1;
+}
+
+/*
+ * Record a path of 'n' nodes, where snr4[i] was measured by nodes[i + 1]
+ * receiving from nodes[i] (n - 1 entries).
+ */
+void linkgraph_path(const uint32_t *path, const int8_t *snr4, unsigned int n,
+                    uint32_t now_s)
+{
+    uint8_t idx[LINKGRAPH_MAX_HOPS + 1];
+    unsigned int i;
+
+    if ((n < 2) || (n > (LINKGRAPH_MAX_HOPS + 1))) {
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        if ((path[i] == 0) || (path[i] == UINT32_MAX)) {
+            return;
+        }
+    }
+
+    portENTER_CRITICAL(&lock);
+
+    for (i = 0; i < n; i++) {
+        idx[i] = linkgraph_claim(path[i], now_s);
+    }
+
+    for (i = 0; (i + 1) < n; i++) {
+        // Skip hops whose ends were recycled by a later claim
+        if ((idx[i] == idx[i + 1]) ||
+            (nodes[idx[i]].node_num != path[i]) ||
+            (nodes[idx[i + 1]].node_num != path[i + 1])) {
+            continue;
+        }
+        linkgraph_link(idx[i], idx[i + 1], snr4[i], now_s);
+    }
+
+    stats.paths++;
+
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Remember a unicast that asked for an ack, so that the routing reply
+ * can be charged to its destination.
+ */
+void linkgraph_sent(uint32_t id, uint32_t dest, uint32_t now_s)
+{
+    (void)(now_s);
+
+    if ((id == 0) || (dest == 0) || (dest == UINT32_MAX)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+    pending[pending_head].id = id;
+    pending[pending_head].dest = dest;
+    pending_head = (pending_head + 1) % LINKGRAPH_PENDING;
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * A routing reply for 'request_id' came from 'from'. Only an ack from the
+ * destination itself proves it reachable; any error counts against it.
+ */
+void linkgraph_acked(uint32_t request_id, uint32_t from, bool ok,
+                     uint32_t now_s)
+{
+    struct linkgraph_node *node;
+    unsigned int i;
+    float decay;
+
+    if (request_id == 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+
+    for (i = 0; i < LINKGRAPH_PENDING; i++) {
+        if (pending[i].id == request_id) {
+            break;
+        }
+    }
+
+    if ((i == LINKGRAPH_PENDING) || (ok && (from != pending[i].dest))) {
+        goto done;
+    }
+
+    node = &nodes[linkgraph_claim(pending[i].dest, now_s)];
+    decay = linkgraph_decay(now_s, node->reach_s);
+    node->acked *= decay;
+    node->failed *= decay;
+    if (ok) {
+        node->acked += 1.0f;
+        stats.acks++;
+    } else {
+        node->failed += 1.0f;
+        stats.failures++;
+    }
+    node->reach_s = now_s;
+    pending[i].id = 0;
+
+done:
+
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * The best path from 'self' to 'dest': Dijkstra over -log(quality), so
+ * that the path found maximizes the product of its hop qualities.
+ */
+bool linkgraph_route(uint32_t self, uint32_t dest, uint32_t now_s,
+                     struct linkgraph_route *route)
+{
+    float cost[LINKGRAPH_EDGES];
+    float dist[LINKGRAPH_NODES];
+    uint8_t via[LINKGRAPH_NODES];
+    bool done[LINKGRAPH_NODES];
+    unsigned int src, dst, u, i, n;
+    bool found = false;
+
+    memset(route, 0x0, sizeof(*route));
+
+    portENTER_CRITICAL(&lock);
+
+    src = linkgraph_find(self);
+    dst = linkgraph_find(dest);
+    if ((src == LINKGRAPH_NONE) || (dst == LINKGRAPH_NONE) || (src == dst)) {
+        goto done;
+    }
+
+    for (i = 0; i < LINKGRAPH_EDGES; i++) {
+        if (edges[i].t != 0) {
+            cost[i] = -logf(linkgraph_quality(&edges[i], now_s));
+        }
+    }
+
+    for (i = 0; i < LINKGRAPH_NODES; i++) {
+        dist[i] = INFINITY;
+        via[i] = LINKGRAPH_NONE;
+        done[i] = false;
+    }
+    dist[src] = 0.0f;
+
+    for (;;) {
+        u = LINKGRAPH_NONE;
+        for (i = 0; i < LINKGRAPH_NODES; i++) {
+            if (!done[i] && (dist[i] != INFINITY) &&
+                ((u == LINKGRAPH_NONE) || (dist[i] < dist[u]))) {
+                u = i;
+            }
+        }
+        if ((u == LINKGRAPH_NONE) || (u == dst)) {
+            break;
+        }
+        done[u] = true;
+
+        for (i = 0; i < LINKGRAPH_EDGES; i++) {
+            if ((edges[i].t != 0) && (edges[i].from == u) &&
+                ((dist[u] + cost[i]) < dist[edges[i].to])) {
+                dist[edges[i].to] = dist[u] + cost[i];
+                via[edges[i].to] = i;
+            }
+        }
+    }
+
+    if (via[dst] == LINKGRAPH_NONE) {
+        goto done;
+    }
+
+    // Count the hops, then fill them in from the destination back
+    n = 0;
+    for (u = dst; u != src; u = edges[via[u]].from) {
+        n++;
+        if (n > LINKGRAPH_MAX_HOPS) {
+            goto done;
+        }
+    }
+
+    route->hops = n;
+    route->quality = (uint8_t) lroundf(expf(-dist[dst]) * 100.0f);
+    for (u = dst; u != src; u = edges[via[u]].from) {
+        const struct linkgraph_edge *edge = &edges[via[u]];
+        struct linkgraph_hop *hop = &route->hop[--n];
+
+        hop->from = nodes[edge->from].node_num;
+        hop->to = nodes[edge->to].node_num;
+        hop->snr4 = edge->snr4;
+        hop->quality = (uint8_t) lroundf(linkgraph_quality(edge, now_s) *
+                                         100.0f);
+        hop->age_s = (now_s > edge->t) ? (now_s - edge->t) : 0;
+    }
+    found = true;
+
+done:
+
+    portEXIT_CRITICAL(&lock);
+
+    return found;
+}
+
+/*
+ * Percentage of recent acked unicasts to 'node_num', or -1 if unknown.
+ */
+int linkgraph_reachability(uint32_t node_num, uint32_t now_s)
+{
+    unsigned int idx;
+    float decay, acked, failed;
+    int ret = -1;
+
+    portENTER_CRITICAL(&lock);
+    idx = linkgraph_find(node_num);
+    if ((node_num != 0) && (idx != LINKGRAPH_NONE)) {
+        decay = linkgraph_decay(now_s, nodes[idx].reach_s);
+        acked = nodes[idx].acked * decay;
+        failed = nodes[idx].failed * decay;
+        if ((acked + failed) >= 0.05f) {
+            ret = (int) lroundf((acked * 100.0f) / (acked + failed));
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    return ret;
+}
+
+void linkgraph_get_stats(struct linkgraph_stats *s)
+{
+    unsigned int i;
+
+    portENTER_CRITICAL(&lock);
+    memcpy(s, &stats, sizeof(*s));
+    s->nodes = 0;
+    s->edges = 0;
+    for (i = 0; i < LINKGRAPH_NODES; i++) {
+        if (nodes[i].node_num != 0) {
+            s->nodes++;
+        }
+    }
+    for (i = 0; i < LINKGRAPH_EDGES; i++) {
+        if (edges[i].t != 0) {
+            s->edges++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,92 @@
+/*
+ * linkgraph.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef LINKGRAPH_H
+#define LINKGRAPH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Directed links between nodes learned from traceroutes, with the SNR
+ * measured on each, and per-node reachability learned from the acks and
+ * routing errors for our own unicasts. Everything decays with
+ * LINKGRAPH_HALF_LIFE_S, so a route answered from here reflects how
+ * fresh its evidence is. When full, the stalest node or link is dropped.
+ */
+#define LINKGRAPH_NODES        32
+#define LINKGRAPH_EDGES        96
+#define LINKGRAPH_PENDING      16
+#define LINKGRAPH_MAX_HOPS     8
+#define LINKGRAPH_HALF_LIFE_S  (2 * 60 * 60)
+#define LINKGRAPH_SNR_UNKNOWN  INT8_MIN
+
+struct linkgraph_hop {
+    uint32_t from;
+    uint32_t to;
+    int8_t snr4;                /* SNR in 0.25 dB */
+    uint8_t quality;            /* Percent, after decay */
+    uint32_t age_s;
+};
+
+struct linkgraph_route {
+    unsigned int hops;
+    uint8_t quality;            /* Percent, product over the hops */
+    struct linkgraph_hop hop[LINKGRAPH_MAX_HOPS];
+};
+
+struct linkgraph_stats {
+    unsigned int nodes;
+    unsigned int edges;
+    uint32_t paths;
+    uint32_t acks;
+    uint32_t failures;
+    uint32_t evictions;
+};
+
+extern void linkgraph_init(void);
+extern void linkgraph_path(const uint32_t *nodes, const int8_t *snr4,
+                           unsigned int n, uint32_t now_s);
+extern void linkgraph_sent(uint32_t id, uint32_t dest, uint32_t now_s);
+extern void linkgraph_acked(uint32_t request_id, uint32_t from, bool ok,
+                            uint32_t now_s);
+extern bool linkgraph_route(uint32_t self, uint32_t dest, uint32_t now_s,
+                            struct linkgraph_route *route);
+extern int linkgraph_reachability(uint32_t node_num, uint32_t now_s);
+extern void linkgraph_get_stats(struct linkgraph_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,364 @@
+/*
+ * logring.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <logring.h>
+
+#define LOG_PBUF_SIZE     256
+#define LOG_ALIGN(x)      (((x) + 3) & ~3)
+
+#define LOG_REC_BUSY      0
+#define LOG_REC_DONE      1
+
+/*
+ * The header is written when the record is reserved; 'state' turns to
+ * LOG_REC_DONE once the text has been copied in behind it.
+ */
+struct log_rec_hdr {
+    uint32_t gseq;
+    uint32_t seq;
+    uint16_t len;
+    uint16_t state;
+};
+
+/*
+ * head is where the next record goes, tail is the oldest record that is
+ * still intact. Both are free-running and only move forward; only tasks on
+ * the ring's own core append to it. The lock covers reserving space, not
+ * copying the text, so several producers may be filling records at once.
+ */
+struct log_ring {
+    char buf[LOG_RING_SIZE];
+    size_t head;
+    size_t tail;
+    uint32_t seq;
+    portMUX_TYPE lock;
+};
+
+static struct log_ring rings[portNUM_PROCESSORS];
+static uint32_t log_gseq = 0;
+static struct log_stats stats;
+static TaskHandle_t waiters[LOG_MAX_WAITERS];
+static portMUX_TYPE waiters_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void log_init(void)
+{
+    int i;
+
+    for (i = 0; i < portNUM_PROCESSORS; i++) {
+        memset(&rings[i], 0x0, sizeof(rings[i]));
+        portMUX_INITIALIZE(&rings[i].lock);
+    }
+    memset(&stats, 0x0, sizeof(stats));
+}
+
+static void ring_put(struct log_ring *ring, size_t pos,
+                     const void *data, size_t len)
+{
+    const char *src = (const char *) data;
+    size_t off = pos & (LOG_RING_SIZE - 1);
+    size_t chunk = LOG_RING_SIZE - off;
+
+    if (chunk > len) {
+        chunk = len;
+    }
+
+    memcpy(ring->buf + off, src, chunk);
+    memcpy(ring->buf, src + chunk, len - chunk);
+}
+
+static void ring_get(const struct log_ring *ring, size_t pos,
+                     void *data, size_t len)
+{
+    char *dst = (char *) data;
+    size_t off = pos & (LOG_RING_SIZE - 1);
+    size_t chunk = LOG_RING_SIZE - off;
+
+    if (chunk > len) {
+        chunk = len;
+    }
+
+    memcpy(dst, ring->buf + off, chunk);
+    memcpy(dst + chunk, ring->buf, len - chunk);
+}
+
+/*
+ * A record starts 4-byte aligned, so its 'state' never straddles the end
+ * of the ring.
+ */
+static inline uint16_t *rec_state(struct log_ring *ring, size_t pos)
+{
+    pos += offsetof(struct log_rec_hdr, state);
+
+    return (uint16_t *) (ring->buf + (pos & (LOG_RING_SIZE - 1)));
+}
+
+void log_write(const char *text, size_t len)
+{
+    struct log_ring *ring;
+    struct log_rec_hdr hdr;
+    struct log_rec_hdr old;
+    size_t pos;
+    size_t rec;
+    int i;
+
+    if (len > LOG_MSG_MAX) {
+        len = LOG_MSG_MAX;
+        __atomic_fetch_add(&stats.truncated, 1, __ATOMIC_RELAXED);
+    }
+
+    rec = LOG_ALIGN(sizeof(hdr) + len);
+    ring = &rings[xPortGetCoreID()];
+
+    portENTER_CRITICAL(&ring->lock);
+
+    // Retire the oldest records until the new one fits
+    while ((LOG_RING_SIZE - (ring->head - ring->tail)) < rec) {
+        if (__atomic_load_n(rec_state(ring, ring->tail),
+                            __ATOMIC_ACQUIRE) != LOG_REC_DONE) {
+            // Still being filled a whole ring ago; readers see the gap
+            ring->seq++;
+            portEXIT_CRITICAL(&ring->lock);
+            __atomic_fetch_add(&stats.lost, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        ring_get(ring, ring->tail, &old, sizeof(old));
+        __atomic_store_n(&ring->tail,
+                         ring->tail + LOG_ALIGN(sizeof(old) + old.len),
+                         __ATOMIC_RELEASE);
+        __atomic_fetch_add(&stats.overwritten, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    pos = ring->head;
+    hdr.gseq = __atomic_fetch_add(&log_gseq, 1, __ATOMIC_RELAXED);
+    hdr.seq = ring->seq++;
+    hdr.len = len;
+    hdr.state = LOG_REC_BUSY;
+    ring_put(ring, pos, &hdr, sizeof(hdr));
+    __atomic_store_n(&ring->head, pos + rec, __ATOMIC_RELEASE);
+
+    portEXIT_CRITICAL(&ring->lock);
+
+    ring_put(ring, pos + sizeof(hdr), text, len);
+    __atomic_store_n(rec_state(ring, pos), LOG_REC_DONE, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&stats.messages, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.bytes, len, __ATOMIC_RELAXED);
+
+    for (i = 0; i < LOG_MAX_WAITERS; i++) {
+        TaskHandle_t task = waiters[i];
+
+        if (task != NULL) {
+            xTaskNotifyGive(task);
+        }
+    }
+}
+
+int log_printf(const char *format, ...)
+{
+    int ret = 0;
+    va_list ap;
+
+    va_start(ap, format);
+    ret = log_vprintf(format, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+int log_vprintf(const char *format, va_list ap)
+{
+    int ret = 0;
+    char pbuf[LOG_PBUF_SIZE];
+    char *buf = pbuf;
+    va_list ap2;
+
+    va_copy(ap2, ap);
+    ret = vsnprintf(pbuf, sizeof(pbuf), format, ap);
+    if (ret < 0) {
+        goto done;
+    }
+
+    if ((size_t) ret >= sizeof(pbuf)) {
+        buf = (char *) malloc(ret + 1);
+        if (buf == NULL) {
+            goto done;
+        }
+        vsnprintf(buf, ret + 1, format, ap2);
+    }
+
+    log_write(buf, ret);
+
+done:
+
+    va_end(ap2);
+    if (buf != pbuf) {
+        free(buf);
+    }
+
+    return ret;
+}
+
+void log_cursor_init(struct log_cursor *cursor)
+{
+    int i;
+
+    for (i = 0; i < portNUM_PROCESSORS; i++) {
+        portENTER_CRITICAL(&rings[i].lock);
+        cursor->pos[i] = rings[i].head;
+        cursor->seq[i] = rings[i].seq;
+        portEXIT_CRITICAL(&rings[i].lock);
+    }
+
+    cursor->dropped = 0;
+}
+
+static inline bool lapped(const struct log_ring *ring, size_t pos)
+{
+    return (ssize_t) (pos - __atomic_load_n(&ring->tail,
+                                            __ATOMIC_ACQUIRE)) < 0;
+}
+
+/*
+ * Copy the oldest unread message (across all cores, by global sequence)
+ * into 'buf'. Returns its length, or 0 if there is nothing new or the
+ * next message is still being written.
+ */
+int log_read(struct log_cursor *cursor, char *buf, size_t size)
+{
+    struct log_ring *ring;
+    struct log_rec_hdr hdr;
+    struct log_rec_hdr best_hdr;
+    uint32_t busy_gseq = 0;
+    bool busy;
+    size_t head;
+    size_t len;
+    int best;
+    int i;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    memset(&best_hdr, 0x0, sizeof(best_hdr));
+    for (;;) {
+        best = -1;
+        busy = false;
+
+        for (i = 0; i < portNUM_PROCESSORS; i++) {
+            ring = &rings[i];
+            head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+            if (lapped(ring, cursor->pos[i])) {
+                cursor->pos[i] = __atomic_load_n(&ring->tail,
+                                                 __ATOMIC_ACQUIRE);
+            }
+
+            if (cursor->pos[i] == head) {
+                continue;
+            }
+
+            ring_get(ring, cursor->pos[i], &hdr, sizeof(hdr));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (lapped(ring, cursor->pos[i])) {
+                i--;
+                continue;
+            }
+
+            if (hdr.seq != cursor->seq[i]) {
+                cursor->dropped += hdr.seq - cursor->seq[i];
+                cursor->seq[i] = hdr.seq;
+            }
+
+            if (__atomic_load_n(rec_state(ring, cursor->pos[i]),
+                                __ATOMIC_ACQUIRE) != LOG_REC_DONE) {
+                if (!busy || ((int32_t) (hdr.gseq - busy_gseq) < 0)) {
+                    busy = true;
+                    busy_gseq = hdr.gseq;
+                }
+                continue;
+            }
+
+            if ((best < 0) || ((int32_t) (hdr.gseq - best_hdr.gseq) < 0)) {
+                best = i;
+                best_hdr = hdr;
+            }
+        }
+
+        if (cursor->dropped > 0) {
+            len = snprintf(buf, size, "[%u messages dropped]\n",
+                           (unsigned int) cursor->dropped);
+            cursor->dropped = 0;
+            return (len < size) ? len : size - 1;
+        }
+
+        // Keep the order across cores while an earlier one is unfinished
+        if ((best < 0) ||
+            (busy && ((int32_t) (busy_gseq - best_hdr.gseq) < 0))) {
+            return 0;
+        }
+
+        ring = &rings[best];
+        len = (best_hdr.len < (size - 1)) ? best_hdr.len : (size - 1);
+        ring_get(ring, cursor->pos[best] + sizeof(best_hdr), buf, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (lapped(ring, cursor->pos[best])) {
+            // Overwritten while copying, account for it and try again
+            continue;
+        }
+
+        buf[len] = '\0';
+        cursor->pos[best] += LOG_ALIGN(sizeof(best_hdr) + best_hdr.len);
+        cursor->seq[best] = best_hdr.seq + 1;
+
+        return len;
+    }
+}
+
+void log_add_waiter(TaskHandle_t task)
+{
+    int i;
+
+    portENTER_CRITICAL(&waiters_lock);
+    for (i = 0; i < LOG_MAX_WAITERS; i++) {
+        if (waiters[i] == NULL) {
+            waiters[i] = task;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&waiters_lock);
+}
+
+void log_remove_waiter(TaskHandle_t task)
+{
+    int i;
+
+    portENTER_CRITICAL(&waiters_lock);
+    for (i = 0; i < LOG_MAX_WAITERS; i++) {
+        if (waiters[i] == task) {
+            waiters[i] = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&waiters_lock);
+}
+
+void log_get_stats(struct log_stats *s)
+{
+    memcpy(s, &stats, sizeof(*s));
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,84 @@
+/*
+ * logring.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Log messages are appended to one ring per CPU core; producers never
+ * wait for consumers. Each consumer (the USB console, every TCP session)
+ * owns a cursor and reads at its own pace. A consumer that falls behind
+ * by more than a ring's worth loses the overwritten messages and gets a
+ * "[N messages dropped]" marker in their place.
+ */
+#define LOG_RING_SIZE     4096
+#define LOG_MSG_MAX       1024
+#define LOG_MAX_WAITERS   8
+
+struct log_cursor {
+    size_t pos[portNUM_PROCESSORS];
+    uint32_t seq[portNUM_PROCESSORS];
+    uint32_t dropped;
+};
+
+struct log_stats {
+    uint32_t messages;
+    uint64_t bytes;
+    uint32_t overwritten;
+    uint32_t truncated;
+    uint32_t lost;
+};
+
+extern void log_init(void);
+extern void log_write(const char *text, size_t len);
+extern int log_printf(const char *format, ...);
+extern int log_vprintf(const char *format, va_list ap);
+
+extern void log_cursor_init(struct log_cursor *cursor);
+extern int log_read(struct log_cursor *cursor, char *buf, size_t size);
+
+extern void log_add_waiter(TaskHandle_t task);
+extern void log_remove_waiter(TaskHandle_t task);
+extern void log_get_stats(struct log_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
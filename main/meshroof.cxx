@@ -5,16 +5,10 @@
  */
 
 #include <stdio.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 #include <memory>
 #include <iostream>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/queue.h>
 #include <driver/usb_serial_jtag.h>
 #include <esp_timer.h>
 #include <esp_log.h>
@@ -22,21 +16,38 @@
 #include <nvs_flash.h>
 #include <nvs.h>
 #include <meshroof.h>
+#include <mtcache.h>
+#include <pktmirror.h>
+#include <txsched.h>
+#include <dedup.h>
+#include <tseries.h>
+#include <nodetab.h>
+#include <linkgraph.h>
+#include <stuckdet.h>
 #include <MeshRoof.hxx>
 #include <MeshRoofShell.hxx>
+#include <MeshRoofConsole.hxx>
 #include "version.h"
 
 #define LED_TASK_STACK_SIZE            1024
 #define LED_TASK_PRIORITY              15
 #define MORSEBUZZER_TASK_STACK_SIZE    1536
 #define MORSEBUZZER_TASK_PRIORITY      14
+#define COMMAND_TASK_STACK_SIZE        4096
+#define COMMAND_TASK_PRIORITY          8
 #define CONSOLE_TASK_STACK_SIZE        6144
 #define CONSOLE_TASK_PRIORITY          5
 #define TCP_CONSOLE_TASK_STACK_SIZE    6144
 #define TCP_CONSOLE_TASK_PRIORITY      5
-#define BINDER_TASK_STACK_SIZE         2048
-#define BINDER_TASK_PRIORITY           4
+#define TCP_CONSOLE_PORT               16876
+#define TCP_CONSOLE_POLL_MS            50
+#define TCP_CONSOLE_RETRY_MS           5000
+#define RPC_PORT                       16877
+#define HTTP_PORT                      80
+#define MIRROR_PORT                    16878
+#define BRIDGE_PORT                    4403
 #define MESHTASTIC_TASK_PRIORITY       10
+#define MESHTASTIC_TASK_TICK_MS        1000
 
 extern void serial_init(void);
 
@@ -46,8 +57,6 @@ static const char *TAG = "meshroof";
 
 shared_ptr<MeshRoof> meshroof = NULL;
 static shared_ptr<MeshRoofShell> shell = NULL;
-static shared_ptr<MeshRoofShell> shell2 = NULL;
-static QueueHandle_t queue = NULL;
 
 static string banner = "The meshroof firmware for ESP32-S3";
 static string version = string("Version: ") + string(MYPROJECT_VERSION_STRING);
@@ -71,6 +80,13 @@ static void morsebuzzer_task(__unused void *params)
     }
 }
 
+static void command_task(__unused void *params)
+{
+    for (;;) {
+        meshroof->runCommands();
+    }
+}
+
 static void console_task(__unused void *params)
 {
     int ret;
@@ -78,105 +94,97 @@ static void console_task(__unused void *params)
     vTaskDelay(pdMS_TO_TICKS(1000));
     shell->showWelcome();
     for (;;) {
+        if (shell->busy()) {
+            shell->poll();
+            vTaskDelay(pdMS_TO_TICKS(TCP_CONSOLE_POLL_MS));
+            continue;
+        }
+
         do {
             ret = shell->process();
-        } while (ret > 0);
+        } while ((ret > 0) && !shell->busy());
 
         taskYIELD();
     }
 }
 
-static int tcp_fd = -1;
+static MeshRoofConsole console;
 
+/*
+ * One task serves the listening sockets and every client of the console,
+ * RPC, HTTP, mirror and API bridge ports; see MeshRoofConsole.
+ */
 static void tcp_console_task(__unused void *params)
 {
-    int ret;
-
-    for (;;) {
-        if (tcp_fd == -1) {
-            ret = xQueueReceive(queue, &tcp_fd, portMAX_DELAY);
-            if ((ret == pdPASS) && (tcp_fd > 0)) {
-                uint32_t ctx = 0x80000000 | tcp_fd;
-                shell2->attach((void *) ctx);
-                shell2->showWelcome();
-            }
-            continue;
-        }
+    struct console_ports ports = {
+        .console = TCP_CONSOLE_PORT,
+        .rpc = RPC_PORT,
+        .http = HTTP_PORT,
+        .mirror = MIRROR_PORT,
+        .bridge = BRIDGE_PORT,
+    };
 
-        ret = shell2->process();
-        if (ret < 0) {
-            shell2->detach();
-            close(tcp_fd);
-            tcp_fd = -1;
-        }
+    while (console.start(&ports) != 0) {
+        ESP_LOGE(TAG, "no network services, retrying");
+        vTaskDelay(pdMS_TO_TICKS(TCP_CONSOLE_RETRY_MS));
+    }
 
-        taskYIELD();
+    for (;;) {
+        console.poll(TCP_CONSOLE_POLL_MS);
     }
 }
 
-static void binder_task(__unused void *params)
+/*
+ * The modules that watch the link see each frame as serial_read() hands
+ * it to the client. Only the stuck detector needs the ones that could
+ * not be decoded.
+ */
+static void observe_stuck(const struct mt_frame *frame,
+                          const struct mt_frame_info *info, int64_t rx_us)
 {
-    int ret;
-    int server_sock = -1;
-    int client_sock = -1;
-    struct sockaddr_in addr;
-    socklen_t len;
-    static const string msg = "Too many connected clients, bye!\n";
-
-    server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_sock == -1) {
-        ESP_LOGE(TAG, "socket ret=%d", server_sock);
-        goto done;
-    }
+    (void) (frame);
+    (void) (info);
 
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(16876);
+    stuckdet_frame(rx_us);
+}
 
-    ret = bind(server_sock, (struct sockaddr *) &addr, sizeof(addr));
-    if (ret != 0) {
-        ESP_LOGE(TAG, "bind ret=%d", bind);
-        goto done;
-    }
+static void observe_cache(const struct mt_frame *frame,
+                          const struct mt_frame_info *info, int64_t rx_us)
+{
+    (void) (rx_us);
 
-    ret = listen(server_sock, 1);
-    if (ret == -1) {
-        ESP_LOGE(TAG, "listen ret=%d", ret);
-        goto done;
+    if (info != NULL) {
+        mtcache_observe(frame, info);
     }
+}
 
-    for (;;) {
-        len = sizeof(addr);
-        client_sock = accept(server_sock, (struct sockaddr *) &addr, &len);
-        if (client_sock == -1) {
-            ESP_LOGE(TAG, "accpet ret=%d\n", client_sock);
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
-        }
+static void observe_mirror(const struct mt_frame *frame,
+                           const struct mt_frame_info *info, int64_t rx_us)
+{
+    (void) (rx_us);
 
-        if (tcp_fd != -1) {
-            write(client_sock, msg.c_str(), msg.size());
-            close(client_sock);
-            client_sock = -1;
-        } else {
-            ret = xQueueSend(queue, &client_sock, 0);
-            if (ret != pdPASS) {
-                write(client_sock, msg.c_str(), msg.size());
-                close(client_sock);
-                client_sock = -1;
-            }
-        }
+    if (info != NULL) {
+        pktmirror_publish(frame);
     }
+}
 
-done:
+static void observe_txsched(const struct mt_frame *frame,
+                            const struct mt_frame_info *info, int64_t rx_us)
+{
+    (void) (rx_us);
 
-    if (server_sock != -1) {
-        close(server_sock);
+    if (info != NULL) {
+        txsched_observe(frame, info);
     }
+}
 
-    for (;;) {
-        ESP_LOGE(TAG, "binder_task is dead");
-        vTaskDelay(pdMS_TO_TICKS(60000));
+static void observe_node(const struct mt_frame *frame,
+                         const struct mt_frame_info *info, int64_t rx_us)
+{
+    (void) (frame);
+
+    if (info != NULL) {
+        meshroof->observeNode(info, rx_us);
     }
 }
 
@@ -184,6 +192,8 @@ static void meshtastic_task(__unused void *params)
 {
     int ret;
     time_t now, last_want_config, last_heartbeat;
+    struct stuckdet_stats stuck;
+    uint32_t false_positives = 0;
     esp_err_t err;
     esp_task_wdt_config_t twdt_config = {
         .timeout_ms = 15000,
@@ -205,6 +215,7 @@ static void meshtastic_task(__unused void *params)
         meshroof->saveNvm();
     }
     meshroof->applyNvmToHomeChat();
+    serial_set_baud(meshroof->getSerialBaud());
     meshroof->espWifi()->start();
 
     xTaskCreatePinnedToCore(tcp_console_task,
@@ -215,14 +226,6 @@ static void meshtastic_task(__unused void *params)
                             NULL,
                             1);
 
-    xTaskCreatePinnedToCore(binder_task,
-                            "TcpBinder",
-                            BINDER_TASK_STACK_SIZE,
-                            NULL,
-                            BINDER_TASK_PRIORITY,
-                            NULL,
-                            1);
-
     now = time(NULL);
     last_heartbeat = now;
     last_want_config = 0;
@@ -235,16 +238,45 @@ static void meshtastic_task(__unused void *params)
         now = time(NULL);
 
         if (meshroof->isConnected() &&
-            (meshroof->meshDeviceLastRecivedSecondsAgo() > 300) &&
             (meshroof->getLastResetSecsAgo() > 120)) {
-            usb_printf("detected meshtastic stuck!\n");
-            meshroof->reset();
+            switch (stuckdet_poll(esp_timer_get_time())) {
+            case STUCKDET_PROBE:
+                ret = meshroof->sendProbe();
+                if (ret == false) {
+                    TRACE("sendProbe failed!\n");
+                }
+                break;
+            case STUCKDET_RESET:
+                stuckdet_get_stats(&stuck);
+                ESP_LOGW(TAG, "radio silent for %u s (threshold %u s, "
+                         "%u false positives), resetting",
+                         (unsigned int) stuck.last_latency_s,
+                         (unsigned int) stuck.threshold_s,
+                         (unsigned int) stuck.false_positives);
+                TRACE("detected meshtastic stuck after %u s!\n",
+                      (unsigned int) stuck.last_latency_s);
+                meshroof->queueCommand(MESHROOF_CMD_RESET);
+                break;
+            default:
+                break;
+            }
+
+            stuckdet_get_stats(&stuck);
+            if (stuck.false_positives != false_positives) {
+                ESP_LOGI(TAG, "radio answered probe after %u s of silence "
+                         "(threshold %u s)",
+                         (unsigned int) stuck.last_false_s,
+                         (unsigned int) stuck.threshold_s);
+                false_positives = stuck.false_positives;
+            }
         }
 
+        meshroof->serviceLink();
+
         if (!meshroof->isConnected() && ((now - last_want_config) >= 5)) {
-            ret = meshroof->sendWantConfig();
+            ret = meshroof->probeWantConfig();
             if (ret == false) {
-                usb_printf("sendWantConfig failed!\n");
+                TRACE("sendWantConfig failed!\n");
             }
 
             last_want_config = now;
@@ -255,31 +287,38 @@ static void meshtastic_task(__unused void *params)
         if (meshroof->isConnected() && ((now - last_heartbeat) >= 60)) {
             ret = meshroof->sendHeartbeat();
             if (ret == false) {
-                usb_printf("sendHeartbeat failed!\n");
+                TRACE("sendHeartbeat failed!\n");
             }
 
             last_heartbeat = now;
         }
 
+        // Sleep until the UART has data or the next housekeeping tick
+        if (serial_rx_wait(pdMS_TO_TICKS(MESHTASTIC_TASK_TICK_MS)) <= 0) {
+            continue;
+        }
+
         while (serial_rx_ready() > 0) {
             ret = mt_serial_process(&meshroof->_mtc, 0);
             if (ret != 0) {
-                usb_printf("mt_serial_process failed!\n");
+                serial_note_decode_error();
+                TRACE("mt_serial_process failed!\n");
                 break;
             }
         }
-
-        taskYIELD();
     }
 }
 
 extern "C" void app_main(void)
 {
     esp_err_t err;
+    int i;
 
     ESP_LOGI(TAG, "meshroof.cxx app_main");
 
+    log_init();
     serial_init();
+    txsched_init();
 
     err = nvs_flash_init();
     if ((err == ESP_ERR_NVS_NO_FREE_PAGES) ||
@@ -288,6 +327,12 @@ extern "C" void app_main(void)
         err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(err);
+    mtcache_init();
+    dedup_init();
+    tseries_init();
+    nodetab_init();
+    linkgraph_init();
+    stuckdet_init();
 
     meshroof = make_shared<MeshRoof>();
     meshroof->setBanner(banner);
@@ -298,19 +343,26 @@ extern "C" void app_main(void)
     meshroof->setNvm(meshroof);
     meshroof->sendDisconnect();
 
+    serial_add_observer(observe_stuck);
+    serial_add_observer(observe_cache);
+    serial_add_observer(observe_mirror);
+    serial_add_observer(observe_txsched);
+    serial_add_observer(observe_node);
+
     shell = make_shared<MeshRoofShell>();
     shell->setClient(meshroof);
     shell->setNvm(meshroof);
     shell->attach((void *) 1);
 
-    shell2 = make_shared<MeshRoofShell>();
-    shell2->setClient(meshroof);
-    shell2->setNvm(meshroof);
-    shell2->attach((void *) 0);
-    shell2->setNoEcho(true);
-    meshroof->addPrintfCallback(shell2.get(), shell->ctx_vprintf);
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS; i++) {
+        shared_ptr<MeshRoofShell> session = make_shared<MeshRoofShell>();
 
-    queue = xQueueCreate(1, sizeof(int));
+        session->setClient(meshroof);
+        session->setNvm(meshroof);
+        session->attach((void *) 0);
+        session->setNoEcho(true);
+        console.setShell(i, session);
+    }
 
     xTaskCreatePinnedToCore(led_task,
                             "Led",
@@ -328,6 +380,13 @@ extern "C" void app_main(void)
                             MORSEBUZZER_TASK_PRIORITY,
                             NULL,
                             0);
+    xTaskCreatePinnedToCore(command_task,
+                            "Command",
+                            COMMAND_TASK_STACK_SIZE,
+                            NULL,
+                            COMMAND_TASK_PRIORITY,
+                            NULL,
+                            0);
     xTaskCreatePinnedToCore(console_task,
                             "Console",
                             CONSOLE_TASK_STACK_SIZE,
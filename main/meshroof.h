@@ -24,6 +24,8 @@
 #endif
 
 #include "serial.h"
+#include "logring.h"
+#include "trace.h"
 
 EXTERN_C_BEGIN
 
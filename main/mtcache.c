@@ -0,0 +1,473 @@
+/*
+ * mtcache.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_crc.h>
+#include <nvs.h>
+#include <mtcache.h>
+
+#define MTCACHE_MAGIC    0x4d544361
+#define MTCACHE_VERSION  2
+
+struct mtcache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t my_node_num;
+    uint32_t size;
+    uint32_t crc32;
+    uint32_t carried;
+} __attribute__((packed));
+
+/*
+ * What is to be written to NVS, copied off the cache so that the write
+ * can run on another task. No frames means erase.
+ */
+struct mtcache_snapshot {
+    struct mtcache_header header;
+    uint8_t frames[];
+};
+
+static const char *TAG = "mtcache";
+
+static uint8_t *cache = NULL;
+static size_t cache_size = 0;
+static uint32_t cache_crc32 = 0;
+static uint32_t cache_carried = 0;
+static uint8_t *capture = NULL;
+static size_t capture_size = 0;
+static uint32_t capture_my_node_num = 0;
+static bool capturing = false;
+static bool capture_overflow = false;
+static bool capture_only_config = false;
+static bool complete = false;
+static struct mtcache_stats stats;
+static SemaphoreHandle_t save_lock = NULL;
+static struct mtcache_snapshot *save_snapshot = NULL;
+static bool save_requested = false;
+
+/*
+ * Iterate over the frames stored back-to-back in a flat buffer.
+ */
+static const uint8_t *next_frame(const uint8_t *p, const uint8_t *end,
+                                 struct mt_frame *frame)
+{
+    size_t len;
+
+    if ((p + MT_FRAME_HDR_SIZE) > end) {
+        return NULL;
+    }
+
+    len = (p[2] << 8) | p[3];
+    if ((p + MT_FRAME_HDR_SIZE + len) > end) {
+        return NULL;
+    }
+
+    mt_frame_from_buffer(frame, p + MT_FRAME_HDR_SIZE, len);
+
+    return p + MT_FRAME_HDR_SIZE + len;
+}
+
+static void update_stats(void)
+{
+    const uint8_t *p = cache;
+    const uint8_t *end = cache + cache_size;
+    struct mt_frame frame;
+    struct mt_frame_info info;
+
+    stats.size = cache_size;
+    stats.frames = 0;
+    stats.node_infos = 0;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    while ((p = next_frame(p, end, &frame)) != NULL) {
+        stats.frames++;
+        if ((mt_frame_peek(&frame, &info) == 0) &&
+            (info.variant == MT_FROMRADIO_NODE_INFO)) {
+            stats.node_infos++;
+        }
+    }
+}
+
+/*
+ * Snapshot the cache for mtcache_save(), replacing one not yet written.
+ */
+static void queue_save(void)
+{
+    struct mtcache_snapshot *snapshot;
+    size_t size = 0;
+
+    if ((cache != NULL) && (cache_size <= MTCACHE_NVS_MAX_SIZE)) {
+        size = cache_size;
+    }
+
+    snapshot = (struct mtcache_snapshot *)
+        malloc(sizeof(*snapshot) + size);
+    if (snapshot == NULL) {
+        ESP_LOGE(TAG, "no memory to save the cache!");
+        return;
+    }
+
+    snapshot->header.magic = MTCACHE_MAGIC;
+    snapshot->header.version = MTCACHE_VERSION;
+    snapshot->header.my_node_num = stats.my_node_num;
+    snapshot->header.size = size;
+    snapshot->header.crc32 = cache_crc32;
+    snapshot->header.carried = cache_carried;
+    if (size > 0) {
+        memcpy(snapshot->frames, cache, size);
+    }
+
+    xSemaphoreTake(save_lock, portMAX_DELAY);
+    if (save_snapshot != NULL) {
+        free(save_snapshot);
+    }
+    save_snapshot = snapshot;
+    xSemaphoreGive(save_lock);
+
+    save_requested = true;
+}
+
+/*
+ * Write the latest snapshot to NVS. Flash writes take a while, so this
+ * runs on the command executor task, not the one draining the UART.
+ */
+void mtcache_save(void)
+{
+    esp_err_t err;
+    nvs_handle_t handle;
+    struct mtcache_snapshot *snapshot;
+
+    xSemaphoreTake(save_lock, portMAX_DELAY);
+    snapshot = save_snapshot;
+    save_snapshot = NULL;
+    xSemaphoreGive(save_lock);
+
+    if (snapshot == NULL) {
+        return;
+    }
+
+    err = nvs_open("mtcache", NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_open: %s!", esp_err_to_name(err));
+        free(snapshot);
+        return;
+    }
+
+    if (snapshot->header.size == 0) {
+        err = nvs_erase_all(handle);
+        goto done;
+    }
+
+    err = nvs_set_blob(handle, "frames", snapshot->frames,
+                       snapshot->header.size);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_set_blob: %s!", esp_err_to_name(err));
+        goto done;
+    }
+
+    err = nvs_set_blob(handle, "header", &snapshot->header,
+                       sizeof(snapshot->header));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_set_blob (header): %s!", esp_err_to_name(err));
+        goto done;
+    }
+
+done:
+
+    if (err == ESP_OK) {
+        nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+    free(snapshot);
+}
+
+/*
+ * True once after the cache changed and a snapshot awaits mtcache_save().
+ */
+bool mtcache_save_requested(void)
+{
+    bool result = save_requested;
+
+    save_requested = false;
+
+    return result;
+}
+
+void mtcache_init(void)
+{
+    esp_err_t err;
+    nvs_handle_t handle;
+    struct mtcache_header header;
+    size_t size;
+    uint8_t *buf = NULL;
+
+    memset(&stats, 0x0, sizeof(stats));
+    save_lock = xSemaphoreCreateMutex();
+
+    err = nvs_open("mtcache", NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return;
+    }
+
+    size = sizeof(header);
+    err = nvs_get_blob(handle, "header", &header, &size);
+    if ((err != ESP_OK) || (size != sizeof(header)) ||
+        (header.magic != MTCACHE_MAGIC) ||
+        (header.version != MTCACHE_VERSION) ||
+        (header.size > MTCACHE_NVS_MAX_SIZE)) {
+        goto done;
+    }
+
+    buf = (uint8_t *) malloc(MTCACHE_MAX_SIZE);
+    if (buf == NULL) {
+        goto done;
+    }
+
+    size = header.size;
+    err = nvs_get_blob(handle, "frames", buf, &size);
+    if ((err != ESP_OK) || (size != header.size) ||
+        (esp_crc32_le(0, buf, size) != header.crc32)) {
+        ESP_LOGW(TAG, "discarding stale cache");
+        goto done;
+    }
+
+    cache = buf;
+    buf = NULL;
+    cache_size = size;
+    cache_crc32 = header.crc32;
+    cache_carried = header.carried;
+    stats.my_node_num = header.my_node_num;
+    update_stats();
+
+done:
+
+    if (buf) {
+        free(buf);
+    }
+
+    nvs_close(handle);
+}
+
+/*
+ * Start capturing a download, a config-only one if the client asked
+ * with MTCACHE_NONCE_ONLY_CONFIG.
+ */
+void mtcache_begin(bool only_config)
+{
+    if (capture == NULL) {
+        capture = (uint8_t *) malloc(MTCACHE_MAX_SIZE);
+    }
+
+    capture_size = 0;
+    capture_my_node_num = 0;
+    capture_overflow = false;
+    capture_only_config = only_config;
+    capturing = (capture != NULL);
+    complete = false;
+}
+
+/*
+ * Fold a finished capture into the cache. A full download replaces it.
+ * A config-only download carries no node_info frames, so those are
+ * carried over from the previous cache and placed right after my_info as
+ * the device would send them.
+ */
+static void commit(void)
+{
+    uint8_t *merged = NULL;
+    size_t merged_size = 0;
+    const uint8_t *p;
+    const uint8_t *q;
+    const uint8_t *end;
+    struct mt_frame frame;
+    struct mt_frame_info info;
+    uint32_t carried = cache_carried;
+    uint32_t crc;
+
+    if (capture_overflow) {
+        ESP_LOGW(TAG, "download exceeds %d bytes, not cached",
+                 MTCACHE_MAX_SIZE);
+        return;
+    }
+
+    if (!capture_only_config || (cache == NULL) ||
+        (capture_my_node_num != stats.my_node_num)) {
+        merged = capture;
+        merged_size = capture_size;
+        capture = NULL;
+        cache_carried = 0;
+    } else {
+        merged = (uint8_t *) malloc(MTCACHE_MAX_SIZE);
+        if (merged == NULL) {
+            return;
+        }
+
+        p = capture;
+        end = capture + capture_size;
+        while ((q = next_frame(p, end, &frame)) != NULL) {
+            memcpy(merged + merged_size, p, q - p);
+            merged_size += q - p;
+
+            if ((mt_frame_peek(&frame, &info) == 0) &&
+                (info.variant == MT_FROMRADIO_MY_INFO)) {
+                const uint8_t *cp = cache;
+                const uint8_t *cq;
+                const uint8_t *cend = cache + cache_size;
+                struct mt_frame cframe;
+                struct mt_frame_info cinfo;
+
+                while ((cq = next_frame(cp, cend, &cframe)) != NULL) {
+                    if ((mt_frame_peek(&cframe, &cinfo) == 0) &&
+                        (cinfo.variant == MT_FROMRADIO_NODE_INFO) &&
+                        ((merged_size + (cq - cp)) <=
+                         (MTCACHE_MAX_SIZE - (end - q)))) {
+                        memcpy(merged + merged_size, cp, cq - cp);
+                        merged_size += cq - cp;
+                    }
+                    cp = cq;
+                }
+            }
+
+            p = q;
+        }
+        cache_carried++;
+    }
+
+    if (cache != NULL) {
+        free(cache);
+    }
+
+    cache = merged;
+    cache_size = merged_size;
+    stats.my_node_num = capture_my_node_num;
+    stats.commits++;
+    update_stats();
+
+    crc = esp_crc32_le(0, cache, cache_size);
+    if ((crc != cache_crc32) || (cache_carried != carried)) {
+        cache_crc32 = crc;
+        queue_save();
+    }
+}
+
+void mtcache_observe(const struct mt_frame *frame,
+                     const struct mt_frame_info *info)
+{
+    if ((info->variant == MT_FROMRADIO_MY_INFO) &&
+        (cache != NULL) && (stats.my_node_num != 0) &&
+        (info->my_node_num != stats.my_node_num)) {
+        ESP_LOGW(TAG, "device changed, invalidating cache");
+        mtcache_invalidate();
+    }
+
+    if (!capturing) {
+        return;
+    }
+
+    switch (info->variant) {
+    case MT_FROMRADIO_MY_INFO:
+        capture_my_node_num = info->my_node_num;
+        break;
+    case MT_FROMRADIO_NODE_INFO:
+    case MT_FROMRADIO_CONFIG:
+    case MT_FROMRADIO_CONFIG_COMPLETE:
+    case MT_FROMRADIO_MODULE_CONFIG:
+    case MT_FROMRADIO_CHANNEL:
+    case MT_FROMRADIO_METADATA:
+        break;
+    default:
+        return;
+    }
+
+    if ((capture_size + MT_FRAME_HDR_SIZE + frame->len) > MTCACHE_MAX_SIZE) {
+        capture_overflow = true;
+    } else {
+        capture[capture_size++] = MT_FRAME_START1;
+        capture[capture_size++] = MT_FRAME_START2;
+        capture[capture_size++] = (frame->len >> 8) & 0xff;
+        capture[capture_size++] = frame->len & 0xff;
+        capture_size += mt_frame_read(frame, 0, capture + capture_size,
+                                      frame->len);
+    }
+
+    if (info->variant == MT_FROMRADIO_CONFIG_COMPLETE) {
+        capturing = false;
+        complete = true;
+        commit();
+    }
+}
+
+bool mtcache_complete(void)
+{
+    bool result = complete;
+
+    complete = false;
+
+    return result;
+}
+
+bool mtcache_valid(void)
+{
+    return (cache != NULL) && (cache_size > 0);
+}
+
+/*
+ * Whether the cached node_info frames already outlived a config-only
+ * download, after which the next one must be a full download.
+ */
+bool mtcache_stale(void)
+{
+    return cache_carried >= MTCACHE_MAX_CARRIED;
+}
+
+void mtcache_invalidate(void)
+{
+    if (cache != NULL) {
+        free(cache);
+        cache = NULL;
+    }
+
+    cache_size = 0;
+    cache_crc32 = 0;
+    cache_carried = 0;
+    stats.my_node_num = 0;
+    stats.invalidations++;
+    update_stats();
+    queue_save();
+}
+
+const uint8_t *mtcache_data(size_t *size)
+{
+    *size = cache_size;
+    if (cache != NULL) {
+        stats.replays++;
+    }
+
+    return cache;
+}
+
+void mtcache_get_stats(struct mtcache_stats *s)
+{
+    memcpy(s, &stats, sizeof(*s));
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,69 @@
+/*
+ * mtcache.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MTCACHE_H
+#define MTCACHE_H
+
+#include <mtframe.h>
+
+EXTERN_C_BEGIN
+
+/*
+ * Cache of the FromRadio frames (my_info, node_info, channels, config,
+ * metadata, ...) received during the last want_config download, kept as
+ * framed bytes so that they can be replayed into the client after a reset.
+ */
+#define MTCACHE_MAX_SIZE       24576
+#define MTCACHE_NVS_MAX_SIZE   8192
+
+/*
+ * want_config_id nonce which asks the device to skip the node database
+ * and only send configuration.
+ */
+#define MTCACHE_NONCE_ONLY_CONFIG  69420
+
+/*
+ * How many config-only downloads the cached node_info frames may be
+ * carried across before the node database is downloaded in full again.
+ */
+#define MTCACHE_MAX_CARRIED        1
+
+struct mtcache_stats {
+    size_t size;
+    unsigned int frames;
+    unsigned int node_infos;
+    uint32_t my_node_num;
+    unsigned int commits;
+    unsigned int replays;
+    unsigned int invalidations;
+};
+
+extern void mtcache_init(void);
+extern void mtcache_begin(bool only_config);
+extern void mtcache_observe(const struct mt_frame *frame,
+                            const struct mt_frame_info *info);
+extern bool mtcache_complete(void);
+extern bool mtcache_valid(void);
+extern bool mtcache_stale(void);
+extern void mtcache_invalidate(void);
+extern const uint8_t *mtcache_data(size_t *size);
+extern void mtcache_get_stats(struct mtcache_stats *stats);
+extern bool mtcache_save_requested(void);
+extern void mtcache_save(void);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,507 @@
+/*
+ * mtframe.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <string.h>
+#include <mtframe.h>
+
+static inline size_t ring_mask(const struct mt_ring *ring, size_t pos)
+{
+    return pos & (ring->size - 1);
+}
+
+static inline uint8_t ring_peek(const struct mt_ring *ring, size_t idx)
+{
+    return ring->buf[ring_mask(ring, ring->tail + idx)];
+}
+
+void mt_ring_init(struct mt_ring *ring, uint8_t *buf, size_t size)
+{
+    memset(ring, 0x0, sizeof(*ring));
+    ring->buf = buf;
+    ring->size = size;
+}
+
+size_t mt_ring_used(const struct mt_ring *ring)
+{
+    return ring->head - ring->tail;
+}
+
+/*
+ * Return the largest contiguous free region at the head of the ring so
+ * that the caller can read from the driver straight into it.
+ */
+size_t mt_ring_write_ptr(struct mt_ring *ring, uint8_t **ptr)
+{
+    size_t off = ring_mask(ring, ring->head);
+    size_t space = ring->size - mt_ring_used(ring);
+    size_t contig = ring->size - off;
+
+    *ptr = ring->buf + off;
+
+    return (space < contig) ? space : contig;
+}
+
+void mt_ring_commit(struct mt_ring *ring, size_t len)
+{
+    ring->head += len;
+}
+
+/*
+ * Give up on the frame at the tail (truncated or undecodable); the next
+ * call to mt_frame_next() searches for a start marker after it.
+ */
+void mt_ring_resync(struct mt_ring *ring)
+{
+    if (mt_ring_used(ring) > 0) {
+        ring->tail++;
+        ring->dropped++;
+        ring->resyncs++;
+    }
+}
+
+/*
+ * Find the next start marker, skipping garbage with memchr() over at most
+ * two contiguous regions. Returns the number of bytes skipped.
+ */
+static size_t ring_skip_to_marker(struct mt_ring *ring)
+{
+    size_t used = mt_ring_used(ring);
+    size_t off = ring_mask(ring, ring->tail);
+    size_t contig = ring->size - off;
+    const uint8_t *p;
+    size_t skip;
+
+    if (contig > used) {
+        contig = used;
+    }
+
+    p = memchr(ring->buf + off, MT_FRAME_START1, contig);
+    if (p != NULL) {
+        skip = p - (ring->buf + off);
+    } else if (contig < used) {
+        p = memchr(ring->buf, MT_FRAME_START1, used - contig);
+        skip = (p != NULL) ? (contig + (p - ring->buf)) : used;
+    } else {
+        skip = used;
+    }
+
+    if (skip > 0) {
+        ring->tail += skip;
+        ring->dropped += skip;
+        ring->resyncs++;
+    }
+
+    return skip;
+}
+
+int mt_frame_next(struct mt_ring *ring, struct mt_frame *frame)
+{
+    size_t used;
+    size_t len;
+    size_t off;
+    size_t contig;
+
+    for (;;) {
+        ring_skip_to_marker(ring);
+
+        used = mt_ring_used(ring);
+        if (used < 2) {
+            return 0;
+        }
+
+        if (ring_peek(ring, 1) != MT_FRAME_START2) {
+            ring->tail++;
+            ring->dropped++;
+            continue;
+        }
+
+        if (used < MT_FRAME_HDR_SIZE) {
+            return 0;
+        }
+
+        len = (ring_peek(ring, 2) << 8) | ring_peek(ring, 3);
+        if (len > MT_FRAME_MAX_PAYLOAD) {
+            ring->tail++;
+            ring->dropped++;
+            ring->oversized++;
+            continue;
+        }
+
+        if (used < (MT_FRAME_HDR_SIZE + len)) {
+            return 0;
+        }
+
+        break;
+    }
+
+    off = ring_mask(ring, ring->tail + MT_FRAME_HDR_SIZE);
+    contig = ring->size - off;
+    frame->len = len;
+    frame->seg[0] = ring->buf + off;
+    if (len <= contig) {
+        frame->seg_len[0] = len;
+        frame->seg[1] = NULL;
+        frame->seg_len[1] = 0;
+    } else {
+        frame->seg_len[0] = contig;
+        frame->seg[1] = ring->buf;
+        frame->seg_len[1] = len - contig;
+    }
+
+    return 1;
+}
+
+void mt_frame_consume(struct mt_ring *ring, const struct mt_frame *frame)
+{
+    ring->tail += MT_FRAME_HDR_SIZE + frame->len;
+}
+
+size_t mt_frame_read(const struct mt_frame *frame, size_t offset,
+                     void *dst, size_t len)
+{
+    uint8_t *d = (uint8_t *) dst;
+    size_t n = 0;
+    size_t chunk;
+
+    if (offset >= frame->len) {
+        return 0;
+    }
+
+    if (len > (frame->len - offset)) {
+        len = frame->len - offset;
+    }
+
+    if (offset < frame->seg_len[0]) {
+        chunk = frame->seg_len[0] - offset;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(d, frame->seg[0] + offset, chunk);
+        n += chunk;
+        offset += chunk;
+    }
+
+    if (n < len) {
+        memcpy(d + n, frame->seg[1] + (offset - frame->seg_len[0]), len - n);
+        n = len;
+    }
+
+    return n;
+}
+
+static bool mt_frame_pb_read(pb_istream_t *stream, pb_byte_t *buf,
+                             size_t count)
+{
+    struct mt_frame_cursor *cursor = (struct mt_frame_cursor *) stream->state;
+    size_t n;
+
+    if (buf == NULL) {
+        n = count;
+    } else {
+        n = mt_frame_read(cursor->frame, cursor->offset, buf, count);
+    }
+
+    cursor->offset += n;
+
+    return n == count;
+}
+
+/*
+ * Set up a nanopb input stream over the frame payload. A contiguous frame
+ * is decoded directly from the ring; a wrapped one goes through a callback
+ * that walks both segments.
+ */
+void mt_frame_istream(const struct mt_frame *frame,
+                      struct mt_frame_cursor *cursor,
+                      pb_istream_t *stream)
+{
+    if (frame->seg_len[1] == 0) {
+        *stream = pb_istream_from_buffer(frame->seg[0], frame->len);
+        return;
+    }
+
+    cursor->frame = frame;
+    cursor->offset = 0;
+    memset(stream, 0x0, sizeof(*stream));
+    stream->callback = mt_frame_pb_read;
+    stream->state = cursor;
+    stream->bytes_left = frame->len;
+}
+
+void mt_frame_from_buffer(struct mt_frame *frame,
+                          const uint8_t *buf, size_t len)
+{
+    frame->seg[0] = buf;
+    frame->seg_len[0] = len;
+    frame->seg[1] = NULL;
+    frame->seg_len[1] = 0;
+    frame->len = len;
+}
+
+static bool peek_data(pb_istream_t *stream, struct mt_frame_info *info)
+{
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+    uint64_t value;
+
+    while (pb_decode_tag(stream, &wire_type, &tag, &eof)) {
+        if ((tag == 1) && (wire_type == PB_WT_VARINT)) {
+            if (!pb_decode_varint(stream, &value)) {
+                return false;
+            }
+            info->portnum = (uint32_t) value;
+        } else if (!pb_skip_field(stream, wire_type)) {
+            return false;
+        }
+    }
+
+    return eof;
+}
+
+static bool peek_packet(pb_istream_t *stream, struct mt_frame_info *info)
+{
+    pb_istream_t substream;
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+    uint32_t snr;
+    uint64_t value;
+    uint64_t hop_limit = 0;
+    uint64_t hop_start = 0;
+
+    while (pb_decode_tag(stream, &wire_type, &tag, &eof)) {
+        if ((tag == 1) && (wire_type == PB_WT_32BIT)) {
+            if (!pb_decode_fixed32(stream, &info->from)) {
+                return false;
+            }
+        } else if ((tag == 2) && (wire_type == PB_WT_32BIT)) {
+            if (!pb_decode_fixed32(stream, &info->to)) {
+                return false;
+            }
+        } else if ((tag == 6) && (wire_type == PB_WT_32BIT)) {
+            if (!pb_decode_fixed32(stream, &info->id)) {
+                return false;
+            }
+        } else if ((tag == 8) && (wire_type == PB_WT_32BIT)) {
+            if (!pb_decode_fixed32(stream, &snr)) {
+                return false;
+            }
+            memcpy(&info->rx_snr, &snr, sizeof(info->rx_snr));
+        } else if ((tag == 9) && (wire_type == PB_WT_VARINT)) {
+            if (!pb_decode_varint(stream, &hop_limit)) {
+                return false;
+            }
+        } else if ((tag == 12) && (wire_type == PB_WT_VARINT)) {
+            if (!pb_decode_varint(stream, &value)) {
+                return false;
+            }
+            info->rx_rssi = (int32_t) value;
+        } else if ((tag == 15) && (wire_type == PB_WT_VARINT)) {
+            if (!pb_decode_varint(stream, &hop_start)) {
+                return false;
+            }
+        } else if ((tag == 4) && (wire_type == PB_WT_STRING)) {
+            if (!pb_make_string_substream(stream, &substream)) {
+                return false;
+            }
+            if (!peek_data(&substream, info)) {
+                return false;
+            }
+            if (!pb_close_string_substream(stream, &substream)) {
+                return false;
+            }
+        } else if (!pb_skip_field(stream, wire_type)) {
+            return false;
+        }
+    }
+
+    // Firmware older than 2.3 does not fill in hop_start
+    if ((hop_start != 0) && (hop_start >= hop_limit)) {
+        info->hops = (uint8_t) (hop_start - hop_limit);
+    }
+
+    return eof;
+}
+
+static bool peek_user(pb_istream_t *stream, struct mt_frame_info *info)
+{
+    pb_istream_t substream;
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+    size_t len;
+    bool ok;
+
+    while (pb_decode_tag(stream, &wire_type, &tag, &eof)) {
+        if ((tag == 3) && (wire_type == PB_WT_STRING)) {
+            if (!pb_make_string_substream(stream, &substream)) {
+                return false;
+            }
+            len = substream.bytes_left;
+            if (len >= sizeof(info->short_name)) {
+                len = sizeof(info->short_name) - 1;
+            }
+            memset(info->short_name, 0x0, sizeof(info->short_name));
+            ok = pb_read(&substream, (pb_byte_t *) info->short_name, len);
+            if (!pb_close_string_substream(stream, &substream) || !ok) {
+                return false;
+            }
+        } else if (!pb_skip_field(stream, wire_type)) {
+            return false;
+        }
+    }
+
+    return eof;
+}
+
+static bool peek_node_info(pb_istream_t *stream, struct mt_frame_info *info)
+{
+    pb_istream_t substream;
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+    uint32_t snr;
+    uint64_t value;
+
+    while (pb_decode_tag(stream, &wire_type, &tag, &eof)) {
+        if ((tag == 1) && (wire_type == PB_WT_VARINT)) {
+            if (!pb_decode_varint(stream, &value)) {
+                return false;
+            }
+            info->from = (uint32_t) value;
+        } else if ((tag == 2) && (wire_type == PB_WT_STRING)) {
+            if (!pb_make_string_substream(stream, &substream)) {
+                return false;
+            }
+            if (!peek_user(&substream, info)) {
+                return false;
+            }
+            if (!pb_close_string_substream(stream, &substream)) {
+                return false;
+            }
+        } else if ((tag == 4) && (wire_type == PB_WT_32BIT)) {
+            if (!pb_decode_fixed32(stream, &snr)) {
+                return false;
+            }
+            memcpy(&info->rx_snr, &snr, sizeof(info->rx_snr));
+        } else if ((tag == 9) && (wire_type == PB_WT_VARINT)) {
+            if (!pb_decode_varint(stream, &value)) {
+                return false;
+            }
+            info->hops = (value < MT_HOPS_UNKNOWN) ?
+                (uint8_t) value : MT_HOPS_UNKNOWN;
+        } else if (!pb_skip_field(stream, wire_type)) {
+            return false;
+        }
+    }
+
+    return eof;
+}
+
+static bool peek_my_info(pb_istream_t *stream, struct mt_frame_info *info)
+{
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+    uint64_t value;
+
+    while (pb_decode_tag(stream, &wire_type, &tag, &eof)) {
+        if ((tag == 1) && (wire_type == PB_WT_VARINT)) {
+            if (!pb_decode_varint(stream, &value)) {
+                return false;
+            }
+            info->my_node_num = (uint32_t) value;
+        } else if (!pb_skip_field(stream, wire_type)) {
+            return false;
+        }
+    }
+
+    return eof;
+}
+
+/*
+ * Walk the top level of an encoded FromRadio in place and fill in 'info'.
+ * Returns 0 on success, -1 if the payload is not a valid protobuf.
+ */
+int mt_frame_peek(const struct mt_frame *frame, struct mt_frame_info *info)
+{
+    struct mt_frame_cursor cursor;
+    pb_istream_t stream;
+    pb_istream_t substream;
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof = false;
+    bool ok = true;
+    uint64_t value = 0;
+
+    memset(info, 0x0, sizeof(*info));
+    info->hops = MT_HOPS_UNKNOWN;
+    mt_frame_istream(frame, &cursor, &stream);
+
+    while (ok && pb_decode_tag(&stream, &wire_type, &tag, &eof)) {
+        if (tag == 1) {
+            ok = pb_skip_field(&stream, wire_type);
+            continue;
+        }
+
+        info->variant = tag;
+        if ((tag == MT_FROMRADIO_CONFIG_COMPLETE) &&
+            (wire_type == PB_WT_VARINT)) {
+            ok = pb_decode_varint(&stream, &value);
+            info->config_complete_id = (uint32_t) value;
+        } else if (((tag == MT_FROMRADIO_PACKET) ||
+                    (tag == MT_FROMRADIO_MY_INFO) ||
+                    (tag == MT_FROMRADIO_NODE_INFO)) &&
+                   (wire_type == PB_WT_STRING)) {
+            ok = pb_make_string_substream(&stream, &substream);
+            if (ok) {
+                if (tag == MT_FROMRADIO_PACKET) {
+                    ok = peek_packet(&substream, info);
+                } else if (tag == MT_FROMRADIO_MY_INFO) {
+                    ok = peek_my_info(&substream, info);
+                } else {
+                    ok = peek_node_info(&substream, info);
+                }
+            }
+            if (ok) {
+                ok = pb_close_string_substream(&stream, &substream);
+            }
+        } else {
+            ok = pb_skip_field(&stream, wire_type);
+        }
+    }
+
+    return (ok && eof) ? 0 : -1;
+}
+
+/*
+ * Return the payload variant of an encoded ToRadio (its first field).
+ */
+int mt_frame_toradio_variant(const struct mt_frame *frame, uint32_t *variant)
+{
+    struct mt_frame_cursor cursor;
+    pb_istream_t stream;
+    pb_wire_type_t wire_type;
+    bool eof;
+
+    mt_frame_istream(frame, &cursor, &stream);
+    if (!pb_decode_tag(&stream, &wire_type, variant, &eof)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
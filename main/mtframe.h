@@ -0,0 +1,147 @@
+/*
+ * mtframe.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MTFRAME_H
+#define MTFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pb_decode.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Meshtastic stream framing: 0x94 0xc3 <len MSB> <len LSB> <protobuf>
+ */
+#define MT_FRAME_START1       0x94
+#define MT_FRAME_START2       0xc3
+#define MT_FRAME_HDR_SIZE     4
+#define MT_FRAME_MAX_PAYLOAD  512
+
+/*
+ * Byte ring that the UART driver reads into directly. The size must be a
+ * power of two; head and tail are free-running and masked on access.
+ */
+struct mt_ring {
+    uint8_t *buf;
+    size_t size;
+    size_t head;
+    size_t tail;
+
+    unsigned int resyncs;
+    unsigned int dropped;
+    unsigned int oversized;
+};
+
+/*
+ * A view of one complete frame payload still sitting in the ring. When the
+ * payload wraps around the end of the ring it is split in two segments.
+ */
+struct mt_frame {
+    const uint8_t *seg[2];
+    size_t seg_len[2];
+    size_t len;
+};
+
+/*
+ * FromRadio payload variants (field numbers in mesh.proto).
+ */
+#define MT_FROMRADIO_PACKET            2
+#define MT_FROMRADIO_MY_INFO           3
+#define MT_FROMRADIO_NODE_INFO         4
+#define MT_FROMRADIO_CONFIG            5
+#define MT_FROMRADIO_LOG_RECORD        6
+#define MT_FROMRADIO_CONFIG_COMPLETE   7
+#define MT_FROMRADIO_REBOOTED          8
+#define MT_FROMRADIO_MODULE_CONFIG     9
+#define MT_FROMRADIO_CHANNEL           10
+#define MT_FROMRADIO_QUEUE_STATUS      11
+#define MT_FROMRADIO_METADATA          13
+
+/*
+ * ToRadio payload variants.
+ */
+#define MT_TORADIO_PACKET              1
+#define MT_TORADIO_WANT_CONFIG_ID      3
+#define MT_TORADIO_DISCONNECT          4
+#define MT_TORADIO_HEARTBEAT           7
+
+/*
+ * The few fields that the firmware needs to route a frame, pulled out of
+ * the encoded FromRadio without decoding the whole message. For a
+ * node_info 'from' is the node described.
+ */
+#define MT_HOPS_UNKNOWN  0xff
+
+struct mt_frame_info {
+    uint32_t variant;
+    uint32_t my_node_num;
+    uint32_t config_complete_id;
+    uint32_t from;
+    uint32_t to;
+    uint32_t id;
+    uint32_t portnum;
+    float rx_snr;
+    int32_t rx_rssi;
+    uint8_t hops;
+    char short_name[5];
+};
+
+struct mt_frame_cursor {
+    const struct mt_frame *frame;
+    size_t offset;
+};
+
+extern void mt_ring_init(struct mt_ring *ring, uint8_t *buf, size_t size);
+extern size_t mt_ring_used(const struct mt_ring *ring);
+extern size_t mt_ring_write_ptr(struct mt_ring *ring, uint8_t **ptr);
+extern void mt_ring_commit(struct mt_ring *ring, size_t len);
+extern void mt_ring_resync(struct mt_ring *ring);
+
+extern int mt_frame_next(struct mt_ring *ring, struct mt_frame *frame);
+extern void mt_frame_consume(struct mt_ring *ring,
+                             const struct mt_frame *frame);
+extern size_t mt_frame_read(const struct mt_frame *frame, size_t offset,
+                            void *dst, size_t len);
+extern void mt_frame_from_buffer(struct mt_frame *frame,
+                                 const uint8_t *buf, size_t len);
+extern int mt_frame_peek(const struct mt_frame *frame,
+                         struct mt_frame_info *info);
+extern int mt_frame_toradio_variant(const struct mt_frame *frame,
+                                    uint32_t *variant);
+extern void mt_frame_istream(const struct mt_frame *frame,
+                             struct mt_frame_cursor *cursor,
+                             pb_istream_t *stream);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,294 @@
+/*
+ * nodetab.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <string.h>
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#else
+/* Host builds (misc/nodebench.c) are single-threaded */
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  0
+#define portENTER_CRITICAL(lock)      ((void) (lock))
+#define portEXIT_CRITICAL(lock)       ((void) (lock))
+#endif
+#include <nodetab.h>
+
+#define NODETAB_MASK  (NODETAB_SLOTS - 1)
+
+static struct nodetab_entry table[NODETAB_SLOTS];
+static unsigned int count = 0;
+static struct nodetab_stats stats;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline unsigned int nodetab_hash(uint32_t node_num)
+{
+    uint32_t h = node_num * 0x9e3779b1;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+
+    return h & NODETAB_MASK;
+}
+
+void nodetab_init(void)
+{
+    portENTER_CRITICAL(&lock);
+    memset(table, 0x0, sizeof(table));
+    memset(&stats, 0x0, sizeof(stats));
+    count = 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+static struct nodetab_entry *nodetab_find(uint32_t node_num)
+{
+    unsigned int i = nodetab_hash(node_num);
+
+    while (table[i].node_num != 0) {
+        if (table[i].node_num == node_num) {
+            return &table[i];
+        }
+        i = (i + 1) & NODETAB_MASK;
+    }
+
+    return NULL;
+}
+
+/*
+ * Empty slot 'i' and shift back the entries after it that probed past
+ * it, so that lookups never need tombstones.
+ */
+static void nodetab_remove(unsigned int i)
+{
+    unsigned int j = i;
+    unsigned int home;
+
+    for (;;) {
+        j = (j + 1) & NODETAB_MASK;
+        if (table[j].node_num == 0) {
+            break;
+        }
+
+        home = nodetab_hash(table[j].node_num);
+        if (((j > i) && ((home <= i) || (home > j))) ||
+            ((j < i) && ((home <= i) && (home > j)))) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+
+    memset(&table[i], 0x0, sizeof(table[i]));
+    count--;
+}
+
+/*
+ * Find or add 'node_num', evicting the unflagged node heard from least
+ * recently when the table is full.
+ */
+static struct nodetab_entry *nodetab_claim(uint32_t node_num)
+{
+    struct nodetab_entry *entry;
+    int victim = -1;
+    unsigned int i;
+
+    entry = nodetab_find(node_num);
+    if (entry != NULL) {
+        return entry;
+    }
+
+    if (count >= NODETAB_MAX_NODES) {
+        for (i = 0; i < NODETAB_SLOTS; i++) {
+            if ((table[i].node_num == 0) || (table[i].flags != 0)) {
+                continue;
+            }
+            if ((victim < 0) ||
+                (table[i].last_heard_s < table[victim].last_heard_s)) {
+                victim = i;
+            }
+        }
+        if (victim < 0) {
+            stats.full++;
+            return NULL;
+        }
+        nodetab_remove(victim);
+        stats.evictions++;
+    }
+
+    i = nodetab_hash(node_num);
+    while (table[i].node_num != 0) {
+        i = (i + 1) & NODETAB_MASK;
+    }
+
+    entry = &table[i];
+    memset(entry, 0x0, sizeof(*entry));
+    entry->node_num = node_num;
+    entry->snr4 = NODETAB_SNR_UNKNOWN;
+    entry->hops = NODETAB_HOPS_UNKNOWN;
+    count++;
+
+    return entry;
+}
+
+/*
+ * A packet from 'node_num' was received.
+ */
+void nodetab_heard(uint32_t node_num, uint32_t now_s, int8_t snr4,
+                   int16_t rssi, uint8_t hops)
+{
+    struct nodetab_entry *entry;
+
+    if ((node_num == 0) || (node_num == UINT32_MAX)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+    entry = nodetab_claim(node_num);
+    if (entry != NULL) {
+        entry->last_heard_s = (now_s != 0) ? now_s : 1;
+        entry->packets++;
+        if (snr4 != NODETAB_SNR_UNKNOWN) {
+            entry->snr4 = snr4;
+            entry->rssi = rssi;
+        }
+        if (hops != NODETAB_HOPS_UNKNOWN) {
+            entry->hops = hops;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * The radio's node database described 'node_num'. Its link figures are
+ * only used until the node is heard directly.
+ */
+void nodetab_named(uint32_t node_num, const char *short_name, int8_t snr4,
+                   uint8_t hops)
+{
+    struct nodetab_entry *entry;
+
+    if ((node_num == 0) || (node_num == UINT32_MAX)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+    entry = nodetab_claim(node_num);
+    if (entry != NULL) {
+        if ((short_name != NULL) && (short_name[0] != '\0')) {
+            strncpy(entry->short_name, short_name,
+                    sizeof(entry->short_name) - 1);
+        }
+        if (entry->last_heard_s == 0) {
+            entry->snr4 = snr4;
+            entry->hops = hops;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+bool nodetab_lookup(uint32_t node_num, struct nodetab_entry *entry)
+{
+    const struct nodetab_entry *found;
+
+    portENTER_CRITICAL(&lock);
+    stats.lookups++;
+    found = (node_num != 0) ? nodetab_find(node_num) : NULL;
+    if (found != NULL) {
+        stats.hits++;
+        if (entry != NULL) {
+            memcpy(entry, found, sizeof(*entry));
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    return found != NULL;
+}
+
+void nodetab_set_flags(uint32_t node_num, uint8_t flags)
+{
+    struct nodetab_entry *entry;
+
+    if (node_num == 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+    entry = nodetab_claim(node_num);
+    if (entry != NULL) {
+        entry->flags |= flags;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void nodetab_clear_flags(uint8_t flags)
+{
+    unsigned int i;
+
+    portENTER_CRITICAL(&lock);
+    for (i = 0; i < NODETAB_SLOTS; i++) {
+        table[i].flags &= ~flags;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * True if 'a' sorts before 'b': heard more recently, then by node number.
+ */
+static inline bool nodetab_before(const struct nodetab_entry *a,
+                                  const struct nodetab_entry *b)
+{
+    return (a->last_heard_s > b->last_heard_s) ||
+        ((a->last_heard_s == b->last_heard_s) && (a->node_num < b->node_num));
+}
+
+/*
+ * Walk the table most recently heard first without a sort buffer: pass
+ * NULL for the first entry, then the entry last returned.
+ */
+bool nodetab_next(const struct nodetab_entry *prev,
+                  struct nodetab_entry *next)
+{
+    const struct nodetab_entry *best = NULL;
+    unsigned int i;
+
+    portENTER_CRITICAL(&lock);
+    for (i = 0; i < NODETAB_SLOTS; i++) {
+        if (table[i].node_num == 0) {
+            continue;
+        }
+        if ((prev != NULL) && !nodetab_before(prev, &table[i])) {
+            continue;
+        }
+        if ((best == NULL) || nodetab_before(&table[i], best)) {
+            best = &table[i];
+        }
+    }
+    if (best != NULL) {
+        memcpy(next, best, sizeof(*next));
+    }
+    portEXIT_CRITICAL(&lock);
+
+    return best != NULL;
+}
+
+void nodetab_get_stats(struct nodetab_stats *s)
+{
+    portENTER_CRITICAL(&lock);
+    memcpy(s, &stats, sizeof(*s));
+    s->nodes = count;
+    s->capacity = NODETAB_MAX_NODES;
+    s->memory = sizeof(table);
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
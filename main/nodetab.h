@@ -0,0 +1,98 @@
+/*
+ * nodetab.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef NODETAB_H
+#define NODETAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * What we know about each node heard on the mesh, in fixed 24-byte
+ * records kept in one linear-probing hash table. At most NODETAB_MAX_NODES
+ * are kept; a new node then replaces the one heard from least recently,
+ * except that admins and mates are never evicted. The sizes may be
+ * overridden at build time; NODETAB_SLOTS must be a power of two.
+ */
+#if !defined(NODETAB_SLOTS)
+#define NODETAB_SLOTS      256
+#endif
+#if !defined(NODETAB_MAX_NODES)
+#define NODETAB_MAX_NODES  ((NODETAB_SLOTS * 3) / 4)
+#endif
+
+#define NODETAB_ADMIN      0x01
+#define NODETAB_MATE       0x02
+
+#define NODETAB_HOPS_UNKNOWN  0xff
+#define NODETAB_SNR_UNKNOWN   INT8_MIN
+
+struct nodetab_entry {
+    uint32_t node_num;
+    uint32_t last_heard_s;      /* Uptime, 0 if not heard since boot */
+    uint32_t packets;
+    int16_t rssi;
+    int8_t snr4;                /* SNR in 0.25 dB */
+    uint8_t hops;
+    uint8_t flags;
+    char short_name[5];
+    uint8_t reserved[2];
+};
+
+struct nodetab_stats {
+    unsigned int nodes;
+    unsigned int capacity;
+    uint32_t lookups;
+    uint32_t hits;
+    uint32_t evictions;
+    uint32_t full;
+    size_t memory;
+};
+
+extern void nodetab_init(void);
+extern void nodetab_heard(uint32_t node_num, uint32_t now_s, int8_t snr4,
+                          int16_t rssi, uint8_t hops);
+extern void nodetab_named(uint32_t node_num, const char *short_name,
+                          int8_t snr4, uint8_t hops);
+extern bool nodetab_lookup(uint32_t node_num, struct nodetab_entry *entry);
+extern void nodetab_set_flags(uint32_t node_num, uint8_t flags);
+extern void nodetab_clear_flags(uint8_t flags);
+extern bool nodetab_next(const struct nodetab_entry *prev,
+                         struct nodetab_entry *next);
+extern void nodetab_get_stats(struct nodetab_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,205 @@
+/*
+ * outbuf.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <esp_timer.h>
+#include <outbuf.h>
+
+void outbuf_init(struct outbuf *ob, char *buf, size_t size)
+{
+    ob->buf = buf;
+    ob->size = size;
+    ob->len = 0;
+    ob->dropped = 0;
+    ob->unreported = 0;
+}
+
+static void outbuf_drop(struct outbuf *ob, size_t len)
+{
+    ob->dropped += len;
+    ob->unreported += len;
+}
+
+/*
+ * Send as much as the socket takes without waiting. Once everything is
+ * out, the note about dropped output is queued in its place. Returns -1
+ * only if the connection failed.
+ */
+int outbuf_send(struct outbuf *ob, int fd)
+{
+    int ret;
+
+    if (fd == -1) {
+        ob->len = 0;
+        ob->unreported = 0;
+        return 0;
+    }
+
+    for (;;) {
+        if ((ob->len == 0) && (ob->unreported > 0)) {
+            ret = snprintf(ob->buf, ob->size,
+                           "\n[%u bytes of output dropped]\n",
+                           (unsigned int) ob->unreported);
+            ob->len = ((size_t) ret < ob->size) ? (size_t) ret : 0;
+            ob->unreported = 0;
+        }
+
+        if (ob->len == 0) {
+            return 0;
+        }
+
+        ret = send(fd, ob->buf, ob->len, MSG_DONTWAIT);
+        if (ret < 0) {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        } else if (ret == 0) {
+            return 0;
+        }
+
+        ob->len -= ret;
+        memmove(ob->buf, ob->buf + ret, ob->len);
+    }
+}
+
+/*
+ * Make room for 'room' more bytes, waiting up to OUTBUF_WAIT_MS for the
+ * peer to take what is queued. Once output has been dropped there is no
+ * waiting until the buffer drains.
+ */
+static int outbuf_make_room(struct outbuf *ob, int fd, size_t room)
+{
+    int64_t deadline = esp_timer_get_time() + (OUTBUF_WAIT_MS * 1000);
+    int64_t left;
+    struct timeval timeout;
+    fd_set wfds;
+
+    for (;;) {
+        if (outbuf_send(ob, fd) < 0) {
+            return -1;
+        }
+        if ((ob->unreported > 0) || ((ob->size - ob->len) >= room)) {
+            return 0;
+        }
+
+        left = deadline - esp_timer_get_time();
+        if (left <= 0) {
+            break;
+        }
+        FD_ZERO(&wfds);
+        FD_SET(fd, &wfds);
+        timeout.tv_sec = 0;
+        timeout.tv_usec = left;
+        if (select(fd + 1, NULL, &wfds, NULL, &timeout) <= 0) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Queue data, sending whenever the buffer fills so that long output
+ * streams through it. Returns -1 if the connection failed.
+ */
+int outbuf_write(struct outbuf *ob, int fd, const void *data, size_t len)
+{
+    const char *p = (const char *) data;
+    size_t chunk;
+
+    while (len > 0) {
+        if ((ob->len == ob->size) || (ob->unreported > 0)) {
+            if (outbuf_make_room(ob, fd, 1) < 0) {
+                return -1;
+            }
+            if ((ob->len == ob->size) || (ob->unreported > 0)) {
+                break;
+            }
+        }
+
+        chunk = ob->size - ob->len;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(ob->buf + ob->len, p, chunk);
+        ob->len += chunk;
+        p += chunk;
+        len -= chunk;
+    }
+
+    if (len > 0) {
+        outbuf_drop(ob, len);
+    }
+
+    return 0;
+}
+
+/*
+ * Format in place behind what is queued, sending that first if the text
+ * does not fit. Text longer than the whole buffer is cut short. Returns
+ * the formatted length, or -1 if the connection failed.
+ */
+int outbuf_vprintf(struct outbuf *ob, int fd, const char *format,
+                   va_list ap)
+{
+    va_list ap2;
+    size_t space;
+    size_t room;
+    int ret;
+
+    va_copy(ap2, ap);
+
+    if ((ob->unreported > 0) && (outbuf_send(ob, fd) < 0)) {
+        ret = -1;
+        goto done;
+    }
+
+    space = ob->size - ob->len;
+    ret = vsnprintf(ob->buf + ob->len, space, format, ap);
+    if ((ret >= 0) && ((size_t) ret >= space) && (ob->len > 0) &&
+        (ob->unreported == 0)) {
+        room = ((size_t) ret < ob->size) ? (size_t) ret + 1 : ob->size;
+        if (outbuf_make_room(ob, fd, room) < 0) {
+            ret = -1;
+            goto done;
+        }
+        space = ob->size - ob->len;
+        ret = vsnprintf(ob->buf + ob->len, space, format, ap2);
+    }
+
+    if (ret < 0) {
+        goto done;
+    }
+
+    if (ob->unreported > 0) {
+        outbuf_drop(ob, ret);
+    } else if ((size_t) ret < space) {
+        ob->len += ret;
+    } else if (ob->len == 0) {
+        ob->len = space - 1;
+        outbuf_drop(ob, ret - ob->len);
+    } else {
+        outbuf_drop(ob, ret);
+    }
+
+done:
+
+    va_end(ap2);
+
+    return ret;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
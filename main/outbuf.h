@@ -0,0 +1,77 @@
+/*
+ * outbuf.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Output for a socket served by the console event loop: text is
+ * formatted in place into a caller-owned buffer and sent with
+ * MSG_DONTWAIT, and what the socket does not take stays queued for the
+ * next outbuf_send(). Output longer than the buffer streams through it
+ * as long as the peer keeps reading; a peer that takes nothing for
+ * OUTBUF_WAIT_MS loses new output until the buffer drains, and a
+ * "[N bytes of output dropped]" line marks the gap. An fd of -1 discards
+ * output. Callers serialize access.
+ */
+#define OUTBUF_WAIT_MS  20
+
+struct outbuf {
+    char *buf;
+    size_t size;
+    size_t len;
+    uint32_t dropped;
+    uint32_t unreported;
+};
+
+extern void outbuf_init(struct outbuf *ob, char *buf, size_t size);
+extern int outbuf_write(struct outbuf *ob, int fd, const void *data,
+                        size_t len);
+extern int outbuf_vprintf(struct outbuf *ob, int fd, const char *format,
+                          va_list ap);
+extern int outbuf_send(struct outbuf *ob, int fd);
+
+static inline bool outbuf_pending(const struct outbuf *ob)
+{
+    return (ob->len > 0) || (ob->unreported > 0);
+}
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,181 @@
+/*
+ * pktmirror.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <freertos/FreeRTOS.h>
+#include <pktmirror.h>
+
+#define PKTMIRROR_ALIGN(x)  (((x) + 3) & ~3)
+
+struct pktmirror_hdr {
+    uint32_t seq;
+    uint16_t len;
+    uint16_t reserved;
+};
+
+static uint8_t ring[PKTMIRROR_RING_SIZE];
+static size_t head = 0;
+static size_t tail = 0;
+static uint32_t seq = 0;
+static unsigned int subscribers = 0;
+static struct pktmirror_stats stats;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void ring_put(size_t pos, const void *data, size_t len)
+{
+    const uint8_t *src = (const uint8_t *) data;
+    size_t off = pos & (PKTMIRROR_RING_SIZE - 1);
+    size_t chunk = PKTMIRROR_RING_SIZE - off;
+
+    if (len == 0) {
+        return;
+    }
+
+    if (chunk > len) {
+        chunk = len;
+    }
+
+    memcpy(ring + off, src, chunk);
+    memcpy(ring, src + chunk, len - chunk);
+}
+
+static void ring_get(size_t pos, void *data, size_t len)
+{
+    uint8_t *dst = (uint8_t *) data;
+    size_t off = pos & (PKTMIRROR_RING_SIZE - 1);
+    size_t chunk = PKTMIRROR_RING_SIZE - off;
+
+    if (chunk > len) {
+        chunk = len;
+    }
+
+    memcpy(dst, ring + off, chunk);
+    memcpy(dst + chunk, ring, len - chunk);
+}
+
+/*
+ * Called by the serial receive path for every valid frame; costs nothing
+ * while nobody is subscribed.
+ */
+void pktmirror_publish(const struct mt_frame *frame)
+{
+    struct pktmirror_hdr hdr;
+    struct pktmirror_hdr old;
+    uint8_t fhdr[MT_FRAME_HDR_SIZE];
+    size_t rec;
+    size_t pos;
+
+    if (subscribers == 0) {
+        return;
+    }
+
+    hdr.len = MT_FRAME_HDR_SIZE + frame->len;
+    hdr.reserved = 0;
+    rec = PKTMIRROR_ALIGN(sizeof(hdr) + hdr.len);
+
+    fhdr[0] = MT_FRAME_START1;
+    fhdr[1] = MT_FRAME_START2;
+    fhdr[2] = (frame->len >> 8) & 0xff;
+    fhdr[3] = frame->len & 0xff;
+
+    portENTER_CRITICAL(&lock);
+
+    while ((PKTMIRROR_RING_SIZE - (head - tail)) < rec) {
+        ring_get(tail, &old, sizeof(old));
+        tail += PKTMIRROR_ALIGN(sizeof(old) + old.len);
+        stats.overwritten++;
+    }
+
+    hdr.seq = seq++;
+    pos = head;
+    ring_put(pos, &hdr, sizeof(hdr));
+    pos += sizeof(hdr);
+    ring_put(pos, fhdr, sizeof(fhdr));
+    pos += sizeof(fhdr);
+    ring_put(pos, frame->seg[0], frame->seg_len[0]);
+    pos += frame->seg_len[0];
+    ring_put(pos, frame->seg[1], frame->seg_len[1]);
+    head += rec;
+    stats.frames++;
+
+    portEXIT_CRITICAL(&lock);
+}
+
+void pktmirror_subscribe(struct pktmirror_cursor *cursor)
+{
+    portENTER_CRITICAL(&lock);
+    cursor->pos = head;
+    cursor->seq = seq;
+    cursor->dropped = 0;
+    subscribers++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void pktmirror_unsubscribe(struct pktmirror_cursor *cursor)
+{
+    (void)(cursor);
+
+    portENTER_CRITICAL(&lock);
+    if (subscribers > 0) {
+        subscribers--;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Copy the next frame for this subscriber, header included, into 'buf'
+ * (which must hold PKTMIRROR_MAX_FRAME bytes). Returns its length or 0.
+ */
+int pktmirror_read(struct pktmirror_cursor *cursor, uint8_t *buf, size_t size)
+{
+    struct pktmirror_hdr hdr;
+    int ret = 0;
+
+    portENTER_CRITICAL(&lock);
+
+    if ((ssize_t) (cursor->pos - tail) < 0) {
+        cursor->pos = tail;
+    }
+
+    if (cursor->pos == head) {
+        goto done;
+    }
+
+    ring_get(cursor->pos, &hdr, sizeof(hdr));
+    if (hdr.seq != cursor->seq) {
+        cursor->dropped += hdr.seq - cursor->seq;
+        stats.dropped += hdr.seq - cursor->seq;
+    }
+
+    if (hdr.len <= size) {
+        ring_get(cursor->pos + sizeof(hdr), buf, hdr.len);
+        ret = hdr.len;
+    }
+    cursor->pos += PKTMIRROR_ALIGN(sizeof(hdr) + hdr.len);
+    cursor->seq = hdr.seq + 1;
+
+done:
+
+    portEXIT_CRITICAL(&lock);
+
+    return ret;
+}
+
+void pktmirror_get_stats(struct pktmirror_stats *s)
+{
+    memcpy(s, &stats, sizeof(*s));
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,72 @@
+/*
+ * pktmirror.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef PKTMIRROR_H
+#define PKTMIRROR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mtframe.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Copies of the FromRadio frames received from the device, kept in their
+ * serial framing for LAN subscribers. Publishing never waits: each
+ * subscriber reads through its own cursor and one that falls a ring
+ * behind silently loses the oldest frames.
+ */
+#define PKTMIRROR_RING_SIZE   8192
+#define PKTMIRROR_MAX_FRAME   (MT_FRAME_HDR_SIZE + MT_FRAME_MAX_PAYLOAD)
+
+struct pktmirror_cursor {
+    size_t pos;
+    uint32_t seq;
+    uint32_t dropped;
+};
+
+struct pktmirror_stats {
+    uint32_t frames;
+    uint32_t overwritten;
+    uint32_t dropped;
+};
+
+extern void pktmirror_publish(const struct mt_frame *frame);
+extern void pktmirror_subscribe(struct pktmirror_cursor *cursor);
+extern void pktmirror_unsubscribe(struct pktmirror_cursor *cursor);
+extern int pktmirror_read(struct pktmirror_cursor *cursor,
+                          uint8_t *buf, size_t size);
+extern void pktmirror_get_stats(struct pktmirror_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
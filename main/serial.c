@@ -5,47 +5,125 @@
  */
 
 #include <stdarg.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <sys/select.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <driver/gpio.h>
 #include <driver/uart.h>
-#include <driver/uart_vfs.h>
 #include <driver/usb_serial_jtag.h>
+#include <esp_timer.h>
 #include <esp_console.h>
 #include <esp_vfs_dev.h>
 #include <esp_log.h>
 #include <sdkconfig.h>
 #include <meshroof.h>
+#include <mtframe.h>
+#include <logring.h>
+#include <txsched.h>
 
-#define SERIAL_PBUF_SIZE  512
+#define SERIAL_PBUF_SIZE  256
 
 #define SERIAL_RX_PIN GPIO_NUM_44
 #define SERIAL_TX_PIN GPIO_NUM_43
 #define UART_BUF_SIZE 512
+#define UART_MAX_BUF_SIZE 8192
+#define UART_EVENT_QUEUE_SIZE 16
+#define SERIAL_RX_RING_SIZE 2048
+#define SERIAL_FRAME_TIMEOUT_US 250000
+#define SERIAL_RX_FILL_LOG_SIZE 16
+#define SERIAL_TX_RING_SIZE 4096
+#define SERIAL_TX_WAIT_MS 50
+#define SERIAL_TX_NOWAIT_PRIORITY 10
+#define SERIAL_TX_TASK_STACK_SIZE 2048
+#define SERIAL_TX_TASK_PRIORITY 11
+#define USB_TX_RING_SIZE 4096
+#define USB_TX_CHUNK 1024
+#define USB_TX_WAIT_MS 50
+#define USB_TX_NOWAIT_PRIORITY 10
+#define USB_TX_TASK_STACK_SIZE 2048
+#define USB_TX_TASK_PRIORITY 4
 
 static const char *TAG = "serial";
 
-static int fd = -1;
+static QueueHandle_t uart_queue = NULL;
+static SemaphoreHandle_t uart_lock = NULL;
+static uint32_t uart_baud = 0;
 
-void serial_init(void)
+static uint8_t rx_ring_buf[SERIAL_RX_RING_SIZE];
+static struct mt_ring rx_ring;
+static struct mt_frame rx_frame;
+static bool rx_frame_valid = false;
+static size_t rx_frame_offset = 0;
+static int64_t rx_last_fill_us = 0;
+static const uint8_t *rx_inject = NULL;
+static size_t rx_inject_len = 0;
+static int64_t rx_frame_us = 0;
+static int64_t rx_delivered_us = 0;
+static bool rx_delivered_bad = false;
+static struct serial_rx_stats rx_stats;
+static serial_observer_t rx_observers[SERIAL_MAX_OBSERVERS];
+static unsigned int rx_n_observers = 0;
+
+/*
+ * Arrival time of each chunk moved into the RX ring, keyed by the ring
+ * position just past the chunk, used to time-stamp the first byte of a
+ * frame.
+ */
+static struct {
+    size_t end;
+    int64_t us;
+} rx_fill_log[SERIAL_RX_FILL_LOG_SIZE];
+static unsigned int rx_fill_log_head = 0;
+static unsigned int rx_fill_log_tail = 0;
+
+static uint8_t tx_ring_buf[SERIAL_TX_RING_SIZE];
+static size_t tx_head = 0;
+static size_t tx_tail = 0;
+static SemaphoreHandle_t tx_lock = NULL;
+static SemaphoreHandle_t tx_space = NULL;
+static TaskHandle_t tx_task_handle = NULL;
+static struct serial_tx_stats tx_stats;
+
+static void serial_tx_task(void *params);
+
+static char usb_tx_ring_buf[USB_TX_RING_SIZE];
+static size_t usb_tx_head = 0;
+static size_t usb_tx_tail = 0;
+static SemaphoreHandle_t usb_tx_lock = NULL;
+static SemaphoreHandle_t usb_tx_space = NULL;
+static TaskHandle_t usb_tx_task_handle = NULL;
+static struct usb_tx_stats usb_tx_stats;
+
+static void usb_tx_task(void *params);
+static int usb_tx_enqueue(const char *data, size_t len, bool crlf);
+
+/*
+ * Scale the driver buffers with the link speed so that roughly the same
+ * amount of time worth of data can be buffered at any rate.
+ */
+static size_t serial_buf_size(uint32_t baud, size_t base)
 {
-    int ret;
+    size_t mult = baud / SERIAL_DEFAULT_BAUD;
 
-    usb_serial_jtag_driver_config_t usb_serial_jtag_config = {
-        .rx_buffer_size = UART_BUF_SIZE,
-        .tx_buffer_size = UART_BUF_SIZE,
-    };
+    if (mult < 1) {
+        mult = 1;
+    }
 
-    // Set up the USB/Serial/JTAG driver first (console over USB CDC)
-    ret = usb_serial_jtag_driver_install(&usb_serial_jtag_config);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "usb_serial_jtag_driver_install failed!");
-        goto done;
+    if ((base * mult) > UART_MAX_BUF_SIZE) {
+        return UART_MAX_BUF_SIZE;
     }
 
+    return base * mult;
+}
+
+static int serial_uart_install(uint32_t baud)
+{
+    int ret;
     uart_config_t uart_config = {
-        .baud_rate = 115200,
+        .baud_rate = (int) baud,
         .data_bits = UART_DATA_8_BITS,
         .parity    = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
@@ -53,12 +131,15 @@ void serial_init(void)
         .source_clk = UART_SCLK_DEFAULT,
     };
 
-    ret = uart_driver_install(UART_NUM_0, UART_BUF_SIZE * 2,
-                              0, 0, NULL, 0);
-    if (ret!= ESP_OK) {
+    ret = uart_driver_install(UART_NUM_0,
+                              serial_buf_size(baud, UART_BUF_SIZE * 2),
+                              serial_buf_size(baud, UART_BUF_SIZE),
+                              UART_EVENT_QUEUE_SIZE, &uart_queue, 0);
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "uart_driver_install failed!");
+        uart_queue = NULL;
         goto done;
-	}
+    }
 
     ret = uart_param_config(UART_NUM_0, &uart_config);
     if (ret != ESP_OK) {
@@ -66,32 +147,342 @@ void serial_init(void)
         goto done;
     }
 
-    uart_vfs_dev_use_driver(UART_NUM_0);
-
     ret = uart_set_pin(UART_NUM_0, SERIAL_TX_PIN, SERIAL_RX_PIN,
                        UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "uart_set_pin failed!");
+        goto done;
     }
 
-    fd = open("/dev/uart/0", O_RDWR);
-    if (fd == -1) {
-        ESP_LOGE(TAG, "open /dev/uart/0 failed!");
+    uart_baud = baud;
+
+done:
+
+    return ret;
+}
+
+void serial_init(void)
+{
+    int ret;
+
+    mt_ring_init(&rx_ring, rx_ring_buf, sizeof(rx_ring_buf));
+    uart_lock = xSemaphoreCreateMutex();
+    tx_lock = xSemaphoreCreateMutex();
+    tx_space = xSemaphoreCreateBinary();
+
+    usb_serial_jtag_driver_config_t usb_serial_jtag_config = {
+        .rx_buffer_size = UART_BUF_SIZE,
+        .tx_buffer_size = UART_BUF_SIZE,
+    };
+
+    // Set up the USB/Serial/JTAG driver first (console over USB CDC)
+    ret = usb_serial_jtag_driver_install(&usb_serial_jtag_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "usb_serial_jtag_driver_install failed!");
         goto done;
     }
 
+    usb_tx_lock = xSemaphoreCreateMutex();
+    usb_tx_space = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(usb_tx_task,
+                            "UsbTx",
+                            USB_TX_TASK_STACK_SIZE,
+                            NULL,
+                            USB_TX_TASK_PRIORITY,
+                            &usb_tx_task_handle,
+                            1);
+    log_add_waiter(usb_tx_task_handle);
+
+    serial_uart_install(SERIAL_DEFAULT_BAUD);
+
+    xTaskCreatePinnedToCore(serial_tx_task,
+                            "SerialTx",
+                            SERIAL_TX_TASK_STACK_SIZE,
+                            NULL,
+                            SERIAL_TX_TASK_PRIORITY,
+                            &tx_task_handle,
+                            1);
+
 done:
 
     return;
 }
 
-int usb_tx_write(const uint8_t *data, size_t size)
+/*
+ * Switch the link to the Meshtastic device to a new rate. The driver is
+ * re-installed with buffers sized for the new rate; any partially received
+ * frame is discarded. Only the local UART is re-clocked; the radio keeps
+ * its own rate.
+ */
+int serial_set_baud(uint32_t baud)
+{
+    int ret = 0;
+
+    if (baud == uart_baud) {
+        goto done;
+    }
+
+    xSemaphoreTake(uart_lock, portMAX_DELAY);
+
+    if (uart_queue != NULL) {
+        uart_driver_delete(UART_NUM_0);
+        uart_queue = NULL;
+    }
+
+    mt_ring_init(&rx_ring, rx_ring_buf, sizeof(rx_ring_buf));
+    rx_frame_valid = false;
+    rx_frame_offset = 0;
+    rx_fill_log_tail = rx_fill_log_head;
+
+    ret = serial_uart_install(baud);
+
+    xSemaphoreGive(uart_lock);
+
+done:
+
+    return ret;
+}
+
+/*
+ * Queue already framed bytes (e.g. cached FromRadio frames) to be handed
+ * to the client ahead of anything received from the device. The buffer
+ * must stay valid until it has been consumed or the injection cancelled
+ * with serial_rx_inject(NULL, 0).
+ */
+void serial_rx_inject(const uint8_t *buf, size_t len)
+{
+    rx_inject = buf;
+    rx_inject_len = (buf != NULL) ? len : 0;
+}
+
+uint32_t serial_get_baud(void)
+{
+    return uart_baud;
+}
+
+/*
+ * Move log messages into the console ring while there is room for a
+ * worst-case (every byte a newline) message; the rest stay in the log
+ * ring until the host catches up, or are lapped there.
+ */
+static void usb_tx_pull_log(void)
+{
+    static struct log_cursor cursor;
+    static char buf[LOG_MSG_MAX + 1];
+    size_t avail;
+    int n;
+
+    for (;;) {
+        xSemaphoreTake(usb_tx_lock, portMAX_DELAY);
+        avail = USB_TX_RING_SIZE - (usb_tx_head - usb_tx_tail);
+        xSemaphoreGive(usb_tx_lock);
+
+        if (avail < (LOG_MSG_MAX * 2)) {
+            break;
+        }
+
+        n = log_read(&cursor, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+
+        usb_tx_enqueue(buf, n, true);
+    }
+}
+
+/*
+ * Console output is staged in a ring and drained to the USB/Serial/JTAG
+ * driver by its own task, so printing never busy-waits on the host.
+ */
+static void usb_tx_task(__unused void *params)
+{
+    size_t used;
+    size_t off;
+    size_t span;
+    bool connected;
+    int n;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (;;) {
+            usb_tx_pull_log();
+
+            xSemaphoreTake(usb_tx_lock, portMAX_DELAY);
+            used = usb_tx_head - usb_tx_tail;
+            off = usb_tx_tail & (USB_TX_RING_SIZE - 1);
+            xSemaphoreGive(usb_tx_lock);
+
+            if (used == 0) {
+                break;
+            }
+
+            span = USB_TX_RING_SIZE - off;
+            if (span > used) {
+                span = used;
+            }
+
+            connected = usb_serial_jtag_is_connected();
+            if (connected == false) {
+                // Nobody is listening, throw away what is pending
+                n = span;
+            } else {
+                n = usb_serial_jtag_write_bytes(usb_tx_ring_buf + off, span,
+                                                pdMS_TO_TICKS(USB_TX_WAIT_MS));
+                if (n <= 0) {
+                    continue;
+                }
+            }
+
+            xSemaphoreTake(usb_tx_lock, portMAX_DELAY);
+            if (connected == false) {
+                usb_tx_stats.dropped += n;
+            } else {
+                usb_tx_stats.bytes_sent += n;
+            }
+            usb_tx_tail += n;
+            xSemaphoreGive(usb_tx_lock);
+            xSemaphoreGive(usb_tx_space);
+        }
+    }
+}
+
+static void usb_tx_copy(const char *data, size_t len)
+{
+    size_t off;
+    size_t chunk;
+
+    while (len > 0) {
+        off = usb_tx_head & (USB_TX_RING_SIZE - 1);
+        chunk = USB_TX_RING_SIZE - off;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(usb_tx_ring_buf + off, data, chunk);
+        usb_tx_head += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+static void usb_tx_drop(size_t len)
+{
+    if (usb_tx_lock == NULL) {
+        // Before serial_init() only app_main runs
+        usb_tx_stats.dropped += len;
+        return;
+    }
+
+    xSemaphoreTake(usb_tx_lock, portMAX_DELAY);
+    usb_tx_stats.dropped += len;
+    xSemaphoreGive(usb_tx_lock);
+}
+
+/*
+ * Measure the longest run from 'p' that takes at most 'limit' bytes of
+ * ring once newlines are expanded, never splitting a "\r\n". Returns its
+ * length and stores the ring bytes it needs in 'total'.
+ */
+static size_t usb_tx_piece(const char *p, const char *end, bool crlf,
+                           size_t limit, size_t *total)
 {
-    if (usb_serial_jtag_is_connected() == false) {
-        return size;
+    const char *q = p;
+    const char *nl;
+    size_t run;
+
+    *total = 0;
+    while (q < end) {
+        nl = crlf ? memchr(q, '\n', end - q) : NULL;
+        run = (nl != NULL) ? (size_t) (nl - q) : (size_t) (end - q);
+        if ((*total + run) > limit) {
+            run = limit - *total;
+            q += run;
+            *total += run;
+            break;
+        }
+        q += run;
+        *total += run;
+        if (nl != NULL) {
+            if ((*total + 2) > limit) {
+                break;
+            }
+            q++;
+            *total += 2;
+        }
     }
 
-    return usb_serial_jtag_write_bytes(data, size, 0);
+    return q - p;
+}
+
+/*
+ * Append a message to the console ring, optionally turning each '\n'
+ * into "\r\n". Lines are copied in contiguous runs between newlines.
+ * A message that fits in the ring goes in whole; a longer one goes in
+ * USB_TX_CHUNK at a time as the drain task makes room. Low-priority
+ * callers may wait a little for room; what cannot be queued is dropped.
+ */
+static int usb_tx_enqueue(const char *data, size_t len, bool crlf)
+{
+    const char *p;
+    const char *q;
+    const char *nl;
+    const char *end = data + len;
+    size_t limit;
+    size_t total;
+    size_t n;
+    bool may_wait;
+
+    if ((usb_tx_lock == NULL) || (usb_serial_jtag_is_connected() == false)) {
+        usb_tx_drop(len);
+        goto done;
+    }
+
+    may_wait = (uxTaskPriorityGet(NULL) < USB_TX_NOWAIT_PRIORITY) &&
+        (xTaskGetCurrentTaskHandle() != usb_tx_task_handle);
+
+    limit = USB_TX_RING_SIZE;
+    for (p = data; p < end; p += n) {
+        n = usb_tx_piece(p, end, crlf, limit, &total);
+        if ((p == data) && (n < len)) {
+            limit = USB_TX_CHUNK;
+            n = usb_tx_piece(p, end, crlf, limit, &total);
+        }
+
+        xSemaphoreTake(usb_tx_lock, portMAX_DELAY);
+        while ((USB_TX_RING_SIZE - (usb_tx_head - usb_tx_tail)) < total) {
+            xSemaphoreGive(usb_tx_lock);
+            if (!may_wait ||
+                (xSemaphoreTake(usb_tx_space,
+                                pdMS_TO_TICKS(USB_TX_WAIT_MS)) != pdTRUE)) {
+                usb_tx_drop(end - p);
+                goto done;
+            }
+            xSemaphoreTake(usb_tx_lock, portMAX_DELAY);
+        }
+
+        if (crlf) {
+            for (q = p; (nl = memchr(q, '\n', p + n - q)) != NULL;
+                 q = nl + 1) {
+                usb_tx_copy(q, nl - q);
+                usb_tx_copy("\r\n", 2);
+            }
+            usb_tx_copy(q, p + n - q);
+        } else {
+            usb_tx_copy(p, n);
+        }
+        xSemaphoreGive(usb_tx_lock);
+
+        xTaskNotifyGive(usb_tx_task_handle);
+    }
+
+done:
+
+    return len;
+}
+
+int usb_tx_write(const uint8_t *data, size_t size)
+{
+    return usb_tx_enqueue((const char *) data, size, false);
 }
 
 int usb_printf(const char *format, ...)
@@ -110,34 +501,44 @@ int usb_vprintf(const char *format, va_list ap)
 {
     int ret = 0;
     char pbuf[SERIAL_PBUF_SIZE];
-    int i;
+    char *buf = pbuf;
+    va_list ap2;
 
-    ret = vsnprintf(pbuf, SERIAL_PBUF_SIZE - 1, format, ap);
-
-    if (usb_serial_jtag_is_connected() == false) {
+    va_copy(ap2, ap);
+    ret = vsnprintf(pbuf, sizeof(pbuf), format, ap);
+    if (ret < 0) {
         goto done;
     }
 
-    for (i = 0; i < ret; i++) {
-        if (pbuf[i] == '\n') {
-            do {
-                if (usb_serial_jtag_is_connected() == false) {
-                    break;
-                }
-            } while (usb_serial_jtag_write_bytes("\r", 1, 0) != 1);
+    if ((size_t) ret >= sizeof(pbuf)) {
+        // Long output (e.g. task lists): format it again into the heap
+        buf = (char *) malloc(ret + 1);
+        if (buf == NULL) {
+            usb_tx_drop(ret);
+            goto done;
         }
-        do {
-            if (usb_serial_jtag_is_connected() == false) {
-                break;
-            }
-        } while (usb_serial_jtag_write_bytes(pbuf + i, 1, 0) != 1);
+        vsnprintf(buf, ret + 1, format, ap2);
     }
 
+    usb_tx_enqueue(buf, ret, true);
+
 done:
 
+    va_end(ap2);
+    if (buf != pbuf) {
+        free(buf);
+    }
+
     return ret;
 }
 
+void usb_get_tx_stats(struct usb_tx_stats *stats)
+{
+    xSemaphoreTake(usb_tx_lock, portMAX_DELAY);
+    memcpy(stats, &usb_tx_stats, sizeof(*stats));
+    xSemaphoreGive(usb_tx_lock);
+}
+
 int usb_rx_ready(void)
 {
     return usb_serial_jtag_is_connected();
@@ -148,31 +549,328 @@ int usb_rx_read_timeout(uint8_t *data, size_t size, unsigned int ticks)
     return usb_serial_jtag_read_bytes(data, size, ticks);
 }
 
+/*
+ * Drain the TX ring into the UART driver. Everything queued since the last
+ * wakeup goes out in as few driver writes as the ring layout allows (at
+ * most two when the data wraps), regardless of how many frames it holds.
+ */
+static void serial_tx_task(__unused void *params)
+{
+    size_t used;
+    size_t off;
+    size_t span;
+    int n;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (;;) {
+            xSemaphoreTake(tx_lock, portMAX_DELAY);
+            used = tx_head - tx_tail;
+            off = tx_tail & (SERIAL_TX_RING_SIZE - 1);
+            xSemaphoreGive(tx_lock);
+
+            if (used == 0) {
+                break;
+            }
+
+            span = SERIAL_TX_RING_SIZE - off;
+            if (span > used) {
+                span = used;
+            }
+
+            n = -1;
+            xSemaphoreTake(uart_lock, portMAX_DELAY);
+            if (uart_queue != NULL) {
+                n = uart_write_bytes(UART_NUM_0, tx_ring_buf + off, span);
+            }
+            xSemaphoreGive(uart_lock);
+
+            xSemaphoreTake(tx_lock, portMAX_DELAY);
+            if (n <= 0) {
+                // Link is being reconfigured, discard what is pending
+                n = span;
+                tx_stats.dropped += span;
+            } else {
+                tx_stats.bytes_sent += n;
+                tx_stats.writes++;
+            }
+            tx_tail += n;
+            xSemaphoreGive(tx_lock);
+            xSemaphoreGive(tx_space);
+        }
+    }
+}
+
+/*
+ * Queue a frame given as a list of fragments (e.g. header and payload).
+ * The fragments are appended to the TX ring as-is and the frame is queued
+ * atomically. If the ring is full, meshtastic_task and anything above it
+ * drop the frame at once; lower priority tasks wait up to
+ * SERIAL_TX_WAIT_MS for the UART to make room first.
+ */
+int serial_writev(const struct serial_iov *iov, unsigned int iovcnt)
+{
+    int ret = 0;
+    int64_t start_us = esp_timer_get_time();
+    int64_t elapsed_us;
+    size_t total = 0;
+    size_t off;
+    size_t chunk;
+    size_t depth;
+    const uint8_t *p;
+    size_t len;
+    bool may_wait;
+    unsigned int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].len;
+    }
+
+    if ((total == 0) || (total > SERIAL_TX_RING_SIZE)) {
+        ret = (total == 0) ? 0 : -1;
+        goto done;
+    }
+
+    may_wait = uxTaskPriorityGet(NULL) < SERIAL_TX_NOWAIT_PRIORITY;
+
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    while ((SERIAL_TX_RING_SIZE - (tx_head - tx_tail)) < total) {
+        xSemaphoreGive(tx_lock);
+        if (!may_wait ||
+            (xSemaphoreTake(tx_space, pdMS_TO_TICKS(SERIAL_TX_WAIT_MS)) !=
+             pdTRUE)) {
+            xSemaphoreTake(tx_lock, portMAX_DELAY);
+            tx_stats.dropped += total;
+            tx_stats.full++;
+            xSemaphoreGive(tx_lock);
+            ret = -1;
+            goto done;
+        }
+        xSemaphoreTake(tx_lock, portMAX_DELAY);
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        p = (const uint8_t *) iov[i].base;
+        len = iov[i].len;
+        while (len > 0) {
+            off = tx_head & (SERIAL_TX_RING_SIZE - 1);
+            chunk = SERIAL_TX_RING_SIZE - off;
+            if (chunk > len) {
+                chunk = len;
+            }
+            memcpy(tx_ring_buf + off, p, chunk);
+            tx_head += chunk;
+            p += chunk;
+            len -= chunk;
+        }
+    }
+
+    depth = tx_head - tx_tail;
+    if (depth > tx_stats.max_depth) {
+        tx_stats.max_depth = depth;
+    }
+    tx_stats.bytes_queued += total;
+    tx_stats.frames++;
+    elapsed_us = esp_timer_get_time() - start_us;
+    if (elapsed_us > tx_stats.max_enqueue_us) {
+        tx_stats.max_enqueue_us = elapsed_us;
+    }
+    xSemaphoreGive(tx_lock);
+
+    xTaskNotifyGive(tx_task_handle);
+
+    ret = total;
+
+done:
+
+    return ret;
+}
+
+/*
+ * Frames from the client that go on air are paced by the scheduler;
+ * everything else is queued to the device right away.
+ */
 int serial_write(const void *buf, size_t len)
 {
-    return uart_write_bytes(UART_NUM_0, buf, len);
+    struct serial_iov iov = {
+        .base = buf,
+        .len = len,
+    };
+    int ret;
+
+    ret = txsched_submit((const uint8_t *) buf, len);
+    if (ret != 0) {
+        return (ret > 0) ? (int) len : -1;
+    }
+
+    return serial_writev(&iov, 1);
+}
+
+void serial_get_rx_stats(struct serial_rx_stats *stats)
+{
+    memcpy(stats, &rx_stats, sizeof(*stats));
+    stats->resyncs = rx_ring.resyncs;
+    stats->dropped = rx_ring.dropped;
+    stats->oversized = rx_ring.oversized;
+}
+
+/*
+ * Arrival time of the first byte of the frame most recently handed to the
+ * client, or 0 if it was replayed from the cache.
+ */
+int64_t serial_rx_frame_us(void)
+{
+    return rx_delivered_us;
+}
+
+/*
+ * The client failed to decode the frame last handed to it. One that
+ * serial_read() could not peek into has been counted already.
+ */
+void serial_note_decode_error(void)
+{
+    if (!rx_delivered_bad) {
+        rx_stats.decode_errors++;
+    }
+    rx_delivered_bad = false;
+}
+
+void serial_note_handler_latency(int64_t us)
+{
+    unsigned int bucket = 0;
+
+    while ((us > 1) && (bucket < (SERIAL_STATS_LATENCY_BUCKETS - 1))) {
+        us >>= 1;
+        bucket++;
+    }
+
+    rx_stats.latency[bucket]++;
+}
+
+/*
+ * Only for meshtastic_task, which updates the receive counters; other
+ * tasks go through MeshRoof::requestStatsReset().
+ */
+void serial_reset_stats(void)
+{
+    memset(&rx_stats, 0x0, sizeof(rx_stats));
+    rx_ring.resyncs = 0;
+    rx_ring.dropped = 0;
+    rx_ring.oversized = 0;
+
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    memset(&tx_stats, 0x0, sizeof(tx_stats));
+    xSemaphoreGive(tx_lock);
 }
 
+void serial_get_tx_stats(struct serial_tx_stats *stats)
+{
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    memcpy(stats, &tx_stats, sizeof(*stats));
+    stats->depth = tx_head - tx_tail;
+    xSemaphoreGive(tx_lock);
+}
+
+/*
+ * Move whatever the UART driver has buffered straight into the RX ring.
+ */
+static void serial_rx_fill(void)
+{
+    size_t avail = 0;
+    size_t contig;
+    uint8_t *ptr;
+    int n;
+
+    for (;;) {
+        if ((uart_get_buffered_data_len(UART_NUM_0, &avail) != ESP_OK) ||
+            (avail == 0)) {
+            break;
+        }
+
+        contig = mt_ring_write_ptr(&rx_ring, &ptr);
+        if (contig == 0) {
+            rx_stats.ring_full++;
+            break;
+        }
+
+        n = uart_read_bytes(UART_NUM_0, ptr,
+                            (avail < contig) ? avail : contig, 0);
+        if (n <= 0) {
+            break;
+        }
+
+        mt_ring_commit(&rx_ring, n);
+        rx_last_fill_us = esp_timer_get_time();
+        rx_stats.bytes_in += n;
+
+        if ((rx_fill_log_head - rx_fill_log_tail) >= SERIAL_RX_FILL_LOG_SIZE) {
+            rx_fill_log_tail++;
+        }
+        rx_fill_log[rx_fill_log_head % SERIAL_RX_FILL_LOG_SIZE].end =
+            rx_ring.head;
+        rx_fill_log[rx_fill_log_head % SERIAL_RX_FILL_LOG_SIZE].us =
+            rx_last_fill_us;
+        rx_fill_log_head++;
+    }
+}
+
+/*
+ * When did the byte at ring position 'pos' arrive?
+ */
+static int64_t serial_rx_arrival_us(size_t pos)
+{
+    while (rx_fill_log_tail != rx_fill_log_head) {
+        unsigned int i = rx_fill_log_tail % SERIAL_RX_FILL_LOG_SIZE;
+
+        if ((rx_fill_log[i].end - pos - 1) < rx_ring.size) {
+            return rx_fill_log[i].us;
+        }
+
+        rx_fill_log_tail++;
+    }
+
+    return rx_last_fill_us;
+}
+
+/*
+ * Returns 1 when a complete, validated frame is available to serial_read().
+ * A partial frame that has not grown for SERIAL_FRAME_TIMEOUT_US is treated
+ * as truncated and the parser resynchronizes on the next start marker.
+ */
 int serial_rx_ready(void)
 {
     int ret = 0;
-    fd_set rfds;
-    struct timeval timeout = {
-        .tv_sec = 0,
-        .tv_usec = 0,
-    };
 
-    if (fd == -1) {
+    if (uart_queue == NULL) {
         ret = -1;
         goto done;
     }
 
-    FD_ZERO(&rfds);
-    FD_SET(fd, &rfds);
+    if (rx_frame_valid || (rx_inject_len > 0)) {
+        ret = 1;
+        goto done;
+    }
+
+    serial_rx_fill();
+
+    for (;;) {
+        ret = mt_frame_next(&rx_ring, &rx_frame);
+        if (ret > 0) {
+            rx_frame_valid = true;
+            rx_frame_offset = 0;
+            rx_frame_us = serial_rx_arrival_us(rx_ring.tail);
+            break;
+        }
 
-    ret = select(fd + 1, &rfds, NULL, NULL, &timeout);
-    if (ret == -1) {
-        ESP_LOGE(TAG, "select ret=%d errno=%d", ret, errno);
+        if ((mt_ring_used(&rx_ring) == 0) ||
+            ((esp_timer_get_time() - rx_last_fill_us) <
+             SERIAL_FRAME_TIMEOUT_US)) {
+            break;
+        }
+
+        rx_stats.truncated++;
+        mt_ring_resync(&rx_ring);
     }
 
 done:
@@ -180,18 +878,148 @@ done:
     return ret;
 }
 
+/*
+ * Block on the UART event queue for up to 'ticks' or until there is
+ * received data to process. Any events already queued are drained without
+ * blocking. FIFO and ring buffer overflows discard the partially received
+ * data so that the protocol parser can resynchronize on the next frame.
+ */
+int serial_rx_wait(unsigned int ticks)
+{
+    int ret = 0;
+    uart_event_t event;
+    TickType_t wait;
+
+    if (uart_queue == NULL) {
+        vTaskDelay(ticks);
+        ret = -1;
+        goto done;
+    }
+
+    wait = (serial_rx_ready() > 0) ? 0 : ticks;
+    while (xQueueReceive(uart_queue, &event, wait) == pdTRUE) {
+        switch (event.type) {
+        case UART_DATA:
+        case UART_PATTERN_DET:
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            if (event.type == UART_FIFO_OVF) {
+                rx_stats.fifo_overflows++;
+            } else {
+                rx_stats.buffer_overflows++;
+            }
+            ESP_LOGW(TAG, "uart overflow (%d), flushing", event.type);
+            uart_flush_input(UART_NUM_0);
+            xQueueReset(uart_queue);
+            break;
+        case UART_BREAK:
+        case UART_PARITY_ERR:
+        case UART_FRAME_ERR:
+            rx_stats.line_errors++;
+            ESP_LOGW(TAG, "uart error event %d", event.type);
+            break;
+        default:
+            break;
+        }
+
+        wait = 0;
+    }
+
+    ret = serial_rx_ready();
+
+done:
+
+    return ret;
+}
+
 int serial_read(void *buf, size_t len)
 {
     int ret = 0;
+    uint8_t *dst = (uint8_t *) buf;
+    uint8_t hdr[MT_FRAME_HDR_SIZE];
+    struct mt_frame_info info;
+    size_t n;
+    unsigned int i;
 
     ret = serial_rx_ready();
-    if (ret > 0) {
-        ret = uart_read_bytes(UART_NUM_0, buf, len, 0);
+    if (ret <= 0) {
+        goto done;
+    }
+
+    if (rx_inject_len > 0) {
+        rx_delivered_us = 0;
+        n = (len < rx_inject_len) ? len : rx_inject_len;
+        memcpy(dst, rx_inject, n);
+        rx_inject += n;
+        rx_inject_len -= n;
+        ret = n;
+        goto done;
+    }
+
+    /*
+     * libmeshtastic decodes from its own buffer, so this is the one copy
+     * out of the ring; mt_frame_peek() below decodes the frame in place.
+     */
+    ret = 0;
+    if (rx_frame_offset < MT_FRAME_HDR_SIZE) {
+        hdr[0] = MT_FRAME_START1;
+        hdr[1] = MT_FRAME_START2;
+        hdr[2] = (rx_frame.len >> 8) & 0xff;
+        hdr[3] = rx_frame.len & 0xff;
+        n = MT_FRAME_HDR_SIZE - rx_frame_offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(dst, hdr + rx_frame_offset, n);
+        rx_frame_offset += n;
+        ret += n;
+    }
+
+    if ((size_t) ret < len) {
+        n = mt_frame_read(&rx_frame, rx_frame_offset - MT_FRAME_HDR_SIZE,
+                          dst + ret, len - ret);
+        rx_frame_offset += n;
+        ret += n;
+    }
+
+    if (rx_frame_offset >= (MT_FRAME_HDR_SIZE + rx_frame.len)) {
+        rx_stats.frames++;
+        if (mt_frame_peek(&rx_frame, &info) == 0) {
+            if (info.variant == MT_FROMRADIO_PACKET) {
+                rx_stats.portnums[(info.portnum < SERIAL_STATS_PORTNUMS) ?
+                                  info.portnum : SERIAL_STATS_PORTNUMS]++;
+            }
+            rx_delivered_bad = false;
+        } else {
+            rx_stats.decode_errors++;
+            rx_delivered_bad = true;
+        }
+        for (i = 0; i < rx_n_observers; i++) {
+            rx_observers[i](&rx_frame, rx_delivered_bad ? NULL : &info,
+                            rx_frame_us);
+        }
+        rx_delivered_us = rx_frame_us;
+        mt_frame_consume(&rx_ring, &rx_frame);
+        rx_frame_valid = false;
     }
 
+done:
+
     return ret;
 }
 
+int serial_add_observer(serial_observer_t observer)
+{
+    if (rx_n_observers >= SERIAL_MAX_OBSERVERS) {
+        return -1;
+    }
+
+    rx_observers[rx_n_observers++] = observer;
+
+    return 0;
+}
+
 /*
  * Local variables:
  * mode: C
@@ -7,21 +7,103 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
 EXTERN_C_BEGIN
 
+#define SERIAL_DEFAULT_BAUD 115200
+#define SERIAL_MAX_BAUD     921600
+
 typedef struct uart_inst uart_inst_t;
 
+struct serial_iov {
+    const void *base;
+    size_t len;
+};
+
+#define SERIAL_STATS_PORTNUMS         80
+#define SERIAL_STATS_LATENCY_BUCKETS  21
+
+/*
+ * Receive side counters. portnums[] counts decoded MeshPackets by portnum,
+ * with the last slot for anything >= SERIAL_STATS_PORTNUMS. latency[i]
+ * counts frames whose first byte reached a handler in [2^i, 2^(i+1)) us.
+ */
+struct serial_rx_stats {
+    uint64_t bytes_in;
+    uint32_t frames;
+    uint32_t decode_errors;
+    uint32_t fifo_overflows;
+    uint32_t buffer_overflows;
+    uint32_t ring_full;
+    uint32_t line_errors;
+    uint32_t truncated;
+    uint32_t resyncs;
+    uint32_t dropped;
+    uint32_t oversized;
+    uint32_t portnums[SERIAL_STATS_PORTNUMS + 1];
+    uint32_t latency[SERIAL_STATS_LATENCY_BUCKETS];
+};
+
+struct serial_tx_stats {
+    size_t depth;
+    size_t max_depth;
+    uint64_t bytes_queued;
+    uint64_t bytes_sent;
+    uint32_t frames;
+    uint32_t writes;
+    uint32_t dropped;
+    uint32_t full;
+    int64_t max_enqueue_us;
+};
+
+struct usb_tx_stats {
+    uint64_t bytes_sent;
+    uint32_t dropped;
+};
+
+struct mt_frame;
+struct mt_frame_info;
+
+/*
+ * Called on the meshtastic task for each frame serial_read() hands to
+ * the client, with the arrival time of its first byte; 'info' is NULL if
+ * the frame could not be decoded. Observers are added at start-up,
+ * before the first read, and run in the order added.
+ */
+#define SERIAL_MAX_OBSERVERS  8
+
+typedef void (*serial_observer_t)(const struct mt_frame *frame,
+                                  const struct mt_frame_info *info,
+                                  int64_t rx_us);
+
 extern void serial_init(void);
 
 extern int usb_tx_write(const uint8_t *data, size_t size);
 extern int usb_printf(const char *format, ...);
 extern int usb_vprintf(const char *format, va_list ap);
+extern void usb_get_tx_stats(struct usb_tx_stats *stats);
 extern int usb_rx_ready(void);
 extern int usb_rx_read_timeout(uint8_t *data, size_t size, unsigned int ticks);
 
+extern int serial_set_baud(uint32_t baud);
+extern uint32_t serial_get_baud(void);
+
 extern int serial_write(const void *buf, size_t len);
+extern int serial_writev(const struct serial_iov *iov, unsigned int iovcnt);
+extern void serial_get_tx_stats(struct serial_tx_stats *stats);
+extern void serial_get_rx_stats(struct serial_rx_stats *stats);
+extern int64_t serial_rx_frame_us(void);
+extern void serial_note_decode_error(void);
+extern void serial_note_handler_latency(int64_t us);
+extern void serial_reset_stats(void);
 extern int serial_rx_ready(void);
+extern int serial_rx_wait(unsigned int ticks);
+extern void serial_rx_inject(const uint8_t *buf, size_t len);
 extern int serial_read(void *buf, size_t len);
+extern int serial_add_observer(serial_observer_t observer);
 
 EXTERN_C_END
 
@@ -0,0 +1,238 @@
+/*
+ * stuckdet.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <stuckdet.h>
+
+enum stuckdet_state {
+    STUCKDET_WATCH = 0,
+    STUCKDET_PROBING,
+};
+
+static enum stuckdet_state state = STUCKDET_WATCH;
+static int64_t last_frame_us = 0;
+static int64_t last_poll_us = 0;
+static int64_t probe_us = 0;
+static unsigned int probes_sent = 0;
+static bool skip_gap = false;
+static uint32_t total = 0;
+static uint32_t span_ms = 0;
+static struct stuckdet_stats stats;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+void stuckdet_init(void)
+{
+    portENTER_CRITICAL(&lock);
+    state = STUCKDET_WATCH;
+    last_frame_us = 0;
+    last_poll_us = 0;
+    probes_sent = 0;
+    skip_gap = false;
+    total = 0;
+    span_ms = 0;
+    memset(&stats, 0x0, sizeof(stats));
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Upper edge of 'bucket': STUCKDET_BUCKET_MIN_MS * 2^((bucket + 1) / 4).
+ */
+uint32_t stuckdet_bucket_ms(unsigned int bucket)
+{
+    static const uint16_t quarter[4] = { 1189, 1414, 1682, 2000, };
+
+    return ((STUCKDET_BUCKET_MIN_MS << (bucket / 4)) *
+            quarter[bucket % 4]) / 1000;
+}
+
+/*
+ * The upper edge of the bucket holding the STUCKDET_PERCENTILE gap,
+ * widened by STUCKDET_MARGIN_PCT. Until enough gaps are seen this is
+ * the old fixed STUCKDET_MAX_S.
+ */
+static uint32_t threshold(void)
+{
+    uint32_t target;
+    uint32_t cum = 0;
+    uint32_t t = STUCKDET_MAX_S;
+    unsigned int i;
+
+    if ((total < STUCKDET_MIN_GAPS) ||
+        (span_ms < (STUCKDET_MIN_SPAN_S * 1000))) {
+        return STUCKDET_MAX_S;
+    }
+
+    target = ((total * STUCKDET_PERCENTILE) + 999) / 1000;
+    for (i = 0; i < STUCKDET_BUCKETS; i++) {
+        cum += stats.hist[i];
+        if (cum >= target) {
+            t = (stuckdet_bucket_ms(i) / 1000 * STUCKDET_MARGIN_PCT) / 100;
+            break;
+        }
+    }
+
+    if (t < STUCKDET_MIN_S) {
+        t = STUCKDET_MIN_S;
+    } else if (t > STUCKDET_MAX_S) {
+        t = STUCKDET_MAX_S;
+    }
+
+    return t;
+}
+
+static void learn(uint32_t gap_ms)
+{
+    unsigned int i;
+
+    if ((gap_ms / 1000) > stats.max_gap_s) {
+        stats.max_gap_s = gap_ms / 1000;
+    }
+    stats.gaps++;
+
+    for (i = 0; i < (STUCKDET_BUCKETS - 1); i++) {
+        if (gap_ms < stuckdet_bucket_ms(i)) {
+            break;
+        }
+    }
+    stats.hist[i]++;
+    total++;
+    if (span_ms < (STUCKDET_MIN_SPAN_S * 1000)) {
+        span_ms += gap_ms;
+    }
+
+    if (total >= STUCKDET_WINDOW) {
+        total = 0;
+        span_ms /= 2;
+        for (i = 0; i < STUCKDET_BUCKETS; i++) {
+            stats.hist[i] /= 2;
+            total += stats.hist[i];
+        }
+    }
+}
+
+/*
+ * A complete FromRadio frame arrived at 'now_us'.
+ */
+void stuckdet_frame(int64_t now_us)
+{
+    int64_t gap_ms;
+
+    portENTER_CRITICAL(&lock);
+
+    if (last_frame_us != 0) {
+        gap_ms = (now_us - last_frame_us) / 1000;
+        if (gap_ms > (UINT32_MAX / 2)) {
+            gap_ms = UINT32_MAX / 2;
+        }
+        if (!skip_gap) {
+            learn((uint32_t) gap_ms);
+        }
+        if (state == STUCKDET_PROBING) {
+            // Quiet, but alive: the silence was within what it may do
+            stats.false_positives++;
+            stats.last_false_s = (uint32_t) (gap_ms / 1000);
+            state = STUCKDET_WATCH;
+        }
+    }
+
+    last_frame_us = now_us;
+    skip_gap = false;
+
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Called periodically while the link is up. Returns STUCKDET_PROBE when
+ * the caller should send a probe, STUCKDET_RESET when the radio should
+ * be reset. The gap spanning a reset is not learned.
+ */
+enum stuckdet_action stuckdet_poll(int64_t now_us)
+{
+    enum stuckdet_action action = STUCKDET_NONE;
+    int64_t silence_us;
+
+    portENTER_CRITICAL(&lock);
+
+    last_poll_us = now_us;
+    if (last_frame_us == 0) {
+        last_frame_us = now_us;
+        skip_gap = true;
+        goto done;
+    }
+
+    silence_us = now_us - last_frame_us;
+
+    switch (state) {
+    case STUCKDET_WATCH:
+        if (silence_us >= (threshold() * 1000000LL)) {
+            state = STUCKDET_PROBING;
+            probe_us = now_us;
+            probes_sent = 1;
+            stats.probes++;
+            action = STUCKDET_PROBE;
+        }
+        break;
+    case STUCKDET_PROBING:
+        if ((now_us - probe_us) < (STUCKDET_PROBE_TIMEOUT_S * 1000000LL)) {
+            break;
+        }
+        if (probes_sent < STUCKDET_PROBES) {
+            probe_us = now_us;
+            probes_sent++;
+            stats.probes++;
+            action = STUCKDET_PROBE;
+            break;
+        }
+        stats.detections++;
+        stats.last_latency_s = (uint32_t) (silence_us / 1000000);
+        state = STUCKDET_WATCH;
+        last_frame_us = now_us;
+        skip_gap = true;
+        action = STUCKDET_RESET;
+        break;
+    default:
+        break;
+    }
+
+done:
+
+    portEXIT_CRITICAL(&lock);
+
+    return action;
+}
+
+uint32_t stuckdet_threshold_s(void)
+{
+    uint32_t t;
+
+    portENTER_CRITICAL(&lock);
+    t = threshold();
+    portEXIT_CRITICAL(&lock);
+
+    return t;
+}
+
+void stuckdet_get_stats(struct stuckdet_stats *s)
+{
+    portENTER_CRITICAL(&lock);
+    memcpy(s, &stats, sizeof(*s));
+    s->threshold_s = threshold();
+    s->silence_s = ((last_frame_us != 0) && (last_poll_us > last_frame_us)) ?
+        (uint32_t) ((last_poll_us - last_frame_us) / 1000000) : 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
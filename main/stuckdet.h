@@ -0,0 +1,91 @@
+/*
+ * stuckdet.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef STUCKDET_H
+#define STUCKDET_H
+
+#include <stdint.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Decides when the radio has gone quiet for longer than it normally
+ * does. Gaps between FromRadio frames are counted in a histogram of
+ * log-spaced buckets, four per octave from 250 ms up, that halves itself
+ * every STUCKDET_WINDOW gaps. Once STUCKDET_MIN_GAPS gaps spanning at
+ * least STUCKDET_MIN_SPAN_S are seen, silence beyond STUCKDET_MARGIN_PCT
+ * of the learned percentile, bounded by STUCKDET_MIN_S and
+ * STUCKDET_MAX_S, is probed with a request the radio answers locally,
+ * and only when STUCKDET_PROBES of those go unanswered is the radio
+ * reset.
+ */
+#define STUCKDET_BUCKET_MIN_MS     250
+#define STUCKDET_BUCKETS           44
+#define STUCKDET_WINDOW            1024
+#define STUCKDET_MIN_GAPS          32
+#define STUCKDET_MIN_SPAN_S        600
+#define STUCKDET_PERCENTILE        995      /* Permille */
+#define STUCKDET_MARGIN_PCT        150
+#define STUCKDET_MIN_S             30
+#define STUCKDET_MAX_S             300
+#define STUCKDET_PROBE_TIMEOUT_S   10
+#define STUCKDET_PROBES            2
+
+enum stuckdet_action {
+    STUCKDET_NONE = 0,
+    STUCKDET_PROBE,
+    STUCKDET_RESET,
+};
+
+struct stuckdet_stats {
+    uint32_t gaps;
+    uint32_t threshold_s;
+    uint32_t silence_s;
+    uint32_t max_gap_s;
+    uint32_t probes;
+    uint32_t false_positives;
+    uint32_t detections;
+    uint32_t last_latency_s;    /* Silence when the last reset was decided */
+    uint32_t last_false_s;      /* Silence ended by the last answered probe */
+    uint16_t hist[STUCKDET_BUCKETS];
+};
+
+extern void stuckdet_init(void);
+extern void stuckdet_frame(int64_t now_us);
+extern enum stuckdet_action stuckdet_poll(int64_t now_us);
+extern uint32_t stuckdet_threshold_s(void);
+extern uint32_t stuckdet_bucket_ms(unsigned int bucket);
+extern void stuckdet_get_stats(struct stuckdet_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,202 @@
+/*
+ * telnet.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <string.h>
+#include <telnet.h>
+
+enum {
+    TS_DATA = 0,
+    TS_IAC,
+    TS_OPT,
+    TS_SB,
+    TS_SB_IAC,
+};
+
+static inline bool opt_get(const uint32_t *bits, uint8_t opt)
+{
+    return (bits[opt / 32] & (1U << (opt % 32))) != 0;
+}
+
+static inline void opt_set(uint32_t *bits, uint8_t opt, bool on)
+{
+    if (on) {
+        bits[opt / 32] |= (1U << (opt % 32));
+    } else {
+        bits[opt / 32] &= ~(1U << (opt % 32));
+    }
+}
+
+static void reply(struct telnet *t, uint8_t cmd, uint8_t opt)
+{
+    if ((t->reply_len + 3) > sizeof(t->reply)) {
+        return;
+    }
+
+    t->reply[t->reply_len++] = TELNET_IAC;
+    t->reply[t->reply_len++] = cmd;
+    t->reply[t->reply_len++] = opt;
+}
+
+static bool opt_supported_us(uint8_t opt)
+{
+    return (opt == TELNET_OPT_SGA) || (opt == TELNET_OPT_TM);
+}
+
+/*
+ * Answer only on a state change so that the two sides cannot loop
+ * acknowledging each other (RFC 854).
+ */
+static void negotiate(struct telnet *t, uint8_t cmd, uint8_t opt)
+{
+    switch (cmd) {
+    case TELNET_DO:
+        if (opt == TELNET_OPT_TM) {
+            reply(t, TELNET_WILL, opt);
+        } else if (!opt_supported_us(opt)) {
+            reply(t, TELNET_WONT, opt);
+        } else if (!opt_get(t->us, opt)) {
+            opt_set(t->us, opt, true);
+            reply(t, TELNET_WILL, opt);
+        }
+        break;
+    case TELNET_DONT:
+        if (opt_get(t->us, opt)) {
+            opt_set(t->us, opt, false);
+            reply(t, TELNET_WONT, opt);
+        }
+        break;
+    case TELNET_WILL:
+        if (opt != TELNET_OPT_NAWS) {
+            reply(t, TELNET_DONT, opt);
+        } else if (!opt_get(t->him, opt)) {
+            opt_set(t->him, opt, true);
+            reply(t, TELNET_DO, opt);
+        }
+        break;
+    case TELNET_WONT:
+        if (opt_get(t->him, opt)) {
+            opt_set(t->him, opt, false);
+            reply(t, TELNET_DONT, opt);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void subnegotiation(struct telnet *t)
+{
+    if ((t->sb_len == 5) && (t->sb[0] == TELNET_OPT_NAWS)) {
+        t->width = (t->sb[1] << 8) | t->sb[2];
+        t->height = (t->sb[3] << 8) | t->sb[4];
+    }
+}
+
+void telnet_init(struct telnet *t)
+{
+    memset(t, 0x0, sizeof(*t));
+}
+
+/*
+ * Our opening negotiation: ask the client for its window size. The DO is
+ * recorded as pending so the client's WILL is not answered twice.
+ */
+size_t telnet_start(struct telnet *t, uint8_t *buf, size_t size)
+{
+    if (size < 3) {
+        return 0;
+    }
+
+    opt_set(t->him, TELNET_OPT_NAWS, true);
+    buf[0] = TELNET_IAC;
+    buf[1] = TELNET_DO;
+    buf[2] = TELNET_OPT_NAWS;
+
+    return 3;
+}
+
+size_t telnet_rx(struct telnet *t, uint8_t *buf, size_t len)
+{
+    size_t i;
+    size_t out = 0;
+    uint8_t c;
+
+    for (i = 0; i < len; i++) {
+        c = buf[i];
+
+        switch (t->state) {
+        case TS_DATA:
+            if (c == TELNET_IAC) {
+                t->state = TS_IAC;
+            } else {
+                buf[out++] = c;
+            }
+            break;
+        case TS_IAC:
+            t->state = TS_DATA;
+            switch (c) {
+            case TELNET_IAC:
+                buf[out++] = c;
+                break;
+            case TELNET_DO:
+            case TELNET_DONT:
+            case TELNET_WILL:
+            case TELNET_WONT:
+                t->cmd = c;
+                t->state = TS_OPT;
+                break;
+            case TELNET_SB:
+                t->sb_len = 0;
+                t->state = TS_SB;
+                break;
+            case TELNET_IP:
+            case TELNET_BRK:
+                t->interrupt = true;
+                break;
+            default:
+                break;
+            }
+            break;
+        case TS_OPT:
+            negotiate(t, t->cmd, c);
+            t->state = TS_DATA;
+            break;
+        case TS_SB:
+            if (c == TELNET_IAC) {
+                t->state = TS_SB_IAC;
+            } else if (t->sb_len < sizeof(t->sb)) {
+                t->sb[t->sb_len++] = c;
+            }
+            break;
+        case TS_SB_IAC:
+            if (c == TELNET_SE) {
+                subnegotiation(t);
+                t->state = TS_DATA;
+            } else {
+                if ((c == TELNET_IAC) && (t->sb_len < sizeof(t->sb))) {
+                    t->sb[t->sb_len++] = c;
+                }
+                t->state = TS_SB;
+            }
+            break;
+        default:
+            t->state = TS_DATA;
+            break;
+        }
+    }
+
+    return out;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
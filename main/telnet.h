@@ -0,0 +1,92 @@
+/*
+ * telnet.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef TELNET_H
+#define TELNET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+#define TELNET_IAC        255
+#define TELNET_DONT       254
+#define TELNET_DO         253
+#define TELNET_WONT       252
+#define TELNET_WILL       251
+#define TELNET_SB         250
+#define TELNET_IP         244
+#define TELNET_BRK        243
+#define TELNET_SE         240
+
+#define TELNET_OPT_ECHO   1
+#define TELNET_OPT_SGA    3
+#define TELNET_OPT_TM     6
+#define TELNET_OPT_NAWS   31
+
+#define TELNET_SB_MAX     8
+#define TELNET_RX_MAX     64
+#define TELNET_REPLY_MAX  (TELNET_RX_MAX + 2)
+
+/*
+ * Byte-stream telnet receiver. telnet_rx() strips IAC sequences from a
+ * receive buffer in place and leaves the negotiation answers to send back
+ * in 'reply'. We do SGA and timing marks, never ECHO (the client echoes
+ * locally), and ask for NAWS to learn the window size.
+ *
+ * Each answer is three bytes for the last byte of a three byte request,
+ * two of which may have come in the previous call, so feeding at most
+ * TELNET_RX_MAX bytes per call and sending 'reply' after each call never
+ * loses one.
+ */
+struct telnet {
+    uint8_t state;
+    uint8_t cmd;
+    uint8_t sb[TELNET_SB_MAX];
+    uint8_t sb_len;
+    uint32_t us[256 / 32];
+    uint32_t him[256 / 32];
+    uint16_t width;
+    uint16_t height;
+    bool interrupt;
+    uint8_t reply[TELNET_REPLY_MAX];
+    size_t reply_len;
+};
+
+extern void telnet_init(struct telnet *t);
+extern size_t telnet_start(struct telnet *t, uint8_t *buf, size_t size);
+extern size_t telnet_rx(struct telnet *t, uint8_t *buf, size_t len);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
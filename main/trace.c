@@ -0,0 +1,117 @@
+/*
+ * trace.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_timer.h>
+#include <logring.h>
+#include <trace.h>
+
+static struct trace_rec trace_ring[TRACE_RING_RECS];
+static uint32_t trace_head = 0;
+static bool trace_on = false;
+static struct trace_stats stats;
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void trace_write(unsigned int nargs, const char *format, ...)
+{
+    struct trace_rec *rec;
+    uint32_t ts_us;
+    va_list ap;
+    unsigned int i;
+
+    va_start(ap, format);
+
+    if (!trace_on) {
+        log_vprintf(format, ap);
+        goto done;
+    }
+
+    if (nargs > TRACE_MAX_ARGS) {
+        nargs = TRACE_MAX_ARGS;
+    }
+
+    ts_us = (uint32_t) esp_timer_get_time();
+
+    portENTER_CRITICAL(&trace_lock);
+    rec = &trace_ring[trace_head % TRACE_RING_RECS];
+    rec->ts_us = ts_us;
+    rec->fmt = (uint32_t) (uintptr_t) format;
+    rec->seq = (uint16_t) trace_head;
+    rec->core = xPortGetCoreID();
+    rec->nargs = nargs;
+    for (i = 0; i < nargs; i++) {
+        rec->args[i] = va_arg(ap, uint32_t);
+    }
+    if (trace_head >= TRACE_RING_RECS) {
+        stats.overwritten++;
+    }
+    trace_head++;
+    stats.records++;
+    portEXIT_CRITICAL(&trace_lock);
+
+done:
+
+    va_end(ap);
+}
+
+void trace_enable(bool enable)
+{
+    trace_on = enable;
+}
+
+bool trace_enabled(void)
+{
+    return trace_on;
+}
+
+void trace_clear(void)
+{
+    portENTER_CRITICAL(&trace_lock);
+    trace_head = 0;
+    memset(&stats, 0x0, sizeof(stats));
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+/*
+ * Copy out up to 'max' records starting at '*pos', oldest first, and
+ * advance '*pos'. Start from 0 to get the oldest record still held.
+ */
+unsigned int trace_read(uint32_t *pos, struct trace_rec *recs,
+                        unsigned int max)
+{
+    uint32_t oldest;
+    unsigned int n = 0;
+
+    portENTER_CRITICAL(&trace_lock);
+    oldest = (trace_head > TRACE_RING_RECS) ?
+        (trace_head - TRACE_RING_RECS) : 0;
+    if ((*pos < oldest) || (*pos > trace_head)) {
+        *pos = oldest;
+    }
+    while ((n < max) && (*pos != trace_head)) {
+        recs[n++] = trace_ring[*pos % TRACE_RING_RECS];
+        (*pos)++;
+    }
+    portEXIT_CRITICAL(&trace_lock);
+
+    return n;
+}
+
+void trace_get_stats(struct trace_stats *s)
+{
+    memcpy(s, &stats, sizeof(*s));
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
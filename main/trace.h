@@ -0,0 +1,96 @@
+/*
+ * trace.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * TRACE() sites print through the log ring as usual. With binary tracing
+ * enabled they instead store the format string's address and up to
+ * TRACE_MAX_ARGS raw 32-bit arguments; misc/tracedecode.py turns a 'trace
+ * dump' back into text using the firmware ELF. Arguments must be 32-bit
+ * integers or pointers (%s only for strings in flash); no 64-bit or
+ * floating point values.
+ */
+#define TRACE_MAX_ARGS    4
+#define TRACE_RING_RECS   256
+
+struct trace_rec {
+    uint32_t ts_us;
+    uint32_t fmt;
+    uint16_t seq;
+    uint8_t core;
+    uint8_t nargs;
+    uint32_t args[TRACE_MAX_ARGS];
+};
+
+struct trace_stats {
+    uint32_t records;
+    uint32_t overwritten;
+};
+
+/*
+ * Counts the arguments after the format. Five to sixteen expand to an
+ * undeclared identifier, so a TRACE() with too many fails to compile
+ * instead of recording one of its arguments as the count.
+ */
+#define TRACE_NARGS_(_f, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, \
+                     _12, _13, _14, _15, _16, n, ...) n
+#define TRACE_NARGS(...)                                                \
+    TRACE_NARGS_(__VA_ARGS__, TRACE_TOO_MANY_ARGS, TRACE_TOO_MANY_ARGS, \
+                 TRACE_TOO_MANY_ARGS, TRACE_TOO_MANY_ARGS,             \
+                 TRACE_TOO_MANY_ARGS, TRACE_TOO_MANY_ARGS,             \
+                 TRACE_TOO_MANY_ARGS, TRACE_TOO_MANY_ARGS,             \
+                 TRACE_TOO_MANY_ARGS, TRACE_TOO_MANY_ARGS,             \
+                 TRACE_TOO_MANY_ARGS, TRACE_TOO_MANY_ARGS,             \
+                 4, 3, 2, 1, 0)
+
+#define TRACE(...) trace_write(TRACE_NARGS(__VA_ARGS__), __VA_ARGS__)
+
+extern void trace_write(unsigned int nargs, const char *format, ...);
+extern void trace_enable(bool enable);
+extern bool trace_enabled(void);
+extern void trace_clear(void);
+extern unsigned int trace_read(uint32_t *pos, struct trace_rec *recs,
+                               unsigned int max);
+extern void trace_get_stats(struct trace_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,375 @@
+/*
+ * tseries.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <tseries.h>
+
+struct tseries_sample {
+    uint32_t t;
+    uint8_t mask;
+    int16_t v[TSERIES_METRICS];
+};
+
+struct tseries_bucket {
+    uint32_t t;
+    uint8_t mask;
+    uint16_t count[TSERIES_METRICS];
+    int16_t min[TSERIES_METRICS];
+    int16_t max[TSERIES_METRICS];
+    int32_t sum[TSERIES_METRICS];
+};
+
+struct tseries_rollup {
+    unsigned int head;
+    unsigned int count;
+    struct tseries_bucket b[TSERIES_ROLLUP_LEN];
+};
+
+struct tseries_node {
+    uint32_t node_num;
+    uint32_t last_s;
+    unsigned int raw_head;
+    unsigned int raw_count;
+    struct tseries_sample raw[TSERIES_RAW_LEN];
+    struct tseries_rollup rollup[TSERIES_LEVELS - 1];
+};
+
+static const uint32_t rollup_secs[TSERIES_LEVELS - 1] = {
+    TSERIES_L1_SECS,
+    TSERIES_L2_SECS,
+};
+
+static const char *metric_names[TSERIES_METRICS] = {
+    "battery",
+    "voltage",
+    "chutil",
+    "airutil",
+    "temp",
+};
+
+static struct tseries_node nodes[TSERIES_NODES];
+static struct tseries_stats stats;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+void tseries_init(void)
+{
+    portENTER_CRITICAL(&lock);
+    memset(nodes, 0x0, sizeof(nodes));
+    memset(&stats, 0x0, sizeof(stats));
+    portEXIT_CRITICAL(&lock);
+}
+
+static struct tseries_node *tseries_find(uint32_t node_num)
+{
+    unsigned int i;
+
+    for (i = 0; i < TSERIES_NODES; i++) {
+        if (nodes[i].node_num == node_num) {
+            return &nodes[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * A free slot, or else the one heard from least recently.
+ */
+static struct tseries_node *tseries_claim(uint32_t node_num)
+{
+    struct tseries_node *node = NULL;
+    unsigned int i;
+
+    for (i = 0; i < TSERIES_NODES; i++) {
+        if (nodes[i].node_num == 0) {
+            node = &nodes[i];
+            break;
+        }
+        if ((node == NULL) || (nodes[i].last_s < node->last_s)) {
+            node = &nodes[i];
+        }
+    }
+
+    if (node->node_num != 0) {
+        stats.recycled++;
+    }
+
+    memset(node, 0x0, sizeof(*node));
+    node->node_num = node_num;
+
+    return node;
+}
+
+static void tseries_fold(struct tseries_rollup *rollup, uint32_t secs,
+                         uint32_t now_s, uint8_t mask,
+                         const int16_t values[TSERIES_METRICS])
+{
+    struct tseries_bucket *bucket = &rollup->b[rollup->head];
+    uint32_t start = now_s - (now_s % secs);
+    unsigned int m;
+
+    /* A sample older than the current bucket is folded into it */
+    if ((rollup->count == 0) || (start > bucket->t)) {
+        if (rollup->count > 0) {
+            rollup->head = (rollup->head + 1) % TSERIES_ROLLUP_LEN;
+        }
+        if (rollup->count < TSERIES_ROLLUP_LEN) {
+            rollup->count++;
+        }
+        bucket = &rollup->b[rollup->head];
+        memset(bucket, 0x0, sizeof(*bucket));
+        bucket->t = start;
+    }
+
+    for (m = 0; m < TSERIES_METRICS; m++) {
+        if (((mask & (1 << m)) == 0) || (bucket->count[m] == UINT16_MAX)) {
+            continue;
+        }
+
+        if (bucket->count[m] == 0) {
+            bucket->min[m] = values[m];
+            bucket->max[m] = values[m];
+        } else if (values[m] < bucket->min[m]) {
+            bucket->min[m] = values[m];
+        } else if (values[m] > bucket->max[m]) {
+            bucket->max[m] = values[m];
+        }
+        bucket->sum[m] += values[m];
+        bucket->count[m]++;
+    }
+    bucket->mask |= mask;
+}
+
+void tseries_add(uint32_t node_num, uint32_t now_s, uint8_t mask,
+                 const int16_t values[TSERIES_METRICS])
+{
+    struct tseries_node *node;
+    struct tseries_sample *sample;
+    unsigned int i;
+
+    mask &= (1 << TSERIES_METRICS) - 1;
+    if ((node_num == 0) || (mask == 0)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&lock);
+
+    node = tseries_find(node_num);
+    if (node == NULL) {
+        node = tseries_claim(node_num);
+    }
+    node->last_s = now_s;
+
+    if (node->raw_count > 0) {
+        node->raw_head = (node->raw_head + 1) % TSERIES_RAW_LEN;
+    }
+    if (node->raw_count < TSERIES_RAW_LEN) {
+        node->raw_count++;
+    }
+    sample = &node->raw[node->raw_head];
+    sample->t = now_s;
+    sample->mask = mask;
+    memcpy(sample->v, values, sizeof(sample->v));
+
+    for (i = 0; i < TSERIES_LEVELS - 1; i++) {
+        tseries_fold(&node->rollup[i], rollup_secs[i], now_s, mask, values);
+    }
+
+    stats.samples++;
+
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Copy up to 'max_points' of the most recent points at 'level' that end
+ * after 'since_s', oldest first. Returns the number copied.
+ */
+unsigned int tseries_query(uint32_t node_num, unsigned int level,
+                           uint32_t since_s,
+                           struct tseries_point *points,
+                           unsigned int max_points)
+{
+    const struct tseries_node *node;
+    const struct tseries_sample *sample;
+    const struct tseries_rollup *rollup;
+    const struct tseries_bucket *bucket;
+    struct tseries_point *point;
+    unsigned int n = 0;
+    unsigned int i, m;
+
+    if ((level >= TSERIES_LEVELS) || (node_num == 0)) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&lock);
+
+    node = tseries_find(node_num);
+    if (node == NULL) {
+        goto done;
+    }
+
+    if (level == TSERIES_RAW) {
+        n = (node->raw_count < max_points) ? node->raw_count : max_points;
+        while ((n > 0) &&
+               (node->raw[(node->raw_head + TSERIES_RAW_LEN - (n - 1)) %
+                          TSERIES_RAW_LEN].t < since_s)) {
+            n--;
+        }
+        for (i = 0; i < n; i++) {
+            sample = &node->raw[(node->raw_head + TSERIES_RAW_LEN -
+                                 (n - 1 - i)) % TSERIES_RAW_LEN];
+            point = &points[i];
+            memset(point, 0x0, sizeof(*point));
+            point->t = sample->t;
+            point->mask = sample->mask;
+            for (m = 0; m < TSERIES_METRICS; m++) {
+                if (sample->mask & (1 << m)) {
+                    point->count[m] = 1;
+                    point->min[m] = sample->v[m];
+                    point->max[m] = sample->v[m];
+                    point->avg[m] = sample->v[m];
+                }
+            }
+        }
+    } else {
+        rollup = &node->rollup[level - 1];
+        n = (rollup->count < max_points) ? rollup->count : max_points;
+        /* Buckets are not filled in across gaps, so some may be stale */
+        while ((n > 0) &&
+               ((rollup->b[(rollup->head + TSERIES_ROLLUP_LEN - (n - 1)) %
+                           TSERIES_ROLLUP_LEN].t +
+                 rollup_secs[level - 1]) <= since_s)) {
+            n--;
+        }
+        for (i = 0; i < n; i++) {
+            bucket = &rollup->b[(rollup->head + TSERIES_ROLLUP_LEN -
+                                 (n - 1 - i)) % TSERIES_ROLLUP_LEN];
+            point = &points[i];
+            memset(point, 0x0, sizeof(*point));
+            point->t = bucket->t;
+            point->span = rollup_secs[level - 1];
+            point->mask = bucket->mask;
+            for (m = 0; m < TSERIES_METRICS; m++) {
+                if (bucket->count[m] == 0) {
+                    continue;
+                }
+                point->count[m] = bucket->count[m];
+                point->min[m] = bucket->min[m];
+                point->max[m] = bucket->max[m];
+                point->avg[m] = (int16_t) (bucket->sum[m] / bucket->count[m]);
+            }
+        }
+    }
+
+done:
+
+    portEXIT_CRITICAL(&lock);
+
+    return n;
+}
+
+/*
+ * The nodes that have a history, most recently heard from first.
+ */
+unsigned int tseries_nodes(uint32_t *node_nums, unsigned int max_nodes)
+{
+    uint32_t last_s[TSERIES_NODES];
+    unsigned int n = 0;
+    unsigned int i, j;
+
+    portENTER_CRITICAL(&lock);
+    for (i = 0; i < TSERIES_NODES; i++) {
+        if (nodes[i].node_num == 0) {
+            continue;
+        }
+        for (j = n; (j > 0) && (last_s[j - 1] < nodes[i].last_s); j--) {
+            if (j < max_nodes) {
+                node_nums[j] = node_nums[j - 1];
+                last_s[j] = last_s[j - 1];
+            }
+        }
+        if (j < max_nodes) {
+            node_nums[j] = nodes[i].node_num;
+            last_s[j] = nodes[i].last_s;
+            if (n < max_nodes) {
+                n++;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    return n;
+}
+
+const char *tseries_metric_name(unsigned int metric)
+{
+    if (metric >= TSERIES_METRICS) {
+        return "?";
+    }
+
+    return metric_names[metric];
+}
+
+/*
+ * Print a value in its natural unit, e.g. "4.01V" or "21.5C".
+ */
+int tseries_format(char *buf, size_t size, unsigned int metric,
+                   int16_t value)
+{
+    int sign = (value < 0) ? -1 : 1;
+    int v = value * sign;
+
+    switch (metric) {
+    case TSERIES_BATTERY:
+        return snprintf(buf, size, "%d%%", value);
+    case TSERIES_VOLTAGE:
+        return snprintf(buf, size, "%s%d.%02dV", (sign < 0) ? "-" : "",
+                        v / 1000, (v % 1000) / 10);
+    case TSERIES_CHUTIL:
+    case TSERIES_AIRUTIL:
+        return snprintf(buf, size, "%d.%d%%", v / 10, v % 10);
+    case TSERIES_TEMPERATURE:
+        return snprintf(buf, size, "%s%d.%dC", (sign < 0) ? "-" : "",
+                        v / 10, v % 10);
+    default:
+        break;
+    }
+
+    return snprintf(buf, size, "%d", value);
+}
+
+size_t tseries_memory(void)
+{
+    return sizeof(nodes);
+}
+
+void tseries_get_stats(struct tseries_stats *s)
+{
+    unsigned int i;
+
+    portENTER_CRITICAL(&lock);
+    memcpy(s, &stats, sizeof(*s));
+    s->nodes = 0;
+    for (i = 0; i < TSERIES_NODES; i++) {
+        if (nodes[i].node_num != 0) {
+            s->nodes++;
+        }
+    }
+    s->memory = sizeof(nodes);
+    portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,118 @@
+/*
+ * tseries.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef TSERIES_H
+#define TSERIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Recent telemetry per node. Every sample goes into a ring of raw
+ * samples and is folded into min/max/avg buckets at two coarser
+ * resolutions. Storage is static, TSERIES_NODES nodes of tseries_memory()
+ * / TSERIES_NODES bytes each; when all are taken the node heard from
+ * least recently is recycled. The sizes may be overridden at build time.
+ */
+#if !defined(TSERIES_NODES)
+#define TSERIES_NODES        8
+#endif
+#if !defined(TSERIES_RAW_LEN)
+#define TSERIES_RAW_LEN      32
+#endif
+#if !defined(TSERIES_ROLLUP_LEN)
+#define TSERIES_ROLLUP_LEN   24
+#endif
+#define TSERIES_L1_SECS      (15 * 60)
+#define TSERIES_L2_SECS      (2 * 60 * 60)
+
+/*
+ * Values are kept as scaled integers: battery in percent, voltage in mV,
+ * channel and TX air utilization in permille, temperature in 0.1 C.
+ */
+enum tseries_metric {
+    TSERIES_BATTERY = 0,
+    TSERIES_VOLTAGE,
+    TSERIES_CHUTIL,
+    TSERIES_AIRUTIL,
+    TSERIES_TEMPERATURE,
+    TSERIES_METRICS,
+};
+
+enum tseries_level {
+    TSERIES_RAW = 0,
+    TSERIES_L1,
+    TSERIES_L2,
+    TSERIES_LEVELS,
+};
+
+/*
+ * One raw sample or one bucket, starting at 't' and covering 'span'
+ * seconds (0 for a raw sample). Only metrics set in 'mask' are valid.
+ */
+struct tseries_point {
+    uint32_t t;
+    uint32_t span;
+    uint8_t mask;
+    uint16_t count[TSERIES_METRICS];
+    int16_t min[TSERIES_METRICS];
+    int16_t max[TSERIES_METRICS];
+    int16_t avg[TSERIES_METRICS];
+};
+
+struct tseries_stats {
+    unsigned int nodes;
+    uint32_t samples;
+    uint32_t recycled;
+    size_t memory;
+};
+
+extern void tseries_init(void);
+extern void tseries_add(uint32_t node_num, uint32_t now_s, uint8_t mask,
+                        const int16_t values[TSERIES_METRICS]);
+extern unsigned int tseries_query(uint32_t node_num, unsigned int level,
+                                  uint32_t since_s,
+                                  struct tseries_point *points,
+                                  unsigned int max_points);
+extern unsigned int tseries_nodes(uint32_t *node_nums,
+                                  unsigned int max_nodes);
+extern const char *tseries_metric_name(unsigned int metric);
+extern int tseries_format(char *buf, size_t size, unsigned int metric,
+                          int16_t value);
+extern size_t tseries_memory(void);
+extern void tseries_get_stats(struct tseries_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,623 @@
+/*
+ * txsched.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <meshtastic/mesh.pb.h>
+#include <meshtastic/telemetry.pb.h>
+#include <meshroof.h>
+#include <txsched.h>
+
+#define TXSCHED_TASK_STACK_SIZE  2048
+#define TXSCHED_TASK_PRIORITY    9
+#define TXSCHED_WINDOW_US        (60 * 1000000LL)
+
+#define LORA_PREAMBLE_SYMS       16
+#define LORA_HEADER_BYTES        16
+#define LORA_DEFAULT_PRESET      0
+#define NODENUM_BROADCAST        0xffffffff
+
+struct lora_params {
+    const char *name;
+    uint8_t sf;
+    uint8_t cr;
+    uint32_t bw_hz;
+};
+
+/*
+ * Indexed by Config.LoRaConfig.ModemPreset.
+ */
+static const struct lora_params presets[] = {
+    { "LongFast",     11, 5, 250000, },
+    { "LongSlow",     12, 8, 125000, },
+    { "VeryLongSlow", 12, 8,  62500, },
+    { "MediumSlow",   10, 5, 250000, },
+    { "MediumFast",    9, 5, 250000, },
+    { "ShortSlow",     8, 5, 250000, },
+    { "ShortFast",     7, 5, 250000, },
+    { "LongModerate", 11, 8, 125000, },
+    { "ShortTurbo",    7, 5, 500000, },
+    { "LongTurbo",    11, 8, 500000, },
+};
+
+#define N_PRESETS  ((int) (sizeof(presets) / sizeof(presets[0])))
+
+static const char *class_names[TXSCHED_CLASSES] = {
+    "admin", "alert", "heartbeat", "bulk",
+};
+
+struct txsched_entry {
+    bool used;
+    bool text;
+    uint8_t cls;
+    uint8_t channel;
+    uint16_t len;
+    uint32_t seq;
+    uint32_t to;
+    uint32_t airtime_us;
+    uint8_t buf[MT_FRAME_HDR_SIZE + MT_FRAME_MAX_PAYLOAD];
+};
+
+static struct txsched_entry entries[TXSCHED_QUEUE_LEN];
+static uint32_t next_seq = 0;
+static SemaphoreHandle_t lock = NULL;
+static TaskHandle_t task_handle = NULL;
+
+static int64_t tokens_us = TXSCHED_BURST_MS * 1000LL;
+static int64_t refill_us = 0;
+static int64_t window_start_us = 0;
+static uint64_t window_airtime_us = 0;
+
+static uint32_t my_node_num = 0;
+static struct lora_params lora;
+static struct txsched_stats stats;
+
+// Decode scratch, only touched with the lock held
+static meshtastic_ToRadio to_radio;
+static meshtastic_ToRadio merged;
+static meshtastic_FromRadio from_radio;
+static meshtastic_Telemetry telemetry;
+
+/*
+ * LoRa time on air (Semtech AN1200.13): explicit header, CRC on, low data
+ * rate optimization when a symbol lasts more than 16 ms. 'cr' is the
+ * denominator of the coding rate (5 for 4/5).
+ */
+static uint32_t lora_airtime_us(unsigned int sf, uint32_t bw_hz,
+                                unsigned int cr, size_t pl)
+{
+    uint32_t tsym_us = (uint32_t) ((1000000ULL << sf) / bw_hz);
+    int de = (tsym_us > 16000) ? 1 : 0;
+    int num = (8 * (int) pl) - (4 * (int) sf) + 28 + 16;
+    int den = 4 * ((int) sf - (2 * de));
+    uint32_t nsym = 8;
+
+    if (num > 0) {
+        nsym += ((num + den - 1) / den) * cr;
+    }
+
+    return (((LORA_PREAMBLE_SYMS * 4) + 17) * tsym_us / 4) + (nsym * tsym_us);
+}
+
+uint32_t txsched_airtime_us(size_t len)
+{
+    return lora_airtime_us(lora.sf, lora.bw_hz, lora.cr,
+                           LORA_HEADER_BYTES + len);
+}
+
+static uint32_t packet_airtime_us(const meshtastic_MeshPacket *packet)
+{
+    size_t size = 0;
+
+    if (packet->which_payload_variant == meshtastic_MeshPacket_decoded_tag) {
+        pb_get_encoded_size(&size, meshtastic_Data_fields, &packet->decoded);
+    } else {
+        size = packet->encrypted.size;
+    }
+
+    return txsched_airtime_us(size);
+}
+
+static uint32_t rate_permille(void)
+{
+    uint32_t busy = stats.channel_util_permille;
+    uint32_t rate;
+
+    if (busy > 1000) {
+        busy = 1000;
+    }
+
+    rate = TXSCHED_DUTY_PERMILLE * (1000 - busy) / 1000;
+
+    return (rate < TXSCHED_MIN_DUTY_PERMILLE) ?
+        TXSCHED_MIN_DUTY_PERMILLE : rate;
+}
+
+static void refill(int64_t now)
+{
+    tokens_us += (now - refill_us) * rate_permille() / 1000;
+    if (tokens_us > (TXSCHED_BURST_MS * 1000LL)) {
+        tokens_us = TXSCHED_BURST_MS * 1000LL;
+    }
+    refill_us = now;
+}
+
+static void roll_window(int64_t now)
+{
+    if ((now - window_start_us) >= TXSCHED_WINDOW_US) {
+        stats.recent_permille =
+            window_airtime_us * 1000 / (now - window_start_us);
+        window_airtime_us = 0;
+        window_start_us = now;
+    }
+}
+
+/*
+ * Whether a text starts with the "i/n " that numbers the parts of a
+ * reply split over several packets (MeshRoof::packReply()).
+ */
+static bool is_fragment(const meshtastic_Data_payload_t *payload)
+{
+    const uint8_t *p = payload->bytes;
+    const uint8_t *end = payload->bytes + payload->size;
+    unsigned int part;
+
+    for (part = 0; part < 2; part++) {
+        if ((p == end) || (*p < '0') || (*p > '9')) {
+            return false;
+        }
+        while ((p < end) && (*p >= '0') && (*p <= '9')) {
+            p++;
+        }
+        if ((p == end) || (*p != ((part == 0) ? '/' : ' '))) {
+            return false;
+        }
+        p++;
+    }
+
+    return true;
+}
+
+/*
+ * Sort a packet into its class. 'text' is set for text that may be
+ * merged with other queued text; numbered parts of a split reply are
+ * left alone so that each keeps its own packet.
+ */
+static unsigned int classify(const meshtastic_MeshPacket *packet, bool *text)
+{
+    *text = false;
+
+    if (packet->which_payload_variant != meshtastic_MeshPacket_decoded_tag) {
+        return TXSCHED_BULK;
+    }
+
+    switch (packet->decoded.portnum) {
+    case meshtastic_PortNum_TEXT_MESSAGE_APP:
+        *text = !is_fragment(&packet->decoded.payload);
+        return (packet->to == NODENUM_BROADCAST) ?
+            TXSCHED_ALERT : TXSCHED_ADMIN;
+    case meshtastic_PortNum_POSITION_APP:
+    case meshtastic_PortNum_NODEINFO_APP:
+    case meshtastic_PortNum_TELEMETRY_APP:
+        return TXSCHED_HEARTBEAT;
+    default:
+        return TXSCHED_BULK;
+    }
+}
+
+static bool encode_entry(struct txsched_entry *entry,
+                         const meshtastic_ToRadio *msg)
+{
+    pb_ostream_t stream;
+    size_t size;
+
+    if (!pb_get_encoded_size(&size, meshtastic_ToRadio_fields, msg) ||
+        (size > MT_FRAME_MAX_PAYLOAD)) {
+        return false;
+    }
+
+    stream = pb_ostream_from_buffer(entry->buf + MT_FRAME_HDR_SIZE, size);
+    if (!pb_encode(&stream, meshtastic_ToRadio_fields, msg)) {
+        return false;
+    }
+
+    entry->buf[0] = MT_FRAME_START1;
+    entry->buf[1] = MT_FRAME_START2;
+    entry->buf[2] = (size >> 8) & 0xff;
+    entry->buf[3] = size & 0xff;
+    entry->len = MT_FRAME_HDR_SIZE + size;
+    entry->airtime_us = packet_airtime_us(&msg->packet);
+
+    return true;
+}
+
+/*
+ * Append the text of 'packet' to a queued message for the same
+ * destination and channel, so that several replies cost one preamble.
+ */
+static bool coalesce(unsigned int cls, const meshtastic_MeshPacket *packet)
+{
+    struct txsched_entry *entry;
+    pb_istream_t stream;
+    meshtastic_Data_payload_t *payload;
+    size_t add = packet->decoded.payload.size;
+    unsigned int i;
+
+    for (i = 0; i < TXSCHED_QUEUE_LEN; i++) {
+        entry = &entries[i];
+        if (!entry->used || !entry->text || (entry->cls != cls) ||
+            (entry->to != packet->to) || (entry->channel != packet->channel)) {
+            continue;
+        }
+
+        stream = pb_istream_from_buffer(entry->buf + MT_FRAME_HDR_SIZE,
+                                        entry->len - MT_FRAME_HDR_SIZE);
+        if (!pb_decode(&stream, meshtastic_ToRadio_fields, &merged)) {
+            continue;
+        }
+
+        payload = &merged.packet.decoded.payload;
+        if ((payload->size + 1 + add) > sizeof(payload->bytes)) {
+            continue;
+        }
+
+        payload->bytes[payload->size++] = '\n';
+        memcpy(payload->bytes + payload->size, packet->decoded.payload.bytes,
+               add);
+        payload->size += add;
+
+        if (encode_entry(entry, &merged)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Find room for a packet of class 'cls', evicting the newest packet of the
+ * least important class queued if that class ranks below 'cls'.
+ */
+static struct txsched_entry *alloc_entry(unsigned int cls)
+{
+    struct txsched_entry *victim = NULL;
+    unsigned int i;
+
+    for (i = 0; i < TXSCHED_QUEUE_LEN; i++) {
+        if (!entries[i].used) {
+            return &entries[i];
+        }
+        if ((victim == NULL) || (entries[i].cls > victim->cls) ||
+            ((entries[i].cls == victim->cls) &&
+             ((int32_t) (entries[i].seq - victim->seq) > 0))) {
+            victim = &entries[i];
+        }
+    }
+
+    if (victim->cls <= cls) {
+        return NULL;
+    }
+
+    victim->used = false;
+    stats.dropped++;
+
+    return victim;
+}
+
+static struct txsched_entry *next_entry(void)
+{
+    struct txsched_entry *best = NULL;
+    unsigned int i;
+
+    for (i = 0; i < TXSCHED_QUEUE_LEN; i++) {
+        if (!entries[i].used) {
+            continue;
+        }
+        if ((best == NULL) || (entries[i].cls < best->cls) ||
+            ((entries[i].cls == best->cls) &&
+             ((int32_t) (entries[i].seq - best->seq) < 0))) {
+            best = &entries[i];
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Take a frame that the client is about to send. Returns 1 if it was
+ * queued (or merged), 0 if it does not go on air and should be written
+ * straight away, and -1 if the queue is full of more important traffic.
+ */
+int txsched_submit(const uint8_t *buf, size_t len)
+{
+    struct txsched_entry *entry;
+    pb_istream_t stream;
+    const meshtastic_MeshPacket *packet;
+    unsigned int cls;
+    bool text;
+    int ret = 0;
+
+    if ((lock == NULL) || (len < MT_FRAME_HDR_SIZE) ||
+        (len > (MT_FRAME_HDR_SIZE + MT_FRAME_MAX_PAYLOAD)) ||
+        (buf[0] != MT_FRAME_START1) || (buf[1] != MT_FRAME_START2) ||
+        ((size_t) ((buf[2] << 8) | buf[3]) != (len - MT_FRAME_HDR_SIZE))) {
+        return 0;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    stream = pb_istream_from_buffer(buf + MT_FRAME_HDR_SIZE,
+                                    len - MT_FRAME_HDR_SIZE);
+    if (!pb_decode(&stream, meshtastic_ToRadio_fields, &to_radio) ||
+        (to_radio.which_payload_variant != meshtastic_ToRadio_packet_tag) ||
+        ((my_node_num != 0) && (to_radio.packet.to == my_node_num))) {
+        // Heartbeats, want_config and local admin never leave the device
+        stats.bypassed++;
+        ret = 0;
+        goto done;
+    }
+
+    packet = &to_radio.packet;
+    cls = classify(packet, &text);
+
+    if (text && coalesce(cls, packet)) {
+        stats.coalesced++;
+        ret = 1;
+        goto done;
+    }
+
+    entry = alloc_entry(cls);
+    if (entry == NULL) {
+        stats.dropped++;
+        ret = -1;
+        goto done;
+    }
+
+    memcpy(entry->buf, buf, len);
+    entry->len = len;
+    entry->used = true;
+    entry->text = text;
+    entry->cls = cls;
+    entry->channel = packet->channel;
+    entry->to = packet->to;
+    entry->seq = next_seq++;
+    entry->airtime_us = packet_airtime_us(packet);
+    ret = 1;
+
+done:
+
+    xSemaphoreGive(lock);
+
+    if (ret == 1) {
+        xTaskNotifyGive(task_handle);
+    }
+
+    return ret;
+}
+
+/*
+ * Release queued packets in priority order as the bucket allows. Admin
+ * replies only need a positive balance and may run it into debt; the
+ * other classes wait until their whole airtime is covered.
+ */
+static void txsched_task(__unused void *params)
+{
+    static uint8_t out[MT_FRAME_HDR_SIZE + MT_FRAME_MAX_PAYLOAD];
+    struct txsched_entry *entry;
+    size_t out_len;
+    TickType_t wait;
+    int64_t now;
+    int64_t need;
+
+    for (;;) {
+        out_len = 0;
+        wait = portMAX_DELAY;
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        now = esp_timer_get_time();
+        refill(now);
+        roll_window(now);
+
+        entry = next_entry();
+        if (entry != NULL) {
+            need = (entry->cls == TXSCHED_ADMIN) ? 1 : entry->airtime_us;
+            if (need > (TXSCHED_BURST_MS * 1000LL)) {
+                need = TXSCHED_BURST_MS * 1000LL;
+            }
+
+            if (tokens_us >= need) {
+                memcpy(out, entry->buf, entry->len);
+                out_len = entry->len;
+                entry->used = false;
+                tokens_us -= entry->airtime_us;
+                if (tokens_us < -(TXSCHED_BURST_MS * 1000LL)) {
+                    tokens_us = -(TXSCHED_BURST_MS * 1000LL);
+                }
+                window_airtime_us += entry->airtime_us;
+                stats.airtime_us += entry->airtime_us;
+                stats.sent++;
+            } else {
+                wait = pdMS_TO_TICKS((need - tokens_us) / rate_permille()) + 1;
+            }
+        }
+
+        xSemaphoreGive(lock);
+
+        if (out_len > 0) {
+            struct serial_iov iov = {
+                .base = out,
+                .len = out_len,
+            };
+
+            serial_writev(&iov, 1);
+            continue;
+        }
+
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+static void observe_config(void)
+{
+    const meshtastic_Config_LoRaConfig *cfg;
+    uint32_t bw_hz;
+
+    if (from_radio.config.which_payload_variant != meshtastic_Config_lora_tag) {
+        return;
+    }
+
+    cfg = &from_radio.config.payload_variant.lora;
+    if (cfg->use_preset) {
+        if (((int) cfg->modem_preset >= 0) &&
+            ((int) cfg->modem_preset < N_PRESETS)) {
+            lora = presets[cfg->modem_preset];
+            stats.preset = cfg->modem_preset;
+        }
+        return;
+    }
+
+    // Custom settings: 31 and 62 kHz stand for 31.25 and 62.5 kHz
+    bw_hz = (cfg->bandwidth == 31) ? 31250 :
+        (cfg->bandwidth == 62) ? 62500 : cfg->bandwidth * 1000;
+    if ((cfg->spread_factor >= 7) && (cfg->spread_factor <= 12) &&
+        (cfg->coding_rate >= 5) && (cfg->coding_rate <= 8) &&
+        (bw_hz > 0)) {
+        lora.name = "custom";
+        lora.sf = cfg->spread_factor;
+        lora.cr = cfg->coding_rate;
+        lora.bw_hz = bw_hz;
+        stats.preset = -1;
+    }
+}
+
+static void observe_telemetry(void)
+{
+    const meshtastic_Data *data = &from_radio.packet.decoded;
+    const meshtastic_DeviceMetrics *metrics;
+    pb_istream_t stream;
+
+    stream = pb_istream_from_buffer(data->payload.bytes, data->payload.size);
+    if (!pb_decode(&stream, meshtastic_Telemetry_fields, &telemetry) ||
+        (telemetry.which_variant != meshtastic_Telemetry_device_metrics_tag)) {
+        return;
+    }
+
+    metrics = &telemetry.variant.device_metrics;
+    if (metrics->has_channel_utilization) {
+        stats.channel_util_permille =
+            (uint32_t) (metrics->channel_utilization * 10.0f);
+    }
+    if (metrics->has_air_util_tx) {
+        stats.air_util_tx_permille = (uint32_t) (metrics->air_util_tx * 10.0f);
+    }
+}
+
+/*
+ * Called for every frame from the device: picks up our node number, the
+ * LoRa settings and the channel utilization in our own device metrics.
+ */
+void txsched_observe(const struct mt_frame *frame,
+                     const struct mt_frame_info *info)
+{
+    struct mt_frame_cursor cursor;
+    pb_istream_t stream;
+
+    if (info->variant == MT_FROMRADIO_MY_INFO) {
+        my_node_num = info->my_node_num;
+        return;
+    }
+
+    if ((lock == NULL) ||
+        !((info->variant == MT_FROMRADIO_CONFIG) ||
+          ((info->variant == MT_FROMRADIO_PACKET) &&
+           (info->portnum == meshtastic_PortNum_TELEMETRY_APP) &&
+           (my_node_num != 0) && (info->from == my_node_num)))) {
+        return;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    mt_frame_istream(frame, &cursor, &stream);
+    if (pb_decode(&stream, meshtastic_FromRadio_fields, &from_radio)) {
+        if (info->variant == MT_FROMRADIO_CONFIG) {
+            observe_config();
+        } else {
+            observe_telemetry();
+        }
+    }
+
+    xSemaphoreGive(lock);
+}
+
+const char *txsched_class_name(unsigned int cls)
+{
+    return (cls < TXSCHED_CLASSES) ? class_names[cls] : "?";
+}
+
+const char *txsched_preset_name(int preset)
+{
+    return ((preset >= 0) && (preset < N_PRESETS)) ?
+        presets[preset].name : "custom";
+}
+
+void txsched_get_stats(struct txsched_stats *s)
+{
+    unsigned int i;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    refill(esp_timer_get_time());
+    roll_window(esp_timer_get_time());
+    stats.tokens_ms = tokens_us / 1000;
+    stats.rate_permille = rate_permille();
+    stats.sf = lora.sf;
+    stats.bw_hz = lora.bw_hz;
+    stats.cr = lora.cr;
+    for (i = 0; i < TXSCHED_CLASSES; i++) {
+        stats.depth[i] = 0;
+    }
+    for (i = 0; i < TXSCHED_QUEUE_LEN; i++) {
+        if (entries[i].used) {
+            stats.depth[entries[i].cls]++;
+        }
+    }
+    memcpy(s, &stats, sizeof(*s));
+
+    xSemaphoreGive(lock);
+}
+
+void txsched_init(void)
+{
+    lora = presets[LORA_DEFAULT_PRESET];
+    stats.preset = LORA_DEFAULT_PRESET;
+    refill_us = esp_timer_get_time();
+    window_start_us = refill_us;
+
+    lock = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(txsched_task,
+                            "TxSched",
+                            TXSCHED_TASK_STACK_SIZE,
+                            NULL,
+                            TXSCHED_TASK_PRIORITY,
+                            &task_handle,
+                            1);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,90 @@
+/*
+ * txsched.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef TXSCHED_H
+#define TXSCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mtframe.h>
+
+#if !defined(EXTERN_C_BEGIN)
+#if defined(__cplusplus)
+#define EXTERN_C_BEGIN extern "C" {
+#else
+#define EXTERN_C_BEGIN
+#endif
+#endif
+
+#if !defined(EXTERN_C_END)
+#if defined(__cplusplus)
+#define EXTERN_C_END }
+#else
+#define EXTERN_C_END
+#endif
+#endif
+
+EXTERN_C_BEGIN
+
+/*
+ * Outbound scheduler for packets that go on air. They are queued by
+ * priority class and released against a token bucket of LoRa airtime,
+ * whose refill rate shrinks as the device reports a busier channel.
+ * Text replies still queued for the same destination are merged.
+ */
+#define TXSCHED_QUEUE_LEN          16
+#define TXSCHED_DUTY_PERMILLE      100
+#define TXSCHED_MIN_DUTY_PERMILLE  10
+#define TXSCHED_BURST_MS           5000
+
+enum txsched_class {
+    TXSCHED_ADMIN = 0,
+    TXSCHED_ALERT,
+    TXSCHED_HEARTBEAT,
+    TXSCHED_BULK,
+    TXSCHED_CLASSES,
+};
+
+struct txsched_stats {
+    unsigned int depth[TXSCHED_CLASSES];
+    uint32_t sent;
+    uint32_t coalesced;
+    uint32_t dropped;
+    uint32_t bypassed;
+    uint64_t airtime_us;
+    uint32_t recent_permille;
+    int32_t tokens_ms;
+    uint32_t rate_permille;
+    uint32_t channel_util_permille;
+    uint32_t air_util_tx_permille;
+    int preset;
+    unsigned int sf;
+    unsigned int bw_hz;
+    unsigned int cr;
+};
+
+extern void txsched_init(void);
+extern int txsched_submit(const uint8_t *buf, size_t len);
+extern void txsched_observe(const struct mt_frame *frame,
+                            const struct mt_frame_info *info);
+extern uint32_t txsched_airtime_us(size_t len);
+extern const char *txsched_class_name(unsigned int cls);
+extern const char *txsched_preset_name(int preset);
+extern void txsched_get_stats(struct txsched_stats *stats);
+
+EXTERN_C_END
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,213 @@
+/*
+ * bridgetest.cxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host test of the API bridge against a simulated radio: a client on a
+ * socketpair asks for the config, the radio streams a download several
+ * times the size of the packet mirror at 921600 baud, one event loop tick
+ * at a time, and every frame must reach the client in order. A client
+ * that stops reading must be disconnected once the mirror overwrites
+ * frames it has not seen. Run with 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <meshroof.h>
+#include <MeshRoofBridge.hxx>
+
+#define CONFIG_FRAMES   400
+#define FRAME_PAYLOAD   96
+#define TICK_BYTES      (921600 / 10 / 20)      /* 50 ms of UART */
+
+__thread int host_core_id = 0;
+
+static unsigned int want_configs = 0;
+static unsigned int pending = 0;
+static uint32_t next_id = 0;
+
+/*
+ * FromRadio { id = n, <filler> } as the radio would send it.
+ */
+static void radio_send(uint32_t id)
+{
+    uint8_t payload[FRAME_PAYLOAD];
+    struct mt_frame frame;
+    size_t len = 0;
+    uint32_t v = id;
+
+    payload[len++] = 0x08;
+    do {
+        payload[len] = v & 0x7f;
+        v >>= 7;
+        if (v != 0) {
+            payload[len] |= 0x80;
+        }
+        len++;
+    } while (v != 0);
+    memset(payload + len, 0x5a, sizeof(payload) - len);
+
+    mt_frame_from_buffer(&frame, payload, sizeof(payload));
+    pktmirror_publish(&frame);
+}
+
+/*
+ * The simulated radio: a want_config queues a whole download, which
+ * radio_tick() then publishes as fast as the UART would deliver it.
+ */
+int serial_writev(const struct serial_iov *iov, unsigned int iovcnt)
+{
+    const uint8_t *hdr = (const uint8_t *) iov[0].base;
+    const uint8_t *payload;
+
+    assert(iovcnt >= 2);
+    assert((hdr[0] == MT_FRAME_START1) && (hdr[1] == MT_FRAME_START2));
+    payload = (const uint8_t *) iov[1].base;
+    if ((payload[0] >> 3) == MT_TORADIO_WANT_CONFIG_ID) {
+        want_configs++;
+        pending += CONFIG_FRAMES;
+    }
+
+    return 1;
+}
+
+static void radio_tick(void)
+{
+    unsigned int n = TICK_BYTES / (MT_FRAME_HDR_SIZE + FRAME_PAYLOAD);
+
+    for (; (n > 0) && (pending > 0); n--, pending--) {
+        radio_send(next_id++);
+    }
+}
+
+static void client_want_config(int fd)
+{
+    static const uint8_t want_config[] = {
+        MT_FRAME_START1, MT_FRAME_START2, 0x00, 0x02, 0x18, 0x2a,
+    };
+
+    assert(write(fd, want_config, sizeof(want_config)) ==
+           (ssize_t) sizeof(want_config));
+}
+
+/*
+ * Read whatever the bridge sent and check that the ids follow on.
+ */
+static unsigned int client_read(int fd, uint32_t *expect)
+{
+    static uint8_t buf[65536];
+    static size_t len = 0;
+    unsigned int frames = 0;
+    size_t flen;
+    ssize_t ret;
+
+    ret = recv(fd, buf + len, sizeof(buf) - len, MSG_DONTWAIT);
+    if (ret > 0) {
+        len += ret;
+    }
+
+    while (len >= MT_FRAME_HDR_SIZE) {
+        assert((buf[0] == MT_FRAME_START1) && (buf[1] == MT_FRAME_START2));
+        flen = MT_FRAME_HDR_SIZE + ((buf[2] << 8) | buf[3]);
+        if (len < flen) {
+            break;
+        }
+        uint32_t id = 0;
+        unsigned int shift = 0;
+        size_t i = MT_FRAME_HDR_SIZE + 1;
+        do {
+            id |= (uint32_t) (buf[i] & 0x7f) << shift;
+            shift += 7;
+        } while (buf[i++] & 0x80);
+        if (id != *expect) {
+            fprintf(stderr, "expected frame %u, got %u\n", *expect, id);
+            exit(1);
+        }
+        (*expect)++;
+        frames++;
+        memmove(buf, buf + flen, len - flen);
+        len -= flen;
+    }
+
+    return frames;
+}
+
+int main(void)
+{
+    MeshRoofBridge bridge;
+    struct bridge_stats stats;
+    int sv[2];
+    int sndbuf = 4096;
+    uint32_t expect = 0;
+    unsigned int frames = 0;
+    unsigned int rounds = 0;
+    unsigned int n;
+    int ret;
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    bridge.attach(sv[0]);
+
+    /* A client that keeps reading gets the whole download in order */
+    client_want_config(sv[1]);
+    assert(bridge.process() == 0);
+    assert(want_configs == 1);
+    while (frames < CONFIG_FRAMES) {
+        assert(rounds++ < 100000);
+        radio_tick();
+        /* select() wakes the loop again whenever the socket drains */
+        do {
+            ret = bridge.drain();
+            assert(ret == 0);
+            n = client_read(sv[1], &expect);
+            frames += n;
+        } while (n > 0);
+    }
+    printf("download: %u frames of %u bytes in order\n",
+           frames, FRAME_PAYLOAD);
+
+    /*
+     * A client that stalls through a download is closed when it resumes,
+     * having seen every frame up to the gap and none after it
+     */
+    client_want_config(sv[1]);
+    assert(bridge.process() == 0);
+    for (rounds = 0; pending > 0; rounds++) {
+        radio_tick();
+        assert(bridge.drain() == 0);
+    }
+    frames = 0;
+    do {
+        ret = bridge.drain();
+        frames += client_read(sv[1], &expect);
+    } while (ret == 0);
+    MeshRoofBridge::getStats(&stats);
+    printf("stalled client: %u frames after %u ticks, then closed, "
+           "%u overruns\n", frames, rounds, (unsigned int) stats.overruns);
+    assert((frames < CONFIG_FRAMES) && (stats.overruns == 1));
+
+    bridge.detach();
+    close(sv[0]);
+    close(sv[1]);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
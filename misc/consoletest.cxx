@@ -0,0 +1,451 @@
+/*
+ * consoletest.cxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host load test of the console event loop: MeshRoofConsole.cxx runs in
+ * its own thread on ephemeral ports, with the stand-in shell in
+ * misc/host/console and the real RPC, HTTP and API bridge servers.
+ * While one session runs a two second ping, a second session, an RPC
+ * client and an HTTP client must keep getting answers within a few loop
+ * rounds, and ^C must stop the ping. So must they while a session that
+ * stopped reading floods its output, and while scrapers that stopped
+ * reading hold /metrics replies. A /metrics reply must carry the status
+ * line, headers and the whole body, even when read a little at a time.
+ * Finally, with the HTTP port taken by another socket, the console and
+ * RPC must still come up. Run with 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <esp_timer.h>
+#include <meshroof.h>
+#include <logring.h>
+#include <mtcache.h>
+#include <MeshRoof.hxx>
+#include <MeshRoofConsole.hxx>
+
+#define POLL_MS       50
+#define ROUNDS        20      /* about half of the ping */
+#define MAX_RTT_US    200000
+
+__thread int host_core_id = 0;
+
+shared_ptr<MeshRoof> meshroof;
+
+static MeshRoofConsole console;
+static volatile bool running = true;
+
+uint32_t serial_get_baud(void)
+{
+    return 921600;
+}
+
+int serial_writev(const struct serial_iov *iov, unsigned int iovcnt)
+{
+    (void) (iov);
+    (void) (iovcnt);
+
+    return 1;
+}
+
+void serial_get_rx_stats(struct serial_rx_stats *stats)
+{
+    memset(stats, 0x0, sizeof(*stats));
+    stats->frames = 1234;
+}
+
+void serial_get_tx_stats(struct serial_tx_stats *stats)
+{
+    memset(stats, 0x0, sizeof(*stats));
+}
+
+void usb_get_tx_stats(struct usb_tx_stats *stats)
+{
+    memset(stats, 0x0, sizeof(*stats));
+}
+
+void mtcache_get_stats(struct mtcache_stats *stats)
+{
+    memset(stats, 0x0, sizeof(*stats));
+}
+
+static void *loop_main(void *arg)
+{
+    (void) (arg);
+
+    while (running) {
+        console.poll(POLL_MS);
+    }
+
+    return NULL;
+}
+
+static int tcp_connect(uint16_t port)
+{
+    struct sockaddr_in addr;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd != -1);
+    memset(&addr, 0x0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    assert(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+
+    return fd;
+}
+
+/*
+ * Read until 'expect' shows up in what was received, or fail after a
+ * second. What was read is left in 'buf'; RPC replies are binary-framed,
+ * hence memmem().
+ */
+static size_t read_until(int fd, const char *expect, char *buf, size_t size)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int64_t deadline = esp_timer_get_time() + 1000000;
+    size_t len = 0;
+    ssize_t ret;
+
+    buf[0] = '\0';
+    while (memmem(buf, len, expect, strlen(expect)) == NULL) {
+        if (esp_timer_get_time() >= deadline) {
+            fprintf(stderr, "no '%s' in %zu bytes\n", expect, len);
+            assert(0);
+        }
+        if (::poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        ret = recv(fd, buf + len, size - 1 - len, 0);
+        assert(ret > 0);
+        len += ret;
+        buf[len] = '\0';
+    }
+
+    return len;
+}
+
+static int64_t shell_rtt(int fd)
+{
+    char buf[256];
+    int64_t t;
+
+    t = esp_timer_get_time();
+    assert(write(fd, "status\n", 7) == 7);
+    read_until(fd, "ok\n", buf, sizeof(buf));
+
+    return esp_timer_get_time() - t;
+}
+
+static int64_t rpc_rtt(int fd)
+{
+    static const char json[] = "{\"id\":1,\"method\":\"status\"}";
+    uint8_t msg[4 + sizeof(json)];
+    char buf[RPC_MAX_MSG + 1];
+    size_t len = sizeof(json) - 1;
+    int64_t t;
+
+    msg[0] = 0;
+    msg[1] = 0;
+    msg[2] = 0;
+    msg[3] = len;
+    memcpy(msg + 4, json, len);
+
+    t = esp_timer_get_time();
+    assert(write(fd, msg, 4 + len) == (ssize_t) (4 + len));
+    read_until(fd, "\"result\"", buf, sizeof(buf));
+
+    return esp_timer_get_time() - t;
+}
+
+/*
+ * Send 'req' on a new connection and read the reply until the server
+ * closes it.
+ */
+static size_t http_get(uint16_t port, const char *req, char *buf,
+                       size_t size)
+{
+    size_t len = 0;
+    ssize_t ret;
+    int fd;
+
+    fd = tcp_connect(port);
+    assert(write(fd, req, strlen(req)) == (ssize_t) strlen(req));
+    while ((ret = recv(fd, buf + len, size - 1 - len, 0)) > 0) {
+        len += ret;
+    }
+    assert(ret == 0);
+    buf[len] = '\0';
+    close(fd);
+
+    return len;
+}
+
+static int64_t http_rtt(uint16_t port)
+{
+    static char buf[HTTP_OBUF_SIZE + 1];
+    int64_t t;
+
+    t = esp_timer_get_time();
+    http_get(port, "GET /metrics HTTP/1.0\r\n\r\n", buf, sizeof(buf));
+    assert(strstr(buf, "meshroof_log_lost_total ") != NULL);
+
+    return esp_timer_get_time() - t;
+}
+
+/*
+ * A /metrics reply is complete and well-formed, and other paths are
+ * not found.
+ */
+static void http_check(uint16_t port)
+{
+    static const char head[] =
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+    static char buf[HTTP_OBUF_SIZE + 1];
+    const char *body;
+    size_t len;
+
+    len = http_get(port, "GET /metrics HTTP/1.0\r\nHost: x\r\n\r\n", buf,
+                   sizeof(buf));
+    assert(strncmp(buf, head, sizeof(head) - 1) == 0);
+    body = buf + sizeof(head) - 1;
+    assert(strncmp(body, "# HELP ", 7) == 0);
+    assert(strstr(body, "\nmeshroof_serial_baud 921600\n") != NULL);
+    assert(strstr(body, "\nmeshroof_serial_rx_frames_total 1234\n") != NULL);
+    assert(strstr(body, "\nmeshroof_amplify 0\n") != NULL);
+    assert(strstr(body, "# TYPE meshroof_log_lost_total counter\n") != NULL);
+    assert(strstr(body, "bytes of output dropped") == NULL);
+    assert(buf[len - 1] == '\n');
+    printf("/metrics: %zu byte reply\n", len);
+
+    http_get(port, "GET / HTTP/1.0\r\n\r\n", buf, sizeof(buf));
+    assert(strncmp(buf, "HTTP/1.0 404 Not Found\r\n", 24) == 0);
+    http_get(port, "POST /metrics HTTP/1.0\r\n\r\n", buf, sizeof(buf));
+    assert(strncmp(buf, "HTTP/1.0 405 ", 13) == 0);
+}
+
+/*
+ * A scraper with a small receive window that reads a little at a time
+ * still gets the whole reply.
+ */
+static void http_slow(uint16_t port)
+{
+    static const char req[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    static char buf[HTTP_OBUF_SIZE + 1];
+    struct sockaddr_in addr;
+    int rcvbuf = 1024;
+    size_t len = 0;
+    ssize_t ret;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd != -1);
+    assert(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                      sizeof(rcvbuf)) == 0);
+    memset(&addr, 0x0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    assert(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert(write(fd, req, sizeof(req) - 1) == (ssize_t) (sizeof(req) - 1));
+    usleep(2 * POLL_MS * 1000);
+    while ((ret = recv(fd, buf + len, 256, 0)) > 0) {
+        len += ret;
+        usleep(1000);
+    }
+    assert(ret == 0);
+    buf[len] = '\0';
+    close(fd);
+    assert(strncmp(buf, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    assert(strstr(buf, "meshroof_log_lost_total ") != NULL);
+    assert(strstr(buf, "bytes of output dropped") == NULL);
+    printf("/metrics: %zu bytes read slowly\n", len);
+}
+
+int main(void)
+{
+    struct console_ports ports = { 0, 0, 0, 0, 0 };
+    pthread_t thread;
+    char buf[4096];
+    int64_t worst_shell = 0;
+    int64_t worst_rpc = 0;
+    int64_t worst_http = 0;
+    int64_t t;
+    unsigned int replies;
+    const char *p;
+    int clients[TCP_CONSOLE_MAX_SESSIONS - 1];
+    int scrapers[HTTP_MAX_CLIENTS];
+    int a, b, c, rpc;
+    int taken;
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    unsigned int i;
+
+    log_init();
+    meshroof = make_shared<MeshRoof>();
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS; i++) {
+        console.setShell(i, make_shared<MeshRoofShell>());
+    }
+    assert(console.start(&ports) == 0);
+    console.getPorts(&ports);
+    assert(pthread_create(&thread, NULL, loop_main, NULL) == 0);
+
+    a = tcp_connect(ports.console);
+    read_until(a, "welcome", buf, sizeof(buf));
+    b = tcp_connect(ports.console);
+    read_until(b, "welcome", buf, sizeof(buf));
+    rpc = tcp_connect(ports.rpc);
+
+    /* Session A pings while everyone else keeps being served */
+    assert(write(a, "ping\n", 5) == 5);
+    read_until(a, "reply seq=1\n", buf, sizeof(buf));
+    for (i = 0; i < ROUNDS; i++) {
+        t = shell_rtt(b);
+        worst_shell = (t > worst_shell) ? t : worst_shell;
+        t = rpc_rtt(rpc);
+        worst_rpc = (t > worst_rpc) ? t : worst_rpc;
+        if ((i % 4) == 0) {
+            t = http_rtt(ports.http);
+            worst_http = (t > worst_http) ? t : worst_http;
+        }
+        usleep(POLL_MS * 1000);
+    }
+    printf("during ping: worst shell %lld us, rpc %lld us, http %lld us\n",
+           (long long) worst_shell, (long long) worst_rpc,
+           (long long) worst_http);
+    assert(worst_shell < MAX_RTT_US);
+    assert(worst_rpc < MAX_RTT_US);
+    assert(worst_http < MAX_RTT_US);
+
+    /* ^C stops the ping early and gives the session back */
+    t = esp_timer_get_time();
+    assert(write(a, "\x03", 1) == 1);
+    read_until(a, " replies\n> ", buf, sizeof(buf));
+    t = esp_timer_get_time() - t;
+    for (p = strstr(buf, " replies"); (p > buf) && (p[-1] != '\n'); p--);
+    assert(sscanf(p, "%u", &replies) == 1);
+    printf("^C: ping stopped after %u replies in %lld us\n", replies,
+           (long long) t);
+    assert((replies > 1) && (replies < PING_REPLIES));
+    assert(t < MAX_RTT_US);
+    assert(shell_rtt(a) < MAX_RTT_US);
+
+    /* A client that stops reading its output holds up nobody */
+    c = tcp_connect(ports.console);
+    read_until(c, "welcome", buf, sizeof(buf));
+    worst_shell = 0;
+    worst_rpc = 0;
+    for (i = 0; i < ROUNDS; i++) {
+        assert(write(c, "flood\n", 6) == 6);
+        t = shell_rtt(a);
+        worst_shell = (t > worst_shell) ? t : worst_shell;
+        t = rpc_rtt(rpc);
+        worst_rpc = (t > worst_rpc) ? t : worst_rpc;
+    }
+    printf("during flood: worst shell %lld us, rpc %lld us\n",
+           (long long) worst_shell, (long long) worst_rpc);
+    assert(worst_shell < MAX_RTT_US);
+    assert(worst_rpc < MAX_RTT_US);
+    close(c);
+
+    /* Nor do scrapers that stop reading their replies */
+    http_check(ports.http);
+    http_slow(ports.http);
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        scrapers[i] = tcp_connect(ports.http);
+        assert(write(scrapers[i], "GET /metrics HTTP/1.0\r\n\r\n", 25) ==
+               25);
+    }
+    worst_shell = 0;
+    worst_rpc = 0;
+    for (i = 0; i < ROUNDS; i++) {
+        t = shell_rtt(a);
+        worst_shell = (t > worst_shell) ? t : worst_shell;
+        t = rpc_rtt(rpc);
+        worst_rpc = (t > worst_rpc) ? t : worst_rpc;
+    }
+    printf("stalled scrapers: worst shell %lld us, rpc %lld us\n",
+           (long long) worst_shell, (long long) worst_rpc);
+    assert(worst_shell < MAX_RTT_US);
+    assert(worst_rpc < MAX_RTT_US);
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        close(scrapers[i]);
+    }
+
+    /* A session that drops out mid-ping frees its slot */
+    assert(write(b, "ping\n", 5) == 5);
+    read_until(b, "PING\n", buf, sizeof(buf));
+    close(b);
+    usleep(4 * POLL_MS * 1000);
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS - 1; i++) {
+        clients[i] = tcp_connect(ports.console);
+        read_until(clients[i], "welcome", buf, sizeof(buf));
+    }
+    for (i = 0; i < TCP_CONSOLE_MAX_SESSIONS - 1; i++) {
+        close(clients[i]);
+    }
+
+    running = false;
+    pthread_join(thread, NULL);
+    console.stop();
+    close(a);
+    close(rpc);
+
+    /* A port that is taken leaves out that service only */
+    taken = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0x0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    assert(bind(taken, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert(listen(taken, 1) == 0);
+    assert(getsockname(taken, (struct sockaddr *) &addr, &len) == 0);
+    memset(&ports, 0x0, sizeof(ports));
+    ports.http = ntohs(addr.sin_port);
+    assert(console.start(&ports) == 0);
+    console.getPorts(&ports);
+    assert((ports.http == 0) && (ports.console != 0) && (ports.rpc != 0));
+    running = true;
+    assert(pthread_create(&thread, NULL, loop_main, NULL) == 0);
+    a = tcp_connect(ports.console);
+    read_until(a, "welcome", buf, sizeof(buf));
+    assert(shell_rtt(a) < MAX_RTT_US);
+    rpc = tcp_connect(ports.rpc);
+    assert(rpc_rtt(rpc) < MAX_RTT_US);
+    printf("HTTP port taken: console and RPC up\n");
+
+    running = false;
+    pthread_join(thread, NULL);
+    console.stop();
+    close(a);
+    close(rpc);
+    close(taken);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,149 @@
+/*
+ * deduptest.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host test of the duplicate packet cache: repeats within the TTL are
+ * caught, expired and id-less packets pass, a full probe window evicts
+ * its oldest entry, and a mesh's worth of recent packets all stay
+ * resident. Also reports the cost of a lookup. Run with 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <dedup.h>
+
+#define RECENT    (DEDUP_SLOTS / 2)
+#define LOOKUPS   4000000
+
+/*
+ * Same mix as dedup.c, to build keys that share a home slot.
+ */
+static unsigned int home_slot(uint32_t from, uint32_t id)
+{
+    uint32_t h = (from * 0x9e3779b1) ^ id;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+
+    return h & (DEDUP_SLOTS - 1);
+}
+
+static uint32_t xorshift(void)
+{
+    static uint32_t x = 2463534242U;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return x;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+int main(void)
+{
+    struct dedup_stats stats;
+    uint32_t colliding[DEDUP_MAX_PROBE + 1];
+    uint32_t from[RECENT];
+    uint32_t id[RECENT];
+    unsigned int dups = 0;
+    unsigned int n;
+    unsigned int i;
+    uint32_t key;
+    int64_t t = 1000000;
+    double start;
+
+    /* A retry within the TTL is a duplicate, after it a new packet */
+    dedup_init();
+    assert(!dedup_check(0x1234, 100, t));
+    assert(dedup_check(0x1234, 100, t + 1000000));
+    assert(!dedup_check(0x1234, 101, t));
+    assert(!dedup_check(0x5678, 100, t));
+    assert(!dedup_check(0x1234, 100, t + DEDUP_TTL_US));
+    assert(dedup_check(0x1234, 100, t + DEDUP_TTL_US + 1));
+
+    /* Packets without an id always pass and are not counted */
+    assert(!dedup_check(0x1234, 0, t));
+    assert(!dedup_check(0x1234, 0, t));
+    dedup_get_stats(&stats);
+    assert((stats.hits == 2) && (stats.misses == 4));
+
+    /* A full probe window evicts its oldest entry */
+    dedup_init();
+    for (key = 1, n = 0; n < (DEDUP_MAX_PROBE + 1); key++) {
+        if (home_slot(0x1234, key) == 0) {
+            colliding[n++] = key;
+        }
+    }
+    for (i = 0; i < (DEDUP_MAX_PROBE + 1); i++) {
+        assert(!dedup_check(0x1234, colliding[i], t + i));
+    }
+    dedup_get_stats(&stats);
+    assert(stats.evictions == 1);
+    for (i = 1; i < (DEDUP_MAX_PROBE + 1); i++) {
+        assert(dedup_check(0x1234, colliding[i], t + 100));
+    }
+    assert(!dedup_check(0x1234, colliding[0], t + 100));
+    printf("probe window: %u colliding ids, %u evicted\n",
+           DEDUP_MAX_PROBE + 1, (unsigned int) stats.evictions);
+
+    /* Half a table of recent packets from a busy mesh all stay resident */
+    dedup_init();
+    for (i = 0; i < RECENT; i++) {
+        from[i] = xorshift();
+        id[i] = xorshift() | 1;
+        assert(!dedup_check(from[i], id[i], t + i));
+    }
+    for (i = 0; i < RECENT; i++) {
+        assert(dedup_check(from[i], id[i], t + RECENT));
+    }
+    dedup_get_stats(&stats);
+    printf("recent: %u packets, %u hits, %u evictions\n", RECENT,
+           (unsigned int) stats.hits, (unsigned int) stats.evictions);
+
+    /* Lookup cost on a stream where one packet in four is a repeat */
+    dedup_init();
+    start = now_ns();
+    for (i = 0; i < LOOKUPS; i++) {
+        n = i % RECENT;
+        if ((xorshift() & 3) != 0) {
+            from[n] = xorshift();
+            id[n] = xorshift() | 1;
+        }
+        if (dedup_check(from[n], id[n], t + i)) {
+            dups++;
+        }
+    }
+    dedup_get_stats(&stats);
+    printf("stream: %.1f ns per packet, %u duplicates, %u evictions\n",
+           (now_ns() - start) / LOOKUPS, dups,
+           (unsigned int) stats.evictions);
+    assert(dups > 0);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
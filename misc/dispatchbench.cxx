@@ -0,0 +1,173 @@
+/*
+ * dispatchbench.cxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host microbenchmark of the mesh command dispatch: the old substr /
+ * lowercase / if-else chain against the MeshRoofCommands table. Counts
+ * heap allocations per dispatch by replacing operator new. Both must
+ * accept the same commands and leave the same arguments. Run with
+ * 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <string>
+#include <MeshRoofCommands.hxx>
+
+using namespace std;
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    void *p = malloc(size);
+
+    allocations++;
+    if (p == NULL) {
+        throw bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static const char *samples[] = {
+    "status",
+    "Wifi",
+    "net",
+    "amplify on",
+    "buzz",
+    "morse the quick brown fox jumps over the lazy dog",
+    "reset now please",
+    "what is this",
+};
+
+#define N_MESSAGES  (sizeof(samples) / sizeof(samples[0]))
+#define ROUNDS      200000
+
+static int old_dispatch(string &message)
+{
+    string first_word;
+
+    first_word = message.substr(0, message.find(' '));
+    transform(first_word.begin(), first_word.end(), first_word.begin(),
+              ::tolower);
+    message = message.substr(first_word.size());
+    message.erase(0, message.find_first_not_of(' '));
+
+    if (first_word == "status") {
+        return 1;
+    } else if (first_word == "wifi") {
+        return 2;
+    } else if (first_word == "net") {
+        return 3;
+    } else if (first_word == "amplify") {
+        return 4;
+    } else if (first_word == "reset") {
+        return 5;
+    } else if (first_word == "buzz") {
+        return 6;
+    } else if (first_word == "morse") {
+        return 7;
+    }
+
+    return 0;
+}
+
+static int new_dispatch(string &message)
+{
+    string_view rest;
+    MeshRoofCommand cmd;
+    size_t offset;
+
+    cmd = lookupCommand(commandWord(message, &rest), CMD_MESH);
+    if (cmd == MeshRoofCommand::Unknown) {
+        return 0;
+    }
+
+    offset = rest.data() - message.data();
+    message.erase(offset + rest.size());
+    message.erase(0, offset);
+
+    return (int) cmd;
+}
+
+static void bench(const char *name, int (*dispatch)(string &))
+{
+    string copies[N_MESSAGES];
+    chrono::steady_clock::time_point start;
+    double ns = 0.0;
+    size_t allocs = 0;
+    size_t before;
+    unsigned int sum = 0;
+    unsigned int i, j;
+
+    for (i = 0; i < ROUNDS; i++) {
+        for (j = 0; j < N_MESSAGES; j++) {
+            copies[j].assign(samples[j]);
+        }
+
+        before = allocations;
+        start = chrono::steady_clock::now();
+        for (j = 0; j < N_MESSAGES; j++) {
+            sum += dispatch(copies[j]);
+        }
+        ns += chrono::duration<double, nano>(chrono::steady_clock::now() -
+                                             start).count();
+        allocs += allocations - before;
+    }
+
+    printf("%-6s %8.1f ns/dispatch %6.2f allocations/dispatch (%u)\n",
+           name, ns / (ROUNDS * N_MESSAGES),
+           (double) allocs / (ROUNDS * N_MESSAGES), sum);
+}
+
+int main(void)
+{
+    string a, b;
+    unsigned int i;
+
+    for (i = 0; i < N_MESSAGES; i++) {
+        a = samples[i];
+        b = samples[i];
+        if (old_dispatch(a) == 0) {
+            assert(new_dispatch(b) == 0);
+        } else {
+            assert(new_dispatch(b) != 0);
+            assert(a == b);
+        }
+    }
+
+    bench("old", old_dispatch);
+    bench("table", new_dispatch);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,181 @@
+/*
+ * MeshRoofShell.hxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MESHROOFSHELL_HXX
+#define MESHROOFSHELL_HXX
+
+/*
+ * Stand-in for the firmware's MeshRoofShell with the interface the
+ * console loop uses, so that MeshRoofConsole.cxx builds and runs on the
+ * host. It knows three commands: 'status' answers at once, 'flood'
+ * prints FLOOD_LINES lines, and 'ping' runs as a job printing a reply
+ * every 100 ms for two seconds or until ^C. Output goes through outbuf
+ * like the real shell's.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <esp_timer.h>
+#include <outbuf.h>
+
+#define PING_INTERVAL_US  100000
+#define PING_REPLIES      20
+#define FLOOD_LINES       2000
+
+class MeshRoofShell {
+
+public:
+
+    MeshRoofShell() : _fd(-1), _ilen(0), _pingUs(0), _replies(0) {
+        outbuf_init(&_out, _obuf, sizeof(_obuf));
+    }
+
+    void attach(void *ctx) {
+        uintptr_t c = (uintptr_t) ctx;
+
+        _fd = (c & 0x80000000) ? (int) (c & 0x7fffffff) : -1;
+        _ilen = 0;
+    }
+    void detach(void) {
+        _fd = -1;
+    }
+    void telnetStart(void) {
+
+    }
+    void showWelcome(void) {
+        this->printf("welcome\n> ");
+    }
+
+    int process(void) {
+        char *eol;
+        ssize_t ret;
+
+        eol = (char *) memchr(_ibuf, '\n', _ilen);
+        if (eol == NULL) {
+            ret = recv(_fd, _ibuf + _ilen, sizeof(_ibuf) - _ilen,
+                       MSG_DONTWAIT);
+            if (ret == 0) {
+                return -1;
+            } else if (ret < 0) {
+                return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ?
+                    0 : -1;
+            }
+            _ilen += ret;
+            eol = (char *) memchr(_ibuf, '\n', _ilen);
+            if (eol == NULL) {
+                return 0;
+            }
+        }
+
+        *eol = '\0';
+        if (strncmp(_ibuf, "ping", 4) == 0) {
+            _pingUs = esp_timer_get_time();
+            _replies = 0;
+            this->printf("PING\n");
+        } else if (strncmp(_ibuf, "flood", 5) == 0) {
+            for (unsigned int i = 0; i < FLOOD_LINES; i++) {
+                this->printf("flood line %u of %u\n", i, FLOOD_LINES);
+            }
+            this->printf("> ");
+        } else if (strncmp(_ibuf, "status", 6) == 0) {
+            this->printf("ok\n> ");
+        } else {
+            this->printf("unknown\n> ");
+        }
+        _ilen -= (eol + 1) - _ibuf;
+        memmove(_ibuf, eol + 1, _ilen);
+
+        return 1;
+    }
+
+    int flush(void) {
+        return outbuf_send(&_out, _fd);
+    }
+
+    bool pending(void) const {
+        return outbuf_pending(&_out);
+    }
+
+    bool busy(void) const {
+        return _pingUs != 0;
+    }
+
+    int poll(void) {
+        char buf[32];
+        ssize_t ret;
+        bool stop = false;
+
+        if (_pingUs == 0) {
+            return flush();
+        }
+
+        if (_fd == -1) {
+            stop = true;
+        } else {
+            ret = recv(_fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if ((ret == 0) || ((ret > 0) && memchr(buf, '\x03', ret))) {
+                stop = true;
+            }
+        }
+
+        while (!stop && (_replies < PING_REPLIES) &&
+               (esp_timer_get_time() >=
+                _pingUs + ((_replies + 1) * PING_INTERVAL_US))) {
+            _replies++;
+            this->printf("reply seq=%u\n", _replies);
+        }
+
+        if (stop || (_replies == PING_REPLIES)) {
+            this->printf("%u replies\n> ", _replies);
+            _pingUs = 0;
+        }
+
+        return flush();
+    }
+
+    void cancel(void) {
+        _pingUs = 0;
+    }
+
+private:
+
+    int printf(const char *format, ...) {
+        va_list ap;
+        int ret;
+
+        va_start(ap, format);
+        ret = outbuf_vprintf(&_out, _fd, format, ap);
+        va_end(ap);
+
+        return ret;
+    }
+
+    int _fd;
+    char _ibuf[128];
+    size_t _ilen;
+    char _obuf[1024];
+    struct outbuf _out;
+    int64_t _pingUs;
+    unsigned int _replies;
+
+};
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
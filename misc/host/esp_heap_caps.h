@@ -0,0 +1,46 @@
+/*
+ * esp_heap_caps.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_INTERNAL  (1 << 11)
+
+static inline size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void) (caps);
+
+    return 200 * 1024;
+}
+
+static inline size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    (void) (caps);
+
+    return 150 * 1024;
+}
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void) (caps);
+
+    return 100 * 1024;
+}
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
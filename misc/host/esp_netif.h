@@ -0,0 +1,39 @@
+/*
+ * esp_netif.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef ESP_NETIF_H
+#define ESP_NETIF_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+#define IPSTR  "%d.%d.%d.%d"
+#define IP2STR(a)                               \
+    (int) ((a)->addr & 0xff),                   \
+    (int) (((a)->addr >> 8) & 0xff),            \
+    (int) (((a)->addr >> 16) & 0xff),           \
+    (int) (((a)->addr >> 24) & 0xff)
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,51 @@
+/*
+ * FreeRTOS.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+/*
+ * Just enough of FreeRTOS for the host tests and benches under misc/ to
+ * build the firmware's pure C modules. Critical sections are pthread
+ * mutexes and a thread picks its "core" through host_core_id, which a
+ * test that needs it defines.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define portNUM_PROCESSORS  2
+#define portMAX_DELAY       0xffffffffU
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef pthread_mutex_t portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED  PTHREAD_MUTEX_INITIALIZER
+#define portMUX_INITIALIZE(mux)       pthread_mutex_init(mux, NULL)
+
+#define portENTER_CRITICAL(mux)  pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)   pthread_mutex_unlock(mux)
+
+extern __thread int host_core_id;
+
+#define xPortGetCoreID()  (host_core_id)
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,53 @@
+/*
+ * task.h
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef TASK_H
+#define TASK_H
+
+#include <unistd.h>
+#include <freertos/FreeRTOS.h>
+
+#define pdMS_TO_TICKS(ms)  ((TickType_t) (ms))
+
+typedef void *TaskHandle_t;
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * 1000);
+}
+
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    (void) (task);
+
+    return pdPASS;
+}
+
+static inline TaskHandle_t xTaskGetHandle(const char *name)
+{
+    (void) (name);
+
+    return NULL;
+}
+
+static inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    (void) (task);
+
+    return 0;
+}
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,240 @@
+/*
+ * MeshRoof.hxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+#ifndef MESHROOF_HXX
+#define MESHROOF_HXX
+
+/*
+ * Stand-in for the firmware's MeshRoof with just the methods the RPC
+ * and HTTP servers call, so that MeshRoofRpc.cxx and MeshRoofHttp.cxx
+ * build and run on the host. Commands are counted instead of executed.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <esp_netif.h>
+
+#define CMD_BUZZ_MAX_MS   5000
+
+using namespace std;
+
+enum meshroof_cmd {
+    MESHROOF_CMD_BUZZ = 0,
+    MESHROOF_CMD_RESET,
+    MESHROOF_CMD_CACHE_SAVE,
+    MESHROOF_CMDS,
+};
+
+#define CMD_HIST_BUCKETS  12
+
+struct cmd_stats {
+    unsigned int depth;
+    unsigned int max_depth;
+    uint32_t dropped;
+    uint32_t count[MESHROOF_CMDS];
+    uint64_t total_us[MESHROOF_CMDS];
+    uint32_t hist[MESHROOF_CMDS][CMD_HIST_BUCKETS];
+};
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_event_sta_connected_t;
+
+class EspWifi {
+
+public:
+
+    EspWifi() {
+        memset(&_sta, 0x0, sizeof(_sta));
+        memset(&_ip, 0x0, sizeof(_ip));
+    }
+
+    int getRssi(void) const {
+        return -60;
+    }
+    const wifi_event_sta_connected_t *getStaConnected(void) const {
+        return &_sta;
+    }
+    const esp_netif_ip_info_t *getIpInfo(void) const {
+        return &_ip;
+    }
+
+private:
+
+    wifi_event_sta_connected_t _sta;
+    esp_netif_ip_info_t _ip;
+
+};
+
+class MeshRoof {
+
+public:
+
+    MeshRoof() : _wifi(make_shared<EspWifi>()), _amplify(false),
+                 _baud(115200), _queued{0, 0, 0}, _lastArg(0) {
+
+    }
+
+    shared_ptr<EspWifi> espWifi(void) {
+        return _wifi;
+    }
+
+    void amplify(bool onOff) {
+        _amplify = onOff;
+    }
+    bool isAmplifying(void) const {
+        return _amplify;
+    }
+    bool isConnected(void) const {
+        return true;
+    }
+    unsigned int getResetCount(void) const {
+        return _queued[MESHROOF_CMD_RESET];
+    }
+    unsigned int getLastResetSecsAgo(void) const {
+        return 0;
+    }
+    float getCpuTempC(void) const {
+        return 42.0;
+    }
+    unsigned int meshDeviceLastRecivedSecondsAgo(void) const {
+        return 0;
+    }
+    void getCommandStats(struct cmd_stats *stats) const {
+        unsigned int i;
+
+        memset(stats, 0x0, sizeof(*stats));
+        for (i = 0; i < MESHROOF_CMDS; i++) {
+            stats->count[i] = _queued[i];
+        }
+    }
+    static const char *commandName(unsigned int cmd) {
+        static const char *names[MESHROOF_CMDS] = {
+            "buzz", "reset", "cache_save",
+        };
+
+        return (cmd < MESHROOF_CMDS) ? names[cmd] : "?";
+    }
+    unsigned int getConfigDownloadMs(void) const {
+        return 0;
+    }
+    uint32_t getConfigDownloadBaud(void) const {
+        return _baud;
+    }
+    unsigned int getUsableMs(void) const {
+        return 0;
+    }
+    bool wasUsableFromCache(void) const {
+        return false;
+    }
+
+    bool queueCommand(enum meshroof_cmd cmd, uint32_t node_num = 0,
+                      unsigned int arg = 0) {
+        (void)(node_num);
+        _queued[cmd]++;
+        _lastArg = arg;
+        return true;
+    }
+    unsigned int queued(enum meshroof_cmd cmd) const {
+        return _queued[cmd];
+    }
+    unsigned int lastArg(void) const {
+        return _lastArg;
+    }
+
+    void addMorseText(const string &text) {
+        (void)(text);
+    }
+
+    string getWifiSsid(void) const {
+        return "meshroof";
+    }
+    uint32_t getIp(void) const {
+        return 0;
+    }
+    string getIpString(void) const {
+        return "";
+    }
+    string getNetmaskString(void) const {
+        return "";
+    }
+    string getGatewayString(void) const {
+        return "";
+    }
+    string getDns1String(void) const {
+        return "";
+    }
+    string getDns2String(void) const {
+        return "";
+    }
+    string getDns3String(void) const {
+        return "";
+    }
+    uint32_t getSerialBaud(void) const {
+        return _baud;
+    }
+
+    bool setWifiSsid(const string &v) {
+        return !v.empty();
+    }
+    bool setWifiPasswd(const string &v) {
+        return !v.empty();
+    }
+    bool setIp(const string &v) {
+        return !v.empty();
+    }
+    bool setNetmask(const string &v) {
+        return !v.empty();
+    }
+    bool setGateway(const string &v) {
+        return !v.empty();
+    }
+    bool setDns1(const string &v) {
+        return !v.empty();
+    }
+    bool setDns2(const string &v) {
+        return !v.empty();
+    }
+    bool setDns3(const string &v) {
+        return !v.empty();
+    }
+    bool setSerialBaud(uint32_t baud) {
+        _baud = baud;
+        return true;
+    }
+    bool saveNvm(void) {
+        return true;
+    }
+    void requestLinkBaud(void) {
+
+    }
+
+private:
+
+    shared_ptr<EspWifi> _wifi;
+    bool _amplify;
+    uint32_t _baud;
+    unsigned int _queued[MESHROOF_CMDS];
+    unsigned int _lastArg;
+
+};
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
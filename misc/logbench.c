@@ -0,0 +1,162 @@
+/*
+ * logbench.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host benchmark of the log ring with several producers per core and one
+ * reader. Every message carries its producer, its number and a pattern
+ * derived from both, so a torn or reordered message fails the run.
+ * Reports messages/s for 1, 2 and 4 producers per core. Run with
+ * 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <logring.h>
+
+#define MESSAGES      200000
+#define MAX_PRODUCERS (4 * portNUM_PROCESSORS)
+
+__thread int host_core_id = 0;
+
+struct producer {
+    pthread_t thread;
+    unsigned int id;
+};
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static size_t message(char *buf, unsigned int id, unsigned int n)
+{
+    size_t len;
+    size_t i;
+
+    len = snprintf(buf, 32, "P%u %u ", id, n);
+    for (i = len; i < 16 + ((n * 37) % 280); i++) {
+        buf[i] = 'a' + ((id + n + i) % 26);
+    }
+
+    return i;
+}
+
+static void *producer_main(void *arg)
+{
+    struct producer *producer = (struct producer *) arg;
+    char buf[512];
+    unsigned int n;
+
+    host_core_id = producer->id % portNUM_PROCESSORS;
+    for (n = 0; n < MESSAGES; n++) {
+        log_write(buf, message(buf, producer->id, n));
+    }
+
+    return NULL;
+}
+
+static void run(unsigned int per_core)
+{
+    struct producer producers[MAX_PRODUCERS];
+    struct log_cursor cursor;
+    struct log_stats stats;
+    unsigned int next[MAX_PRODUCERS];
+    unsigned int count = per_core * portNUM_PROCESSORS;
+    unsigned int id, n;
+    unsigned int received = 0;
+    unsigned int markers = 0;
+    bool done = false;
+    char expect[512];
+    char buf[LOG_MSG_MAX + 1];
+    double start;
+    double t;
+    size_t len;
+    unsigned int i;
+    int ret;
+
+    log_init();
+    log_cursor_init(&cursor);
+    memset(next, 0x0, sizeof(next));
+
+    start = now_s();
+    for (i = 0; i < count; i++) {
+        producers[i].id = i;
+        assert(pthread_create(&producers[i].thread, NULL, producer_main,
+                              &producers[i]) == 0);
+    }
+
+    for (;;) {
+        ret = log_read(&cursor, buf, sizeof(buf));
+        if (ret == 0) {
+            if (done) {
+                break;
+            }
+            // Once every message is in, read until the ring is empty
+            log_get_stats(&stats);
+            done = (stats.messages + stats.lost) == (count * MESSAGES);
+            sched_yield();
+            continue;
+        }
+
+        if (buf[0] == '[') {
+            markers++;
+            continue;
+        }
+
+        assert(sscanf(buf, "P%u %u ", &id, &n) == 2);
+        assert((id < count) && (n >= next[id]));
+        len = message(expect, id, n);
+        if (((size_t) ret != len) || (memcmp(buf, expect, len) != 0)) {
+            fprintf(stderr, "torn message from P%u #%u\n", id, n);
+            exit(1);
+        }
+        next[id] = n + 1;
+        received++;
+    }
+    t = now_s() - start;
+
+    for (i = 0; i < count; i++) {
+        pthread_join(producers[i].thread, NULL);
+    }
+    log_get_stats(&stats);
+    assert(stats.messages + stats.lost == count * MESSAGES);
+
+    printf("%u producers/core: %8.0f messages/s, %u read intact, "
+           "%u overwritten, %u lost\n", per_core,
+           (count * MESSAGES) / t, received,
+           (unsigned int) stats.overwritten, (unsigned int) stats.lost);
+    assert((received > 0) || (markers > 0));
+}
+
+int main(void)
+{
+    run(1);
+    run(2);
+    run(4);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
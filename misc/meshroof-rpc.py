@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+#
+# meshroof-rpc.py
+#
+# Copyright (C) 2025, Charles Chiou
+#
+# Client for the meshroof RPC port (16877). Each message is a 4-byte
+# big-endian length followed by a JSON object.
+#
+# Usage:
+#   misc/meshroof-rpc.py <host> status
+#   misc/meshroof-rpc.py <host> amplify on=true
+#   misc/meshroof-rpc.py <host> nvm.set wifi_ssid=home serial_baud=460800
+#   misc/meshroof-rpc.py <host> --bench 1000 [--depth 16] status
+#
+
+import argparse
+import json
+import socket
+import struct
+import sys
+import time
+
+RPC_PORT = 16877
+
+
+class Client:
+    def __init__(self, host, port=RPC_PORT):
+        self.sock = socket.create_connection((host, port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b''
+        self.next_id = 1
+
+    def send(self, method, params=None):
+        req = {'id': self.next_id, 'method': method}
+        if params:
+            req['params'] = params
+        self.next_id += 1
+        data = json.dumps(req, separators=(',', ':')).encode()
+        self.sock.sendall(struct.pack('>I', len(data)) + data)
+        return req['id']
+
+    def recv(self):
+        while True:
+            if len(self.buf) >= 4:
+                (n,) = struct.unpack('>I', self.buf[:4])
+                if len(self.buf) >= 4 + n:
+                    msg = self.buf[4:4 + n]
+                    self.buf = self.buf[4 + n:]
+                    return json.loads(msg)
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError('connection closed')
+            self.buf += data
+
+    def call(self, method, params=None):
+        rid = self.send(method, params)
+        reply = self.recv()
+        if reply.get('id') != rid:
+            raise RuntimeError('reply id %s != %s' % (reply.get('id'), rid))
+        return reply
+
+
+def parse_params(args):
+    params = {}
+    for arg in args:
+        key, _, value = arg.partition('=')
+        try:
+            params[key] = json.loads(value)
+        except ValueError:
+            params[key] = value
+    return params
+
+
+def bench(client, method, params, count, depth):
+    sent = 0
+    received = 0
+    start = time.monotonic()
+    while received < count:
+        while sent < count and sent - received < depth:
+            client.send(method, params)
+            sent += 1
+        reply = client.recv()
+        if 'error' in reply:
+            raise RuntimeError(reply['error'])
+        received += 1
+    elapsed = time.monotonic() - start
+    print('%d requests in %.3f s: %.1f req/s (pipeline depth %d)' %
+          (count, elapsed, count / elapsed, depth))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('host')
+    ap.add_argument('method')
+    ap.add_argument('params', nargs='*', help='key=value (JSON values)')
+    ap.add_argument('--port', type=int, default=RPC_PORT)
+    ap.add_argument('--bench', type=int, metavar='N',
+                    help='send N requests and report the rate')
+    ap.add_argument('--depth', type=int, default=16,
+                    help='requests in flight while benchmarking')
+    args = ap.parse_args()
+
+    client = Client(args.host, args.port)
+    params = parse_params(args.params)
+
+    if args.bench:
+        bench(client, args.method, params, args.bench, args.depth)
+        return 0
+
+    reply = client.call(args.method, params)
+    print(json.dumps(reply, indent=2))
+
+    return 1 if 'error' in reply else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
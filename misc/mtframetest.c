@@ -0,0 +1,321 @@
+/*
+ * mtframetest.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host test of the RX frame assembler: frames are fed into a small ring
+ * byte by byte and in bursts, across the wrap point, behind garbage and
+ * bogus length headers, and every frame must come out whole with the
+ * same fields as when it is peeked from a flat buffer. Run with
+ * 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <mtframe.h>
+
+#define RING_SIZE  256
+
+static uint8_t ring_buf[RING_SIZE];
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+
+    do {
+        p[n] = v & 0x7f;
+        v >>= 7;
+        if (v != 0) {
+            p[n] |= 0x80;
+        }
+        n++;
+    } while (v != 0);
+
+    return n;
+}
+
+static size_t put_fixed32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+
+    return sizeof(v);
+}
+
+static size_t put_float(uint8_t *p, float f)
+{
+    uint32_t v;
+
+    memcpy(&v, &f, sizeof(v));
+
+    return put_fixed32(p, v);
+}
+
+static size_t put_string(uint8_t *p, uint32_t tag, const uint8_t *s,
+                         size_t len)
+{
+    size_t n = 0;
+
+    p[n++] = (tag << 3) | PB_WT_STRING;
+    n += put_varint(p + n, len);
+    memcpy(p + n, s, len);
+
+    return n + len;
+}
+
+/*
+ * FromRadio { packet { from, to, decoded { portnum }, id, rx_snr,
+ * hop_limit, rx_rssi, hop_start } }
+ */
+static size_t make_packet(uint8_t *p, uint32_t from, uint32_t id)
+{
+    uint8_t pkt[64];
+    uint8_t data[8];
+    size_t n = 0;
+    size_t d = 0;
+
+    data[d++] = (1 << 3) | PB_WT_VARINT;
+    data[d++] = 1;
+
+    pkt[n++] = (1 << 3) | PB_WT_32BIT;
+    n += put_fixed32(pkt + n, from);
+    pkt[n++] = (2 << 3) | PB_WT_32BIT;
+    n += put_fixed32(pkt + n, 0xffffffff);
+    n += put_string(pkt + n, 4, data, d);
+    pkt[n++] = (6 << 3) | PB_WT_32BIT;
+    n += put_fixed32(pkt + n, id);
+    pkt[n++] = (8 << 3) | PB_WT_32BIT;
+    n += put_float(pkt + n, -7.25f);
+    pkt[n++] = (9 << 3) | PB_WT_VARINT;
+    n += put_varint(pkt + n, 1);
+    pkt[n++] = (12 << 3) | PB_WT_VARINT;
+    n += put_varint(pkt + n, (uint64_t) (int64_t) -100);
+    pkt[n++] = (15 << 3) | PB_WT_VARINT;
+    n += put_varint(pkt + n, 3);
+
+    return put_string(p, MT_FROMRADIO_PACKET, pkt, n);
+}
+
+/*
+ * FromRadio { node_info { num, user { id, long_name, short_name },
+ * snr, hops_away } }
+ */
+static size_t make_node_info(uint8_t *p, uint32_t num)
+{
+    uint8_t user[32];
+    uint8_t ni[64];
+    size_t u = 0;
+    size_t n = 0;
+
+    u += put_string(user + u, 1, (const uint8_t *) "!x", 2);
+    u += put_string(user + u, 2, (const uint8_t *) "Long", 4);
+    u += put_string(user + u, 3, (const uint8_t *) "ABCDEF", 6);
+
+    ni[n++] = (1 << 3) | PB_WT_VARINT;
+    n += put_varint(ni + n, num);
+    n += put_string(ni + n, 2, user, u);
+    ni[n++] = (4 << 3) | PB_WT_32BIT;
+    n += put_float(ni + n, 5.5f);
+    ni[n++] = (9 << 3) | PB_WT_VARINT;
+    n += put_varint(ni + n, 2);
+
+    return put_string(p, MT_FROMRADIO_NODE_INFO, ni, n);
+}
+
+static size_t make_frame(uint8_t *p, const uint8_t *payload, size_t len)
+{
+    p[0] = MT_FRAME_START1;
+    p[1] = MT_FRAME_START2;
+    p[2] = (len >> 8) & 0xff;
+    p[3] = len & 0xff;
+    memcpy(p + MT_FRAME_HDR_SIZE, payload, len);
+
+    return MT_FRAME_HDR_SIZE + len;
+}
+
+/*
+ * Feed 'len' bytes the way serial_rx_fill() does, 'chunk' at a time.
+ */
+static void ring_feed(struct mt_ring *ring, const uint8_t *buf, size_t len,
+                      size_t chunk)
+{
+    uint8_t *ptr;
+    size_t n;
+
+    while (len > 0) {
+        n = mt_ring_write_ptr(ring, &ptr);
+        assert(n > 0);
+        if (n > chunk) {
+            n = chunk;
+        }
+        if (n > len) {
+            n = len;
+        }
+        memcpy(ptr, buf, n);
+        mt_ring_commit(ring, n);
+        buf += n;
+        len -= n;
+    }
+}
+
+static void check_same(const struct mt_frame_info *a,
+                       const struct mt_frame_info *b)
+{
+    assert(a->variant == b->variant);
+    assert(a->from == b->from);
+    assert(a->to == b->to);
+    assert(a->id == b->id);
+    assert(a->portnum == b->portnum);
+    assert(a->rx_snr == b->rx_snr);
+    assert(a->rx_rssi == b->rx_rssi);
+    assert(a->hops == b->hops);
+    assert(strcmp(a->short_name, b->short_name) == 0);
+}
+
+/*
+ * Stream 'count' alternating packets and node infos through the ring in
+ * 'chunk' byte reads and check each one against a flat peek. Returns the
+ * number of frames that wrapped.
+ */
+static unsigned int stream_frames(unsigned int count, size_t chunk)
+{
+    struct mt_ring ring;
+    struct mt_frame frame;
+    struct mt_frame flat;
+    struct mt_frame_info info;
+    struct mt_frame_info expect;
+    uint8_t payload[MT_FRAME_MAX_PAYLOAD];
+    uint8_t wire[MT_FRAME_HDR_SIZE + MT_FRAME_MAX_PAYLOAD];
+    uint8_t copy[MT_FRAME_MAX_PAYLOAD];
+    unsigned int wrapped = 0;
+    unsigned int i;
+    size_t len;
+    size_t off;
+
+    mt_ring_init(&ring, ring_buf, sizeof(ring_buf));
+    for (i = 0; i < count; i++) {
+        if (i & 1) {
+            len = make_node_info(payload, 0x1000 + i);
+        } else {
+            len = make_packet(payload, 0xa1b2c3d4, i);
+        }
+        mt_frame_from_buffer(&flat, payload, len);
+        assert(mt_frame_peek(&flat, &expect) == 0);
+
+        /* Nothing is handed out until the last byte is in */
+        len = make_frame(wire, payload, len);
+        for (off = 0; off < len; off += chunk) {
+            assert(mt_frame_next(&ring, &frame) == 0);
+            ring_feed(&ring, wire + off,
+                      ((len - off) < chunk) ? (len - off) : chunk, chunk);
+        }
+        assert(mt_frame_next(&ring, &frame) == 1);
+        assert(frame.len == flat.len);
+        if (frame.seg_len[1] != 0) {
+            wrapped++;
+        }
+
+        assert(mt_frame_read(&frame, 0, copy, sizeof(copy)) == frame.len);
+        assert(memcmp(copy, payload, frame.len) == 0);
+        assert(mt_frame_peek(&frame, &info) == 0);
+        check_same(&info, &expect);
+
+        mt_frame_consume(&ring, &frame);
+        assert(mt_ring_used(&ring) == 0);
+    }
+    assert(ring.dropped == 0);
+
+    return wrapped;
+}
+
+int main(void)
+{
+    struct mt_ring ring;
+    struct mt_frame frame;
+    struct mt_frame_info info;
+    uint8_t payload[MT_FRAME_MAX_PAYLOAD];
+    uint8_t wire[64 + MT_FRAME_HDR_SIZE + MT_FRAME_MAX_PAYLOAD];
+    uint32_t variant;
+    unsigned int wrapped;
+    size_t len;
+    size_t n;
+
+    /* Whole frames in bursts and byte by byte, wrapping the ring */
+    wrapped = stream_frames(200, 64);
+    printf("burst: 200 frames, %u wrapped\n", wrapped);
+    assert(wrapped > 0);
+    wrapped = stream_frames(200, 1);
+    printf("byte by byte: 200 frames, %u wrapped\n", wrapped);
+    assert(wrapped > 0);
+
+    /* Garbage, a lone start byte and an oversized header are skipped */
+    mt_ring_init(&ring, ring_buf, sizeof(ring_buf));
+    n = 0;
+    memcpy(wire + n, "noise", 5);
+    n += 5;
+    wire[n++] = MT_FRAME_START1;
+    wire[n++] = 0x00;
+    wire[n++] = MT_FRAME_START1;
+    wire[n++] = MT_FRAME_START2;
+    wire[n++] = 0xff;
+    wire[n++] = 0xff;
+    len = make_packet(payload, 0x1234, 42);
+    n += make_frame(wire + n, payload, len);
+    ring_feed(&ring, wire, n, n);
+    assert(mt_frame_next(&ring, &frame) == 1);
+    assert(mt_frame_peek(&frame, &info) == 0);
+    assert((info.from == 0x1234) && (info.id == 42));
+    assert(ring.oversized == 1);
+    assert(ring.dropped == 11);
+    mt_frame_consume(&ring, &frame);
+    printf("resync: skipped %u bytes, %u oversized\n",
+           ring.dropped, ring.oversized);
+
+    /* A frame that is not a valid protobuf is found but fails the peek */
+    memset(payload, 0xff, 8);
+    n = make_frame(wire, payload, 8);
+    ring_feed(&ring, wire, n, n);
+    assert(mt_frame_next(&ring, &frame) == 1);
+    assert(mt_frame_peek(&frame, &info) == -1);
+    mt_frame_consume(&ring, &frame);
+
+    /*
+     * A truncated frame stalls until serial_rx_ready() gives up on it; the
+     * resync then finds the next frame
+     */
+    len = make_packet(payload, 0x5678, 7);
+    n = make_frame(wire, payload, len) - 3;
+    ring_feed(&ring, wire, n, n);
+    assert(mt_frame_next(&ring, &frame) == 0);
+    mt_ring_resync(&ring);
+    n = make_frame(wire, payload, len);
+    ring_feed(&ring, wire, n, n);
+    assert(mt_frame_next(&ring, &frame) == 1);
+    assert(mt_frame_peek(&frame, &info) == 0);
+    assert((info.from == 0x5678) && (info.id == 7));
+    mt_frame_consume(&ring, &frame);
+    assert(mt_ring_used(&ring) == 0);
+
+    /* ToRadio { want_config_id } */
+    payload[0] = (MT_TORADIO_WANT_CONFIG_ID << 3) | PB_WT_VARINT;
+    payload[1] = 42;
+    mt_frame_from_buffer(&frame, payload, 2);
+    assert(mt_frame_toradio_variant(&frame, &variant) == 0);
+    assert(variant == MT_TORADIO_WANT_CONFIG_ID);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
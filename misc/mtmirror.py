@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+#
+# mtmirror.py
+#
+# Copyright (C) 2025, Charles Chiou
+#
+# Watch the meshroof packet mirror (port 16878). The stream is FromRadio
+# protobufs in the Meshtastic serial framing (0x94 0xc3 <len16> <payload>);
+# this prints packet rates per portnum every few seconds.
+#
+# Usage: misc/mtmirror.py <host> [--interval 10] [--port 16878]
+#
+
+import argparse
+import collections
+import socket
+import sys
+import time
+
+MIRROR_PORT = 16878
+
+FROMRADIO_VARIANTS = {
+    2: 'packet', 3: 'my_info', 4: 'node_info', 5: 'config',
+    6: 'log_record', 7: 'config_complete', 8: 'rebooted',
+    9: 'module_config', 10: 'channel', 11: 'queue_status',
+    13: 'metadata',
+}
+
+PORTNUMS = {
+    0: 'UNKNOWN_APP', 1: 'TEXT_MESSAGE_APP', 2: 'REMOTE_HARDWARE_APP',
+    3: 'POSITION_APP', 4: 'NODEINFO_APP', 5: 'ROUTING_APP', 6: 'ADMIN_APP',
+    7: 'TEXT_MESSAGE_COMPRESSED_APP', 8: 'WAYPOINT_APP', 9: 'AUDIO_APP',
+    10: 'DETECTION_SENSOR_APP', 32: 'REPLY_APP', 33: 'IP_TUNNEL_APP',
+    34: 'PAXCOUNTER_APP', 64: 'SERIAL_APP', 65: 'STORE_FORWARD_APP',
+    66: 'RANGE_TEST_APP', 67: 'TELEMETRY_APP', 68: 'ZPS_APP',
+    69: 'SIMULATOR_APP', 70: 'TRACEROUTE_APP', 71: 'NEIGHBORINFO_APP',
+    72: 'ATAK_PLUGIN', 73: 'MAP_REPORT_APP', 256: 'PRIVATE_APP',
+}
+
+
+def varint(buf, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7f) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def fields(buf):
+    """Yield (field number, wire type, value) for one protobuf message."""
+    pos = 0
+    while pos < len(buf):
+        key, pos = varint(buf, pos)
+        num, wt = key >> 3, key & 7
+        if wt == 0:
+            value, pos = varint(buf, pos)
+        elif wt == 1:
+            value, pos = buf[pos:pos + 8], pos + 8
+        elif wt == 2:
+            n, pos = varint(buf, pos)
+            value, pos = buf[pos:pos + n], pos + n
+        elif wt == 5:
+            value, pos = buf[pos:pos + 4], pos + 4
+        else:
+            raise ValueError('wire type %d' % wt)
+        yield num, wt, value
+
+
+def classify(payload):
+    """Name a FromRadio: its variant, or the portnum for packets."""
+    for num, wt, value in fields(payload):
+        if num == 1:
+            continue
+        if num != 2 or wt != 2:
+            return FROMRADIO_VARIANTS.get(num, 'variant_%d' % num)
+        for pnum, pwt, pvalue in fields(value):
+            if pnum == 5 and pwt == 2:
+                return 'encrypted'
+            if pnum == 4 and pwt == 2:
+                for dnum, dwt, dvalue in fields(pvalue):
+                    if dnum == 1 and dwt == 0:
+                        return PORTNUMS.get(dvalue, 'portnum_%d' % dvalue)
+                return PORTNUMS[0]
+        return 'packet'
+    return 'empty'
+
+
+def frames(sock):
+    buf = b''
+    while True:
+        data = sock.recv(4096)
+        if not data:
+            return
+        buf += data
+        while len(buf) >= 4:
+            if buf[0] != 0x94 or buf[1] != 0xc3:
+                buf = buf[1:]
+                continue
+            n = (buf[2] << 8) | buf[3]
+            if len(buf) < 4 + n:
+                break
+            yield buf[4:4 + n]
+            buf = buf[4 + n:]
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('host')
+    ap.add_argument('--port', type=int, default=MIRROR_PORT)
+    ap.add_argument('--interval', type=float, default=10.0)
+    args = ap.parse_args()
+
+    sock = socket.create_connection((args.host, args.port))
+    counts = collections.Counter()
+    totals = collections.Counter()
+    start = last = time.monotonic()
+
+    for payload in frames(sock):
+        try:
+            kind = classify(payload)
+        except (ValueError, IndexError):
+            kind = 'malformed'
+        counts[kind] += 1
+        totals[kind] += 1
+
+        now = time.monotonic()
+        if now - last >= args.interval:
+            print('--- %.0f s' % (now - start))
+            for kind, n in totals.most_common():
+                print('%-28s %8.2f/min %8d total' %
+                      (kind, counts[kind] * 60.0 / (now - last), n))
+            sys.stdout.flush()
+            counts.clear()
+            last = now
+
+    return 0
+
+
+if __name__ == '__main__':
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        sys.exit(0)
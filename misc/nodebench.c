@@ -0,0 +1,140 @@
+/*
+ * nodebench.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host benchmark of the node table: thousands of synthetic nodes are
+ * heard, then lookups of resident and unknown nodes are timed against a
+ * linear scan of the same records. Every resident node must be found,
+ * no evicted one, and the sorted walk must visit each resident node
+ * once. Run with 'make hosttest'. Table sizes may be overridden:
+ *
+ *   gcc -O2 -Imisc/host -Imain -DNODETAB_SLOTS=8192 \
+ *       misc/nodebench.c main/nodetab.c -o /tmp/nodebench
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <nodetab.h>
+
+#define SYNTHETIC_NODES  ((NODETAB_MAX_NODES * 4) + 4096)
+#define LOOKUPS          2000000
+
+static uint32_t nodes[SYNTHETIC_NODES];
+static struct nodetab_entry linear[NODETAB_MAX_NODES];
+
+static uint32_t xorshift(void)
+{
+    static uint32_t x = 2463534242U;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return x;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+int main(void)
+{
+    struct nodetab_stats stats;
+    struct nodetab_entry entry;
+    unsigned int resident;
+    unsigned int found = 0;
+    unsigned int i, j, n;
+    double start;
+
+    nodetab_init();
+    for (i = 0; i < SYNTHETIC_NODES; i++) {
+        nodes[i] = xorshift() | 0x1;
+    }
+
+    start = now_ns();
+    for (i = 0; i < SYNTHETIC_NODES; i++) {
+        nodetab_heard(nodes[i], 1000 + i, (int8_t) (xorshift() % 80) - 40,
+                      -(int16_t) (xorshift() % 120), xorshift() % 4);
+    }
+    printf("heard %u nodes: %.1f ns each\n", SYNTHETIC_NODES,
+           (now_ns() - start) / SYNTHETIC_NODES);
+
+    nodetab_get_stats(&stats);
+    printf("table: %u/%u nodes in %u slots, %zu bytes (%zu per node), "
+           "%u evictions\n",
+           stats.nodes, stats.capacity, NODETAB_SLOTS, stats.memory,
+           sizeof(struct nodetab_entry), (unsigned int) stats.evictions);
+
+    /* The most recently heard nodes are the ones still resident */
+    resident = stats.nodes;
+    for (i = 0; i < resident; i++) {
+        nodetab_lookup(nodes[SYNTHETIC_NODES - resident + i], &linear[i]);
+    }
+
+    start = now_ns();
+    for (i = 0; i < LOOKUPS; i++) {
+        found += nodetab_lookup(nodes[SYNTHETIC_NODES - 1 - (i % resident)],
+                                &entry);
+    }
+    printf("lookup hit:  %.1f ns\n", (now_ns() - start) / LOOKUPS);
+    assert(found == LOOKUPS);
+
+    start = now_ns();
+    for (i = 0; i < LOOKUPS; i++) {
+        found += nodetab_lookup(nodes[i % (SYNTHETIC_NODES - resident)],
+                                &entry);
+    }
+    printf("lookup miss: %.1f ns\n", (now_ns() - start) / LOOKUPS);
+    assert(found == LOOKUPS);
+
+    start = now_ns();
+    for (i = 0; i < LOOKUPS / 100; i++) {
+        uint32_t node_num = nodes[SYNTHETIC_NODES - 1 - (i % resident)];
+
+        for (j = 0; j < resident; j++) {
+            if (linear[j].node_num == node_num) {
+                memcpy(&entry, &linear[j], sizeof(entry));
+                found++;
+                break;
+            }
+        }
+    }
+    printf("linear scan hit: %.1f ns\n",
+           (now_ns() - start) / (LOOKUPS / 100));
+
+    start = now_ns();
+    n = 0;
+    if (nodetab_next(NULL, &entry)) {
+        do {
+            n++;
+        } while (nodetab_next(&entry, &entry));
+    }
+    printf("sorted walk of %u nodes: %.1f us\n", n, (now_ns() - start) / 1e3);
+    assert(found == (LOOKUPS + (LOOKUPS / 100)));
+    assert(n == resident);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
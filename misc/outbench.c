@@ -0,0 +1,279 @@
+/*
+ * outbench.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host benchmark of the TCP shell's output path (outbuf.c): a command
+ * that prints a screenful of formatted lines and one that streams a task
+ * list sized blob, for a client that keeps up and for one that stopped
+ * reading. malloc() is wrapped to count allocations, which must be zero
+ * per command. The client that keeps up must get every byte; the stalled
+ * one may hold up a command by OUTBUF_WAIT_MS once, and the output it
+ * missed must be marked. Run with 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <outbuf.h>
+
+#define OBUF_SIZE     1024
+#define COMMANDS      20000
+#define STALLED       200
+#define TASKS_LEN     6000
+#define EXPECT_MAX    (STALLED * (TASKS_LEN + 4096))
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned int allocs = 0;
+static int counting = 0;
+
+void *malloc(size_t size)
+{
+    allocs += counting;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    allocs += counting;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocs += counting;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static char obuf[OBUF_SIZE];
+static struct outbuf ob;
+static char tasks[TASKS_LEN + 1];
+static char expect[EXPECT_MAX];
+static size_t expect_len;
+static char got[EXPECT_MAX + 256];
+static volatile size_t got_len;
+static volatile bool keep;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+/*
+ * What the shell's printf() does for a TCP session, also recording the
+ * text for the checks.
+ */
+static void out(int fd, bool record, const char *format, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, format);
+    ret = outbuf_vprintf(&ob, fd, format, ap);
+    va_end(ap);
+    assert(ret >= 0);
+
+    if (record) {
+        va_start(ap, format);
+        expect_len += vsnprintf(expect + expect_len,
+                                sizeof(expect) - expect_len, format, ap);
+        va_end(ap);
+    }
+}
+
+static void cmd_stats(int fd, bool record, unsigned int n)
+{
+    unsigned int i;
+
+    out(fd, record, "serial: %u frames, %u bytes, %u decode errors\n",
+        n, n * 97, n % 7);
+    for (i = 0; i < 30; i++) {
+        out(fd, record, "%-12s %10u %8.1f%% 0x%08x %s\n", "counter", n + i,
+            (double) i * 3.3, n ^ i, (i & 1) ? "up" : "down");
+    }
+    out(fd, record, "> ");
+}
+
+static void cmd_tasks(int fd, bool record)
+{
+    assert(outbuf_write(&ob, fd, tasks, TASKS_LEN) == 0);
+    if (record) {
+        memcpy(expect + expect_len, tasks, TASKS_LEN);
+        expect_len += TASKS_LEN;
+    }
+}
+
+/*
+ * The client that keeps up: reads everything, keeping it when asked.
+ */
+static void *reader_main(void *arg)
+{
+    int fd = *(int *) arg;
+    char buf[4096];
+    ssize_t ret;
+
+    while ((ret = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        if (keep) {
+            memcpy(got + got_len, buf, ret);
+        }
+        got_len += ret;
+    }
+
+    return NULL;
+}
+
+/*
+ * What the event loop does between commands: send until nothing is left.
+ */
+static void send_all(int fd)
+{
+    while (outbuf_pending(&ob)) {
+        assert(outbuf_send(&ob, fd) == 0);
+        sched_yield();
+    }
+}
+
+int main(void)
+{
+    pthread_t reader;
+    int sv[2];
+    int sndbuf = 4096;
+    unsigned int i;
+    double start;
+    double t;
+    double worst = 0;
+    char marker[64];
+    size_t kept;
+    ssize_t ret;
+
+    for (i = 0; i < TASKS_LEN; i++) {
+        tasks[i] = ((i % 64) == 63) ? '\n' : 'a' + (i % 26);
+    }
+
+    /* A small socket buffer makes short writes the common case */
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    assert(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+                      sizeof(sndbuf)) == 0);
+    outbuf_init(&ob, obuf, sizeof(obuf));
+    keep = true;
+    assert(pthread_create(&reader, NULL, reader_main, &sv[1]) == 0);
+
+    /* A client that keeps up gets every byte in order, however long */
+    for (i = 0; i < 100; i++) {
+        cmd_stats(sv[0], true, i);
+        cmd_tasks(sv[0], true);
+        send_all(sv[0]);
+    }
+    while (got_len < expect_len) {
+        sched_yield();
+    }
+    assert(got_len == expect_len);
+    assert(memcmp(got, expect, expect_len) == 0);
+    assert(ob.dropped == 0);
+    printf("client keeping up: %zu bytes through a %u byte buffer intact\n",
+           expect_len, OBUF_SIZE);
+
+    keep = false;
+    counting = 1;
+    start = now_ns();
+    for (i = 0; i < COMMANDS; i++) {
+        cmd_stats(sv[0], false, i);
+        send_all(sv[0]);
+    }
+    t = now_ns() - start;
+    counting = 0;
+    printf("stats command: %.0f ns each, %.2f allocations per command\n",
+           t / COMMANDS, (double) allocs / COMMANDS);
+    assert(allocs == 0);
+    assert(ob.dropped == 0);
+
+    shutdown(sv[0], SHUT_WR);
+    pthread_join(reader, NULL);
+    close(sv[0]);
+    close(sv[1]);
+
+    /* A stalled client costs one short wait; later output is dropped */
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    assert(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+                      sizeof(sndbuf)) == 0);
+    outbuf_init(&ob, obuf, sizeof(obuf));
+    expect_len = 0;
+    got_len = 0;
+    counting = 1;
+    start = now_ns();
+    for (i = 0; i < STALLED; i++) {
+        t = now_ns();
+        cmd_stats(sv[0], true, i);
+        cmd_tasks(sv[0], true);
+        t = now_ns() - t;
+        if (t > worst) {
+            worst = t;
+        }
+    }
+    t = now_ns() - start;
+    counting = 0;
+    printf("stalled client: %u commands in %.1f ms, worst %.1f ms, "
+           "%u bytes dropped, %u allocations\n", STALLED, t / 1e6,
+           worst / 1e6, (unsigned int) ob.dropped, allocs);
+    assert(allocs == 0);
+    assert(ob.dropped > 0);
+    assert(worst < (2 * OUTBUF_WAIT_MS * 1e6));
+    assert(t < (4 * OUTBUF_WAIT_MS * 1e6));
+
+    /* Once it reads again it gets what fit, then a note about the rest */
+    snprintf(marker, sizeof(marker), "\n[%u bytes of output dropped]\n",
+             (unsigned int) ob.dropped);
+    kept = expect_len - ob.dropped;
+    do {
+        assert(outbuf_send(&ob, sv[0]) == 0);
+        ret = recv(sv[1], got + got_len, sizeof(got) - got_len,
+                   MSG_DONTWAIT);
+        if (ret > 0) {
+            got_len += ret;
+        }
+    } while (outbuf_pending(&ob) || (ret > 0));
+    assert(got_len == kept + strlen(marker));
+    assert(memcmp(got, expect, kept) == 0);
+    assert(memcmp(got + kept, marker, strlen(marker)) == 0);
+    printf("after the stall: %zu bytes delivered, then the marker\n", kept);
+
+    close(sv[0]);
+    close(sv[1]);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
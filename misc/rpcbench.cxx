@@ -0,0 +1,232 @@
+/*
+ * rpcbench.cxx
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host benchmark of the JSON RPC server: MeshRoofRpc.cxx is built against
+ * the stand-in MeshRoof in misc/host/rpc and served over a socketpair the
+ * way the console loop serves it, with requests pipelined DEPTH deep.
+ * Reports requests/s and the worst single process() call per method, and
+ * checks that buzz and reset are queued rather than run in the loop and
+ * that a client that stops reading its replies never makes process()
+ * wait. Run with 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <esp_timer.h>
+#include <meshroof.h>
+#include <MeshRoof.hxx>
+#include <MeshRoofRpc.hxx>
+
+#define REQUESTS  100000
+#define DEPTH     16
+#define STALLED   200
+
+__thread int host_core_id = 0;
+
+shared_ptr<MeshRoof> meshroof;
+
+uint32_t serial_get_baud(void)
+{
+    return 921600;
+}
+
+static void send_request(int fd, const char *json)
+{
+    uint8_t msg[4 + RPC_MAX_MSG];
+    size_t len = strlen(json);
+
+    msg[0] = (len >> 24) & 0xff;
+    msg[1] = (len >> 16) & 0xff;
+    msg[2] = (len >> 8) & 0xff;
+    msg[3] = len & 0xff;
+    memcpy(msg + 4, json, len);
+    assert(write(fd, msg, 4 + len) == (ssize_t) (4 + len));
+}
+
+/*
+ * Read the replies that are complete; the last one is kept in 'last'.
+ */
+static unsigned int read_replies(int fd, char *last, size_t size)
+{
+    static uint8_t buf[65536];
+    static size_t len = 0;
+    unsigned int replies = 0;
+    size_t rlen;
+    ssize_t ret;
+
+    ret = recv(fd, buf + len, sizeof(buf) - len, MSG_DONTWAIT);
+    if (ret > 0) {
+        len += ret;
+    }
+
+    while (len >= 4) {
+        rlen = ((size_t) buf[0] << 24) | ((size_t) buf[1] << 16) |
+            ((size_t) buf[2] << 8) | (size_t) buf[3];
+        if (len < (4 + rlen)) {
+            break;
+        }
+        if (last != NULL) {
+            snprintf(last, size, "%.*s", (int) rlen, buf + 4);
+        }
+        memmove(buf, buf + 4 + rlen, len - 4 - rlen);
+        len -= 4 + rlen;
+        replies++;
+    }
+
+    return replies;
+}
+
+static void bench(MeshRoofRpc *rpc, int fd, const char *name,
+                  const char *json)
+{
+    unsigned int sent = 0;
+    unsigned int done = 0;
+    int64_t start;
+    int64_t t;
+    int64_t worst = 0;
+
+    start = esp_timer_get_time();
+    while (done < REQUESTS) {
+        while ((sent < REQUESTS) && ((sent - done) < DEPTH)) {
+            send_request(fd, json);
+            sent++;
+        }
+        t = esp_timer_get_time();
+        assert(rpc->process() == 0);
+        t = esp_timer_get_time() - t;
+        if (t > worst) {
+            worst = t;
+        }
+        done += read_replies(fd, NULL, 0);
+    }
+    t = esp_timer_get_time() - start;
+
+    printf("%-7s %8.0f requests/s, worst process() %lld us\n", name,
+           REQUESTS / (t / 1e6), (long long) worst);
+}
+
+/*
+ * One request and its reply, for the checks.
+ */
+static void call(MeshRoofRpc *rpc, int fd, const char *json, char *reply,
+                 size_t size)
+{
+    send_request(fd, json);
+    assert(rpc->process() == 0);
+    assert(read_replies(fd, reply, size) == 1);
+}
+
+/*
+ * A client pipelines requests without reading the replies: process()
+ * must answer what fits and leave the rest queued rather than wait, and
+ * once the client reads again every request gets its reply.
+ */
+static void stalled(void)
+{
+    MeshRoofRpc *rpc = new MeshRoofRpc();
+    const char *json = "{\"id\":7,\"method\":\"status\"}";
+    int sndbuf = 4096;
+    unsigned int replies = 0;
+    int64_t t;
+    int64_t worst = 0;
+    unsigned int i;
+    int sv[2];
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    assert(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+                      sizeof(sndbuf)) == 0);
+    rpc->attach(sv[0]);
+
+    for (i = 0; i < STALLED; i++) {
+        send_request(sv[1], json);
+        t = esp_timer_get_time();
+        assert(rpc->process() == 0);
+        t = esp_timer_get_time() - t;
+        if (t > worst) {
+            worst = t;
+        }
+    }
+    assert(rpc->pending());
+    printf("stalled client: worst process() %lld us, replies queued\n",
+           (long long) worst);
+    assert(worst < 10000);
+
+    while (replies < STALLED) {
+        assert(rpc->process() == 0);
+        replies += read_replies(sv[1], NULL, 0);
+    }
+    assert(!rpc->pending());
+
+    rpc->detach();
+    close(sv[0]);
+    close(sv[1]);
+    delete rpc;
+}
+
+int main(void)
+{
+    MeshRoofRpc *rpc = new MeshRoofRpc();
+    char reply[RPC_MAX_MSG + 1];
+    int64_t t;
+    int sv[2];
+
+    meshroof = make_shared<MeshRoof>();
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    rpc->attach(sv[0]);
+
+    bench(rpc, sv[1], "status", "{\"id\":1,\"method\":\"status\"}");
+    bench(rpc, sv[1], "amplify",
+          "{\"id\":2,\"method\":\"amplify\",\"params\":{\"on\":true}}");
+    bench(rpc, sv[1], "buzz",
+          "{\"id\":3,\"method\":\"buzz\",\"params\":{\"ms\":500}}");
+    assert(meshroof->queued(MESHROOF_CMD_BUZZ) == REQUESTS);
+
+    /* Out of range buzzes are refused instead of stalling the loop */
+    t = esp_timer_get_time();
+    call(rpc, sv[1], "{\"id\":4,\"method\":\"buzz\","
+         "\"params\":{\"ms\":2000000000}}", reply, sizeof(reply));
+    t = esp_timer_get_time() - t;
+    printf("buzz 2000000000 ms: %s (%lld us)\n", reply, (long long) t);
+    assert(strstr(reply, "\"error\"") != NULL);
+    assert(meshroof->queued(MESHROOF_CMD_BUZZ) == REQUESTS);
+
+    call(rpc, sv[1], "{\"id\":5,\"method\":\"buzz\","
+         "\"params\":{\"ms\":5000}}", reply, sizeof(reply));
+    assert(strstr(reply, "\"result\"") != NULL);
+    assert(meshroof->lastArg() == 5000);
+
+    /* A reset is queued for the meshtastic task, not done in the loop */
+    call(rpc, sv[1], "{\"id\":6,\"method\":\"reset\","
+         "\"params\":{\"apply\":true}}", reply, sizeof(reply));
+    printf("reset: %s\n", reply);
+    assert(strstr(reply, "\"reset_queued\":true") != NULL);
+    assert(meshroof->queued(MESHROOF_CMD_RESET) == 1);
+
+    rpc->detach();
+    close(sv[0]);
+    close(sv[1]);
+    delete rpc;
+
+    stalled();
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C++
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
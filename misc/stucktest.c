@@ -0,0 +1,162 @@
+/*
+ * stucktest.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host simulation of the stuck radio detector, polled once a second the
+ * way meshtastic_task does. On a quiet mesh that only answers the 60 s
+ * heartbeat, on a busy mesh and on one busier still, the radio wedges
+ * after WEDGE_GAPS frames: until then there must be no reset, and after
+ * it the reset must come within the learned threshold plus the probes.
+ * A boot-time burst of config frames alone must leave the threshold at
+ * STUCKDET_MAX_S, and a probe the radio answers is a false positive, not
+ * a reset. Run with 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stuckdet.h>
+
+#define SEC_US         1000000LL
+#define POLL_US        SEC_US
+#define WEDGE_GAPS     3000
+#define PROBES_US      (STUCKDET_PROBES * STUCKDET_PROBE_TIMEOUT_S * SEC_US)
+
+__thread int host_core_id = 0;
+
+static int64_t now_us;
+static int64_t next_poll_us;
+static unsigned int resets;
+static unsigned int probes;
+
+static uint32_t xorshift(void)
+{
+    static uint32_t x = 2463534242U;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return x;
+}
+
+/*
+ * Move the clock to 'until_us', polling on the way.
+ */
+static void run_until(int64_t until_us)
+{
+    while (next_poll_us <= until_us) {
+        now_us = next_poll_us;
+        switch (stuckdet_poll(now_us)) {
+        case STUCKDET_PROBE:
+            probes++;
+            break;
+        case STUCKDET_RESET:
+            resets++;
+            break;
+        default:
+            break;
+        }
+        next_poll_us += POLL_US;
+    }
+    now_us = until_us;
+}
+
+static void start(void)
+{
+    stuckdet_init();
+    now_us = SEC_US;
+    next_poll_us = now_us;
+    resets = 0;
+    probes = 0;
+    run_until(now_us);
+}
+
+/*
+ * Frames spaced 'min_ms' to 'max_ms' apart, then silence until the
+ * radio is reset.
+ */
+static void wedge(const char *name, uint32_t min_ms, uint32_t max_ms,
+                  uint32_t min_s, uint32_t max_s)
+{
+    int64_t last_us;
+    uint32_t threshold_s;
+    unsigned int i;
+
+    start();
+    for (i = 0; i < WEDGE_GAPS; i++) {
+        run_until(now_us +
+                  (min_ms + (xorshift() % (max_ms - min_ms + 1))) * 1000LL);
+        stuckdet_frame(now_us);
+    }
+    assert(resets == 0);
+    threshold_s = stuckdet_threshold_s();
+    assert((threshold_s >= min_s) && (threshold_s <= max_s));
+
+    last_us = now_us;
+    while (resets == 0) {
+        run_until(now_us + POLL_US);
+    }
+    printf("%s: threshold %u s, reset %lld s after the wedge\n", name,
+           (unsigned int) threshold_s,
+           (long long) ((now_us - last_us) / SEC_US));
+    assert((now_us - last_us) <=
+           (threshold_s * SEC_US) + PROBES_US + POLL_US);
+}
+
+int main(void)
+{
+    struct stuckdet_stats stats;
+    unsigned int i;
+
+    /* Only heartbeat replies: the threshold tracks the 60 s beat */
+    wedge("55-65 s gaps", 55000, 65000, 90, STUCKDET_MAX_S);
+
+    /* Busy meshes reach the floor and are reset within a minute */
+    wedge("1-4 s gaps  ", 1000, 4000, STUCKDET_MIN_S, STUCKDET_MIN_S);
+    wedge("0-2 s gaps  ", 0, 2000, STUCKDET_MIN_S, STUCKDET_MIN_S);
+
+    /* A config download at boot is no history to go by */
+    start();
+    for (i = 0; i < 500; i++) {
+        run_until(now_us + 20000);
+        stuckdet_frame(now_us);
+    }
+    assert(stuckdet_threshold_s() == STUCKDET_MAX_S);
+    run_until(now_us + (STUCKDET_MAX_S - 1) * SEC_US);
+    assert((probes == 0) && (resets == 0));
+    printf("a 500-frame burst alone: threshold stays at %u s\n",
+           (unsigned int) stuckdet_threshold_s());
+
+    /* A long silence the radio answers a probe in is not a wedge */
+    start();
+    for (i = 0; i < WEDGE_GAPS; i++) {
+        run_until(now_us + SEC_US);
+        stuckdet_frame(now_us);
+    }
+    run_until(now_us + (STUCKDET_MIN_S + 2) * SEC_US);
+    assert((probes == 1) && (resets == 0));
+    stuckdet_frame(now_us);
+    run_until(now_us + 10 * SEC_US);
+    stuckdet_get_stats(&stats);
+    assert((stats.false_positives == 1) && (stats.detections == 0));
+    assert(resets == 0);
+    printf("probe answered after %u s: false positive, no reset\n",
+           (unsigned int) stats.last_false_s);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
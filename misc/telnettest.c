@@ -0,0 +1,117 @@
+/*
+ * telnettest.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host test of the telnet receiver: a client that opens with a burst of
+ * option requests, mixed with typed text, fed to telnet_rx() the way the
+ * shell does it, in every chunk size up to TELNET_RX_MAX. Every request
+ * must be answered and the text must come out unchanged. Run with
+ * 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <telnet.h>
+
+#define REQUESTS      300
+
+static uint8_t stream[REQUESTS * 5];
+static size_t stream_len;
+static uint8_t expect_reply[REQUESTS * 3];
+static size_t expect_reply_len;
+static uint8_t expect_text[REQUESTS * 2];
+static size_t expect_text_len;
+
+static void request(uint8_t cmd, uint8_t opt, uint8_t answer)
+{
+    stream[stream_len++] = TELNET_IAC;
+    stream[stream_len++] = cmd;
+    stream[stream_len++] = opt;
+    expect_reply[expect_reply_len++] = TELNET_IAC;
+    expect_reply[expect_reply_len++] = answer;
+    expect_reply[expect_reply_len++] = opt;
+}
+
+static void text(uint8_t c)
+{
+    stream[stream_len++] = c;
+    if (c == TELNET_IAC) {
+        stream[stream_len++] = c;
+    }
+    expect_text[expect_text_len++] = c;
+}
+
+int main(void)
+{
+    static uint8_t reply[sizeof(expect_reply)];
+    static uint8_t out[sizeof(expect_text)];
+    struct telnet t;
+    uint8_t buf[TELNET_RX_MAX];
+    size_t reply_len;
+    size_t out_len;
+    size_t chunk;
+    size_t off;
+    size_t len;
+    size_t n;
+    unsigned int i;
+
+    /* Options we refuse are refused every time they are asked for */
+    for (i = 0; i < REQUESTS; i++) {
+        if ((i % 2) == 0) {
+            request(TELNET_DO, 100 + (i % 50), TELNET_WONT);
+        } else {
+            request(TELNET_WILL, 100 + (i % 50), TELNET_DONT);
+        }
+        if ((i % 7) == 0) {
+            text('a' + (i % 26));
+        }
+        if ((i % 31) == 0) {
+            text(TELNET_IAC);
+        }
+    }
+
+    for (chunk = 1; chunk <= TELNET_RX_MAX; chunk++) {
+        telnet_init(&t);
+        reply_len = 0;
+        out_len = 0;
+        for (off = 0; off < stream_len; off += len) {
+            len = stream_len - off;
+            len = (len < chunk) ? len : chunk;
+            memcpy(buf, stream + off, len);
+            n = telnet_rx(&t, buf, len);
+            memcpy(out + out_len, buf, n);
+            out_len += n;
+            memcpy(reply + reply_len, t.reply, t.reply_len);
+            reply_len += t.reply_len;
+            t.reply_len = 0;
+        }
+        if ((reply_len != expect_reply_len) ||
+            (memcmp(reply, expect_reply, reply_len) != 0)) {
+            fprintf(stderr, "%zu byte chunks: %zu of %zu reply bytes\n",
+                    chunk, reply_len, expect_reply_len);
+            assert(0);
+        }
+        assert(out_len == expect_text_len);
+        assert(memcmp(out, expect_text, out_len) == 0);
+    }
+    printf("%u requests answered in chunks of 1 to %u bytes\n", REQUESTS,
+           TELNET_RX_MAX);
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
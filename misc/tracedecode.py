@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+#
+# tracedecode.py
+#
+# Copyright (C) 2025, Charles Chiou
+#
+# Decode the "@T" lines printed by the 'trace dump' shell command back into
+# text, using the format strings in the firmware ELF image.
+#
+# Usage: misc/tracedecode.py build/meshroof.elf [capture.txt]
+#
+
+import re
+import struct
+import sys
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+FMT_SPEC = re.compile(r'%([-+ #0]*)(\d+|\*)?(?:\.(\d+))?(hh|h|ll|l|z|j|t)?'
+                      r'([diouxXcsp%])')
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 1:
+            raise ValueError('%s: not a 32-bit ELF file' % path)
+        (shoff,) = struct.unpack_from('<I', self.data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.data, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            (name, stype, flags, addr, offset, size) = \
+                struct.unpack_from('<IIIIII', self.data, shoff + i * shentsize)
+            if (flags & SHF_ALLOC) and stype != SHT_NOBITS and size > 0:
+                self.sections.append((addr, offset, size))
+
+    def string(self, addr):
+        for (base, offset, size) in self.sections:
+            if base <= addr < base + size:
+                start = offset + addr - base
+                end = self.data.index(b'\0', start, offset + size)
+                return self.data[start:end].decode('utf-8', 'replace')
+        return None
+
+
+def signed(v):
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def render(elf, fmt, args):
+    out = []
+    pos = 0
+    argi = 0
+    for m in FMT_SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, prec, _, conv = m.groups()
+        if conv == '%':
+            out.append('%')
+            continue
+        if width == '*' or argi >= len(args):
+            out.append(m.group(0))
+            continue
+        v = args[argi]
+        argi += 1
+        spec = '%' + flags + (width or '') + \
+            ('.' + prec if prec is not None else '')
+        if conv in 'di':
+            out.append((spec + 'd') % signed(v))
+        elif conv == 'u':
+            out.append((spec + 'd') % v)
+        elif conv in 'oxX':
+            out.append((spec + conv) % v)
+        elif conv == 'c':
+            out.append((spec + 'c') % chr(v & 0xff))
+        elif conv == 'p':
+            out.append('0x%08x' % v)
+        elif conv == 's':
+            s = elf.string(v)
+            out.append((spec + 's') % (s if s is not None else
+                                       '<0x%08x>' % v))
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.stderr.write('usage: %s <elf> [capture]\n' % sys.argv[0])
+        return 1
+
+    elf = Elf(sys.argv[1])
+    capture = open(sys.argv[2], 'r', errors='replace') \
+        if len(sys.argv) == 3 else sys.stdin
+
+    for line in capture:
+        fields = line.split()
+        if len(fields) < 5 or fields[0] != '@T':
+            continue
+        try:
+            words = [int(x, 16) for x in fields[1:]]
+        except ValueError:
+            continue
+        seq, ts_us, core, fmt_addr = words[:4]
+        fmt = elf.string(fmt_addr)
+        if fmt is None:
+            text = '<unknown format 0x%08x> %s\n' % \
+                (fmt_addr, ' '.join(fields[5:]))
+        else:
+            text = render(elf, fmt, words[4:])
+        sys.stdout.write('[%10.6f] %d %04x %s' %
+                         (ts_us / 1e6, core, seq, text))
+        if not text.endswith('\n'):
+            sys.stdout.write('\n')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
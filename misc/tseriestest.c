@@ -0,0 +1,151 @@
+/*
+ * tseriestest.c
+ *
+ * Copyright (C) 2025, Charles Chiou
+ */
+
+/*
+ * Host test of the telemetry history: ten hours of one sample a minute,
+ * partial metric masks, more nodes than slots, a node that goes quiet
+ * for days, and value formatting. Run with 'make hosttest'.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <tseries.h>
+
+#define NODE  0x1234
+#define T0    (3 * 24 * 60 * 60)
+
+__thread int host_core_id = 0;
+
+static struct tseries_point points[TSERIES_RAW_LEN + TSERIES_ROLLUP_LEN];
+
+static void add_battery(uint32_t node_num, uint32_t t, int16_t battery)
+{
+    int16_t values[TSERIES_METRICS];
+
+    memset(values, 0x0, sizeof(values));
+    values[TSERIES_BATTERY] = battery;
+    tseries_add(node_num, t, 1 << TSERIES_BATTERY, values);
+}
+
+static void check_format(unsigned int metric, int16_t value,
+                         const char *expect)
+{
+    char buf[16];
+
+    tseries_format(buf, sizeof(buf), metric, value);
+    if (strcmp(buf, expect) != 0) {
+        fprintf(stderr, "%s %d: '%s', expected '%s'\n",
+                tseries_metric_name(metric), value, buf, expect);
+        assert(0);
+    }
+}
+
+int main(void)
+{
+    struct tseries_stats stats;
+    uint32_t node_nums[TSERIES_NODES];
+    int16_t values[TSERIES_METRICS];
+    uint32_t t;
+    unsigned int n;
+    unsigned int i;
+
+    tseries_init();
+
+    /* Ten hours at one sample a minute, battery falling 1% a minute */
+    for (i = 0; i < 600; i++) {
+        add_battery(NODE, T0 + (i * 60), 1000 - i);
+    }
+
+    n = tseries_query(NODE, TSERIES_RAW, 0, points, TSERIES_RAW_LEN);
+    assert(n == TSERIES_RAW_LEN);
+    assert(points[n - 1].t == T0 + (599 * 60));
+    assert(points[n - 1].avg[TSERIES_BATTERY] == 1000 - 599);
+    assert(points[0].t == T0 + ((600 - TSERIES_RAW_LEN) * 60));
+
+    n = tseries_query(NODE, TSERIES_L1, 0, points, TSERIES_ROLLUP_LEN);
+    assert(n == TSERIES_ROLLUP_LEN);
+    for (i = 0; i < n; i++) {
+        assert((points[i].t % TSERIES_L1_SECS) == 0);
+        assert(points[i].span == TSERIES_L1_SECS);
+        if (i > 0) {
+            assert(points[i].t == points[i - 1].t + TSERIES_L1_SECS);
+        }
+    }
+    /* A full bucket holds 15 samples, 1% apart */
+    assert(points[n - 2].count[TSERIES_BATTERY] == 15);
+    assert(points[n - 2].max[TSERIES_BATTERY] -
+           points[n - 2].min[TSERIES_BATTERY] == 14);
+    assert(points[n - 2].avg[TSERIES_BATTERY] ==
+           points[n - 2].min[TSERIES_BATTERY] + 7);
+
+    n = tseries_query(NODE, TSERIES_L2, 0, points, TSERIES_ROLLUP_LEN);
+    assert(n == 5);
+    assert(points[1].count[TSERIES_BATTERY] == 120);
+    printf("10 hours: %u raw, %u 15m, %u 2h points\n", TSERIES_RAW_LEN,
+           TSERIES_ROLLUP_LEN, n);
+
+    /* Only the metrics in the mask are kept */
+    memset(values, 0x0, sizeof(values));
+    values[TSERIES_VOLTAGE] = 4010;
+    values[TSERIES_TEMPERATURE] = 215;
+    tseries_add(NODE + 1, T0, (1 << TSERIES_VOLTAGE), values);
+    n = tseries_query(NODE + 1, TSERIES_L1, 0, points, 1);
+    assert((n == 1) && (points[0].mask == (1 << TSERIES_VOLTAGE)));
+    assert(points[0].count[TSERIES_TEMPERATURE] == 0);
+
+    /*
+     * A node that went quiet for three days has no recent buckets; its
+     * last hour is empty rather than three days old
+     */
+    t = T0 + (600 * 60) + (3 * 24 * 60 * 60);
+    n = tseries_query(NODE, TSERIES_L1, t - (4 * TSERIES_L1_SECS), points,
+                      4);
+    assert(n == 0);
+    add_battery(NODE, t, 50);
+    n = tseries_query(NODE, TSERIES_L1, t - (4 * TSERIES_L1_SECS), points,
+                      4);
+    assert((n == 1) && (points[0].avg[TSERIES_BATTERY] == 50));
+    n = tseries_query(NODE, TSERIES_L1, 0, points, 4);
+    assert(n == 4);
+    printf("after 3 quiet days: 1 bucket in the last hour, %u overall\n",
+           TSERIES_ROLLUP_LEN);
+
+    /* More nodes than slots recycles the one heard from least recently */
+    for (i = 0; i < TSERIES_NODES - 1; i++) {
+        add_battery(0x1000 + i, t + 1 + i, 80);
+    }
+    tseries_get_stats(&stats);
+    assert(stats.nodes == TSERIES_NODES);
+    assert(stats.recycled == 1);
+    assert(tseries_query(NODE + 1, TSERIES_RAW, 0, points, 1) == 0);
+    n = tseries_nodes(node_nums, TSERIES_NODES);
+    assert(n == TSERIES_NODES);
+    assert(node_nums[0] == 0x1000 + TSERIES_NODES - 2);
+    assert(node_nums[n - 1] == NODE);
+    printf("%u nodes in %zu bytes, %u recycled\n", stats.nodes,
+           stats.memory, (unsigned int) stats.recycled);
+
+    check_format(TSERIES_BATTERY, 87, "87%");
+    check_format(TSERIES_VOLTAGE, 4010, "4.01V");
+    check_format(TSERIES_CHUTIL, 123, "12.3%");
+    check_format(TSERIES_TEMPERATURE, 215, "21.5C");
+    check_format(TSERIES_TEMPERATURE, -45, "-4.5C");
+
+    printf("ok\n");
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */